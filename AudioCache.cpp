@@ -0,0 +1,318 @@
+// Copyright (C) 2020 by Jakub Wojciech
+
+// This file is part of Lelo Remote Music Player.
+
+// Lelo Remote Music Player is free software: you can redistribute it
+// and/or modify it under the terms of the GNU General Public License
+// as published by the Free Software Foundation, either version 3 of
+// the License, or (at your option) any later version.
+
+// Lelo Remote Music Player is distributed in the hope that it will be
+// useful, but WITHOUT ANY WARRANTY; without even the implied warranty
+// of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+// General Public License for more details.
+
+// You should have received a copy of the GNU General Public License
+// along with Lelo Remote Music Player. If not, see
+// <https://www.gnu.org/licenses/>.
+
+#include "AudioCache.h"
+
+#include <algorithm>
+#include <cerrno>
+#include <cstdlib>
+#include <system_error>
+#include <utility>
+#include <vector>
+
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "spdlog/spdlog.h"
+
+namespace lrm {
+namespace {
+constexpr char PARTIAL_SUFFIX[] = ".part";
+
+/// Create \e directory with mode 0700 if it doesn't exist and make sure
+/// only this user can use it.
+/// \exception fs::filesystem_error It's not a directory, it belongs to
+/// someone else or it couldn't be created.
+void make_private_directory(const fs::path& directory) {
+  if (directory.has_parent_path()) {
+    fs::create_directories(directory.parent_path());
+  }
+  if (mkdir(directory.c_str(), 0700) != 0 and EEXIST != errno) {
+    throw fs::filesystem_error("Couldn't create the cache directory",
+                               directory,
+                               std::error_code(errno,
+                                               std::generic_category()));
+  }
+
+  struct stat info;
+  if (lstat(directory.c_str(), &info) != 0) {
+    throw fs::filesystem_error("Couldn't read the cache directory",
+                               directory,
+                               std::error_code(errno,
+                                               std::generic_category()));
+  }
+  if (not S_ISDIR(info.st_mode) or info.st_uid != geteuid()) {
+    throw fs::filesystem_error(
+        "The cache directory isn't a directory of this user", directory,
+        std::make_error_code(std::errc::permission_denied));
+  }
+  if ((info.st_mode & 077) != 0 and chmod(directory.c_str(), 0700) != 0) {
+    throw fs::filesystem_error("Couldn't make the cache directory private",
+                               directory,
+                               std::error_code(errno,
+                                               std::generic_category()));
+  }
+}
+}
+
+AudioCache::Writer::Writer(AudioCache* cache, const ContentHash& hash)
+    : cache_(cache), hash_(hash),
+      path_(cache->directory_ / (to_hex(hash) + PARTIAL_SUFFIX)) {
+  // Never through a link, and never into a file someone else has put
+  // there. A leftover from this server is removed, Insert() makes sure no
+  // other writer has it.
+  for (int attempt = 0; attempt < 2 and -1 == fd_; ++attempt) {
+    fd_ = open(path_.c_str(),
+               O_WRONLY | O_CREAT | O_EXCL | O_NOFOLLOW | O_CLOEXEC, 0600);
+    if (-1 == fd_ and EEXIST == errno) {
+      unlink(path_.c_str());
+    }
+  }
+  if (-1 == fd_) {
+    throw std::system_error(errno, std::generic_category(),
+                            "Couldn't create " + path_.string());
+  }
+}
+
+AudioCache::Writer::~Writer() {
+  if (-1 != fd_) {
+    close(fd_);
+  }
+  if (not committed_) {
+    unlink(path_.c_str());
+    cache_->finish_writing(hash_, false, 0);
+  }
+}
+
+void AudioCache::Writer::Write(const char* data, size_t size) {
+  WriteAt(size_, data, size);
+}
+
+void AudioCache::Writer::WriteAt(uint64_t offset, const char* data,
+                                 size_t size) {
+  if (offset != size_) {
+    out_of_order_ = true;
+  }
+
+  for (size_t written = 0; written < size;) {
+    const auto result = pwrite(fd_, data + written, size - written,
+                               offset + written);
+    if (result < 0) {
+      if (EINTR == errno) {
+        continue;
+      }
+      throw std::system_error(errno, std::generic_category(),
+                              "Couldn't write to " + path_.string());
+    }
+    written += result;
+  }
+  if (not out_of_order_) {
+    hasher_.Update(data, size);
+  }
+  size_ += size;
+}
+
+bool AudioCache::Writer::Commit() {
+  const int result = close(std::exchange(fd_, -1));
+  if (result != 0) {
+    spdlog::warn("Couldn't finish writing {}", path_.string());
+    return false;
+  }
+
+  ContentHash hash;
+  try {
+    hash = out_of_order_ ? hash_file(path_.string()) : hasher_.Finish();
+  } catch (const std::exception& e) {
+    spdlog::warn("Couldn't hash {}: {}", path_.string(), e.what());
+    return false;
+  }
+  if (hash != hash_) {
+    spdlog::warn("Received file doesn't match its hash {}, not caching it",
+                 to_hex(hash_));
+    return false;
+  }
+
+  std::error_code ec;
+  fs::rename(path_, cache_->directory_ / to_hex(hash_), ec);
+  if (ec) {
+    spdlog::warn("Couldn't add {} to the cache: {}", to_hex(hash_),
+                 ec.message());
+    return false;
+  }
+
+  committed_ = true;
+  cache_->finish_writing(hash_, true, size_);
+  return true;
+}
+
+AudioCache::AudioCache(const fs::path& directory, uint64_t max_bytes)
+    : directory_(directory), max_bytes_(max_bytes) {
+  make_private_directory(directory_);
+
+  // Oldest first, so add() leaves the newest at the front.
+  std::vector<std::pair<fs::file_time_type, fs::directory_entry>> files;
+  for (const auto& entry : fs::directory_iterator(directory_)) {
+    std::error_code ec;
+    // Links aren't followed, nothing here should be one.
+    if (not fs::is_regular_file(entry.symlink_status())) {
+      continue;
+    }
+    const auto name = entry.path().filename().string();
+    const auto hash = content_hash_from_hex(name);
+    if (not hash) {
+      // Left from an interrupted upload.
+      if (entry.path().extension() == PARTIAL_SUFFIX) {
+        fs::remove(entry.path(), ec);
+      }
+      continue;
+    }
+    // Hashing the whole cache would hold up the start, Find() checks the
+    // contents.
+    if (0 == entry.file_size(ec) or ec) {
+      fs::remove(entry.path(), ec);
+      continue;
+    }
+    files.emplace_back(entry.last_write_time(), entry);
+  }
+  std::sort(files.begin(), files.end(),
+            [](const auto& a, const auto& b){ return a.first < b.first; });
+
+  std::lock_guard<std::mutex> lck(mtx_);
+  for (const auto& [time, entry] : files) {
+    add(entry.path().filename().string(), entry.file_size(), false);
+  }
+  evict();
+
+  spdlog::info("Audio cache in {}: {} files, {} MiB", directory_.string(),
+               entries_.size(), size_ / (1024 * 1024));
+}
+
+fs::path AudioCache::DefaultDirectory() {
+  if (const char* xdg_cache = std::getenv("XDG_CACHE_HOME");
+      xdg_cache and '/' == xdg_cache[0]) {
+    return fs::path(xdg_cache) / "lrm";
+  }
+  if (const char* home = std::getenv("HOME"); home and '/' == home[0]) {
+    return fs::path(home) / ".cache" / "lrm";
+  }
+  return fs::temp_directory_path() /
+      ("lrm-cache-" + std::to_string(geteuid()));
+}
+
+std::optional<fs::path> AudioCache::Find(const ContentHash& hash) {
+  const auto name = to_hex(hash);
+  const auto path = directory_ / name;
+
+  std::unique_lock<std::mutex> lck(mtx_);
+  auto it = entries_.find(name);
+  if (it == entries_.end()) {
+    return std::nullopt;
+  }
+
+  if (not it->second.verified) {
+    // Without the lock, the other calls don't wait for the hashing.
+    lck.unlock();
+    bool matches = false;
+    try {
+      matches = hash_file(path.string()) == hash;
+    } catch (const std::exception& e) {
+      spdlog::warn("Couldn't hash {}: {}", path.string(), e.what());
+    }
+    lck.lock();
+
+    it = entries_.find(name);
+    if (it == entries_.end()) {
+      return std::nullopt;
+    }
+    if (not matches) {
+      spdlog::warn("Removed {} from the audio cache, it didn't match its "
+                   "hash", name);
+      remove(name);
+      return std::nullopt;
+    }
+    it->second.verified = true;
+  }
+
+  lru_.splice(lru_.begin(), lru_, it->second.lru_position);
+
+  std::error_code ec;
+  fs::last_write_time(path, fs::file_time_type::clock::now(), ec);
+  return path;
+}
+
+std::unique_ptr<AudioCache::Writer>
+AudioCache::Insert(const ContentHash& hash) {
+  const auto name = to_hex(hash);
+  {
+    std::lock_guard<std::mutex> lck(mtx_);
+    if (entries_.count(name) or not being_written_.insert(name).second) {
+      return nullptr;
+    }
+  }
+
+  try {
+    return std::unique_ptr<Writer>(new Writer(this, hash));
+  } catch (...) {
+    finish_writing(hash, false, 0);
+    throw;
+  }
+}
+
+uint64_t AudioCache::Size() const {
+  std::lock_guard<std::mutex> lck(mtx_);
+  return size_;
+}
+
+void AudioCache::add(const std::string& name, uint64_t size,
+                     bool verified) {
+  lru_.push_front(name);
+  entries_[name] = Entry{lru_.begin(), size, verified};
+  size_ += size;
+}
+
+void AudioCache::remove(const std::string& name) {
+  const auto it = entries_.find(name);
+  std::error_code ec;
+  // The player may still have the file open, it will keep reading it.
+  fs::remove(directory_ / name, ec);
+
+  size_ -= it->second.size;
+  lru_.erase(it->second.lru_position);
+  entries_.erase(it);
+}
+
+void AudioCache::evict() {
+  while (size_ > max_bytes_ and not lru_.empty()) {
+    const auto name = lru_.back();
+    remove(name);
+  }
+}
+
+void AudioCache::finish_writing(const ContentHash& hash, bool committed,
+                                uint64_t size) {
+  const auto name = to_hex(hash);
+
+  std::lock_guard<std::mutex> lck(mtx_);
+  being_written_.erase(name);
+  if (committed) {
+    add(name, size, true);
+    evict();
+  }
+}
+}
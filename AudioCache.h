@@ -0,0 +1,130 @@
+// Copyright (C) 2020 by Jakub Wojciech
+
+// This file is part of Lelo Remote Music Player.
+
+// Lelo Remote Music Player is free software: you can redistribute it
+// and/or modify it under the terms of the GNU General Public License
+// as published by the Free Software Foundation, either version 3 of
+// the License, or (at your option) any later version.
+
+// Lelo Remote Music Player is distributed in the hope that it will be
+// useful, but WITHOUT ANY WARRANTY; without even the implied warranty
+// of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+// General Public License for more details.
+
+// You should have received a copy of the GNU General Public License
+// along with Lelo Remote Music Player. If not, see
+// <https://www.gnu.org/licenses/>.
+
+#ifndef LRM_AUDIOCACHE_H_
+#define LRM_AUDIOCACHE_H_
+
+#include <list>
+#include <memory>
+#include <mutex>
+#include <optional>
+#include <unordered_map>
+#include <unordered_set>
+
+#include "ContentHash.h"
+#include "filesystem.h"
+
+namespace lrm {
+/// Audio files received from the clients, stored under their ContentHash.
+///
+/// When the files take more than the budget, the least recently used ones
+/// are removed. The order of use is kept in the files' modification times,
+/// so it survives restarts.
+///
+/// The files are played as they are, so the directory must be private to
+/// the server: it's created with mode 0700 and refused if it belongs to
+/// another user. Files found there at the start are checked against their
+/// hashes the first time they're found, and removed if they don't match.
+class AudioCache {
+ public:
+  /// Stores one file in the cache. The file is added only after Commit(),
+  /// if the data matches the hash it was announced with.
+  class Writer {
+   public:
+    ~Writer();
+
+    /// \exception std::system_error Writing to the file failed.
+    void Write(const char* data, size_t size);
+    /// Write \e data at \e offset in the file. If the parts don't come in
+    /// order, the file is read again to check its hash in Commit().
+    /// \exception std::system_error Writing to the file failed.
+    void WriteAt(uint64_t offset, const char* data, size_t size);
+    /// \return \b true if the file was added to the cache.
+    bool Commit();
+
+   private:
+    friend class AudioCache;
+    Writer(AudioCache* cache, const ContentHash& hash);
+
+    AudioCache* cache_;
+    const ContentHash hash_;
+    const fs::path path_;
+    int fd_ = -1;
+    ContentHasher hasher_;
+    uint64_t size_ = 0;
+    // Set when the data didn't come in order, so hasher_ can't be used.
+    bool out_of_order_ = false;
+    bool committed_ = false;
+  };
+
+  /// \param directory Where to keep the files. It's created if necessary.
+  /// \param max_bytes How much space the files can take.
+  /// \exception fs::filesystem_error The directory couldn't be created or
+  /// read, or it belongs to another user.
+  AudioCache(const fs::path& directory, uint64_t max_bytes);
+
+  /// \return $XDG_CACHE_HOME/lrm, ~/.cache/lrm without it, or a directory
+  /// named after the user in the system's temporary directory if there's no
+  /// home either.
+  static fs::path DefaultDirectory();
+
+  AudioCache(const AudioCache&) = delete;
+  AudioCache& operator=(const AudioCache&) = delete;
+
+  /// Find the file with \e hash and mark it as the most recently used.
+  /// A file from before the start is hashed first.
+  /// \return Path to the file or \b std::nullopt if it isn't in the cache.
+  std::optional<fs::path> Find(const ContentHash& hash);
+
+  /// \return Writer for the file with \e hash or \b nullptr if the file
+  /// is already in the cache or is being written.
+  std::unique_ptr<Writer> Insert(const ContentHash& hash);
+
+  /// \return How much space the cached files take.
+  uint64_t Size() const;
+
+ private:
+  struct Entry {
+    std::list<std::string>::iterator lru_position;
+    uint64_t size;
+    // Files found at the start are hashed only when they're needed.
+    bool verified;
+  };
+
+  /// Add a file that's already in the directory.
+  void add(const std::string& name, uint64_t size, bool verified);
+  /// Forget the file and remove it. Must be called with mtx_ locked.
+  void remove(const std::string& name);
+  /// Remove the least recently used files until they fit in max_bytes_.
+  void evict();
+  void finish_writing(const ContentHash& hash, bool committed,
+                      uint64_t size);
+
+  const fs::path directory_;
+  const uint64_t max_bytes_;
+
+  // Hex hashes, the most recently used first.
+  std::list<std::string> lru_;
+  std::unordered_map<std::string, Entry> entries_;
+  std::unordered_set<std::string> being_written_;
+  uint64_t size_ = 0;
+  mutable std::mutex mtx_;
+};
+}
+
+#endif  // LRM_AUDIOCACHE_H_
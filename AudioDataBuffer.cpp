@@ -0,0 +1,70 @@
+// Copyright (C) 2020 by Jakub Wojciech
+
+// This file is part of Lelo Remote Music Player.
+
+// Lelo Remote Music Player is free software: you can redistribute it
+// and/or modify it under the terms of the GNU General Public License
+// as published by the Free Software Foundation, either version 3 of
+// the License, or (at your option) any later version.
+
+// Lelo Remote Music Player is distributed in the hope that it will be
+// useful, but WITHOUT ANY WARRANTY; without even the implied warranty
+// of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+// General Public License for more details.
+
+// You should have received a copy of the GNU General Public License
+// along with Lelo Remote Music Player. If not, see
+// <https://www.gnu.org/licenses/>.
+
+#include "AudioDataBuffer.h"
+
+#include <array>
+#include <cassert>
+#include <cstdint>
+
+#ifndef INCLUDE_GRPCPLUSPLUS
+#include "grpcpp/support/slice.h"
+#else
+#include "grpc++/support/slice.h"
+#endif  // INCLUDE_GRPCPLUSPLUS
+
+namespace lrm {
+namespace {
+// AudioData.data is field 1 with the length-delimited wire type.
+constexpr uint8_t AUDIO_DATA_DATA_TAG = (1 << 3) | 2;
+
+void release_mapping(void* user_data) {
+  delete static_cast<std::shared_ptr<const MappedFile>*>(user_data);
+}
+}
+
+grpc::ByteBuffer make_audio_data(
+    const std::shared_ptr<const MappedFile>& file,
+    size_t offset, size_t size) {
+  assert(offset + size <= file->size());
+
+  // Tag and the varint-encoded length of the data.
+  std::array<uint8_t, 11> header;
+  size_t header_size = 0;
+  header[header_size++] = AUDIO_DATA_DATA_TAG;
+  uint64_t length = size;
+  do {
+    header[header_size] = length & 0x7f;
+    length >>= 7;
+    if (length) {
+      header[header_size] |= 0x80;
+    }
+    ++header_size;
+  } while (length);
+
+  // grpc::Slice takes a non-const pointer but never writes through it.
+  const grpc::Slice slices[] = {
+    grpc::Slice(header.data(), header_size),
+    grpc::Slice(const_cast<char*>(file->data() + offset), size,
+                &release_mapping,
+                new std::shared_ptr<const MappedFile>(file))
+  };
+
+  return grpc::ByteBuffer(slices, 2);
+}
+}
@@ -0,0 +1,44 @@
+// Copyright (C) 2020 by Jakub Wojciech
+
+// This file is part of Lelo Remote Music Player.
+
+// Lelo Remote Music Player is free software: you can redistribute it
+// and/or modify it under the terms of the GNU General Public License
+// as published by the Free Software Foundation, either version 3 of
+// the License, or (at your option) any later version.
+
+// Lelo Remote Music Player is distributed in the hope that it will be
+// useful, but WITHOUT ANY WARRANTY; without even the implied warranty
+// of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+// General Public License for more details.
+
+// You should have received a copy of the GNU General Public License
+// along with Lelo Remote Music Player. If not, see
+// <https://www.gnu.org/licenses/>.
+
+#ifndef LRM_AUDIODATABUFFER_H_
+#define LRM_AUDIODATABUFFER_H_
+
+#include <memory>
+
+#ifndef INCLUDE_GRPCPLUSPLUS
+#include "grpcpp/support/byte_buffer.h"
+#else
+#include "grpc++/support/byte_buffer.h"
+#endif  // INCLUDE_GRPCPLUSPLUS
+
+#include "MappedFile.h"
+
+namespace lrm {
+/// Build a serialized \e AudioData message carrying \e size bytes of
+/// \e file starting at \e offset.
+///
+/// Only the field header is copied. The audio bytes are referenced by a
+/// slice pointing straight into the mapping, which keeps \e file alive
+/// until gRPC is done with the message.
+grpc::ByteBuffer make_audio_data(
+    const std::shared_ptr<const MappedFile>& file,
+    size_t offset, size_t size);
+}
+
+#endif  // LRM_AUDIODATABUFFER_H_
@@ -26,11 +26,16 @@
 namespace lrm {
 using UnauthenticatedContext = grpc::ClientContext;
 
-/// ClientContext with \e x-session-id metadata.
+/// ClientContext with \e x-session-id metadata, and \e x-zone if \e zone
+/// isn't empty.
 class AuthenticatedContext : public grpc::ClientContext {
  public:
-  inline explicit AuthenticatedContext(const std::string& session_key) {
+  inline explicit AuthenticatedContext(const std::string& session_key,
+                                       const std::string& zone = {}) {
     AddMetadata("x-session-key", session_key);
+    if (not zone.empty()) {
+      AddMetadata("x-zone", zone);
+    }
   }
 };
 }
@@ -76,6 +76,25 @@ const std::string& Config::Get(std::string_view variable) {
   }
 }
 
+int64_t Config::GetInt(std::string_view variable, int64_t default_value) {
+  const std::string& value = Get(variable);
+  if (value.empty()) {
+    return default_value;
+  }
+
+  try {
+    size_t parsed = 0;
+    const int64_t result = std::stoll(value, &parsed);
+    if (parsed != value.size()) {
+      throw std::invalid_argument("trailing characters");
+    }
+    return result;
+  } catch (const std::exception& e) {
+    throw std::logic_error(std::string("Config variable '") + variable.data()
+                           + "' is not a number: " + value);
+  }
+}
+
 void Config::Set(std::string_view variable, std::string_view value) {
   if (not value.empty()) {
     config_[variable.data()] = value;
@@ -19,6 +19,7 @@
 #ifndef LRM_CONFIG_H
 #define LRM_CONFIG_H
 
+#include <cstdint>
 #include <unordered_map>
 #include <unordered_set>
 #include <vector>
@@ -41,6 +42,11 @@ public:
   Load(const fs::path& file_path = default_conf_file);
 
   static const std::string& Get(std::string_view variable);
+
+  /// \return Value of \e variable as a number or \e default_value if it's
+  /// not set.
+  /// \exception std::logic_error The value is not a number.
+  static int64_t GetInt(std::string_view variable, int64_t default_value);
   static inline State GetState() {
     return state_;
   }
@@ -0,0 +1,78 @@
+// Copyright (C) 2020 by Jakub Wojciech
+
+// This file is part of Lelo Remote Music Player.
+
+// Lelo Remote Music Player is free software: you can redistribute it
+// and/or modify it under the terms of the GNU General Public License
+// as published by the Free Software Foundation, either version 3 of
+// the License, or (at your option) any later version.
+
+// Lelo Remote Music Player is distributed in the hope that it will be
+// useful, but WITHOUT ANY WARRANTY; without even the implied warranty
+// of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+// General Public License for more details.
+
+// You should have received a copy of the GNU General Public License
+// along with Lelo Remote Music Player. If not, see
+// <https://www.gnu.org/licenses/>.
+
+#include "ContentHash.h"
+
+#include <stdexcept>
+
+#include "FileChunkReader.h"
+#include "crypto/CryptoUtil.h"
+
+namespace lrm {
+ContentHasher::ContentHasher() : ctx_(EVP_MD_CTX_new(), &EVP_MD_CTX_free) {
+  if (not ctx_ or 1 != EVP_DigestInit_ex(ctx_.get(), EVP_sha256(), nullptr)) {
+    throw std::runtime_error("Couldn't initialize SHA-256");
+  }
+}
+
+void ContentHasher::Update(const void* data, size_t size) {
+  EVP_DigestUpdate(ctx_.get(), data, size);
+}
+
+ContentHash ContentHasher::Finish() {
+  ContentHash hash;
+  EVP_DigestFinal_ex(ctx_.get(), hash.data(), nullptr);
+  return hash;
+}
+
+ContentHash hash_file(std::string_view filename) {
+  ContentHasher hasher;
+  FileChunkReader reader(filename);
+  while (const auto chunk = reader.Next()) {
+    hasher.Update(chunk.data(), chunk.size());
+  }
+  return hasher.Finish();
+}
+
+std::string to_hex(const ContentHash& hash) {
+  return crypto::to_hex(hash);
+}
+
+std::optional<ContentHash> content_hash_from_hex(std::string_view hex) {
+  if (hex.size() != 2 * std::tuple_size_v<ContentHash>) {
+    return std::nullopt;
+  }
+
+  const auto nibble = [](char c) -> int {
+                        if (c >= '0' and c <= '9') return c - '0';
+                        if (c >= 'a' and c <= 'f') return c - 'a' + 10;
+                        return -1;
+                      };
+
+  ContentHash hash;
+  for (size_t i = 0; i < hash.size(); ++i) {
+    const int high = nibble(hex[2 * i]);
+    const int low = nibble(hex[2 * i + 1]);
+    if (high < 0 or low < 0) {
+      return std::nullopt;
+    }
+    hash[i] = static_cast<unsigned char>(high << 4 | low);
+  }
+  return hash;
+}
+}
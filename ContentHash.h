@@ -0,0 +1,59 @@
+// Copyright (C) 2020 by Jakub Wojciech
+
+// This file is part of Lelo Remote Music Player.
+
+// Lelo Remote Music Player is free software: you can redistribute it
+// and/or modify it under the terms of the GNU General Public License
+// as published by the Free Software Foundation, either version 3 of
+// the License, or (at your option) any later version.
+
+// Lelo Remote Music Player is distributed in the hope that it will be
+// useful, but WITHOUT ANY WARRANTY; without even the implied warranty
+// of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+// General Public License for more details.
+
+// You should have received a copy of the GNU General Public License
+// along with Lelo Remote Music Player. If not, see
+// <https://www.gnu.org/licenses/>.
+
+#ifndef LRM_CONTENTHASH_H_
+#define LRM_CONTENTHASH_H_
+
+#include <array>
+#include <memory>
+#include <optional>
+#include <string>
+#include <string_view>
+
+#include <openssl/evp.h>
+#include <openssl/sha.h>
+
+namespace lrm {
+/// SHA-256 of the contents of an audio file. Identifies the file in the
+/// server's cache.
+using ContentHash = std::array<unsigned char, SHA256_DIGEST_LENGTH>;
+
+/// Computes a ContentHash of data given in parts.
+class ContentHasher {
+ public:
+  ContentHasher();
+
+  void Update(const void* data, size_t size);
+  /// \return Hash of all the data given to Update(). The hasher can't be
+  /// used after that.
+  ContentHash Finish();
+
+ private:
+  std::unique_ptr<EVP_MD_CTX, decltype(&EVP_MD_CTX_free)> ctx_;
+};
+
+/// \exception std::invalid_argument The file couldn't be opened.
+/// \exception std::system_error Reading the file failed.
+ContentHash hash_file(std::string_view filename);
+
+std::string to_hex(const ContentHash& hash);
+/// \return The hash or \b std::nullopt if \e hex isn't a valid hash.
+std::optional<ContentHash> content_hash_from_hex(std::string_view hex);
+}
+
+#endif  // LRM_CONTENTHASH_H_
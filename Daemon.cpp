@@ -22,6 +22,11 @@
 #include <iostream>
 #include <fstream>
 #include <numeric>
+#include <utility>
+#include <vector>
+
+#include <fcntl.h>
+#include <unistd.h>
 
 #include "spdlog/spdlog.h"
 
@@ -30,9 +35,11 @@
 #ifndef INCLUDE_GRPCPLUSPLUS
 #include "grpcpp/create_channel.h"
 #include "grpcpp/channel.h"
+#include "grpcpp/support/channel_arguments.h"
 #else
 #include "grpc++/create_channel.h"
 #include "grpc++/channel.h"
+#include "grpc++/support/channel_arguments.h"
 #endif  // INCLUDE_GRPCPLUSPLUS
 
 
@@ -44,6 +51,10 @@
 using namespace asio::local;
 
 namespace lrm {
+namespace {
+constexpr int DEFAULT_HTTP2_WINDOW_BYTES = 4 * 1024 * 1024;
+}
+
 const fs::path Daemon::socket_path =
     fs::temp_directory_path().append("lrm/socket");
 
@@ -65,6 +76,7 @@ Daemon::Daemon(std::unique_ptr<daemon_info>&& dinfo) noexcept
 
 Daemon::~Daemon() {
   try {
+    stop_live();
     grpc_channel_state_run_ = false;
     fs::remove(socket_path);
 
@@ -213,8 +225,17 @@ void Daemon::initialize_grpc_client() {
     return options;
   }());
 
+  // Let gRPC grow the HTTP/2 flow-control windows to the bandwidth-delay
+  // product of the link and don't block uploads on a small write buffer.
+  grpc::ChannelArguments channel_args;
+  channel_args.SetInt(GRPC_ARG_HTTP2_BDP_PROBE, 1);
+  channel_args.SetInt(
+      GRPC_ARG_HTTP2_WRITE_BUFFER_SIZE,
+      Config::GetInt("http2_window_bytes", DEFAULT_HTTP2_WINDOW_BYTES));
+
   {
-    const auto channel = grpc::CreateChannel(grpc_address, creds);
+    const auto channel = grpc::CreateCustomChannel(grpc_address, creds,
+                                                   channel_args);
 
     // Trace the channel state
     grpc_channel_state_thread_ =
@@ -232,8 +253,80 @@ void Daemon::initialize_grpc_client() {
     }
 
     remote_ = std::make_unique<PlayerClient>(channel);
+
+    // Every upload channel needs its own connection, otherwise gRPC would
+    // share one between them and they'd share its flow-control window too.
+    const int upload_streams = Config::GetInt("upload_streams", 1);
+    if (upload_streams > 1) {
+      channel_args.SetInt(GRPC_ARG_USE_LOCAL_SUBCHANNEL_POOL, 1);
+      std::vector<std::shared_ptr<grpc::Channel>> channels{channel};
+      for (int i = 1; i < upload_streams; ++i) {
+        channels.push_back(grpc::CreateCustomChannel(grpc_address, creds,
+                                                     channel_args));
+      }
+      remote_->SetUploadChannels(std::move(channels));
+      log_->info("Uploading large files over {} connections",
+                 upload_streams);
+    }
   }
 
+  if (Config::Get("upload_mode") == "mmap") {
+    remote_->SetUploadMode(PlayerClient::MMAP);
+    log_->info("Using memory mapped files for uploads");
+  }
+  if (Config::Get("hash_first") == "no") {
+    remote_->SetHashFirst(false);
+  }
+  if (const auto& zone = Config::Get("zone"); not zone.empty()) {
+    remote_->SetZone(zone);
+    log_->info("Playing in zone '{}'", zone);
+  }
+  remote_->SetSharedPrefixes(
+      SharedPrefixes(Util::tokenize(Config::Get("shared_prefix"), ",")));
+
+  const auto transcode = Util::tokenize(Config::Get("transcode"), ",");
+  if (not transcode.empty()) {
+    Transcoder::Settings settings;
+    settings.codec = Config::Get("transcode_codec");
+    settings.format = Config::Get("transcode_format");
+    settings.bitrate = Config::GetInt("transcode_bitrate", 0);
+    const auto& dir = Config::Get("transcode_dir");
+    remote_->SetTranscoder(
+        std::make_unique<Transcoder>(transcode,
+                                     dir.empty() ?
+                                     fs::temp_directory_path() :
+                                     fs::path(dir)),
+        settings);
+    log_->info("Transcoding {} files before sending them",
+               Config::Get("transcode"));
+  }
+
+  const std::string& upload_rate = Config::Get("upload_rate");
+  const auto upload_buffer = Config::GetInt("upload_buffer_seconds", 0);
+  if (not upload_rate.empty() or upload_buffer > 0) {
+    UploadPacer::Settings pacing;
+    if ("auto" == upload_rate) {
+      pacing.headroom =
+          Config::GetInt("upload_headroom_percent", 150) / 100.0;
+    } else {
+      pacing.rate = Config::GetInt("upload_rate", 0);
+    }
+    pacing.lead = std::chrono::seconds(
+        Config::GetInt("upload_lead_seconds", 30));
+    pacing.target_buffer = std::chrono::seconds(upload_buffer);
+    remote_->SetPacing(pacing);
+    log_->info("Pacing uploads at {} (bytes per second), up to {} s ahead "
+               "of the playback", upload_rate.empty() ? "any" : upload_rate,
+               pacing.lead.count());
+    if (upload_buffer > 0) {
+      log_->info("Keeping {} s of audio buffered on the server",
+                 upload_buffer);
+    }
+  }
+
+  queue_uploader_ = std::make_unique<QueueUploader>(
+      remote_.get(), Config::GetInt("queue_prefetch", 2));
+
   state_ = GRPC_CLIENT_INITIALIZED;
 
 
@@ -282,7 +375,34 @@ void Daemon::connection_handler(
     return;
   }
 
-  args.ParseFromFileDescriptor(socket->native_handle());
+  // remote-control sends its standard input with "play -".
+  std::vector<int> fds;
+  try {
+    args.ParseFromString(
+        Util::receive_with_fds(socket->native_handle(), &fds));
+  } catch (const std::system_error& e) {
+    log_->error("Receiving a request: {}", e.what());
+    for (int fd : fds) {
+      close(fd);
+    }
+
+    DaemonResponse response;
+    response.set_exit_status(EXIT_FAILURE);
+    response.set_response(
+        std::string("The daemon couldn't receive the request: ") + e.what());
+    response.SerializeToFileDescriptor(socket->native_handle());
+    socket->close();
+    return;
+  }
+  int live_fd = -1;
+  if (args.command() == "play" and args.command_arg() == "-" and
+      not fds.empty()) {
+    live_fd = fds.front();
+    fds.erase(fds.begin());
+  }
+  for (int fd : fds) {
+    close(fd);
+  }
 
   log_->info("Request received: {} {}", args.command(), args.command_arg());
 
@@ -301,8 +421,36 @@ void Daemon::connection_handler(
       try {
         int result = 0;
         if (args.command() == "play") {
-          result = remote_->Play(args.command_arg());
+          // Playing a file replaces the queue.
+          queue_uploader_->Clear();
+          stop_live();
+
+          std::error_code ec;
+          if (-1 != live_fd) {
+            start_live(std::exchange(live_fd, -1));
+            response.set_response("Streaming standard input");
+          } else if (fs::is_fifo(args.command_arg(), ec)) {
+            // Doesn't wait for a writer to open the other end.
+            const int fd = open(args.command_arg().c_str(),
+                                O_RDONLY | O_NONBLOCK | O_CLOEXEC);
+            if (-1 == fd) {
+              throw std::system_error(errno, std::system_category(),
+                                      "Opening " + args.command_arg());
+            }
+            start_live(fd);
+            response.set_response("Streaming " + args.command_arg());
+          } else {
+            result = remote_->Play(args.command_arg());
+          }
+        } else if (args.command() == "enqueue") {
+          queue_uploader_->Add(args.command_arg());
+        } else if (args.command() == "clear-queue") {
+          queue_uploader_->Clear();
+          result = remote_->ClearQueue();
+        } else if (args.command() == "queue") {
+          response.set_response(format_queue());
         } else if (args.command() == "stop") {
+          stop_live();
           result = remote_->Stop();
         } else if (args.command() == "toggle-pause") {
           result = remote_->TogglePause();
@@ -332,6 +480,9 @@ void Daemon::connection_handler(
       response.set_response("Daemon in the limbo state.");
       break;
   }
+  if (-1 != live_fd) {
+    close(live_fd);
+  }
 
   response.SerializeToFileDescriptor(socket->native_handle());
   socket->close();
@@ -340,6 +491,49 @@ void Daemon::connection_handler(
              response.exit_status(), response.response());
 }
 
+void Daemon::start_live(int fd) {
+  stop_live();
+  live_reader_ = std::make_shared<LiveReader>(fd);
+  live_thread_ = std::thread([this, reader = live_reader_]{
+                               try {
+                                 remote_->PlayLive(reader.get());
+                               } catch (const std::exception& e) {
+                                 log_->error("Live stream: {}", e.what());
+                               } catch (const grpc::Status& s) {
+                                 log_->error("Live stream: {}",
+                                             s.error_message());
+                               }
+                             });
+}
+
+void Daemon::stop_live() {
+  if (live_reader_) {
+    live_reader_->Stop();
+  }
+  if (live_thread_.joinable()) {
+    live_thread_.join();
+  }
+  live_reader_.reset();
+}
+
+std::string Daemon::format_queue() {
+  int current;
+  const auto files = remote_->ListQueue(&current);
+
+  std::string result;
+  for (size_t i = 0; i < files.size(); ++i) {
+    result += (static_cast<int>(i) == current ? "* " : "  ") + files[i] +
+              '\n';
+  }
+  for (const auto& file : queue_uploader_->Pending()) {
+    result += "  " + file + " (not sent yet)\n";
+  }
+  if (not result.empty()) {
+    result.pop_back();
+  }
+  return result;
+}
+
 void Daemon::trace_grpc_channel_state(
     std::shared_ptr<grpc::Channel> channel) {
   grpc_connectivity_state state = channel->GetState(true);
@@ -29,6 +29,7 @@
 #include "spdlog/spdlog.h"
 
 #include "PlayerClient.h"
+#include "QueueUploader.h"
 
 using namespace asio::local;
 
@@ -69,6 +70,11 @@ class Daemon {
   void authenticate();
   void start_accept();
   void connection_handler(std::unique_ptr<stream_protocol::socket>&& socket);
+  std::string format_queue();
+  /// Stream \e fd as a live source in live_thread_, replacing the previous
+  /// one.
+  void start_live(int fd);
+  void stop_live();
 
   void trace_grpc_channel_state(std::shared_ptr<grpc::Channel> channel);
 
@@ -82,6 +88,10 @@ class Daemon {
   std::unique_ptr<stream_protocol::socket> connection_;
 
   std::unique_ptr<PlayerClient> remote_;
+  std::unique_ptr<QueueUploader> queue_uploader_;
+
+  std::shared_ptr<LiveReader> live_reader_;
+  std::thread live_thread_;
 
   std::thread grpc_channel_state_thread_;
   std::atomic<bool> grpc_channel_state_run_ = true;
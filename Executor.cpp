@@ -0,0 +1,93 @@
+// Copyright (C) 2020 by Jakub Wojciech
+
+// This file is part of Lelo Remote Music Player.
+
+// Lelo Remote Music Player is free software: you can redistribute it
+// and/or modify it under the terms of the GNU General Public License
+// as published by the Free Software Foundation, either version 3 of
+// the License, or (at your option) any later version.
+
+// Lelo Remote Music Player is distributed in the hope that it will be
+// useful, but WITHOUT ANY WARRANTY; without even the implied warranty
+// of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+// General Public License for more details.
+
+// You should have received a copy of the GNU General Public License
+// along with Lelo Remote Music Player. If not, see
+// <https://www.gnu.org/licenses/>.
+
+#include "Executor.h"
+
+#include <cerrno>
+#include <cstring>
+
+#include <pthread.h>
+#include <sys/resource.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+
+#include "spdlog/spdlog.h"
+
+namespace lrm {
+Executor::Executor(std::string name, size_t max_threads, int nice)
+    : name_(std::move(name)), max_threads_(max_threads), nice_(nice) {}
+
+Executor::~Executor() {
+  {
+    std::lock_guard<std::mutex> lck(mtx_);
+    stop_ = true;
+  }
+  cv_.notify_all();
+  for (auto& thread : threads_) {
+    thread.join();
+  }
+}
+
+void Executor::Post(std::function<void()> task) {
+  std::lock_guard<std::mutex> lck(mtx_);
+  tasks_.push_back(std::move(task));
+  if (idle_ < tasks_.size() and
+      (0 == max_threads_ or threads_.size() < max_threads_)) {
+    threads_.emplace_back(&Executor::work, this);
+  }
+  cv_.notify_one();
+}
+
+size_t Executor::Threads() const {
+  std::lock_guard<std::mutex> lck(mtx_);
+  return threads_.size();
+}
+
+void Executor::work() {
+  // Linux keeps the niceness per thread.
+  const auto tid = static_cast<id_t>(syscall(SYS_gettid));
+  if (nice_ != 0) {
+    errno = 0;
+    const int current = getpriority(PRIO_PROCESS, tid);
+    if (0 != errno or
+        0 != setpriority(PRIO_PROCESS, tid, current + nice_)) {
+      spdlog::warn("Couldn't set the priority of {} threads: {}",
+                   name_, std::strerror(errno));
+    }
+  }
+  // At most 15 characters.
+  pthread_setname_np(pthread_self(), name_.substr(0, 15).c_str());
+
+  std::unique_lock<std::mutex> lck(mtx_);
+  for (;;) {
+    ++idle_;
+    cv_.wait(lck, [this]{ return stop_ or not tasks_.empty(); });
+    --idle_;
+    if (tasks_.empty()) {
+      // Stopped, with nothing left to do.
+      return;
+    }
+
+    auto task = std::move(tasks_.front());
+    tasks_.pop_front();
+    lck.unlock();
+    task();
+    lck.lock();
+  }
+}
+}
@@ -0,0 +1,88 @@
+// Copyright (C) 2020 by Jakub Wojciech
+
+// This file is part of Lelo Remote Music Player.
+
+// Lelo Remote Music Player is free software: you can redistribute it
+// and/or modify it under the terms of the GNU General Public License
+// as published by the Free Software Foundation, either version 3 of
+// the License, or (at your option) any later version.
+
+// Lelo Remote Music Player is distributed in the hope that it will be
+// useful, but WITHOUT ANY WARRANTY; without even the implied warranty
+// of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+// General Public License for more details.
+
+// You should have received a copy of the GNU General Public License
+// along with Lelo Remote Music Player. If not, see
+// <https://www.gnu.org/licenses/>.
+
+#ifndef LRM_EXECUTOR_H_
+#define LRM_EXECUTOR_H_
+
+#include <condition_variable>
+#include <cstddef>
+#include <deque>
+#include <functional>
+#include <future>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <type_traits>
+#include <vector>
+
+namespace lrm {
+/// Threads running one class of the server's work, e.g. the uploads, at
+/// their own priority.
+///
+/// The gRPC handler hands the work over with Run() and waits for it. It
+/// doesn't free the handler's thread, but the work is done at the
+/// executor's priority and at most \e max_threads of it run at once, so it
+/// can't take the CPU from the rest of the server.
+class Executor {
+ public:
+  /// \param name Name of the threads, for the logs and tools like top.
+  /// \param max_threads Most threads running at once, 0 for no limit. They
+  /// are started when needed and kept afterwards.
+  /// \param nice Niceness added to the threads, see setpriority(2). Negative
+  /// values need CAP_SYS_NICE, without it the priority is left as it is.
+  Executor(std::string name, size_t max_threads, int nice);
+  ~Executor();
+
+  Executor(const Executor&) = delete;
+  Executor& operator=(const Executor&) = delete;
+
+  /// Queue \e task to be run on one of the threads.
+  void Post(std::function<void()> task);
+
+  /// Run \e function on one of the threads and wait for it.
+  /// \return What \e function has returned.
+  /// \exception Whatever \e function has thrown.
+  template <typename Function>
+  std::invoke_result_t<Function> Run(Function&& function) {
+    std::packaged_task<std::invoke_result_t<Function>()> task(
+        std::forward<Function>(function));
+    auto result = task.get_future();
+    Post([&task]{ task(); });
+    return result.get();
+  }
+
+  /// \return Number of threads started so far.
+  size_t Threads() const;
+
+ private:
+  void work();
+
+  const std::string name_;
+  const size_t max_threads_;
+  const int nice_;
+
+  std::deque<std::function<void()>> tasks_;
+  std::vector<std::thread> threads_;
+  size_t idle_ = 0;
+  bool stop_ = false;
+  mutable std::mutex mtx_;
+  std::condition_variable cv_;
+};
+}
+
+#endif  // LRM_EXECUTOR_H_
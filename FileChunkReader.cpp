@@ -0,0 +1,183 @@
+// Copyright (C) 2020 by Jakub Wojciech
+
+// This file is part of Lelo Remote Music Player.
+
+// Lelo Remote Music Player is free software: you can redistribute it
+// and/or modify it under the terms of the GNU General Public License
+// as published by the Free Software Foundation, either version 3 of
+// the License, or (at your option) any later version.
+
+// Lelo Remote Music Player is distributed in the hope that it will be
+// useful, but WITHOUT ANY WARRANTY; without even the implied warranty
+// of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+// General Public License for more details.
+
+// You should have received a copy of the GNU General Public License
+// along with Lelo Remote Music Player. If not, see
+// <https://www.gnu.org/licenses/>.
+
+#include "FileChunkReader.h"
+
+#include <cerrno>
+#include <cstring>
+#include <stdexcept>
+#include <string>
+#include <system_error>
+#include <utility>
+
+#include <fcntl.h>
+#include <unistd.h>
+
+namespace lrm {
+FileChunkReader::Chunk::Chunk(FileChunkReader* owner,
+                              std::unique_ptr<Buffer>&& buffer,
+                              size_t size)
+    : owner_(owner), buffer_(std::move(buffer)), size_(size) {}
+
+FileChunkReader::Chunk::Chunk(Chunk&& other) noexcept
+    : owner_(other.owner_), buffer_(std::move(other.buffer_)),
+      size_(other.size_) {
+  other.owner_ = nullptr;
+  other.size_ = 0;
+}
+
+FileChunkReader::Chunk&
+FileChunkReader::Chunk::operator=(Chunk&& other) noexcept {
+  if (this != &other) {
+    if (owner_ and buffer_) {
+      owner_->release(std::move(buffer_));
+    }
+    owner_ = std::exchange(other.owner_, nullptr);
+    buffer_ = std::move(other.buffer_);
+    size_ = std::exchange(other.size_, 0);
+  }
+  return *this;
+}
+
+FileChunkReader::Chunk::~Chunk() {
+  if (owner_ and buffer_) {
+    owner_->release(std::move(buffer_));
+  }
+}
+
+FileChunkReader::FileChunkReader(std::string_view filename,
+                                 size_t chunk_size, size_t pool_size,
+                                 uint64_t offset)
+    : chunk_size_(chunk_size) {
+  fd_ = open(std::string(filename).c_str(), O_RDONLY | O_CLOEXEC);
+  if (-1 == fd_) {
+    throw std::invalid_argument(
+        std::string("Couldn't open the file: ") + filename.data());
+  }
+  if (offset > 0 and -1 == lseek(fd_, offset, SEEK_SET)) {
+    close(fd_);
+    throw std::invalid_argument(
+        std::string("Couldn't start reading the file at an offset: ") +
+        filename.data());
+  }
+  // The file is read front to back exactly once.
+  posix_fadvise(fd_, 0, 0, POSIX_FADV_SEQUENTIAL);
+
+  free_.reserve(pool_size);
+  for (size_t i = 0; i < pool_size; ++i) {
+    free_.push_back(std::make_unique<Buffer>(chunk_size_));
+  }
+
+  try {
+    reader_thread_ = std::thread(&FileChunkReader::read_loop, this);
+  } catch (...) {
+    close(fd_);
+    throw;
+  }
+}
+
+FileChunkReader::~FileChunkReader() {
+  {
+    std::lock_guard<std::mutex> lck(mtx_);
+    stop_ = true;
+  }
+  cv_.notify_all();
+
+  if (reader_thread_.joinable()) {
+    reader_thread_.join();
+  }
+  close(fd_);
+}
+
+FileChunkReader::Chunk FileChunkReader::Next() {
+  std::unique_lock<std::mutex> lck(mtx_);
+  cv_.wait(lck, [this]{
+                  return not filled_.empty() or eof_ or error_ != 0;
+                });
+
+  // Return the data read before the error or EOF first.
+  if (not filled_.empty()) {
+    auto [buffer, size] = std::move(filled_.front());
+    filled_.pop_front();
+    return Chunk(this, std::move(buffer), size);
+  }
+  if (error_ != 0) {
+    throw std::system_error(error_, std::generic_category(),
+                            "Reading the file to stream");
+  }
+  return Chunk();
+}
+
+void FileChunkReader::release(std::unique_ptr<Buffer>&& buffer) {
+  {
+    std::lock_guard<std::mutex> lck(mtx_);
+    free_.push_back(std::move(buffer));
+  }
+  cv_.notify_all();
+}
+
+void FileChunkReader::read_loop() {
+  for (;;) {
+    std::unique_ptr<Buffer> buffer;
+    {
+      std::unique_lock<std::mutex> lck(mtx_);
+      cv_.wait(lck, [this]{ return not free_.empty() or stop_; });
+      if (stop_) {
+        return;
+      }
+      buffer = std::move(free_.back());
+      free_.pop_back();
+    }
+
+    // Fill the whole buffer unless the file ends earlier.
+    size_t size = 0;
+    int error = 0;
+    while (size < chunk_size_) {
+      const ssize_t result = read(fd_, buffer->data() + size,
+                                  chunk_size_ - size);
+      if (result > 0) {
+        size += result;
+      } else if (result == 0) {
+        break;
+      } else if (errno != EINTR) {
+        error = errno;
+        break;
+      }
+    }
+
+    {
+      std::lock_guard<std::mutex> lck(mtx_);
+      if (size > 0) {
+        filled_.emplace_back(std::move(buffer), size);
+      } else {
+        free_.push_back(std::move(buffer));
+      }
+      if (error != 0) {
+        error_ = error;
+      } else if (size < chunk_size_) {
+        eof_ = true;
+      }
+    }
+    cv_.notify_all();
+
+    if (error != 0 or size < chunk_size_) {
+      return;
+    }
+  }
+}
+}
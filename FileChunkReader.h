@@ -0,0 +1,114 @@
+// Copyright (C) 2020 by Jakub Wojciech
+
+// This file is part of Lelo Remote Music Player.
+
+// Lelo Remote Music Player is free software: you can redistribute it
+// and/or modify it under the terms of the GNU General Public License
+// as published by the Free Software Foundation, either version 3 of
+// the License, or (at your option) any later version.
+
+// Lelo Remote Music Player is distributed in the hope that it will be
+// useful, but WITHOUT ANY WARRANTY; without even the implied warranty
+// of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+// General Public License for more details.
+
+// You should have received a copy of the GNU General Public License
+// along with Lelo Remote Music Player. If not, see
+// <https://www.gnu.org/licenses/>.
+
+#ifndef LRM_FILECHUNKREADER_H_
+#define LRM_FILECHUNKREADER_H_
+
+#include <condition_variable>
+#include <cstdint>
+#include <deque>
+#include <memory>
+#include <mutex>
+#include <string_view>
+#include <thread>
+#include <vector>
+
+namespace lrm {
+/// Reads a file incrementally into a small pool of fixed-size buffers.
+///
+/// A background thread fills the free buffers while the consumer processes
+/// the filled ones with \ref Next(), so the memory used doesn't depend on
+/// the size of the file: it's at most \e pool_size * \e chunk_size bytes.
+class FileChunkReader {
+  using Buffer = std::vector<char>;
+
+ public:
+  /// A filled buffer borrowed from the pool. It's returned to the pool when
+  /// the Chunk is destroyed, so it must not outlive the FileChunkReader.
+  class Chunk {
+   public:
+    Chunk() = default;
+    Chunk(Chunk&& other) noexcept;
+    Chunk& operator=(Chunk&& other) noexcept;
+    ~Chunk();
+
+    inline const char* data() const {
+      return buffer_ ? buffer_->data() : nullptr;
+    }
+    inline size_t size() const {
+      return size_;
+    }
+    /// \return \b false if it's the end of the file.
+    inline explicit operator bool() const {
+      return size_ > 0;
+    }
+
+   private:
+    friend class FileChunkReader;
+    Chunk(FileChunkReader* owner, std::unique_ptr<Buffer>&& buffer,
+          size_t size);
+
+    FileChunkReader* owner_ = nullptr;
+    std::unique_ptr<Buffer> buffer_;
+    size_t size_ = 0;
+  };
+
+  static constexpr size_t DEFAULT_CHUNK_SIZE = 64 * 1024;
+  static constexpr size_t DEFAULT_POOL_SIZE = 4;
+
+  /// \param offset Where to start reading the file.
+  /// \exception std::invalid_argument The file couldn't be opened or it
+  /// can't start at \e offset.
+  explicit FileChunkReader(std::string_view filename,
+                           size_t chunk_size = DEFAULT_CHUNK_SIZE,
+                           size_t pool_size = DEFAULT_POOL_SIZE,
+                           uint64_t offset = 0);
+  ~FileChunkReader();
+
+  FileChunkReader(const FileChunkReader&) = delete;
+  FileChunkReader& operator=(const FileChunkReader&) = delete;
+
+  /// Wait for the next chunk of the file.
+  /// \return Chunk that evaluates to \b false at the end of the file.
+  /// \exception std::system_error Reading the file failed.
+  Chunk Next();
+
+  inline size_t ChunkSize() const {
+    return chunk_size_;
+  }
+
+ private:
+  void read_loop();
+  void release(std::unique_ptr<Buffer>&& buffer);
+
+  int fd_ = -1;
+  const size_t chunk_size_;
+
+  std::mutex mtx_;
+  std::condition_variable cv_;
+  std::vector<std::unique_ptr<Buffer>> free_;
+  std::deque<std::pair<std::unique_ptr<Buffer>, size_t>> filled_;
+  bool eof_ = false;
+  bool stop_ = false;
+  int error_ = 0;
+
+  std::thread reader_thread_;
+};
+}
+
+#endif  // LRM_FILECHUNKREADER_H_
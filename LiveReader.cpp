@@ -0,0 +1,87 @@
+// Copyright (C) 2020 by Jakub Wojciech
+
+// This file is part of Lelo Remote Music Player.
+
+// Lelo Remote Music Player is free software: you can redistribute it
+// and/or modify it under the terms of the GNU General Public License
+// as published by the Free Software Foundation, either version 3 of
+// the License, or (at your option) any later version.
+
+// Lelo Remote Music Player is distributed in the hope that it will be
+// useful, but WITHOUT ANY WARRANTY; without even the implied warranty
+// of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+// General Public License for more details.
+
+// You should have received a copy of the GNU General Public License
+// along with Lelo Remote Music Player. If not, see
+// <https://www.gnu.org/licenses/>.
+
+
+#include "LiveReader.h"
+
+#include <cerrno>
+#include <cstdint>
+#include <system_error>
+
+#include <fcntl.h>
+#include <poll.h>
+#include <sys/eventfd.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+namespace lrm {
+LiveReader::LiveReader(int fd, size_t pipe_size) : fd_(fd) {
+  wake_fd_ = eventfd(0, EFD_CLOEXEC | EFD_NONBLOCK);
+  if (-1 == wake_fd_) {
+    const int error = errno;
+    close(fd_);
+    throw std::system_error(error, std::system_category(),
+                            "Creating an eventfd");
+  }
+
+  struct stat st;
+  if (pipe_size > 0 and 0 == fstat(fd_, &st) and S_ISFIFO(st.st_mode)) {
+    // Not fatal, the delay is just bigger.
+    fcntl(fd_, F_SETPIPE_SZ, static_cast<int>(pipe_size));
+  }
+}
+
+LiveReader::~LiveReader() {
+  close(wake_fd_);
+  close(fd_);
+}
+
+size_t LiveReader::Read(char* data, size_t size) {
+  pollfd fds[2] = {{fd_, POLLIN, 0}, {wake_fd_, POLLIN, 0}};
+
+  while (not stopped_) {
+    if (poll(fds, 2, -1) < 0) {
+      if (EINTR == errno) {
+        continue;
+      }
+      throw std::system_error(errno, std::system_category(),
+                              "Waiting for the live source");
+    }
+    if (fds[1].revents != 0) {
+      break;
+    }
+
+    // POLLHUP without POLLIN is the end of the pipe, read() returns 0.
+    const ssize_t result = read(fd_, data, size);
+    if (result >= 0) {
+      return result;
+    }
+    if (EINTR != errno and EAGAIN != errno) {
+      throw std::system_error(errno, std::system_category(),
+                              "Reading the live source");
+    }
+  }
+  return 0;
+}
+
+void LiveReader::Stop() {
+  stopped_ = true;
+  const uint64_t one = 1;
+  [[maybe_unused]] const auto result = write(wake_fd_, &one, sizeof(one));
+}
+}
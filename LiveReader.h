@@ -0,0 +1,63 @@
+// Copyright (C) 2020 by Jakub Wojciech
+
+// This file is part of Lelo Remote Music Player.
+
+// Lelo Remote Music Player is free software: you can redistribute it
+// and/or modify it under the terms of the GNU General Public License
+// as published by the Free Software Foundation, either version 3 of
+// the License, or (at your option) any later version.
+
+// Lelo Remote Music Player is distributed in the hope that it will be
+// useful, but WITHOUT ANY WARRANTY; without even the implied warranty
+// of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+// General Public License for more details.
+
+// You should have received a copy of the GNU General Public License
+// along with Lelo Remote Music Player. If not, see
+// <https://www.gnu.org/licenses/>.
+
+
+#ifndef LRM_LIVEREADER_H_
+#define LRM_LIVEREADER_H_
+
+#include <atomic>
+#include <cstddef>
+
+namespace lrm {
+/// Reads a live source, like a pipe from a capture program, for streaming
+/// it with the least delay.
+///
+/// Read() returns whatever is available instead of waiting for a buffer to
+/// fill, and the pipe's buffer is made small, so little audio can queue
+/// up in front of the sender. Stop() wakes a waiting Read() from another
+/// thread.
+class LiveReader {
+ public:
+  static constexpr size_t DEFAULT_PIPE_SIZE = 16 * 1024;
+
+  /// Takes the ownership of \e fd.
+  /// \param pipe_size Size to set for the pipe's buffer if \e fd is a pipe,
+  /// 0 leaves it as it is. The kernel rounds it up to a page.
+  /// \exception std::system_error
+  explicit LiveReader(int fd, size_t pipe_size = DEFAULT_PIPE_SIZE);
+  ~LiveReader();
+
+  LiveReader(const LiveReader&) = delete;
+  LiveReader& operator=(const LiveReader&) = delete;
+
+  /// Wait until there is any data and read at most \e size bytes of it.
+  /// \return Number of bytes read, 0 at the end of the source or after
+  /// Stop().
+  /// \exception std::system_error Reading failed.
+  size_t Read(char* data, size_t size);
+
+  void Stop();
+
+ private:
+  const int fd_;
+  int wake_fd_ = -1;
+  std::atomic<bool> stopped_ = false;
+};
+}
+
+#endif  // LRM_LIVEREADER_H_
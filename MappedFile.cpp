@@ -0,0 +1,68 @@
+// Copyright (C) 2020 by Jakub Wojciech
+
+// This file is part of Lelo Remote Music Player.
+
+// Lelo Remote Music Player is free software: you can redistribute it
+// and/or modify it under the terms of the GNU General Public License
+// as published by the Free Software Foundation, either version 3 of
+// the License, or (at your option) any later version.
+
+// Lelo Remote Music Player is distributed in the hope that it will be
+// useful, but WITHOUT ANY WARRANTY; without even the implied warranty
+// of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+// General Public License for more details.
+
+// You should have received a copy of the GNU General Public License
+// along with Lelo Remote Music Player. If not, see
+// <https://www.gnu.org/licenses/>.
+
+#include "MappedFile.h"
+
+#include <cerrno>
+#include <stdexcept>
+#include <string>
+#include <system_error>
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+namespace lrm {
+MappedFile::MappedFile(std::string_view filename) {
+  const int fd = open(std::string(filename).c_str(), O_RDONLY | O_CLOEXEC);
+  if (-1 == fd) {
+    throw std::invalid_argument(
+        std::string("Couldn't open the file: ") + filename.data());
+  }
+
+  struct stat file_stat;
+  if (-1 == fstat(fd, &file_stat) or not S_ISREG(file_stat.st_mode)) {
+    close(fd);
+    throw std::invalid_argument(
+        std::string("Not a regular file: ") + filename.data());
+  }
+  size_ = file_stat.st_size;
+
+  // mmap() doesn't accept a zero length, an empty file is just empty data.
+  if (size_ > 0) {
+    data_ = mmap(nullptr, size_, PROT_READ, MAP_PRIVATE, fd, 0);
+    const int error = errno;
+    close(fd);
+    if (MAP_FAILED == data_) {
+      data_ = nullptr;
+      throw std::system_error(error, std::generic_category(),
+                              "Mapping the file to stream");
+    }
+    madvise(data_, size_, MADV_SEQUENTIAL);
+  } else {
+    close(fd);
+  }
+}
+
+MappedFile::~MappedFile() {
+  if (data_) {
+    munmap(data_, size_);
+  }
+}
+}
@@ -0,0 +1,51 @@
+// Copyright (C) 2020 by Jakub Wojciech
+
+// This file is part of Lelo Remote Music Player.
+
+// Lelo Remote Music Player is free software: you can redistribute it
+// and/or modify it under the terms of the GNU General Public License
+// as published by the Free Software Foundation, either version 3 of
+// the License, or (at your option) any later version.
+
+// Lelo Remote Music Player is distributed in the hope that it will be
+// useful, but WITHOUT ANY WARRANTY; without even the implied warranty
+// of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+// General Public License for more details.
+
+// You should have received a copy of the GNU General Public License
+// along with Lelo Remote Music Player. If not, see
+// <https://www.gnu.org/licenses/>.
+
+#ifndef LRM_MAPPEDFILE_H_
+#define LRM_MAPPEDFILE_H_
+
+#include <cstddef>
+#include <string_view>
+
+namespace lrm {
+/// Read-only memory mapping of a whole regular file.
+class MappedFile {
+ public:
+  /// \exception std::invalid_argument The file couldn't be opened or isn't
+  /// a regular file.
+  /// \exception std::system_error Mapping the file failed.
+  explicit MappedFile(std::string_view filename);
+  ~MappedFile();
+
+  MappedFile(const MappedFile&) = delete;
+  MappedFile& operator=(const MappedFile&) = delete;
+
+  inline const char* data() const {
+    return static_cast<const char*>(data_);
+  }
+  inline size_t size() const {
+    return size_;
+  }
+
+ private:
+  void* data_ = nullptr;
+  size_t size_ = 0;
+};
+}
+
+#endif  // LRM_MAPPEDFILE_H_
@@ -0,0 +1,732 @@
+// Copyright (C) 2019 by Jakub Wojciech
+
+// This file is part of Lelo Remote Music Player.
+
+// Lelo Remote Music Player is free software: you can redistribute it
+// and/or modify it under the terms of the GNU General Public License
+// as published by the Free Software Foundation, either version 3 of
+// the License, or (at your option) any later version.
+
+// Lelo Remote Music Player is distributed in the hope that it will be
+// useful, but WITHOUT ANY WARRANTY; without even the implied warranty
+// of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+// General Public License for more details.
+
+// You should have received a copy of the GNU General Public License
+// along with Lelo Remote Music Player. If not, see
+// <https://www.gnu.org/licenses/>.
+
+#include "MpvPlayer.h"
+
+#include <algorithm>
+#include <cerrno>
+#include <cstring>
+#include <iostream>
+#include <system_error>
+
+#include <poll.h>
+#include <sys/eventfd.h>
+#include <unistd.h>
+
+#include "mpv/client.h"
+
+#include "spdlog/spdlog.h"
+
+#include "PlaybackState.h"
+
+namespace lrm {
+namespace {
+constexpr char STREAM_PROTOCOL[] = "lrm";
+constexpr char READAHEAD_OPTION[] = "demuxer-readahead-secs";
+
+/// Options for live streams, similar to mpv's "low-latency" profile.
+constexpr std::pair<const char*, const char*> LOW_LATENCY_OPTIONS[] = {
+  {"cache", "no"},
+  {"cache-pause", "no"},
+  {"force-seekable", "no"},
+  {READAHEAD_OPTION, "0"},
+  {"demuxer-max-bytes", "256KiB"},
+  {"demuxer-lavf-analyzeduration", "0.1"},
+  {"demuxer-lavf-probe-info", "nostreams"},
+  {"stream-buffer-size", "4KiB"},
+  {"audio-buffer", "0.05"}
+};
+
+constexpr std::pair<Player::ObservedProperty, const char*>
+OBSERVED_PROPERTIES[] = {
+  {Player::TIME_POSITION, "time-pos"},
+  {Player::TIME_REMAINING, "time-remaining"},
+  {Player::TOTAL_TIME, "duration"},
+  {Player::PLAYTIME_REMAINING, "playtime-remaining"},
+  {Player::VOLUME, "volume"},
+  {Player::PAUSE, "pause"},
+  {Player::SPEED, "speed"},
+  {Player::CACHE_DURATION, "demuxer-cache-duration"},
+  {Player::BUFFERING, "cache-buffering-state"},
+  {Player::PAUSED_FOR_CACHE, "paused-for-cache"}
+};
+
+inline bool is_flag(Player::ObservedProperty property) {
+  return Player::PAUSE == property or Player::PAUSED_FOR_CACHE == property;
+}
+}
+
+int MpvPlayer::send_command_(const std::vector<std::string>&& args) {
+  const char* command[16];
+  const int arg_count = std::min<size_t>(args.size(), 15);
+
+  for(auto i = 0; i < arg_count; ++i) {
+    command[i] = args[i].c_str();
+  }
+  command[arg_count] = nullptr;
+
+  return check_result(mpv_command(ctx_.get(), command));
+}
+
+void MpvPlayer::send_command_async_(const std::vector<std::string>&& args,
+                                    ReplyCallback on_reply) {
+  const char* command[16];
+  const int arg_count = std::min<size_t>(args.size(), 15);
+
+  for(auto i = 0; i < arg_count; ++i) {
+    command[i] = args[i].c_str();
+  }
+  command[arg_count] = nullptr;
+
+  uint64_t id;
+  {
+    std::lock_guard<std::mutex> lck(replies_mtx_);
+    id = next_reply_id_++;
+    pending_replies_.emplace(id, std::move(on_reply));
+  }
+
+  // mpv copies the arguments.
+  const int result = mpv_command_async(ctx_.get(), id, command);
+  if (result < 0) {
+    complete_reply(id, check_result(result));
+  }
+}
+
+void MpvPlayer::complete_reply(uint64_t id, int result) {
+  ReplyCallback on_reply;
+  {
+    std::lock_guard<std::mutex> lck(replies_mtx_);
+    const auto it = pending_replies_.find(id);
+    if (it == pending_replies_.end()) {
+      return;
+    }
+    on_reply = std::move(it->second);
+    pending_replies_.erase(it);
+  }
+
+  if (on_reply) {
+    on_reply(result);
+  }
+}
+
+MpvPlayer::MpvPlayer(const std::string& log_file, const Options& options)
+    : ctx_(mpv_create(), &mpv_terminate_destroy) {
+  for (const auto& [name, value] : options) {
+    const int result = mpv_set_option_string(ctx_.get(), name.c_str(),
+                                             value.c_str());
+    if (MPV_ERROR_SUCCESS != result) {
+      spdlog::warn("Couldn't set mpv option {}: {}", name,
+                   mpv_error_string(result));
+    }
+  }
+  mpv_initialize(ctx_.get());
+  mpv_set_property_string(ctx_.get(), "log-file", log_file.c_str());
+  mpv_set_property_string(ctx_.get(), "video", "no");
+  // NOTE: This allows for cached seeking in streams that can't seek by
+  // themselves, but it's pretty unreliable. Spooled streams are seekable.
+  mpv_set_property_string(ctx_.get(), "force-seekable", "yes");
+  // Open the next file on the playlist while the current one is playing.
+  mpv_set_property_string(ctx_.get(), "prefetch-playlist", "yes");
+  // The volume is in [0; 100], "add volume" stops at this.
+  mpv_set_property_string(ctx_.get(), "volume-max", "100");
+  mpv_request_log_messages(ctx_.get(), "debug");
+
+  check_result(mpv_stream_cb_add_ro(ctx_.get(), STREAM_PROTOCOL, this,
+                                    &MpvPlayer::stream_open_cb));
+
+  for (const auto& [name, low_latency] : LOW_LATENCY_OPTIONS) {
+    // Older versions of mpv may not have some of them.
+    char* normal = mpv_get_property_string(ctx_.get(), name);
+    if (normal) {
+      latency_options_.push_back({name, low_latency, normal});
+      mpv_free(normal);
+    }
+  }
+
+  wakeup_fd_ = eventfd(0, EFD_CLOEXEC | EFD_NONBLOCK);
+  shutdown_fd_ = eventfd(0, EFD_CLOEXEC | EFD_NONBLOCK);
+  if (-1 == wakeup_fd_ or -1 == shutdown_fd_) {
+    const int error = errno;
+    close_event_fds();
+    throw std::system_error(error, std::system_category(),
+                            "Creating an eventfd for the mpv event loop");
+  }
+  mpv_set_wakeup_callback(ctx_.get(), &MpvPlayer::wakeup_cb, this);
+
+  start_event_loop();
+}
+
+MpvPlayer::~MpvPlayer() {
+  stop_event_loop();
+
+  if (event_loop_thread_.joinable()) {
+    try {
+      event_loop_thread_.join();
+    } catch (const std::system_error& e) {
+      spdlog::warn("Trying to join event loop thread in MpvPlayer: {}",
+                   e.what());
+    }
+  }
+
+  // mpv mustn't write to the descriptors while it's being destroyed.
+  mpv_set_wakeup_callback(ctx_.get(), nullptr, nullptr);
+  // Destroying mpv closes the streams it still has open, their callbacks
+  // use the members below, so it must go before them.
+  ctx_.reset();
+  close_event_fds();
+  // The streams that closed now won't load.
+  report_failed_streams();
+
+  // Nothing will reply to these anymore.
+  std::map<uint64_t, ReplyCallback> pending;
+  {
+    std::lock_guard<std::mutex> lck(replies_mtx_);
+    pending.swap(pending_replies_);
+  }
+  for (auto& [id, on_reply] : pending) {
+    if (on_reply) {
+      on_reply(MPV_ERROR_GENERIC);
+    }
+  }
+}
+
+void MpvPlayer::close_event_fds() noexcept {
+  for (int* fd : {&wakeup_fd_, &shutdown_fd_}) {
+    if (-1 != *fd) {
+      close(*fd);
+      *fd = -1;
+    }
+  }
+}
+
+int MpvPlayer::Play() {
+  return load(false);
+}
+
+int MpvPlayer::load(bool low_latency) {
+  // mpv reads the options when it starts loading the file.
+  set_low_latency(low_latency);
+
+  const int result = send_command_({"loadfile", input_});
+  if (MPV_ERROR_SUCCESS != result) {
+    return result;
+  }
+
+  // Unpause without waiting, the result of loading is what matters.
+  send_command_async_({"set", "pause", "no"}, {});
+
+  return result;
+}
+
+void MpvPlayer::set_low_latency(bool enabled) {
+  std::lock_guard<std::mutex> lck(options_mtx_);
+  if (enabled == low_latency_) {
+    return;
+  }
+  low_latency_ = enabled;
+
+  for (const auto& option : latency_options_) {
+    const int result = mpv_set_property_string(
+        ctx_.get(), option.name,
+        enabled ? option.low_latency : option.normal.c_str());
+    if (MPV_ERROR_SUCCESS != result) {
+      spdlog::warn("Couldn't set mpv option {}: {}", option.name,
+                   mpv_error_string(result));
+    }
+  }
+}
+
+void MpvPlayer::TogglePause(ReplyCallback on_reply) {
+  // mpv flips it itself, there's no need to read it first.
+  send_command_async_({"cycle", "pause"}, std::move(on_reply));
+}
+
+void MpvPlayer::Stop(ReplyCallback on_reply) {
+  cancel_pending_streams();
+  send_command_async_({"stop"}, std::move(on_reply));
+}
+
+void MpvPlayer::Volume(std::string_view volume, ReplyCallback on_reply) {
+  int value;
+  bool relative;
+  if (not parse_volume(volume, &value, &relative)) {
+    if (on_reply) {
+      on_reply(MPV_ERROR_INVALID_PARAMETER);
+    }
+    return;
+  }
+
+  if (relative) {
+    // Changed by mpv in one step, so concurrent changes add up. It stays
+    // in [0; volume-max].
+    send_command_async_({"add", "volume", std::to_string(value)},
+                        std::move(on_reply));
+    return;
+  }
+
+  send_command_async_({"set", "volume",
+                       std::to_string(std::clamp(value, 0, 100))},
+                      std::move(on_reply));
+}
+
+void MpvPlayer::Seek(int32_t seconds, ReplyCallback on_reply) {
+  send_command_async_({"seek", std::to_string(seconds)}, std::move(on_reply));
+}
+
+void MpvPlayer::SetVolumeChangeCallback(VolumeChangeCallback&& callback) {
+  std::lock_guard<std::mutex> lck(volume_callback_mtx_);
+  volume_change_callback_ = std::move(callback);
+}
+
+int MpvPlayer::Enqueue(std::string_view path) {
+  return send_command_({"loadfile", std::string(path), "append-play"});
+}
+
+int MpvPlayer::ClearQueue() {
+  return send_command_({"playlist-clear"});
+}
+
+std::vector<std::string> MpvPlayer::Queue(int64_t* current) const {
+  *current = get_property_int64_("playlist-pos");
+
+  std::vector<std::string> files;
+  const auto count = get_property_int64_("playlist-count");
+  for (int64_t i = 0; i < count; ++i) {
+    char* filename = mpv_get_property_string(
+        ctx_.get(), ("playlist/" + std::to_string(i) + "/filename").c_str());
+    // The playlist may have changed since getting the count.
+    if (not filename) {
+      break;
+    }
+    files.emplace_back(filename);
+    mpv_free(filename);
+  }
+  return files;
+}
+
+int MpvPlayer::PlayFromStream(std::shared_ptr<StreamSource> source,
+                              LoadCallback on_load, bool low_latency) {
+  // Only one stream can be played at a time, if mpv didn't open the
+  // previous one, it never will.
+  cancel_pending_streams();
+
+  uint64_t id;
+  {
+    std::lock_guard<std::mutex> lck(streams_mtx_);
+    id = next_stream_id_++;
+    pending_streams_.emplace(
+        id, new Stream{this, source, std::move(on_load)});
+  }
+  spdlog::debug("Playing stream {}, seekable: {}", id, source->IsSeekable());
+
+  Input(std::string(STREAM_PROTOCOL) + "://" + std::to_string(id));
+
+  const int result = load(low_latency);
+  if (MPV_ERROR_SUCCESS != result) {
+    std::lock_guard<std::mutex> lck(streams_mtx_);
+    pending_streams_.erase(id);
+    source->Cancel();
+  }
+  return result;
+}
+
+void MpvPlayer::SetReadahead(double seconds) {
+  const std::string value = std::to_string(seconds);
+
+  std::lock_guard<std::mutex> lck(options_mtx_);
+  for (auto& option : latency_options_) {
+    if (0 == std::strcmp(option.name, READAHEAD_OPTION)) {
+      option.normal = value;
+    }
+  }
+  // Live streams keep theirs, this one is set when they end.
+  if (low_latency_) {
+    return;
+  }
+  const int result = mpv_set_property_string(ctx_.get(), READAHEAD_OPTION,
+                                             value.c_str());
+  if (MPV_ERROR_SUCCESS != result) {
+    spdlog::warn("Couldn't set mpv option {}: {}", READAHEAD_OPTION,
+                 mpv_error_string(result));
+  }
+}
+
+void MpvPlayer::cancel_pending_streams() {
+  std::lock_guard<std::mutex> lck(streams_mtx_);
+  for (auto& [id, stream] : pending_streams_) {
+    stream->source->Cancel();
+  }
+  pending_streams_.clear();
+}
+
+void MpvPlayer::report_loaded_streams() {
+  std::vector<LoadCallback> callbacks;
+  {
+    std::lock_guard<std::mutex> lck(streams_mtx_);
+    for (Stream* stream : loading_streams_) {
+      callbacks.push_back(std::move(stream->on_load));
+    }
+    loading_streams_.clear();
+  }
+  for (auto& callback : callbacks) {
+    if (callback) {
+      callback(true);
+    }
+  }
+}
+
+void MpvPlayer::report_failed_streams() {
+  std::vector<LoadCallback> callbacks;
+  {
+    std::lock_guard<std::mutex> lck(streams_mtx_);
+    callbacks.swap(failed_loads_);
+  }
+  for (auto& callback : callbacks) {
+    if (callback) {
+      callback(false);
+    }
+  }
+}
+
+StreamSource& MpvPlayer::source_from_cookie(void* cookie) {
+  return *static_cast<Stream*>(cookie)->source;
+}
+
+int MpvPlayer::stream_open_cb(void* user_data, char* uri,
+                              mpv_stream_cb_info* info) {
+  MpvPlayer* player = static_cast<MpvPlayer*>(user_data);
+
+  // uri is "lrm://<id>", mpv calls this only for this protocol.
+  std::unique_ptr<Stream> stream;
+  try {
+    const uint64_t id = std::stoull(
+        std::string(uri).substr(std::strlen(STREAM_PROTOCOL) + 3));
+
+    std::lock_guard<std::mutex> lck(player->streams_mtx_);
+    const auto it = player->pending_streams_.find(id);
+    if (it != player->pending_streams_.end()) {
+      stream = std::move(it->second);
+      player->pending_streams_.erase(it);
+      player->loading_streams_.push_back(stream.get());
+    }
+  } catch (const std::exception& e) {
+    spdlog::error("Invalid stream URI '{}': {}", uri, e.what());
+  }
+
+  if (not stream) {
+    return MPV_ERROR_LOADING_FAILED;
+  }
+
+  const bool seekable = stream->source->IsSeekable();
+
+  // The cookie owns the stream until mpv closes it.
+  info->cookie = stream.release();
+  info->read_fn = &MpvPlayer::stream_read_cb;
+  info->seek_fn = seekable ? &MpvPlayer::stream_seek_cb : nullptr;
+  info->size_fn = &MpvPlayer::stream_size_cb;
+  info->close_fn = &MpvPlayer::stream_close_cb;
+  info->cancel_fn = &MpvPlayer::stream_cancel_cb;
+
+  return 0;
+}
+
+int64_t MpvPlayer::stream_read_cb(void* cookie, char* buf, uint64_t nbytes) {
+  return source_from_cookie(cookie).Read(buf, nbytes);
+}
+
+int64_t MpvPlayer::stream_seek_cb(void* cookie, int64_t offset) {
+  const auto result = source_from_cookie(cookie).Seek(offset);
+  return result < 0 ? int64_t{MPV_ERROR_GENERIC} : result;
+}
+
+int64_t MpvPlayer::stream_size_cb(void* cookie) {
+  const auto size = source_from_cookie(cookie).TotalSize();
+  return size < 0 ? int64_t{MPV_ERROR_UNSUPPORTED} : size;
+}
+
+void MpvPlayer::stream_close_cb(void* cookie) {
+  std::unique_ptr<Stream> stream(static_cast<Stream*>(cookie));
+  // Nothing will read the rest, so stop the writer.
+  stream->source->Cancel();
+
+  {
+    MpvPlayer* player = stream->player;
+    std::lock_guard<std::mutex> lck(player->streams_mtx_);
+    const auto it = std::find(player->loading_streams_.begin(),
+                              player->loading_streams_.end(), stream.get());
+    if (it != player->loading_streams_.end()) {
+      player->loading_streams_.erase(it);
+      player->failed_loads_.push_back(std::move(stream->on_load));
+    }
+  }
+
+  const auto stats = stream->source->GetStats();
+  spdlog::debug("Stream closed after reading {} of {} bytes; "
+                "writer waited {} times, reader waited {} times, "
+                "{} seeks failed",
+                stats.bytes_read, stats.bytes_written,
+                stats.writer_stalls, stats.reader_stalls,
+                stats.failed_seeks);
+}
+
+void MpvPlayer::stream_cancel_cb(void* cookie) {
+  source_from_cookie(cookie).Cancel();
+}
+
+int64_t MpvPlayer::get_property_int64_(const std::string_view prop_name) const {
+  int64_t prop_value = 0;
+  const int result = mpv_get_property(ctx_.get(), prop_name.data(),
+                                      MPV_FORMAT_INT64, &prop_value);
+  if (MPV_ERROR_SUCCESS != result) {
+    throw lrm::MpvException((mpv_error)result, prop_name.data());
+  }
+
+  return prop_value;
+}
+
+bool MpvPlayer::get_property_bool_(const std::string_view prop_name) const {
+  int prop_value = 0;
+  const int result = mpv_get_property(ctx_.get(), prop_name.data(),
+                                      MPV_FORMAT_FLAG, &prop_value);
+  if (MPV_ERROR_SUCCESS != result) {
+    throw lrm::MpvException((mpv_error)result, prop_name.data());
+  }
+
+  return prop_value == 1;
+}
+
+void MpvPlayer::update_property(ObservedProperty property,
+                                const mpv_event_property& data) {
+  properties_.Update([&](Properties& properties){
+    // MPV_FORMAT_NONE when the property has no value, e.g. the times when
+    // nothing is loaded.
+    if (MPV_FORMAT_NONE == data.format or nullptr == data.data) {
+      properties.available &= ~property;
+      return;
+    }
+    properties.available |= property;
+
+    if (PAUSE == property) {
+      properties.paused = *static_cast<int*>(data.data);
+      return;
+    }
+    if (PAUSED_FOR_CACHE == property) {
+      const bool paused_for_cache = *static_cast<int*>(data.data);
+      if (paused_for_cache and not properties.paused_for_cache) {
+        ++properties.underruns;
+      }
+      properties.paused_for_cache = paused_for_cache;
+      return;
+    }
+    const double value = *static_cast<double*>(data.data);
+    switch (property) {
+      case TIME_POSITION: properties.time_position = value; break;
+      case TIME_REMAINING: properties.time_remaining = value; break;
+      case TOTAL_TIME: properties.total_time = value; break;
+      case PLAYTIME_REMAINING: properties.playtime_remaining = value; break;
+      case VOLUME: properties.volume = value; break;
+      case SPEED: properties.speed = value; break;
+      case CACHE_DURATION: properties.cache_duration = value; break;
+      case BUFFERING: properties.buffering = value; break;
+      case PAUSE: case PAUSED_FOR_CACHE: break;
+    }
+  });
+}
+
+void MpvPlayer::handle_log_message(const mpv_event_log_message& message) {
+  // "Audio device underrun detected." from the audio output.
+  if (0 != std::strncmp(message.prefix, "ao", 2) or
+      nullptr == std::strstr(message.text, "underrun")) {
+    return;
+  }
+  properties_.Update([](Properties& properties){
+                       ++properties.underruns;
+                     });
+  spdlog::warn("The audio device has run out of data");
+}
+
+void MpvPlayer::start_event_loop() {
+  if (event_loop_thread_.joinable()) {
+    spdlog::error("Tried to start mpv event loop while it's already running");
+    return;
+  }
+
+  try {
+    event_loop_thread_ = std::thread(&MpvPlayer::mpv_event_loop, this);
+  } catch (const std::system_error& e) {
+    spdlog::error("Couldn't start the mpv event loop thread: {}",
+                  e.what());
+  }
+}
+
+void MpvPlayer::stop_event_loop() noexcept {
+  const uint64_t one = 1;
+  [[maybe_unused]] const auto result =
+      write(shutdown_fd_, &one, sizeof(one));
+}
+
+void MpvPlayer::wakeup_cb(void* player) {
+  // Called from mpv's own threads, so it mustn't call mpv.
+  const uint64_t one = 1;
+  [[maybe_unused]] const auto result =
+      write(static_cast<MpvPlayer*>(player)->wakeup_fd_, &one, sizeof(one));
+}
+
+bool MpvPlayer::wait_for_events() {
+  pollfd fds[2] = {{wakeup_fd_, POLLIN, 0}, {shutdown_fd_, POLLIN, 0}};
+
+  while (poll(fds, 2, -1) < 0) {
+    if (EINTR != errno) {
+      spdlog::error("Waiting for mpv events: {}", std::strerror(errno));
+      return false;
+    }
+  }
+  if (fds[1].revents != 0) {
+    return false;
+  }
+
+  // Reset the counter before taking the events. A wakeup coming after this
+  // makes the next poll() return at once, so none is lost.
+  uint64_t count;
+  [[maybe_unused]] const auto result =
+      read(wakeup_fd_, &count, sizeof(count));
+  return true;
+}
+
+void MpvPlayer::mpv_event_loop() {
+  spdlog::debug("Starting mpv event loop...");
+
+  bool initial_state = true;
+  // mpv sends the current values right away and then only the changes, so
+  // the readers don't have to ask for them.
+  for (const auto& [property, name] : OBSERVED_PROPERTIES) {
+    check_result(mpv_observe_property(
+        ctx_.get(), property, name,
+        is_flag(property) ? MPV_FORMAT_FLAG : MPV_FORMAT_DOUBLE));
+  }
+
+  // mpv's wakeup callback signals wakeup_fd_ when there are new events.
+  // The loop takes all of them without waiting and sleeps only in
+  // wait_for_events(), so it doesn't wake up at all while mpv is idle.
+  for (;;) {
+    const mpv_event* event = mpv_wait_event(ctx_.get(), 0);
+
+    if (MPV_EVENT_NONE == event->event_id) {
+      if (not wait_for_events()) {
+        break;
+      }
+      continue;
+    }
+    if (MPV_EVENT_SHUTDOWN == event->event_id) {
+      break;
+    }
+    // Comes with the command's error, handle it before the check below.
+    if (MPV_EVENT_COMMAND_REPLY == event->event_id) {
+      complete_reply(event->reply_userdata, event->error);
+      continue;
+    }
+
+    if (event->error != MPV_ERROR_SUCCESS) {
+      spdlog::error("mpv event '{}': {}",
+                    mpv_event_name(event->event_id),
+                    mpv_error_string(event->error));
+      continue;
+    }
+
+    switch (event->event_id) {
+      case MPV_EVENT_NONE:
+        continue;
+      case MPV_EVENT_END_FILE:
+        {
+          const mpv_event_end_file* end_file_data =
+              (mpv_event_end_file*)event->data;
+
+          switch (end_file_data->reason) {
+            case MPV_END_FILE_REASON_EOF:
+              playback_state_.SetState(PlaybackState::STOPPED);
+              break;
+            case MPV_END_FILE_REASON_ERROR:
+              spdlog::error("mpv file ended: {}",
+                            mpv_error_string(end_file_data->error));
+              playback_state_.SetState(PlaybackState::STOPPED);
+              break;
+            case MPV_END_FILE_REASON_STOP: case MPV_END_FILE_REASON_QUIT:
+              playback_state_.SetState(PlaybackState::STOPPED);
+              break;
+            case MPV_END_FILE_REASON_REDIRECT:
+              spdlog::warn("MPV_END_FILE_REASON_REDIRECT not implemented");
+              break;
+            default:
+              spdlog::warn("Unknown mpv end file reason");
+              break;
+          }
+          report_failed_streams();
+        }
+        break;
+      case MPV_EVENT_FILE_LOADED:
+        report_loaded_streams();
+        if (properties_.Load().paused) {
+          break;
+        }
+        playback_state_.SetState(PlaybackState::PLAYING);
+        break;
+      case MPV_EVENT_LOG_MESSAGE:
+        handle_log_message(
+            *static_cast<mpv_event_log_message*>(event->data));
+        break;
+      case MPV_EVENT_PROPERTY_CHANGE: {
+        const mpv_event_property* property =
+            static_cast<mpv_event_property*>(event->data);
+        const auto observed =
+            static_cast<ObservedProperty>(event->reply_userdata);
+        update_property(observed, *property);
+
+        if (VOLUME == observed) {
+          const Properties properties = properties_.Load();
+          std::lock_guard<std::mutex> lck(volume_callback_mtx_);
+          if (volume_change_callback_ and properties.Has(VOLUME)) {
+            volume_change_callback_(std::lround(properties.volume));
+          }
+        }
+
+        if (PAUSED_FOR_CACHE == observed and
+            properties_.Load().paused_for_cache) {
+          spdlog::warn("The playback waits for the stream's data");
+        }
+
+        if (PAUSE == observed) {
+          if (properties_.Load().paused) {
+            playback_state_.SetState(PlaybackState::PAUSED);
+          } else if ((not get_property_bool_("idle-active")) and
+                     (not initial_state)) {
+            playback_state_.SetState(PlaybackState::PLAYING);
+          } else {
+            playback_state_.SetState(PlaybackState::STOPPED);
+          }
+          initial_state = false;
+        }
+
+        break;
+      }
+      default:
+        continue;
+    }
+  }
+  spdlog::debug("Mpv event loop stopped");
+}
+}
@@ -0,0 +1,191 @@
+// Copyright (C) 2019 by Jakub Wojciech
+
+// This file is part of Lelo Remote Music Player.
+
+// Lelo Remote Music Player is free software: you can redistribute it
+// and/or modify it under the terms of the GNU General Public License
+// as published by the Free Software Foundation, either version 3 of
+// the License, or (at your option) any later version.
+
+// Lelo Remote Music Player is distributed in the hope that it will be
+// useful, but WITHOUT ANY WARRANTY; without even the implied warranty
+// of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+// General Public License for more details.
+
+// You should have received a copy of the GNU General Public License
+// along with Lelo Remote Music Player. If not, see
+// <https://www.gnu.org/licenses/>.
+
+#ifndef LRM_MPVPLAYER_H
+#define LRM_MPVPLAYER_H
+
+#include <cstdint>
+#include <iostream>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <utility>
+#include <vector>
+
+#include "mpv/client.h"
+#include "mpv/stream_cb.h"
+
+#include "Player.h"
+#include "SeqLock.h"
+#include "StreamSource.h"
+
+namespace lrm {
+/// Player playing with libmpv.
+class MpvPlayer : public Player {
+ public:
+  using Options = MpvOptions;
+
+ private:
+  /// Stream played through the custom protocol. It's the cookie of the
+  /// stream's callbacks while mpv has it open.
+  struct Stream {
+    MpvPlayer* player;
+    std::shared_ptr<StreamSource> source;
+    LoadCallback on_load;
+  };
+
+  inline int check_result(int result) {
+    if (0 != result) {
+      std::cerr << mpv_error_string(result) << '\n';
+    }
+    return result;
+  }
+
+  int send_command_(const std::vector<std::string>&& args);
+  /// Send the command without waiting for mpv. \e on_reply is called from
+  /// the event loop when mpv has run it, or at once if it couldn't be sent.
+  void send_command_async_(const std::vector<std::string>&& args,
+                           ReplyCallback on_reply);
+  /// Call the callback waiting for the reply \e id, on
+  /// MPV_EVENT_COMMAND_REPLY.
+  void complete_reply(uint64_t id, int result);
+
+  /// Load input_ with the low-latency options or the normal ones.
+  int load(bool low_latency);
+  void set_low_latency(bool enabled);
+
+  int64_t get_property_int64_(const std::string_view prop_name) const;
+  bool get_property_bool_(const std::string_view prop_name) const;
+
+  /// Store the value from MPV_EVENT_PROPERTY_CHANGE in properties_.
+  void update_property(ObservedProperty property,
+                       const mpv_event_property& data);
+  /// Count the audio device's underruns, mpv only logs them.
+  void handle_log_message(const mpv_event_log_message& message);
+
+  void start_event_loop();
+  void stop_event_loop() noexcept;
+  void mpv_event_loop();
+  /// Sleep until mpv has new events.
+  /// \return \b false if the event loop should stop.
+  bool wait_for_events();
+  void close_event_fds() noexcept;
+  static void wakeup_cb(void* player);
+
+  /// Cancel the streams registered with PlayFromStream() that mpv hasn't
+  /// opened.
+  void cancel_pending_streams();
+  /// Report the streams whose files have loaded, on MPV_EVENT_FILE_LOADED.
+  void report_loaded_streams();
+  /// Report the streams closed before their files loaded, on
+  /// MPV_EVENT_END_FILE. It comes after mpv's FILE_LOADED for the same
+  /// file, so a stream that loaded can't be reported as failed.
+  void report_failed_streams();
+
+  // Callbacks for mpv's custom stream protocol.
+  static StreamSource& source_from_cookie(void* cookie);
+  static int stream_open_cb(void* user_data, char* uri,
+                            mpv_stream_cb_info* info);
+  static int64_t stream_read_cb(void* cookie, char* buf, uint64_t nbytes);
+  static int64_t stream_seek_cb(void* cookie, int64_t offset);
+  static int64_t stream_size_cb(void* cookie);
+  static void stream_close_cb(void* cookie);
+  static void stream_cancel_cb(void* cookie);
+
+ public:
+  /// \param log_file Where mpv writes its log.
+  /// \param options Set before mpv starts, e.g. the audio output.
+  explicit MpvPlayer(const std::string& log_file = "mpv.log",
+                     const Options& options = {});
+  ~MpvPlayer() override;
+
+  int Play() override;
+
+  // mpv's results are passed to \e on_reply from the event loop.
+  void TogglePause(ReplyCallback on_reply) override;
+  void Stop(ReplyCallback on_reply) override;
+  void Volume(std::string_view volume, ReplyCallback on_reply) override;
+  void Seek(int32_t seconds, ReplyCallback on_reply) override;
+  using Player::Volume;
+  void SetVolumeChangeCallback(VolumeChangeCallback&& callback) override;
+
+  /// mpv opens the next file before the current one ends, so the
+  /// transition is gapless.
+  int Enqueue(std::string_view path) override;
+  int ClearQueue() override;
+  std::vector<std::string> Queue(int64_t* current) const override;
+  /// mpv reads the stream directly through a custom stream protocol.
+  int PlayFromStream(std::shared_ptr<StreamSource> source,
+                     LoadCallback on_load = {},
+                     bool low_latency = false) override;
+  /// Sets mpv's \e demuxer-readahead-secs.
+  void SetReadahead(double seconds) override;
+
+  /// It doesn't call mpv, the event loop observes the properties.
+  inline Properties GetProperties() const override {
+    return properties_.Load();
+  }
+
+ private:
+  std::unique_ptr<mpv_handle, decltype(&mpv_terminate_destroy)> ctx_;
+
+  // Written only by the event loop.
+  SeqLock<Properties> properties_;
+
+  // mpv options changed for live streams: the name, the value for them and
+  // the normal value, read from mpv at the start.
+  struct LatencyOption {
+    const char* name;
+    const char* low_latency;
+    std::string normal;
+  };
+  std::vector<LatencyOption> latency_options_;
+  bool low_latency_ = false;
+  // Guards the two above, the streams and SetReadahead() change them from
+  // different threads.
+  std::mutex options_mtx_;
+
+  // Streams waiting for mpv to open them, by their id in the URI.
+  std::map<uint64_t, std::unique_ptr<Stream>> pending_streams_;
+  // Opened by mpv, but their files haven't loaded yet.
+  std::vector<Stream*> loading_streams_;
+  // Callbacks of the streams closed before their files loaded.
+  std::vector<LoadCallback> failed_loads_;
+  uint64_t next_stream_id_ = 0;
+  std::mutex streams_mtx_;
+
+  // Callbacks of the commands sent with send_command_async_(), by their
+  // reply ids. Observed properties use ids from ObservedProperty, but their
+  // events are different, so the ids don't clash.
+  std::map<uint64_t, ReplyCallback> pending_replies_;
+  uint64_t next_reply_id_ = 1;
+  std::mutex replies_mtx_;
+
+  VolumeChangeCallback volume_change_callback_;
+  std::mutex volume_callback_mtx_;
+
+  // Signalled by mpv's wakeup callback and by stop_event_loop().
+  int wakeup_fd_ = -1;
+  int shutdown_fd_ = -1;
+  std::thread event_loop_thread_;
+};
+}
+
+#endif // LRM_MPVPLAYER_H
@@ -0,0 +1,346 @@
+// Copyright (C) 2020 by Jakub Wojciech
+
+// This file is part of Lelo Remote Music Player.
+
+// Lelo Remote Music Player is free software: you can redistribute it
+// and/or modify it under the terms of the GNU General Public License
+// as published by the Free Software Foundation, either version 3 of
+// the License, or (at your option) any later version.
+
+// Lelo Remote Music Player is distributed in the hope that it will be
+// useful, but WITHOUT ANY WARRANTY; without even the implied warranty
+// of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+// General Public License for more details.
+
+// You should have received a copy of the GNU General Public License
+// along with Lelo Remote Music Player. If not, see
+// <https://www.gnu.org/licenses/>.
+
+
+#include "NullPlayer.h"
+
+#include <algorithm>
+#include <fstream>
+
+#include "spdlog/spdlog.h"
+
+namespace lrm {
+namespace {
+constexpr size_t READ_SIZE = 64 * 1024;
+}
+
+NullPlayer::NullPlayer() : thread_(&NullPlayer::run, this) {}
+
+NullPlayer::~NullPlayer() {
+  {
+    std::lock_guard<std::mutex> lck(mtx_);
+    stop_ = true;
+    drop_current();
+  }
+  cv_.notify_all();
+  thread_.join();
+}
+
+int NullPlayer::Play() {
+  std::lock_guard<std::mutex> lck(mtx_);
+  play(Item{input_, nullptr, {}});
+  return MPV_ERROR_SUCCESS;
+}
+
+int NullPlayer::PlayFromStream(std::shared_ptr<StreamSource> source,
+                               LoadCallback on_load, bool) {
+  std::lock_guard<std::mutex> lck(mtx_);
+  play(Item{"", std::move(source), std::move(on_load)});
+  return MPV_ERROR_SUCCESS;
+}
+
+void NullPlayer::play(Item item) {
+  drop_current();
+  playlist_.clear();
+  playlist_.push_back(std::move(item));
+  current_ = 0;
+  // Like mpv, a new file starts playing even if the player was paused.
+  paused_ = false;
+  started_ = std::chrono::steady_clock::now();
+  cv_.notify_all();
+}
+
+void NullPlayer::drop_current() {
+  if (current_ >= 0 and playlist_[current_].source) {
+    playlist_[current_].source->Cancel();
+  }
+  ++generation_;
+  position_ = 0;
+  size_ = -1;
+  seek_to_ = -1;
+}
+
+void NullPlayer::TogglePause(ReplyCallback on_reply) {
+  {
+    std::lock_guard<std::mutex> lck(mtx_);
+    paused_ = not paused_;
+    playback_state_.SetState(paused_ ? PlaybackState::PAUSED :
+                             current_ >= 0 ? PlaybackState::PLAYING :
+                             PlaybackState::STOPPED);
+    cv_.notify_all();
+  }
+  if (on_reply) {
+    on_reply(MPV_ERROR_SUCCESS);
+  }
+}
+
+void NullPlayer::Stop(ReplyCallback on_reply) {
+  {
+    std::lock_guard<std::mutex> lck(mtx_);
+    drop_current();
+    playlist_.clear();
+    current_ = -1;
+    playback_state_.SetState(PlaybackState::STOPPED);
+    cv_.notify_all();
+  }
+  if (on_reply) {
+    on_reply(MPV_ERROR_SUCCESS);
+  }
+}
+
+void NullPlayer::Volume(std::string_view volume, ReplyCallback on_reply) {
+  int value;
+  bool relative;
+  if (not parse_volume(volume, &value, &relative)) {
+    if (on_reply) {
+      on_reply(MPV_ERROR_INVALID_PARAMETER);
+    }
+    return;
+  }
+
+  int new_volume;
+  {
+    std::lock_guard<std::mutex> lck(mtx_);
+    volume_ = std::clamp(relative ? volume_ + value : value, 0, 100);
+    new_volume = volume_;
+  }
+  {
+    std::lock_guard<std::mutex> lck(volume_callback_mtx_);
+    if (volume_change_callback_) {
+      volume_change_callback_(new_volume);
+    }
+  }
+  if (on_reply) {
+    on_reply(MPV_ERROR_SUCCESS);
+  }
+}
+
+void NullPlayer::Seek(int32_t seconds, ReplyCallback on_reply) {
+  int result = MPV_ERROR_SUCCESS;
+  {
+    std::lock_guard<std::mutex> lck(mtx_);
+    if (current_ < 0) {
+      result = MPV_ERROR_COMMAND;
+    } else {
+      int64_t target =
+          position_ + static_cast<int64_t>(seconds * BYTES_PER_SECOND);
+      if (size_ >= 0) {
+        target = std::min(target, size_);
+      }
+      seek_to_ = std::max<int64_t>(target, 0);
+    }
+  }
+  if (on_reply) {
+    on_reply(result);
+  }
+}
+
+void NullPlayer::SetVolumeChangeCallback(VolumeChangeCallback&& callback) {
+  std::lock_guard<std::mutex> lck(volume_callback_mtx_);
+  volume_change_callback_ = std::move(callback);
+}
+
+int NullPlayer::Enqueue(std::string_view path) {
+  std::lock_guard<std::mutex> lck(mtx_);
+  playlist_.push_back(Item{std::string(path), nullptr, {}});
+  if (current_ < 0) {
+    drop_current();
+    current_ = playlist_.size() - 1;
+    started_ = std::chrono::steady_clock::now();
+    cv_.notify_all();
+  }
+  return MPV_ERROR_SUCCESS;
+}
+
+int NullPlayer::ClearQueue() {
+  std::lock_guard<std::mutex> lck(mtx_);
+  if (current_ < 0) {
+    playlist_.clear();
+    return MPV_ERROR_SUCCESS;
+  }
+  Item current = std::move(playlist_[current_]);
+  playlist_.clear();
+  playlist_.push_back(std::move(current));
+  current_ = 0;
+  return MPV_ERROR_SUCCESS;
+}
+
+std::vector<std::string> NullPlayer::Queue(int64_t* current) const {
+  std::lock_guard<std::mutex> lck(mtx_);
+  *current = current_;
+  std::vector<std::string> files;
+  for (const auto& item : playlist_) {
+    files.push_back(item.source ? "stream" : item.path);
+  }
+  return files;
+}
+
+NullPlayer::Properties NullPlayer::GetProperties() const {
+  std::lock_guard<std::mutex> lck(mtx_);
+  Properties properties;
+  properties.volume = volume_;
+  properties.paused = paused_;
+  properties.available = VOLUME | PAUSE | SPEED;
+  if (current_ < 0) {
+    return properties;
+  }
+
+  properties.time_position = position_ / BYTES_PER_SECOND;
+  properties.available |= TIME_POSITION;
+  if (size_ >= 0) {
+    properties.total_time = size_ / BYTES_PER_SECOND;
+    properties.time_remaining =
+        properties.total_time - properties.time_position;
+    properties.playtime_remaining = properties.time_remaining;
+    properties.available |= TOTAL_TIME | TIME_REMAINING | PLAYTIME_REMAINING;
+  }
+  return properties;
+}
+
+void NullPlayer::run() {
+  std::unique_lock<std::mutex> lck(mtx_);
+  // Starting an item changes the generation, so it's never 0 once there's
+  // something to play, even if it has started before this thread.
+  uint64_t consumed = 0;
+  for (;;) {
+    cv_.wait(lck, [&]{
+                    return stop_ or
+                        (current_ >= 0 and generation_ != consumed);
+                  });
+    if (stop_) {
+      return;
+    }
+    consumed = generation_;
+    Item item = playlist_[current_];
+    lck.unlock();
+    consume(item, consumed);
+    lck.lock();
+  }
+}
+
+void NullPlayer::consume(Item& item, uint64_t generation) {
+  std::ifstream file;
+  int64_t size = -1;
+  if (item.source) {
+    size = item.source->TotalSize();
+  } else {
+    file.open(item.path, std::ios::binary | std::ios::ate);
+    if (file) {
+      size = file.tellg();
+      file.seekg(0);
+    } else {
+      spdlog::error("Null player couldn't open {}", item.path);
+    }
+  }
+
+  std::chrono::steady_clock::time_point started;
+  {
+    std::lock_guard<std::mutex> lck(mtx_);
+    if (generation_ != generation) {
+      return;
+    }
+    started = started_;
+    size_ = size;
+  }
+
+  std::vector<char> buffer(READ_SIZE);
+  uint64_t bytes = 0;
+  bool loaded = false;
+  std::chrono::steady_clock::time_point first_byte;
+  const bool opened = item.source or file;
+  while (opened) {
+    {
+      std::unique_lock<std::mutex> lck(mtx_);
+      cv_.wait(lck, [&]{
+                      return not paused_ or generation_ != generation or
+                          stop_;
+                    });
+      if (generation_ != generation or stop_) {
+        break;
+      }
+      if (seek_to_ >= 0) {
+        if (item.source) {
+          if (item.source->Seek(seek_to_) >= 0) {
+            position_ = seek_to_;
+          }
+        } else {
+          file.clear();
+          file.seekg(seek_to_);
+          position_ = seek_to_;
+        }
+        seek_to_ = -1;
+      }
+    }
+
+    int64_t read;
+    if (item.source) {
+      read = item.source->Read(buffer.data(), buffer.size());
+    } else {
+      file.read(buffer.data(), buffer.size());
+      read = file.gcount();
+    }
+    if (read <= 0) {
+      break;
+    }
+
+    bytes += read;
+    const bool first = not loaded;
+    if (first) {
+      loaded = true;
+      first_byte = std::chrono::steady_clock::now();
+      if (item.on_load) {
+        item.on_load(true);
+      }
+    }
+
+    std::lock_guard<std::mutex> lck(mtx_);
+    if (generation_ == generation) {
+      position_ += read;
+      if (first and not paused_) {
+        playback_state_.SetState(PlaybackState::PLAYING);
+      }
+    }
+  }
+
+  if (not loaded and item.on_load) {
+    item.on_load(false);
+  }
+  const std::chrono::duration<double> elapsed =
+      std::chrono::steady_clock::now() - started;
+  spdlog::info("Null player read {} bytes in {:.3f} s ({:.1f} MiB/s), "
+               "the first after {:.1f} ms", bytes, elapsed.count(),
+               bytes / (1024.0 * 1024.0) / std::max(elapsed.count(), 1e-9),
+               loaded ? std::chrono::duration<double, std::milli>(
+                   first_byte - started).count() : 0.0);
+
+  std::lock_guard<std::mutex> lck(mtx_);
+  if (generation_ != generation or stop_) {
+    return;
+  }
+  // It has ended on its own, go to the next one like mpv.
+  if (current_ + 1 < static_cast<int64_t>(playlist_.size())) {
+    drop_current();
+    ++current_;
+    started_ = std::chrono::steady_clock::now();
+  } else {
+    drop_current();
+    current_ = -1;
+    playback_state_.SetState(PlaybackState::STOPPED);
+  }
+}
+}
@@ -0,0 +1,113 @@
+// Copyright (C) 2020 by Jakub Wojciech
+
+// This file is part of Lelo Remote Music Player.
+
+// Lelo Remote Music Player is free software: you can redistribute it
+// and/or modify it under the terms of the GNU General Public License
+// as published by the Free Software Foundation, either version 3 of
+// the License, or (at your option) any later version.
+
+// Lelo Remote Music Player is distributed in the hope that it will be
+// useful, but WITHOUT ANY WARRANTY; without even the implied warranty
+// of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+// General Public License for more details.
+
+// You should have received a copy of the GNU General Public License
+// along with Lelo Remote Music Player. If not, see
+// <https://www.gnu.org/licenses/>.
+
+
+#ifndef LRM_NULLPLAYER_H_
+#define LRM_NULLPLAYER_H_
+
+#include <chrono>
+#include <condition_variable>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "Player.h"
+
+namespace lrm {
+/// Player that doesn't decode or play anything, for benchmarks and load
+/// tests on machines without sound hardware.
+///
+/// It reads the files and the streams as fast as they come and logs how
+/// long it took. The position is the number of bytes read as if they were
+/// CD-quality PCM, so the times don't depend on the machine. The commands
+/// are done at once, without waiting for anything.
+class NullPlayer : public Player {
+ public:
+  /// Bytes per second of the assumed format: 44.1 kHz, 16 bits, stereo.
+  static constexpr double BYTES_PER_SECOND = 44100 * 2 * 2;
+
+  NullPlayer();
+  ~NullPlayer() override;
+
+  int Play() override;
+
+  void TogglePause(ReplyCallback on_reply) override;
+  void Stop(ReplyCallback on_reply) override;
+  void Volume(std::string_view volume, ReplyCallback on_reply) override;
+  void Seek(int32_t seconds, ReplyCallback on_reply) override;
+  using Player::Volume;
+  void SetVolumeChangeCallback(VolumeChangeCallback&& callback) override;
+
+  int Enqueue(std::string_view path) override;
+  int ClearQueue() override;
+  std::vector<std::string> Queue(int64_t* current) const override;
+  int PlayFromStream(std::shared_ptr<StreamSource> source,
+                     LoadCallback on_load = {},
+                     bool low_latency = false) override;
+  /// Does nothing, it doesn't buffer anything.
+  inline void SetReadahead(double) override {}
+
+  Properties GetProperties() const override;
+
+ private:
+  /// A file or a stream on the playlist.
+  struct Item {
+    std::string path;
+    std::shared_ptr<StreamSource> source;
+    LoadCallback on_load;
+  };
+
+  /// Replace the playlist with \e item and start it. Called with mtx_
+  /// locked.
+  void play(Item item);
+  /// Drop the current item, cancelling its stream. Called with mtx_
+  /// locked.
+  void drop_current();
+
+  void run();
+  /// Read the current item until it ends or is replaced.
+  void consume(Item& item, uint64_t generation);
+
+  std::vector<Item> playlist_;
+  // Index of the playing item in playlist_, -1 if nothing plays.
+  int64_t current_ = -1;
+  // Changed every time the current item is replaced or stopped.
+  uint64_t generation_ = 0;
+  bool paused_ = false;
+  int volume_ = 100;
+  // Read from the current item, and its size if it's known.
+  uint64_t position_ = 0;
+  int64_t size_ = -1;
+  // Offset to read from next, set by Seek().
+  int64_t seek_to_ = -1;
+  // When the current item was started, for the logs.
+  std::chrono::steady_clock::time_point started_;
+  bool stop_ = false;
+  mutable std::mutex mtx_;
+  std::condition_variable cv_;
+
+  VolumeChangeCallback volume_change_callback_;
+  std::mutex volume_callback_mtx_;
+
+  std::thread thread_;
+};
+}
+
+#endif  // LRM_NULLPLAYER_H_
@@ -33,6 +33,11 @@ time_info_playback_state_translation_map =
  {TimeInfo::STOPPED, lrm::PlaybackState::STOPPED},
  {TimeInfo::FINISHED, lrm::PlaybackState::FINISHED},
  {TimeInfo::FINISHED_ERROR, lrm::PlaybackState::FINISHED_ERROR}};
+
+int64_t now_us() {
+  return std::chrono::duration_cast<std::chrono::microseconds>(
+      std::chrono::steady_clock::now().time_since_epoch()).count();
+}
 }
 
 PlaybackSynchronizer::~PlaybackSynchronizer() {
@@ -78,10 +83,15 @@ PlaybackSynchronizer::GetPlaybackInfo() const {
     result.total_time = base_playback_info.info.total_time;
     result.playback_state = base_playback_info.info.playback_state;
     result.volume = base_playback_info.info.volume;
+    result.buffered_time = base_playback_info.info.buffered_time;
+    result.buffering = base_playback_info.info.buffering;
+    result.underruns = base_playback_info.info.underruns;
 
     if (base_playback_info.info.playback_state == PlaybackState::PLAYING) {
       const auto time_difference =
-          std::chrono::steady_clock::now() - base_playback_info.last_update;
+          std::chrono::duration<double>(
+              std::chrono::steady_clock::now() -
+              base_playback_info.last_update) * base_playback_info.speed;
 
       result.elapsed_time =
           base_playback_info.info.elapsed_time + time_difference;
@@ -96,12 +106,18 @@ PlaybackSynchronizer::GetPlaybackInfo() const {
   return result;
 }
 
+std::optional<std::chrono::microseconds>
+PlaybackSynchronizer::GetRoundTrip() const {
+  std::lock_guard lck(base_playback_info.mtx);
+  return base_playback_info.round_trip;
+}
+
 void PlaybackSynchronizer::continuous_update(std::chrono::milliseconds
                                              update_interval) {
   try {
     is_updating_ = true;
 
-    AuthenticatedContext context{session_key_};
+    AuthenticatedContext context{session_key_, zone_};
     std::shared_ptr<grpc::ClientReaderWriter<TimeInterval, TimeInfo>> stream(
         stub_->TimeInfoStream(&context));
 
@@ -110,15 +126,25 @@ void PlaybackSynchronizer::continuous_update(std::chrono::milliseconds
 
     spdlog::debug("Setting the info stream interval to {}s",
                   update_interval.count() / (float) 1000);
+    // The server echoes the timestamp to synchronize the clocks.
+    interval.set_client_time_us(now_us());
     stream->Write(interval);
 
     // Writer will just wait until SongInfoUpdater::Stop() is called (it's
-    // called by the destructor).
+    // called by the destructor). Meanwhile it sends the interval again now
+    // and then to measure the round trip, the clocks drift apart.
     std::thread writer(
-        [this, stream]{
+        [this, stream, interval]() mutable {
           {
             std::unique_lock<std::mutex> lck(is_updating_mtx_);
-            is_updating_cv_.wait(lck, [&]{return !is_updating_;});
+            while (not is_updating_cv_.wait_for(
+                       lck, CLOCK_SYNC_INTERVAL,
+                       [&]{return !is_updating_;})) {
+              interval.set_client_time_us(now_us());
+              lck.unlock();
+              stream->Write(interval);
+              lck.lock();
+            }
           }
 
           stream->WritesDone();
@@ -129,6 +155,7 @@ void PlaybackSynchronizer::continuous_update(std::chrono::milliseconds
     TimeInfo time_info;
     PlaybackState::State current_state = PlaybackState::UNDEFINED;
     bool state_changed = false;
+    bool first = true;
 
     while (stream->Read(&time_info)) {
       if (time_info.playback_state() != TimeInfo::NOT_CHANGED) {
@@ -139,25 +166,71 @@ void PlaybackSynchronizer::continuous_update(std::chrono::milliseconds
         state_changed = false;
       }
 
+      const auto received = std::chrono::steady_clock::now();
+      const std::chrono::microseconds server_time{time_info.server_time_us()};
+      if (time_info.echo_client_time_us() != 0) {
+        server_clock_.AddSample(
+            std::chrono::steady_clock::time_point(
+                std::chrono::microseconds(time_info.echo_client_time_us())),
+            std::chrono::microseconds(time_info.echo_hold_us()),
+            server_time, received);
+        spdlog::debug("Info stream round trip: {} ms",
+                      server_clock_.RoundTrip().count() / 1000.0);
+      }
+
       {
         std::lock_guard lck(base_playback_info.mtx);
-        base_playback_info.last_update = std::chrono::steady_clock::now();
-
         base_playback_info.info.playback_state = current_state;
+        if (server_clock_.IsSynchronized()) {
+          base_playback_info.round_trip = server_clock_.RoundTrip();
+        }
+
+        // Only the changes are sent, the rest stays as it was.
+        if (time_info.has_volume()) {
+          base_playback_info.info.volume = time_info.volume();
+        }
+        if (time_info.has_speed()) {
+          base_playback_info.speed = time_info.speed();
+        }
+        if (time_info.has_total_time()) {
+          base_playback_info.info.total_time =
+              std::chrono::duration<double>(time_info.total_time());
+        }
+        if (PlaybackState::PLAYING != current_state and
+            PlaybackState::PAUSED != current_state) {
+          base_playback_info.info.buffered_time.reset();
+        }
+        if (time_info.has_buffered_time()) {
+          base_playback_info.info.buffered_time =
+              std::chrono::duration<double>(time_info.buffered_time());
+          spdlog::debug("The server has {} s buffered, {} s in the player",
+                        time_info.buffered_time(), time_info.cache_time());
+        }
+        if (time_info.has_buffering()) {
+          base_playback_info.info.buffering = time_info.buffering();
+        }
+        if (time_info.has_underruns()) {
+          if (not first and
+              time_info.underruns() > base_playback_info.info.underruns) {
+            spdlog::warn("The server's playback has run out of data ({} "
+                         "times so far)", time_info.underruns());
+          }
+          base_playback_info.info.underruns = time_info.underruns();
+        }
+        if (time_info.has_current_time()) {
+          base_playback_info.last_update =
+              server_clock_.ToLocal(server_time, received);
+          base_playback_info.info.elapsed_time =
+              std::chrono::duration<double>(time_info.current_time());
+          base_playback_info.info.remaining_time =
+              std::chrono::duration<double>(time_info.remaining_time());
 
-        base_playback_info.info.volume = time_info.volume();
-
-        base_playback_info.info.total_time =
-            std::chrono::duration<double>(time_info.total_time());
-        base_playback_info.info.elapsed_time =
-            std::chrono::duration<double>(time_info.current_time());
-        base_playback_info.info.remaining_time =
-            std::chrono::duration<double>(time_info.remaining_time());
-
-        spdlog::debug("total_time: {}, elapsed_time: {}, remaining_time: {}",
-                      base_playback_info.info.total_time.count(),
-                      base_playback_info.info.elapsed_time.count(),
-                      base_playback_info.info.remaining_time.count());
+          spdlog::debug(
+              "total_time: {}, elapsed_time: {}, remaining_time: {}",
+              base_playback_info.info.total_time.count(),
+              base_playback_info.info.elapsed_time.count(),
+              base_playback_info.info.remaining_time.count());
+        }
       }
 
       // This must be run after base_playback_info has been updated because it
@@ -165,6 +238,7 @@ void PlaybackSynchronizer::continuous_update(std::chrono::milliseconds
       if (state_changed) {
         playback_state_.SetState(current_state);
       }
+      first = false;
     }
 
     writer.join();
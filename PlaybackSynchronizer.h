@@ -22,6 +22,7 @@
 #include <chrono>
 #include <condition_variable>
 #include <mutex>
+#include <optional>
 #include <thread>
 
 #include "spdlog/spdlog.h"
@@ -29,12 +30,21 @@
 #include "player_service.grpc.pb.h"
 
 #include "PlaybackState.h"
+#include "ServerClock.h"
 
 namespace lrm {
+/// Keeps the playback info of the server up to date from TimeInfoStream.
+///
+/// The server sends only what has changed, with its clock's timestamp and
+/// the playback speed. The position is extrapolated from that, with the
+/// server's clock mapped onto the client's one by a ServerClock.
 class PlaybackSynchronizer {
  public:
   using StateChangeCallback = PlaybackState::StateChangeCallback;
 
+  /// How often the round trip to the server is measured again.
+  static constexpr std::chrono::seconds CLOCK_SYNC_INTERVAL{10};
+
   struct PlaybackInfo {
     std::string title;
     std::string album;
@@ -47,11 +57,20 @@ class PlaybackSynchronizer {
     std::chrono::duration<double> remaining_time;
 
     PlaybackState::State playback_state = PlaybackState::UNDEFINED;
+
+    /// Audio the server has ahead of the position, see TimeInfo. Unknown
+    /// until the server sends it and while nothing plays.
+    std::optional<std::chrono::duration<double>> buffered_time;
+    /// Percent of the data the playback waits for, 100 if it doesn't.
+    int buffering = 100;
+    uint64_t underruns = 0;
   };
 
   explicit PlaybackSynchronizer(PlayerService::Stub* stub,
-                                const std::string& session_key) noexcept
-      : stub_(stub), session_key_{session_key}, base_playback_info() {}
+                                const std::string& session_key,
+                                const std::string& zone) noexcept
+      : stub_(stub), session_key_{session_key}, zone_{zone},
+        base_playback_info() {}
 
   virtual ~PlaybackSynchronizer();
 
@@ -63,6 +82,10 @@ class PlaybackSynchronizer {
 
   PlaybackInfo GetPlaybackInfo() const;
 
+  /// \return Round trip time to the server measured on the info stream or
+  /// \b std::nullopt if it hasn't been measured yet.
+  std::optional<std::chrono::microseconds> GetRoundTrip() const;
+
   inline void SetCallbackOnStatusChange(StateChangeCallback&& callback) {
     playback_state_.SetStateChangeCallback(
         std::forward<StateChangeCallback>(callback));
@@ -73,6 +96,7 @@ class PlaybackSynchronizer {
 
   PlayerService::Stub* stub_;
   const std::string& session_key_;
+  const std::string& zone_;
 
   std::condition_variable is_updating_cv_;
   std::mutex is_updating_mtx_;
@@ -82,9 +106,17 @@ class PlaybackSynchronizer {
   struct BasePlaybackInfo {
     mutable std::mutex mtx;
     PlaybackInfo info;
+    double speed = 1;
+    /// When the times in \e info were read by the server, in the client's
+    /// clock.
     std::chrono::time_point<std::chrono::steady_clock> last_update;
+    /// Copy of the server_clock_'s one for the other threads.
+    std::optional<std::chrono::microseconds> round_trip;
   } base_playback_info;
 
+  // Only used by the thread reading the stream.
+  ServerClock server_clock_;
+
   PlaybackState playback_state_;
 };
 }
@@ -1,4 +1,4 @@
-// Copyright (C) 2019 by Jakub Wojciech
+// Copyright (C) 2020 by Jakub Wojciech
 
 // This file is part of Lelo Remote Music Player.
 
@@ -16,262 +16,105 @@
 // along with Lelo Remote Music Player. If not, see
 // <https://www.gnu.org/licenses/>.
 
-#include "Player.h"
-
-#include <cstring>
-#include <iostream>
 
-#include "mpv/client.h"
+#include "Player.h"
 
 #include "spdlog/spdlog.h"
 
-#include "PlaybackState.h"
+#include "MpvPlayer.h"
+#include "NullPlayer.h"
 
 namespace lrm {
-int Player::send_command_(const std::vector<std::string>&& args) {
-  const char* command[16];
-  const int arg_count = std::min<size_t>(args.size(), 15);
-
-  for(auto i = 0; i < arg_count; ++i) {
-    command[i] = args[i].c_str();
+namespace {
+constexpr std::string_view WAV_PREFIX = "wav:";
+
+const char* property_name(Player::ObservedProperty property) {
+  switch (property) {
+    case Player::TIME_POSITION: return "time-pos";
+    case Player::TIME_REMAINING: return "time-remaining";
+    case Player::TOTAL_TIME: return "duration";
+    case Player::PLAYTIME_REMAINING: return "playtime-remaining";
+    case Player::VOLUME: return "volume";
+    case Player::PAUSE: return "pause";
+    case Player::SPEED: return "speed";
+    case Player::CACHE_DURATION: return "demuxer-cache-duration";
+    case Player::BUFFERING: return "cache-buffering-state";
+    case Player::PAUSED_FOR_CACHE: return "paused-for-cache";
   }
-  command[arg_count] = nullptr;
-
-  return check_result(mpv_command(ctx_.get(), command));
+  return "";
 }
-
-Player::Player() : ctx_(mpv_create(), &mpv_terminate_destroy),
-                   playback_state_(PlaybackState::STOPPED) {
-  mpv_initialize(ctx_.get());
-  mpv_set_property_string(ctx_.get(), "log-file", "mpv.log");
-  mpv_set_property_string(ctx_.get(), "video", "no");
-  // NOTE: This allows for cached seeking, but it's pretty unreliable
-  mpv_set_property_string(ctx_.get(), "force-seekable", "yes");
-  mpv_request_log_messages(ctx_.get(), "debug");
-
-  start_event_loop();
 }
 
-Player::~Player() {
-  stop_event_loop();
-
-  if (event_loop_thread_.joinable()) {
-    try {
-      event_loop_thread_.join();
-    } catch (const std::system_error& e) {
-      spdlog::warn("Trying to join event loop thread in Player: {}",
-                   e.what());
-    }
+std::unique_ptr<Player> Player::Create(std::string_view output,
+                                       const std::string& log_file,
+                                       const MpvOptions& mpv_options) {
+  if ("null" == output) {
+    spdlog::info("Using the null player, nothing will be heard");
+    return std::make_unique<NullPlayer>();
   }
-}
 
-int Player::Play() {
-  const int result = send_command_({"loadfile", input_});
-  if (MPV_ERROR_SUCCESS != result) {
-    return result;
+  if (output.substr(0, WAV_PREFIX.size()) == WAV_PREFIX) {
+    const std::string path(output.substr(WAV_PREFIX.size()));
+    spdlog::info("Decoding the audio into {}", path);
+    MpvOptions options = mpv_options;
+    options.emplace_back("ao", "pcm");
+    options.emplace_back("ao-pcm-file", path);
+    return std::make_unique<MpvPlayer>(log_file, options);
   }
 
-  if (get_property_bool_("pause")){
-    return TogglePause();
+  MpvOptions options = mpv_options;
+  if (not output.empty()) {
+    options.emplace_back("audio-device", std::string(output));
   }
-
-  return result;
-}
-
-int Player::TogglePause() {
-  int is_paused;
-  check_result(mpv_get_property(ctx_.get(), "pause",
-                                MPV_FORMAT_FLAG, &is_paused));
-
-  int pause_flag = is_paused == 0 ? 1 : 0;
-
-  int result =  check_result(
-      mpv_set_property(ctx_.get(), "pause", MPV_FORMAT_FLAG, &pause_flag));
-
-  return result;
+  return std::make_unique<MpvPlayer>(log_file, options);
 }
 
-int Player::Stop() {
-  return send_command_({"stop"});
-}
+bool Player::parse_volume(std::string_view volume, int* value,
+                          bool* relative) {
+  if (volume.empty()) {
+    return false;
+  }
 
-int Player::Volume(std::string_view volume) {
   try {
-    if (volume.empty()) {
-      throw std::invalid_argument("Volume argument is empty");
-    }
-
-    int64_t vol;
-
     if (volume[0] == '+' or volume[0] == '-') {
-      int relative_volume;
-
+      *relative = true;
       // if just '+' or '-', increment or decrement by 5
-      if (volume.length() < 2) {
-        relative_volume = 5;
-      } else {
-        relative_volume = std::stoi(volume.data() + 1);
+      *value = volume.length() < 2 ?
+               5 : std::stoi(std::string(volume.substr(1)));
+      if (volume[0] == '-') {
+        *value = -*value;
       }
-
-      mpv_get_property(ctx_.get(), "volume", MPV_FORMAT_INT64, &vol);
-
-      if (volume[0] == '+') {
-        vol += relative_volume;
-      } else {
-        vol -= relative_volume;
-      }
-    } else {
-      vol = std::stoi(volume.data());
+      return true;
     }
-    vol = std::clamp(vol, (int64_t)0, (int64_t)100);
-
-    return check_result(
-          mpv_set_property(ctx_.get(), "volume", MPV_FORMAT_INT64, &vol));
-  } catch (const std::invalid_argument& e) {
-    return MPV_ERROR_INVALID_PARAMETER;
-  }
-}
-
-int Player::Seek(int32_t seconds) {
-  return send_command_({"seek", std::to_string(seconds)});
-}
 
-int Player::PlayFromPipe(int fd) {
-  spdlog::debug("Pipe sockfd: {}", fd);
-
-  Input("fdclose://" + std::to_string(fd));
-
-  return Play();
-}
-
-int64_t Player::get_property_int64_(const std::string_view prop_name) const {
-  int64_t prop_value = 0;
-  const int result = mpv_get_property(ctx_.get(), prop_name.data(),
-                                      MPV_FORMAT_INT64, &prop_value);
-  if (MPV_ERROR_SUCCESS != result) {
-    throw lrm::MpvException((mpv_error)result, prop_name.data());
+    *relative = false;
+    *value = std::stoi(std::string(volume));
+    return true;
+  } catch (const std::logic_error&) {
+    // std::invalid_argument or std::out_of_range from parsing.
+    return false;
   }
-
-  return prop_value;
 }
 
-double Player::get_property_double_(const std::string_view prop_name) const {
-  double prop_value = 0;
-  const int result = mpv_get_property(ctx_.get(), prop_name.data(),
-                                      MPV_FORMAT_DOUBLE, &prop_value);
-  if (MPV_ERROR_SUCCESS != result) {
-    throw lrm::MpvException((mpv_error)result, prop_name.data());
-  }
-
-  return prop_value;
-}
-
-bool Player::get_property_bool_(const std::string_view prop_name) const {
-  int prop_value = 0;
-  const int result = mpv_get_property(ctx_.get(), prop_name.data(),
-                                      MPV_FORMAT_FLAG, &prop_value);
-  if (MPV_ERROR_SUCCESS != result) {
-    throw lrm::MpvException((mpv_error)result, prop_name.data());
-  }
-
-  return prop_value == 1;
-}
-
-void Player::start_event_loop() {
-  if (event_loop_running_) {
-    spdlog::error("Tried to start mpv event loop while it's already running");
-    return;
-  }
-  event_loop_running_ = true;
-
-  try {
-    event_loop_thread_ = std::thread(&Player::mpv_event_loop, this);
-  } catch (const std::system_error& e) {
-    spdlog::error("Couldn't start the mpv event loop thread: {}",
-                  e.what());
-    event_loop_running_ = false;
+double Player::observed_double_(ObservedProperty property) const {
+  const Properties properties = GetProperties();
+  if (not properties.Has(property)) {
+    throw lrm::MpvException(MPV_ERROR_PROPERTY_UNAVAILABLE,
+                            property_name(property));
   }
-}
-
-void Player::stop_event_loop() noexcept {
-  event_loop_running_ = false;
-}
 
-void Player::mpv_event_loop() {
-  spdlog::debug("Starting mpv event loop...");
-
-  bool initial_state = true;
-  mpv_observe_property(ctx_.get(), 0, "pause", MPV_FORMAT_FLAG);
-
-  while (event_loop_running_) {
-    const mpv_event* event =  mpv_wait_event(ctx_.get(), 1);
-
-    if (event->error != MPV_ERROR_SUCCESS) {
-      spdlog::error("mpv event '{}': {}",
-                    mpv_event_name(event->event_id),
-                    mpv_error_string(event->error));
-      continue;
-    }
-
-    switch (event->event_id) {
-      case MPV_EVENT_NONE:
-        continue;
-      case MPV_EVENT_END_FILE:
-        {
-          const mpv_event_end_file* end_file_data =
-              (mpv_event_end_file*)event->data;
-
-          switch (end_file_data->reason) {
-            case MPV_END_FILE_REASON_EOF:
-              playback_state_.SetState(PlaybackState::STOPPED);
-              break;
-            case MPV_END_FILE_REASON_ERROR:
-              spdlog::error("mpv file ended: {}",
-                            mpv_error_string(end_file_data->error));
-              playback_state_.SetState(PlaybackState::STOPPED);
-              break;
-            case MPV_END_FILE_REASON_STOP: case MPV_END_FILE_REASON_QUIT:
-              playback_state_.SetState(PlaybackState::STOPPED);
-              break;
-            case MPV_END_FILE_REASON_REDIRECT:
-              spdlog::warn("MPV_END_FILE_REASON_REDIRECT not implemented");
-              break;
-            default:
-              spdlog::warn("Unknown mpv end file reason");
-              break;
-          }
-        }
-        break;
-      case MPV_EVENT_FILE_LOADED:
-        if (get_property_bool_("pause")) {
-          break;
-        }
-        playback_state_.SetState(PlaybackState::PLAYING);
-        break;
-      case MPV_EVENT_PROPERTY_CHANGE: {
-        mpv_event_property* property =
-            static_cast<mpv_event_property*>(event->data);
-
-        if (0 == std::strcmp(property->name, "pause")) {
-          const int is_paused = *(static_cast<int*>(property->data));
-          if (is_paused) {
-            playback_state_.SetState(PlaybackState::PAUSED);
-          } else if ((not get_property_bool_("idle-active")) and
-                     (not initial_state)) {
-            playback_state_.SetState(PlaybackState::PLAYING);
-          } else {
-            playback_state_.SetState(PlaybackState::STOPPED);
-          }
-        }
-
-        initial_state = false;
-
-        break;
-      }
-      default:
-        continue;
-    }
+  switch (property) {
+    case TIME_POSITION: return properties.time_position;
+    case TIME_REMAINING: return properties.time_remaining;
+    case TOTAL_TIME: return properties.total_time;
+    case PLAYTIME_REMAINING: return properties.playtime_remaining;
+    case VOLUME: return properties.volume;
+    case PAUSE: return properties.paused;
+    case SPEED: return properties.speed;
+    case CACHE_DURATION: return properties.cache_duration;
+    case BUFFERING: return properties.buffering;
+    case PAUSED_FOR_CACHE: return properties.paused_for_cache;
   }
-  spdlog::debug("Mpv event loop stopped");
+  return 0;
 }
 }
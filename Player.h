@@ -1,4 +1,4 @@
-// Copyright (C) 2019 by Jakub Wojciech
+// Copyright (C) 2020 by Jakub Wojciech
 
 // This file is part of Lelo Remote Music Player.
 
@@ -16,17 +16,28 @@
 // along with Lelo Remote Music Player. If not, see
 // <https://www.gnu.org/licenses/>.
 
+
 #ifndef LRM_PLAYER_H
 #define LRM_PLAYER_H
 
-#include <iostream>
-#include <thread>
+#include <cmath>
+#include <cstdint>
+#include <functional>
+#include <memory>
+#include <stdexcept>
+#include <string>
+#include <string_view>
+#include <utility>
+#include <vector>
 
 #include "mpv/client.h"
 
 #include "PlaybackState.h"
+#include "StreamSource.h"
 
 namespace lrm {
+/// The results of the players' commands are mpv's error codes, see
+/// mpv_error. They're sent to the clients as they are.
 class MpvException : public std::runtime_error {
  public:
   explicit MpvException(mpv_error error_code, std::string_view details = "")
@@ -41,56 +52,139 @@ class MpvException : public std::runtime_error {
   const std::string details_;
 };
 
+/// Plays the audio for one zone of the server. MpvPlayer plays it with mpv,
+/// NullPlayer only consumes it, for measuring the rest of the server
+/// without sound hardware.
 class Player {
-  inline int check_result(int result) {
-    if (0 != result) {
-      std::cerr << mpv_error_string(result) << '\n';
+ public:
+  /// Called with \b true when the player has opened a stream's file and
+  /// with \b false when it has failed to.
+  using LoadCallback = std::function<void(bool loaded)>;
+  /// Called with the result of an asynchronous command, see mpv_error. It
+  /// may run on the player's own thread, so it mustn't wait for the player.
+  using ReplyCallback = std::function<void(int result)>;
+  using VolumeChangeCallback = std::function<void(int volume)>;
+  /// mpv's options and their values.
+  using MpvOptions = std::vector<std::pair<std::string, std::string>>;
+
+  /// Properties the player keeps up to date. The values are bits of
+  /// Properties::available.
+  enum ObservedProperty : uint32_t {
+    TIME_POSITION = 1 << 0,
+    TIME_REMAINING = 1 << 1,
+    TOTAL_TIME = 1 << 2,
+    PLAYTIME_REMAINING = 1 << 3,
+    VOLUME = 1 << 4,
+    PAUSE = 1 << 5,
+    SPEED = 1 << 6,
+    CACHE_DURATION = 1 << 7,
+    BUFFERING = 1 << 8,
+    PAUSED_FOR_CACHE = 1 << 9
+  };
+
+  /// Last values of the observed properties.
+  struct Properties {
+    double time_position = 0;
+    double time_remaining = 0;
+    double total_time = 0;
+    double playtime_remaining = 0;
+    double volume = 0;
+    double speed = 1;
+    bool paused = false;
+    /// Seconds of audio the player has read ahead of the position.
+    double cache_duration = 0;
+    /// How much of the data the playback waits for has arrived, in
+    /// percent. 100 when it doesn't wait.
+    double buffering = 100;
+    bool paused_for_cache = false;
+    /// How many times the playback has run out of data or the audio device
+    /// has run dry. It only grows.
+    uint64_t underruns = 0;
+    /// ObservedProperty bits of the properties that have a value. There
+    /// are no times when nothing is loaded.
+    uint32_t available = 0;
+
+    /// \return \b true if all \e properties have a value.
+    inline bool Has(uint32_t properties) const {
+      return (available & properties) == properties;
     }
-    return result;
-  }
+  };
 
-  int send_command_(const std::vector<std::string>&& args);
+  /// \param output "null" for NullPlayer, "wav:PATH" for mpv decoding into
+  /// a WAV file at PATH, or else mpv's \e audio-device to play on (the
+  /// default one if empty).
+  /// \param log_file Where mpv writes its log.
+  /// \param mpv_options Set before mpv starts, NullPlayer ignores them.
+  static std::unique_ptr<Player> Create(std::string_view output,
+                                        const std::string& log_file,
+                                        const MpvOptions& mpv_options = {});
 
-  int64_t get_property_int64_(const std::string_view prop_name) const;
-  double get_property_double_(const std::string_view prop_name) const;
-  bool get_property_bool_(const std::string_view prop_name) const;
+  virtual ~Player() = default;
 
-  void start_event_loop();
-  void stop_event_loop() noexcept;
-  void mpv_event_loop();
-
- public:
-  Player();
-  ~Player();
+  Player(const Player&) = delete;
+  Player& operator=(const Player&) = delete;
 
   inline void Input(std::string_view input) {
     input_ = input;
   }
 
-  int Play();
-  int TogglePause();
-  int Stop();
-
-  // volume - can be a number from [0; 100] or +/-number, e.g. +10 or 75
-  int Volume(std::string_view volume);
-  inline int Volume() {
-    return get_property_int64_("volume");
-  }
+  virtual int Play() = 0;
 
-  int Seek(int32_t seconds);
-  int PlayFromPipe(int fd);
+  // The commands below don't wait for the player. They return at once and
+  // the result is passed to \e on_reply later.
+  virtual void TogglePause(ReplyCallback on_reply) = 0;
+  virtual void Stop(ReplyCallback on_reply) = 0;
+  /// \param volume Number from [0; 100] or +/-number, e.g. +10 or 75. Just
+  /// '+' or '-' changes it by 5.
+  virtual void Volume(std::string_view volume, ReplyCallback on_reply) = 0;
+  virtual void Seek(int32_t seconds, ReplyCallback on_reply) = 0;
 
+  inline int Volume() const {
+    return std::lround(observed_double_(VOLUME));
+  }
+  /// Set the callback called when the volume changes, whatever has changed
+  /// it.
+  virtual void SetVolumeChangeCallback(VolumeChangeCallback&& callback) = 0;
+
+  /// Add the file at \e path to the end of the playlist. It starts playing
+  /// at once if nothing is playing.
+  virtual int Enqueue(std::string_view path) = 0;
+  /// Remove everything from the playlist except the playing file.
+  virtual int ClearQueue() = 0;
+  /// \param current Set to the index of the playing file or \b -1.
+  /// \return Files on the playlist.
+  virtual std::vector<std::string> Queue(int64_t* current) const = 0;
+  /// Play the data written to \e source. The source is cancelled when the
+  /// player is done with it, e.g. when the playback is stopped.
+  /// \param on_load Called once the player has opened the file or failed
+  /// to. Not called if the stream is dropped before the player opens it.
+  /// \param low_latency Play it with small buffers and no read-ahead, for
+  /// live sources.
+  virtual int PlayFromStream(std::shared_ptr<StreamSource> source,
+                             LoadCallback on_load = {},
+                             bool low_latency = false) = 0;
+  /// Read up to \e seconds of the playing stream ahead of the position,
+  /// to survive longer gaps in its arrival. It applies to the following
+  /// streams too, except the live ones.
+  virtual void SetReadahead(double seconds) = 0;
+
+  /// \return All observed properties at once. It's cheap enough to be
+  /// called on every tick of the time info.
+  virtual Properties GetProperties() const = 0;
+
+  // The getters below read the observed properties too. They throw
+  // MpvException if the player doesn't have the property.
   inline double TimePosition() const {
-    return get_property_double_("time-pos");
+    return observed_double_(TIME_POSITION);
   }
   inline double TimeRemaining() const {
-    return get_property_double_("time-remaining");
+    return observed_double_(TIME_REMAINING);
   }
   inline double TotalTime() const {
-    return get_property_double_("duration");
+    return observed_double_(TOTAL_TIME);
   }
   inline double PlayTimeRemaining() const {
-    return get_property_double_("playtime-remaining");
+    return observed_double_(PLAYTIME_REMAINING);
   }
   inline PlaybackState::State GetPlaybackState() const {
     return playback_state_.GetState();
@@ -101,14 +195,19 @@ class Player {
         std::forward<PlaybackState::StateChangeCallback>(callback));
   }
 
- private:
-  std::string input_;
-  std::unique_ptr<mpv_handle, decltype(&mpv_terminate_destroy)> ctx_;
+ protected:
+  Player() : playback_state_(PlaybackState::STOPPED) {}
 
-  PlaybackState playback_state_;
+  /// Parse the argument of Volume().
+  /// \return \b false if it's not a number.
+  static bool parse_volume(std::string_view volume, int* value,
+                           bool* relative);
 
-  std::atomic<bool> event_loop_running_ = false;
-  std::thread event_loop_thread_;
+  /// \exception MpvException The property has no value.
+  double observed_double_(ObservedProperty property) const;
+
+  std::string input_;
+  PlaybackState playback_state_;
 };
 }
 
@@ -23,42 +23,39 @@
 #include <fstream>
 #include <sstream>
 #include <string_view>
+#include <thread>
+#include <type_traits>
 #include <netinet/in.h>
 
 #include <openssl/ec.h>
 
 #ifndef INCLUDE_GRPCPLUSPLUS
 #include "grpcpp/channel.h"
+#include "grpcpp/completion_queue.h"
+#include "grpcpp/generic/generic_stub.h"
+#include "grpcpp/impl/codegen/proto_utils.h"
+#include "grpcpp/support/async_stream.h"
 #else
 #include "grpc++/channel.h"
+#include "grpc++/completion_queue.h"
+#include "grpc++/generic/generic_stub.h"
+#include "grpc++/impl/codegen/proto_utils.h"
+#include "grpc++/support/async_stream.h"
 #endif  // INCLUDE_GRPCPLUSPLUS
 
 #include "spdlog/spdlog.h"
 
+#include "AudioDataBuffer.h"
 #include "ClientContexts.h"
 #include "Config.h"
+#include "FileChunkReader.h"
+#include "MappedFile.h"
+#include "UploadPacer.h"
+#include "UploadTuner.h"
 #include "crypto/CryptoUtil.h"
 #include "crypto/ZkpSerialization.h"
 
 namespace lrm {
-std::vector<char> PlayerClient::read_file(std::string_view filename) {
-  std::ifstream ifs(filename.data(), std::ios::binary | std::ios::in);
-  if (not ifs.is_open()) {
-    throw std::invalid_argument(
-        std::string("Couldn't open the file: ") + filename.data());
-  }
-  ifs.seekg(0, std::ios::end);
-  const size_t length = ifs.tellg();
-
-  ifs.seekg(0, std::ios::beg);
-
-  std::vector<char> output(length);
-  ifs.read(output.data(), length);
-  ifs.close();
-
-  return output;
-}
-
 void PlayerClient::start_updating_info() {
   assert(std::any_of(std::begin(session_key_), std::end(session_key_),
                      [](char c){ return c != ' '; })
@@ -77,8 +74,9 @@ void PlayerClient::stop_updating_info() {
 }
 
 PlayerClient::PlayerClient(std::shared_ptr<grpc::Channel> channel) noexcept
-    : stub_(PlayerService::NewStub(channel)),
-      synchronizer_(stub_.get(), session_key_),
+    : channel_(channel),
+      stub_(PlayerService::NewStub(channel)),
+      synchronizer_(stub_.get(), session_key_, zone_),
       log_(spdlog::get("PlayerClient")) {
   try {
     synchronizer_.SetCallbackOnStatusChange(
@@ -190,36 +188,674 @@ bool PlayerClient::Authenticate() {
   return true;
 }
 
+std::chrono::microseconds PlayerClient::round_trip_time() {
+  if (const auto rtt = synchronizer_.GetRoundTrip(); rtt) {
+    return *rtt;
+  }
+
+  std::lock_guard<std::mutex> lck(rtt_mtx_);
+  if (rtt_) {
+    return *rtt_;
+  }
+  const auto start = std::chrono::steady_clock::now();
+  try {
+    Ping();
+  } catch (const grpc::Status& status) {
+    log_->warn("Couldn't measure the round trip time: {}",
+               status.error_message());
+    return DEFAULT_RTT;
+  }
+  rtt_ = std::chrono::duration_cast<std::chrono::microseconds>(
+      std::chrono::steady_clock::now() - start);
+  return *rtt_;
+}
+
+const PlayerClient::UploadMethod PlayerClient::AUDIO_STREAM{
+  &PlayerService::Stub::PrepareAsyncAudioStream, "/PlayerService/AudioStream"};
+const PlayerClient::UploadMethod PlayerClient::AUDIO_RANGE{
+  &PlayerService::Stub::PrepareAsyncAudioRange, "/PlayerService/AudioRange"};
+const PlayerClient::UploadMethod PlayerClient::PREFETCH{
+  &PlayerService::Stub::PrepareAsyncPrefetch, "/PlayerService/Prefetch"};
+
+namespace {
+/// Longer than the server waits for the player, so it's only reached if the
+/// server doesn't answer the probe although it said it would.
+constexpr auto PROBE_WAIT = std::chrono::seconds(5);
+/// Longest sleep between asking the pacer again, so it notices a seek soon.
+constexpr auto MAX_PACING_SLEEP = std::chrono::milliseconds(250);
+
+void wait_for_pacer(UploadPacer* pacer) {
+  for (auto delay = pacer->Delay(); delay.count() > 0;
+       delay = pacer->Delay()) {
+    std::this_thread::sleep_for(
+        std::min<std::chrono::steady_clock::duration>(delay,
+                                                      MAX_PACING_SLEEP));
+  }
+}
+
+/// Run an async client-streaming upload on \e cq to the end.
+///
+/// gRPC allows only one write in flight per stream, so the next message is
+/// prepared with \e next_message while the previous one is being written.
+/// \e next_message(Message*, size_t max_size) fills the message with at
+/// most \e max_size bytes of audio and returns their count, 0 at the end.
+/// If \e probe_bytes isn't 0, the upload stops after that many bytes until
+/// the server accepts the stream (see AudioStream in player_service.proto).
+/// If \e pacer isn't null, every message waits until the pacer allows it.
+/// The calls of the generic stub get the server's reply in \e reply.
+template<class Message, class Writer, class NextMessage>
+grpc::Status pipelined_upload(grpc::ClientContext* context,
+                              Writer* writer,
+                              grpc::CompletionQueue* cq,
+                              UploadTuner* tuner,
+                              UploadPacer* pacer,
+                              uint64_t probe_bytes,
+                              NextMessage&& next_message,
+                              grpc::ByteBuffer* reply = nullptr) {
+  bool ok = false;
+  std::exception_ptr exception;
+
+  const auto chunk_size = [&]{
+                            return pacer ?
+                                pacer->ChunkSize(tuner->ChunkSize()) :
+                                tuner->ChunkSize();
+                          };
+
+  // The server's reply to the probe can arrive after waiting for it has
+  // timed out, so it's skipped when waiting for anything else.
+  int probe_tag;
+  const auto next = [&]{
+                      void* tag;
+                      bool result;
+                      do {
+                        cq->Next(&tag, &result);
+                      } while (&probe_tag == tag);
+                      return result;
+                    };
+
+  writer->StartCall(writer);
+  ok = next();
+
+  if (ok) {
+    Message message;
+    size_t size = 0;
+    uint64_t sent = 0;
+    try {
+      size = next_message(&message, chunk_size());
+    } catch (...) {
+      exception = std::current_exception();
+      context->TryCancel();
+    }
+
+    while (size > 0) {
+      if (pacer) {
+        wait_for_pacer(pacer);
+        pacer->Sent(size);
+      }
+      const auto start = std::chrono::steady_clock::now();
+      writer->Write(message, writer);
+
+      Message following;
+      size_t following_size = 0;
+      try {
+        following_size = next_message(&following, chunk_size());
+      } catch (...) {
+        exception = std::current_exception();
+        context->TryCancel();
+      }
+
+      ok = next();
+      if (not ok or exception) {
+        break;
+      }
+      tuner->WriteCompleted(size, std::chrono::steady_clock::now() - start);
+      sent += size;
+
+      if (probe_bytes > 0 and sent >= probe_bytes) {
+        probe_bytes = 0;
+        writer->ReadInitialMetadata(&probe_tag);
+
+        void* tag;
+        bool probe_ok = false;
+        // Nothing else is in flight, so an event is the reply.
+        if (grpc::CompletionQueue::GOT_EVENT ==
+            cq->AsyncNext(&tag, &probe_ok,
+                          std::chrono::system_clock::now() + PROBE_WAIT)) {
+          const auto& metadata = context->GetServerInitialMetadata();
+          if (not probe_ok or metadata.find("x-probe") == metadata.end()) {
+            // The server has rejected the stream, Finish() tells why.
+            ok = false;
+            break;
+          }
+        }
+      }
+
+      message = std::move(following);
+      size = following_size;
+    }
+
+    if (ok and not exception) {
+      writer->WritesDone(writer);
+      ok = next();
+    }
+  }
+
+  if constexpr (std::is_same_v<Writer, grpc::GenericClientAsyncReaderWriter>) {
+    // The status comes after the reply, even if the call has failed.
+    writer->Read(reply, writer);
+    next();
+  }
+
+  grpc::Status status;
+  writer->Finish(&status, writer);
+  next();
+
+  void* tag;
+  cq->Shutdown();
+  while (cq->Next(&tag, &ok)) {}
+
+  if (exception) {
+    std::rethrow_exception(exception);
+  }
+  return status;
+}
+}
+
+grpc::Status PlayerClient::upload_chunked(std::string_view filename,
+                                          const UploadPart& part,
+                                          grpc::ClientContext* context,
+                                          UploadTuner* tuner,
+                                          MpvResponse* response) {
+  // Open the file before starting the stream so a bad path doesn't leave
+  // the server playing an empty pipe.
+  FileChunkReader reader(filename, FileChunkReader::DEFAULT_CHUNK_SIZE,
+                         FileChunkReader::DEFAULT_POOL_SIZE, part.offset);
+
+  // Messages are assembled from the reader's chunks, so their size doesn't
+  // depend on the size of the reader's buffers.
+  FileChunkReader::Chunk chunk = reader.Next();
+  size_t chunk_offset = 0;
+  uint64_t remaining = part.size;
+  const auto next_message = [&](AudioData* data, size_t max_size) {
+    max_size = std::min<uint64_t>(max_size, remaining);
+    std::string* out = data->mutable_data();
+    out->clear();
+    while (chunk and out->size() < max_size) {
+      const size_t to_copy = std::min(max_size - out->size(),
+                                      chunk.size() - chunk_offset);
+      out->append(chunk.data() + chunk_offset, to_copy);
+      chunk_offset += to_copy;
+
+      if (chunk_offset == chunk.size()) {
+        chunk = reader.Next();
+        chunk_offset = 0;
+      }
+    }
+    remaining -= out->size();
+    return out->size();
+  };
+
+  // The parts of a file can go over different channels.
+  const auto stub = PlayerService::NewStub(part.channel);
+  grpc::CompletionQueue cq;
+  const auto writer = (stub.get()->*part.method->prepare)(context, response,
+                                                          &cq);
+
+  return pipelined_upload<AudioData>(context, writer.get(), &cq, tuner,
+                                     part.pacer, part.probe_bytes,
+                                     next_message);
+}
+
+grpc::Status PlayerClient::upload_mapped(std::string_view filename,
+                                         const UploadPart& part,
+                                         grpc::ClientContext* context,
+                                         UploadTuner* tuner,
+                                         MpvResponse* response) {
+  const auto file = std::make_shared<const MappedFile>(filename);
+
+  size_t offset = std::min<uint64_t>(part.offset, file->size());
+  const size_t end = file->size() - offset > part.size ?
+                     offset + part.size : file->size();
+  const auto next_message = [&](grpc::ByteBuffer* message,
+                                size_t max_size) -> size_t {
+    const size_t to_send = std::min(max_size, end - offset);
+    if (to_send > 0) {
+      *message = make_audio_data(file, offset, to_send);
+      offset += to_send;
+    }
+    return to_send;
+  };
+
+  // The method called with raw, already serialized messages, so they can
+  // reference the mapping instead of holding a copy of the data.
+  grpc::GenericStub stub(part.channel);
+  grpc::CompletionQueue cq;
+  const auto writer = stub.PrepareCall(context, part.method->name, &cq);
+
+  grpc::ByteBuffer reply;
+  auto status = pipelined_upload<grpc::ByteBuffer>(
+      context, writer.get(), &cq, tuner, part.pacer, part.probe_bytes,
+      next_message, &reply);
+  if (status.ok()) {
+    status = grpc::SerializationTraits<MpvResponse>::Deserialize(&reply,
+                                                                 response);
+  }
+  return status;
+}
+
+grpc::Status PlayerClient::upload_part(std::string_view filename,
+                                       const UploadPart& part,
+                                       grpc::ClientContext* context,
+                                       UploadTuner* tuner,
+                                       MpvResponse* response) {
+  return MMAP == upload_mode_ ?
+      upload_mapped(filename, part, context, tuner, response) :
+      upload_chunked(filename, part, context, tuner, response);
+}
+
+grpc::Status PlayerClient::upload_parallel(std::string_view filename,
+                                           uint64_t size,
+                                           const std::string& hash_hex,
+                                           MpvResponse* response) {
+  const size_t count = upload_channels_.size();
+  // Whole chunks of the file reader in every range.
+  constexpr uint64_t CHUNK = FileChunkReader::DEFAULT_CHUNK_SIZE;
+  uint64_t range_size = (size + count - 1) / count;
+  range_size = (range_size + CHUNK - 1) / CHUNK * CHUNK;
+
+  const std::string upload_id = crypto::generate_random_hex(16);
+  const auto rtt = round_trip_time();
+
+  std::vector<std::unique_ptr<AuthenticatedContext>> contexts;
+  std::vector<UploadPart> parts;
+  for (size_t i = 0; i < count and i * range_size < size; ++i) {
+    auto context = std::make_unique<AuthenticatedContext>(session_key_, zone_);
+    context->AddMetadata("x-upload-id", upload_id);
+
+    UploadPart part;
+    part.channel = upload_channels_[i];
+    part.offset = i * range_size;
+    part.size = std::min(range_size, size - part.offset);
+    if (0 == i) {
+      // The first part starts the playback.
+      part.method = &AUDIO_STREAM;
+      context->AddMetadata("x-upload-size", std::to_string(size));
+      if (not hash_hex.empty()) {
+        context->AddMetadata("x-content-hash", hash_hex);
+      }
+    } else {
+      part.method = &AUDIO_RANGE;
+      context->AddMetadata("x-range-offset", std::to_string(part.offset));
+    }
+
+    contexts.push_back(std::move(context));
+    parts.push_back(part);
+  }
+
+  std::vector<grpc::Status> statuses(parts.size());
+  std::vector<MpvResponse> responses(parts.size());
+  std::vector<std::exception_ptr> exceptions(parts.size());
+  const auto cancel_all = [&]{
+                            for (auto& context : contexts) {
+                              context->TryCancel();
+                            }
+                          };
+
+  const auto start = std::chrono::steady_clock::now();
+  std::vector<std::thread> threads;
+  for (size_t i = 0; i < parts.size(); ++i) {
+    threads.emplace_back([&, i]{
+      UploadTuner tuner(rtt);
+      try {
+        statuses[i] = upload_part(filename, parts[i], contexts[i].get(),
+                                  &tuner, &responses[i]);
+      } catch (...) {
+        exceptions[i] = std::current_exception();
+      }
+      // The upload can't finish without this part.
+      if (exceptions[i] or not statuses[i].ok()) {
+        cancel_all();
+      }
+    });
+  }
+  for (auto& thread : threads) {
+    thread.join();
+  }
+  const std::chrono::duration<double> upload_time =
+      std::chrono::steady_clock::now() - start;
+
+  for (const auto& exception : exceptions) {
+    if (exception) {
+      std::rethrow_exception(exception);
+    }
+  }
+
+  log_->info("Upload of '{}' in {} parts finished in {:.2f} s: RTT {:.1f} "
+             "ms, throughput {:.2f} MiB/s",
+             filename, parts.size(), upload_time.count(),
+             rtt.count() / 1000.0,
+             size / upload_time.count() / (1024 * 1024));
+
+  *response = responses[0];
+  // The first error that wasn't caused by cancelling the other parts.
+  for (const auto& status : statuses) {
+    if (not status.ok() and StatusCode::CANCELLED != status.error_code()) {
+      return status;
+    }
+  }
+  for (const auto& status : statuses) {
+    if (not status.ok()) {
+      return status;
+    }
+  }
+  return grpc::Status::OK;
+}
+
+std::optional<uint64_t> PlayerClient::upload_offset(
+    const std::string& upload_id) {
+  if (not channel_->WaitForConnected(std::chrono::system_clock::now() +
+                                     RESUME_TIMEOUT)) {
+    log_->error("Couldn't reconnect to resume the upload");
+    return std::nullopt;
+  }
+
+  AuthenticatedContext context(session_key_, zone_);
+  UploadId id;
+  id.set_id(upload_id);
+  UploadOffset offset;
+
+  const auto status = stub_->UploadStatus(&context, id, &offset);
+  if (not status.ok()) {
+    log_->error("Couldn't resume the upload: {}", status.error_message());
+    return std::nullopt;
+  }
+  return offset.offset();
+}
+
+ContentHash PlayerClient::file_hash(std::string_view filename) {
+  const fs::path path{filename};
+  const auto size = fs::file_size(path);
+  const auto modification_time = fs::last_write_time(path);
+
+  std::lock_guard<std::mutex> lck(file_hashes_mtx_);
+  const auto it = file_hashes_.find(path.string());
+  if (it != file_hashes_.end() and it->second.size == size and
+      it->second.modification_time == modification_time) {
+    return it->second.hash;
+  }
+
+  const auto hash = hash_file(filename);
+  file_hashes_[path.string()] = FileHash{size, modification_time, hash};
+  return hash;
+}
+
+std::optional<int> PlayerClient::play_cached(const ContentHash& hash) {
+  AuthenticatedContext context(session_key_, zone_);
+  CachedAudio cached;
+  cached.set_sha256(hash.data(), hash.size());
+  MpvResponse response;
+
+  const auto status = stub_->PlayCached(&context, cached, &response);
+  if (status.ok()) {
+    return response.response();
+  } else if (StatusCode::NOT_FOUND != status.error_code() and
+             StatusCode::UNIMPLEMENTED != status.error_code()) {
+    throw status;
+  }
+  return std::nullopt;
+}
+
+Capabilities PlayerClient::server_capabilities() {
+  std::lock_guard<std::mutex> lck(server_capabilities_mtx_);
+  if (not server_capabilities_) {
+    AuthenticatedContext context(session_key_, zone_);
+    Capabilities capabilities;
+    const auto status = stub_->GetCapabilities(&context, Empty(),
+                                               &capabilities);
+    if (not status.ok() and
+        StatusCode::UNIMPLEMENTED != status.error_code()) {
+      throw status;
+    }
+    server_capabilities_ = status.ok() ? capabilities : Capabilities();
+  }
+  return *server_capabilities_;
+}
+
+Transcoder::Settings PlayerClient::transcode_settings() {
+  const auto capabilities = server_capabilities();
+
+  Transcoder::Settings server;
+  server.codec = capabilities.transcode_codec();
+  server.format = capabilities.transcode_format();
+  server.bitrate = capabilities.transcode_bitrate();
+  return transcode_settings_.Or(server).Or(Transcoder::DEFAULT_SETTINGS);
+}
+
+std::string PlayerClient::transcode_key(std::string_view filename) {
+  const auto settings = transcode_settings();
+  return to_hex(file_hash(filename)) + '/' + settings.codec + '/' +
+      settings.format + '/' + std::to_string(settings.bitrate);
+}
+
+std::optional<ContentHash> PlayerClient::transcoded_hash(
+    const std::string& key) {
+  std::lock_guard<std::mutex> lck(file_hashes_mtx_);
+  const auto it = transcoded_files_.find(key);
+  if (it == transcoded_files_.end()) {
+    return std::nullopt;
+  }
+  return it->second.hash;
+}
+
+std::unique_ptr<Transcoder::Output> PlayerClient::transcode(
+    std::string_view filename, const std::string& key, ContentHash* hash) {
+  std::unique_ptr<Transcoder::Output> output;
+  try {
+    output = transcoder_->Transcode(filename, transcode_settings());
+    *hash = hash_file(output->Path().string());
+  } catch (const std::exception& e) {
+    log_->warn("Sending '{}' without transcoding: {}", filename, e.what());
+    return nullptr;
+  }
+
+  const auto& stats = output->GetStats();
+  log_->info("Transcoded '{}' in {:.2f} s ({:.2f} s of CPU): {} KiB "
+             "instead of {} KiB, {:.0f}% less to send",
+             filename, stats.wall_time.count(), stats.cpu_time.count(),
+             stats.output_bytes / 1024, stats.input_bytes / 1024,
+             stats.input_bytes > 0 ?
+             100.0 - 100.0 * stats.output_bytes / stats.input_bytes : 0.0);
+
+  std::lock_guard<std::mutex> lck(file_hashes_mtx_);
+  transcoded_files_[key] = TranscodedFile{*hash, std::string(filename)};
+  return output;
+}
+
 int PlayerClient::Play(std::string_view filename) {
   log_->debug("PlayerClient::Play(\"{}\")", filename);
 
-  AuthenticatedContext context(session_key_);
   MpvResponse response;
+  std::string hash_hex;
+
+  if (const auto reference = shared_prefixes_.Map(filename); reference) {
+    AuthenticatedContext context(session_key_, zone_);
+    MediaReference request;
+    request.set_reference(*reference);
+
+    const auto status = stub_->PlayByReference(&context, request, &response);
+    if (status.ok()) {
+      log_->info("Server plays '{}' from '{}'", filename, *reference);
+      return response.response();
+    } else if (StatusCode::NOT_FOUND != status.error_code() and
+               StatusCode::PERMISSION_DENIED != status.error_code() and
+               StatusCode::UNIMPLEMENTED != status.error_code()) {
+      throw status;
+    }
+    log_->warn("Server can't play '{}' by reference, uploading it: {}",
+               *reference, status.error_message());
+  }
 
-  auto writer = stub_->AudioStream(&context, &response);
+  std::string source(filename);
+  std::unique_ptr<Transcoder::Output> transcoded;
+  std::optional<ContentHash> hash;
+  if (transcoder_ and transcoder_->Accepts(filename)) {
+    const std::string key = transcode_key(filename);
+    // The server may have it from the last time.
+    if (hash_first_) {
+      if (const auto previous = transcoded_hash(key); previous) {
+        if (const auto result = play_cached(*previous); result) {
+          log_->info("Playing transcoded '{}' from the server's cache",
+                     filename);
+          return *result;
+        }
+      }
+    }
 
-  AudioData data;
-  size_t written = 0;
-  streaming_file_ = read_file(filename);
+    ContentHash transcoded_hash;
+    transcoded = transcode(filename, key, &transcoded_hash);
+    if (transcoded) {
+      source = transcoded->Path().string();
+      hash = transcoded_hash;
+      hash_hex = to_hex(*hash);
+    }
+  }
 
-  constexpr size_t PACKAGE_BYTES = 1024;
+  if (hash_first_ and not transcoded) {
+    try {
+      hash = file_hash(filename);
+    } catch (const std::exception& e) {
+      // Not a regular file, e.g. a pipe. Just send it.
+      log_->debug("Not hashing '{}': {}", filename, e.what());
+    }
 
-  while (written < streaming_file_.size()) {
-    const size_t to_send = std::min(PACKAGE_BYTES,
-                                    streaming_file_.size() - written);
-    data.set_data(streaming_file_.data() + written,
-                  to_send);
+    if (hash) {
+      if (const auto result = play_cached(*hash); result) {
+        log_->info("Playing '{}' from the server's cache", filename);
+        return *result;
+      }
+      hash_hex = to_hex(*hash);
+    }
+  }
 
-    if (not writer->Write(data)) {
-      break;
+  const auto status = upload(source, AUDIO_STREAM, hash_hex, &response);
+  if (status.ok()) {
+    return response.response();
+  } else if (StatusCode::CANCELLED == status.error_code()) {
+    // The server cancels the upload when something else starts playing.
+    // The file was played until then.
+    log_->info("Upload of '{}' stopped, the server plays something else",
+               filename);
+    return 0;
+  } else {
+    throw status;
+  }
+}
+
+int PlayerClient::PlayLive(LiveReader* reader) {
+  log_->debug("PlayerClient::PlayLive()");
+
+  AuthenticatedContext context(session_key_, zone_);
+  context.AddMetadata("x-live", "1");
+
+  uint64_t sent = 0;
+  const auto next_message = [&](AudioData* data, size_t max_size) {
+    std::string* out = data->mutable_data();
+    out->resize(std::min(max_size, LIVE_CHUNK_SIZE));
+    out->resize(reader->Read(out->data(), out->size()));
+    sent += out->size();
+    return out->size();
+  };
+
+  UploadTuner tuner(round_trip_time());
+  MpvResponse response;
+  grpc::CompletionQueue cq;
+  const auto writer = stub_->PrepareAsyncAudioStream(&context, &response,
+                                                     &cq);
+
+  const auto status = pipelined_upload<AudioData>(&context, writer.get(),
+                                                  &cq, &tuner, nullptr, 0,
+                                                  next_message);
+  log_->info("Live stream ended after {} bytes", sent);
+
+  if (status.ok()) {
+    return response.response();
+  } else if (StatusCode::CANCELLED == status.error_code()) {
+    // Replaced on the server by something else.
+    return 0;
+  } else {
+    throw status;
+  }
+}
+
+int PlayerClient::Enqueue(std::string_view filename) {
+  log_->debug("PlayerClient::Enqueue(\"{}\")", filename);
+
+  std::string source(filename);
+  std::unique_ptr<Transcoder::Output> transcoded;
+  std::optional<ContentHash> hash;
+  std::string key;
+  if (transcoder_ and transcoder_->Accepts(filename)) {
+    key = transcode_key(filename);
+    hash = transcoded_hash(key);
+  }
+  // Transcode the file only when it has to be sent.
+  const auto transcode_once = [&]{
+                                ContentHash transcoded_hash;
+                                transcoded = transcode(filename, key,
+                                                       &transcoded_hash);
+                                if (transcoded) {
+                                  source = transcoded->Path().string();
+                                  hash = transcoded_hash;
+                                } else {
+                                  hash = file_hash(filename);
+                                }
+                                key.clear();
+                              };
+  if (not hash) {
+    if (key.empty()) {
+      hash = file_hash(filename);
+    } else {
+      transcode_once();
     }
+  }
 
-    written += to_send;
+  MpvResponse response;
+
+  for (int attempt = 0; attempt < 2; ++attempt) {
+    CachedAudio cached;
+    cached.set_sha256(hash->data(), hash->size());
+
+    AuthenticatedContext context(session_key_, zone_);
+    const auto status = stub_->Enqueue(&context, cached, &response);
+    if (status.ok()) {
+      return response.response();
+    } else if (StatusCode::NOT_FOUND != status.error_code() or
+               attempt > 0) {
+      throw status;
+    }
+
+    // Not on the server yet, send it and try again.
+    if (not key.empty()) {
+      transcode_once();
+    }
+    const auto upload_status = upload(source, PREFETCH, to_hex(*hash),
+                                      &response);
+    if (not upload_status.ok() and
+        StatusCode::ALREADY_EXISTS != upload_status.error_code()) {
+      throw upload_status;
+    }
   }
+  return response.response();
+}
+
+int PlayerClient::ClearQueue() {
+  log_->debug("PlayerClient::ClearQueue()");
 
-  writer->WritesDone();
-  auto status = writer->Finish();
+  AuthenticatedContext context(session_key_, zone_);
+  MpvResponse response;
 
+  const grpc::Status status = stub_->ClearQueue(&context, Empty(),
+                                                &response);
   if (status.ok()) {
     return response.response();
   } else {
@@ -227,10 +863,160 @@ int PlayerClient::Play(std::string_view filename) {
   }
 }
 
+std::vector<std::string> PlayerClient::ListQueue(int* current) {
+  log_->debug("PlayerClient::ListQueue()");
+
+  AuthenticatedContext context(session_key_, zone_);
+  QueueList queue;
+
+  const grpc::Status status = stub_->ListQueue(&context, Empty(), &queue);
+  if (not status.ok()) {
+    throw status;
+  }
+
+  *current = queue.current();
+
+  // Show the names of the files this client has sent.
+  std::unordered_map<std::string, std::string> names;
+  {
+    std::lock_guard<std::mutex> lck(file_hashes_mtx_);
+    for (const auto& [path, file] : file_hashes_) {
+      names.emplace(std::string(file.hash.begin(), file.hash.end()), path);
+    }
+    for (const auto& [key, file] : transcoded_files_) {
+      names.emplace(std::string(file.hash.begin(), file.hash.end()),
+                    file.name);
+    }
+  }
+
+  std::vector<std::string> result;
+  for (const auto& entry : queue.entries()) {
+    const auto name = names.find(entry.sha256());
+    if (name != names.end()) {
+      result.push_back(name->second);
+    } else if (not entry.sha256().empty()) {
+      result.push_back(crypto::to_hex(entry.sha256()));
+    } else {
+      result.push_back("(stream)");
+    }
+  }
+  return result;
+}
+
+grpc::Status PlayerClient::upload(std::string_view filename,
+                                  const UploadMethod& method,
+                                  const std::string& hash_hex,
+                                  MpvResponse* response) {
+  UploadTuner tuner(round_trip_time());
+
+  // Only AudioStream can be resumed after losing the connection.
+  const bool resumable = &AUDIO_STREAM == &method;
+
+  std::error_code ec;
+  const auto size = fs::file_size(filename, ec);
+
+  // Pacing limits the rate on purpose, so it's never sent in parallel.
+  if (resumable and upload_channels_.size() > 1 and
+      not pacing_.IsEnabled()) {
+    if (not ec and size >= MIN_PARALLEL_UPLOAD_SIZE) {
+      return upload_parallel(filename, size, hash_hex, response);
+    }
+  }
+
+  UploadPacer::PlaybackSource playback;
+  if (resumable) {
+    // The file being sent to AudioStream is the one being played. Right
+    // after it starts the server may still report the previous one, the
+    // pacer catches up with the next update.
+    playback = [this]() -> std::optional<UploadPacer::Playback> {
+                 const auto info = synchronizer_.GetPlaybackInfo();
+                 if (PlaybackState::PLAYING != info.playback_state and
+                     PlaybackState::PAUSED != info.playback_state) {
+                   return std::nullopt;
+                 }
+                 return UploadPacer::Playback{info.total_time,
+                                              info.elapsed_time,
+                                              info.buffered_time};
+               };
+  }
+  UploadPacer pacer(pacing_, ec ? 0 : size, std::move(playback));
+
+  // Waiting for the answer to the probe would only stall the upload if
+  // the server doesn't send it.
+  bool probe = false;
+  if (resumable) {
+    try {
+      probe = server_capabilities().probe();
+    } catch (const grpc::Status& status) {
+      log_->warn("Couldn't get the server's capabilities: {}",
+                 status.error_message());
+    }
+  }
+
+  const std::string upload_id =
+      resumable ? crypto::generate_random_hex(16) : "";
+  uint64_t offset = 0;
+
+  const auto start = std::chrono::steady_clock::now();
+  grpc::Status status;
+  for (int attempt = 0; ; ++attempt) {
+    AuthenticatedContext context(session_key_, zone_);
+    if (not hash_hex.empty()) {
+      // The server stores the file under this hash.
+      context.AddMetadata("x-content-hash", hash_hex);
+    }
+    if (resumable) {
+      context.AddMetadata("x-upload-id", upload_id);
+      if (offset > 0) {
+        context.AddMetadata("x-upload-offset", std::to_string(offset));
+      }
+    }
+
+    UploadPart part;
+    part.method = &method;
+    part.channel = channel_;
+    part.offset = offset;
+    if (pacer.IsEnabled()) {
+      pacer.SetPosition(offset);
+      part.pacer = &pacer;
+    }
+    if (probe and 0 == offset) {
+      // Don't send the whole file if the server can't play it.
+      part.probe_bytes = PROBE_BYTES;
+      context.AddMetadata("x-probe-bytes", std::to_string(PROBE_BYTES));
+    }
+    status = upload_part(filename, part, &context, &tuner, response);
+
+    if (not resumable or StatusCode::UNAVAILABLE != status.error_code() or
+        attempt >= MAX_RESUME_ATTEMPTS) {
+      break;
+    }
+
+    const auto resume_offset = upload_offset(upload_id);
+    if (not resume_offset) {
+      break;
+    }
+    offset = *resume_offset;
+    log_->warn("Connection lost while uploading '{}', resuming at {} bytes",
+               filename, offset);
+  }
+  const std::chrono::duration<double> upload_time =
+      std::chrono::steady_clock::now() - start;
+
+  log_->info("Upload of '{}' finished in {:.2f} s: RTT {:.1f} ms, "
+             "chunk size {} KiB, throughput {:.2f} MiB/s",
+             filename, upload_time.count(),
+             tuner.Rtt().count() / 1000.0,
+             tuner.ChunkSize() / 1024,
+             tuner.Throughput() / (1024 * 1024));
+
+  return status;
+}
+
 int PlayerClient::Stop() {
   log_->debug("PlayerClient::Stop()");
 
-  AuthenticatedContext context(session_key_);
+  AuthenticatedContext context(session_key_, zone_);
   MpvResponse response;
 
   const grpc::Status status = stub_->Stop(&context, Empty(), &response);
@@ -244,7 +1030,7 @@ int PlayerClient::Stop() {
 int PlayerClient::TogglePause() {
   log_->debug("PlayerClient::TogglePause()");
 
-  AuthenticatedContext context(session_key_);
+  AuthenticatedContext context(session_key_, zone_);
   MpvResponse response;
 
   const grpc::Status status = stub_->TogglePause(&context, Empty(),
@@ -259,7 +1045,7 @@ int PlayerClient::TogglePause() {
 int PlayerClient::Volume(std::string_view volume) {
   log_->debug("PlayerClient::Volume(\"{}\")", volume);
 
-  AuthenticatedContext context(session_key_);
+  AuthenticatedContext context(session_key_, zone_);
   MpvResponse response;
 
   VolumeMessage vol_msg;
@@ -276,7 +1062,7 @@ int PlayerClient::Volume(std::string_view volume) {
 int PlayerClient::Seek(std::string_view seconds) {
   log_->debug("PlayerClient::Seek()");
 
-  AuthenticatedContext context(session_key_);
+  AuthenticatedContext context(session_key_, zone_);
   MpvResponse response;
 
   SeekMessage seek_msg;
@@ -300,7 +1086,7 @@ PlaybackSynchronizer::PlaybackInfo PlayerClient::GetPlaybackInfo() {
 bool PlayerClient::Ping() {
   log_->debug("PlayerClient::Ping()");
 
-  AuthenticatedContext context(session_key_);
+  AuthenticatedContext context(session_key_, zone_);
   Empty empty;
 
   const grpc::Status status = stub_->Ping(&context, empty, &empty);
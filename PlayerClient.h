@@ -29,15 +29,24 @@
 
 #include "spdlog/spdlog.h"
 
+#include "ContentHash.h"
+#include "LiveReader.h"
 #include "PlaybackSynchronizer.h"
+#include "SharedPaths.h"
+#include "Transcoder.h"
+#include "UploadPacer.h"
+#include "UploadTuner.h"
 #include "crypto/CryptoUtil.h"
+#include "filesystem.h"
+
+#include <limits>
+#include <unordered_map>
+#include <vector>
 
 using namespace grpc;
 
 namespace lrm {
 class PlayerClient {
-  std::vector<char> read_file(std::string_view filename);
-
   /// Start a thread that will continuously update song_info_, taking
   /// information from the remote server.
   void start_updating_info();
@@ -48,17 +57,146 @@ class PlayerClient {
       std::string_view token,
       const PlaybackSynchronizer::PlaybackInfo* playback_info);
 
+  /// \return Round trip time to the server. It's the one measured on the
+  /// info stream if it's running, otherwise it's measured once with Ping()
+  /// and remembered.
+  std::chrono::microseconds round_trip_time();
+
+  /// \return Hash of the file, computed again only if the file has changed
+  /// since the last call.
+  ContentHash file_hash(std::string_view filename);
+
+  /// Play a file from the server's cache.
+  /// \return The server's response or \b std::nullopt if it doesn't have
+  /// the file.
+  std::optional<int> play_cached(const ContentHash& hash);
+
+  /// \return What the server supports, asked for on the first call. Empty
+  /// if the server is too old to tell.
+  /// \exception grpc::Status The server couldn't be asked.
+  Capabilities server_capabilities();
+  /// Client's transcoding settings completed with the server's preferences.
+  Transcoder::Settings transcode_settings();
+  /// \return Identifies the result of transcoding \e filename with the
+  /// current settings.
+  std::string transcode_key(std::string_view filename);
+  /// \return Hash of the result if \e key was transcoded before.
+  std::optional<ContentHash> transcoded_hash(const std::string& key);
+  /// Transcode the file and remember the hash of the result under \e key.
+  /// \param hash Set to the hash of the result.
+  /// \return The transcoded file or \b nullptr if it couldn't be
+  /// transcoded; the original should be sent then.
+  std::unique_ptr<Transcoder::Output> transcode(std::string_view filename,
+                                                const std::string& key,
+                                                ContentHash* hash);
+
+  /// An RPC the files are uploaded with.
+  struct UploadMethod {
+    /// Starts the call on the generated stub.
+    std::unique_ptr<grpc::ClientAsyncWriter<AudioData>>
+    (PlayerService::Stub::*prepare)(grpc::ClientContext*, MpvResponse*,
+                                    grpc::CompletionQueue*);
+    /// The full name of the method, for the generic stub.
+    const char* name;
+  };
+  static const UploadMethod AUDIO_STREAM;
+  static const UploadMethod AUDIO_RANGE;
+  static const UploadMethod PREFETCH;
+
+  /// Send the file to \e method (AUDIO_STREAM or PREFETCH) with the current
+  /// upload mode. AudioStream uploads are resumed if the connection is
+  /// lost.
+  /// \param hash_hex Sent as the \e x-content-hash metadata if not empty.
+  grpc::Status upload(std::string_view filename,
+                      const UploadMethod& method,
+                      const std::string& hash_hex,
+                      MpvResponse* response);
+  /// Part of a file sent by one call.
+  struct UploadPart {
+    const UploadMethod* method = nullptr;
+    std::shared_ptr<grpc::Channel> channel;
+    uint64_t offset = 0;
+    /// How many bytes to send, by default everything from the offset.
+    uint64_t size = std::numeric_limits<uint64_t>::max();
+    /// Wait for the server to accept the stream after this many bytes.
+    uint64_t probe_bytes = 0;
+    /// Limits the rate of the upload if not null.
+    UploadPacer* pacer = nullptr;
+  };
+  /// Send \e part with the current upload mode.
+  grpc::Status upload_part(std::string_view filename,
+                           const UploadPart& part,
+                           grpc::ClientContext* context,
+                           UploadTuner* tuner,
+                           MpvResponse* response);
+  grpc::Status upload_chunked(std::string_view filename,
+                              const UploadPart& part,
+                              grpc::ClientContext* context,
+                              UploadTuner* tuner,
+                              MpvResponse* response);
+  grpc::Status upload_mapped(std::string_view filename,
+                             const UploadPart& part,
+                             grpc::ClientContext* context,
+                             UploadTuner* tuner,
+                             MpvResponse* response);
+  /// Split the file into ranges and send them at once, each one over
+  /// a different channel from upload_channels_.
+  grpc::Status upload_parallel(std::string_view filename,
+                               uint64_t size,
+                               const std::string& hash_hex,
+                               MpvResponse* response);
+
+  /// Wait for the connection to come back and ask the server how much of
+  /// the upload it has.
+  /// \return Offset to resume from or \b std::nullopt if the upload can't
+  /// be resumed.
+  std::optional<uint64_t> upload_offset(const std::string& upload_id);
+
+  static constexpr std::chrono::microseconds DEFAULT_RTT =
+      std::chrono::milliseconds(50);
+  static constexpr int MAX_RESUME_ATTEMPTS = 5;
+  /// Live sources are sent in pieces no bigger than that.
+  static constexpr size_t LIVE_CHUNK_SIZE = 4 * 1024;
+  /// Enough for the player to recognize most files, unless they start with
+  /// large tags, e.g. with cover art.
+  static constexpr uint64_t PROBE_BYTES = 512 * 1024;
+  /// Smaller files are sent in one piece even if there are more channels.
+  static constexpr uint64_t MIN_PARALLEL_UPLOAD_SIZE = 4 * 1024 * 1024;
+  /// Less than the server's default grace period for the lost uploads.
+  static constexpr std::chrono::seconds RESUME_TIMEOUT{20};
+
  public:
+  enum UploadMode {
+    /// Read the file in chunks and copy them into AudioData messages.
+    COPY,
+    /// Map the file into memory and send slices of the mapping without
+    /// copying them. Works only for regular files.
+    MMAP
+  };
+
   explicit PlayerClient(std::shared_ptr<grpc::Channel> channel) noexcept;
   virtual ~PlayerClient();
 
   bool Authenticate();
 
   int Play(std::string_view filename);
+  /// Stream a live source, like a pipe from a capture program, until it
+  /// ends. The server plays it with low latency.
+  /// \param reader The source. Stop() on it from another thread finishes
+  /// the stream.
+  int PlayLive(LiveReader* reader);
   int Stop();
   int TogglePause();
   int Volume(std::string_view volume);
   int Seek(std::string_view seconds);
+
+  /// Add the file to the end of the server's play queue, uploading it
+  /// first if the server doesn't have it in its cache.
+  int Enqueue(std::string_view filename);
+  int ClearQueue();
+  /// \param current Set to the index of the playing file or \b -1.
+  /// \return Names of the files on the server's play queue.
+  std::vector<std::string> ListQueue(int* current);
   PlaybackSynchronizer::PlaybackInfo GetPlaybackInfo();
   bool Ping();
   std::string Info(std::string_view format);
@@ -70,19 +208,95 @@ class PlayerClient {
   using SongFinishedCallback = std::function<void(PlaybackState::State)>;
   void SetSongFinishedCallback(SongFinishedCallback&& callback);
 
+  inline void SetUploadMode(UploadMode mode) {
+    upload_mode_ = mode;
+  }
+
+  /// Send large files in parts over all of \e channels at once, to get
+  /// past the flow-control window of a single stream on links with a long
+  /// round trip time. The first channel should be the one given to the
+  /// constructor. Fewer than 2 channels disable it.
+  inline void SetUploadChannels(
+      std::vector<std::shared_ptr<grpc::Channel>> channels) {
+    upload_channels_ = std::move(channels);
+  }
+
+  /// Files under these prefixes are played by the server from its own
+  /// copy instead of being uploaded.
+  inline void SetSharedPrefixes(SharedPrefixes prefixes) {
+    shared_prefixes_ = std::move(prefixes);
+  }
+
+  /// Limit the rate of the uploads, see UploadPacer. Paced uploads are
+  /// never split between the upload channels.
+  inline void SetPacing(const UploadPacer::Settings& settings) {
+    pacing_ = settings;
+  }
+
+  /// Transcode the files accepted by \e transcoder before sending them.
+  /// The fields of \e settings left empty are taken from the server's
+  /// preferences (see Capabilities in player_service.proto) or from
+  /// Transcoder::DEFAULT_SETTINGS.
+  inline void SetTranscoder(std::unique_ptr<Transcoder> transcoder,
+                            const Transcoder::Settings& settings) {
+    transcoder_ = std::move(transcoder);
+    transcode_settings_ = settings;
+  }
+
+  /// If enabled, Play() first asks the server to play the file from its
+  /// cache and uploads it only if it's not there.
+  inline void SetHashFirst(bool enabled) {
+    hash_first_ = enabled;
+  }
+
+  /// Control the server's player named \e zone instead of the default one.
+  /// Set it before connecting.
+  inline void SetZone(std::string zone) {
+    zone_ = std::move(zone);
+  }
+
  private:
+  std::shared_ptr<grpc::Channel> channel_;
   std::unique_ptr<PlayerService::Stub> stub_;
 
-  std::vector<char> streaming_file_;
+  UploadMode upload_mode_ = COPY;
+  std::vector<std::shared_ptr<grpc::Channel>> upload_channels_;
+  bool hash_first_ = true;
+  SharedPrefixes shared_prefixes_;
+  UploadPacer::Settings pacing_;
+
+  struct FileHash {
+    uintmax_t size;
+    fs::file_time_type modification_time;
+    ContentHash hash;
+  };
+  std::unordered_map<std::string, FileHash> file_hashes_;
+  struct TranscodedFile {
+    ContentHash hash;
+    std::string name;
+  };
+  // By transcode_key(). Guarded by file_hashes_mtx_.
+  std::unordered_map<std::string, TranscodedFile> transcoded_files_;
+  std::mutex file_hashes_mtx_;
+
+  std::unique_ptr<Transcoder> transcoder_;
+  Transcoder::Settings transcode_settings_;
+  std::optional<Capabilities> server_capabilities_;
+  std::mutex server_capabilities_mtx_;
 
   PlaybackSynchronizer synchronizer_;
 
+  // Measured with Ping() if the synchronizer didn't measure it.
+  std::optional<std::chrono::microseconds> rtt_;
+  std::mutex rtt_mtx_;
+
   std::shared_ptr<spdlog::logger> log_;
 
   SongFinishedCallback song_finished_callback_;
   std::mutex song_finished_mtx_;
 
   std::string session_key_ = std::string(crypto::LRM_SESSION_KEY_SIZE, ' ');
+  std::string zone_;
 };
 }
 
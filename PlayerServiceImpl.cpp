@@ -19,10 +19,10 @@
 #include "PlayerServiceImpl.h"
 #include "crypto/CryptoUtil.h"
 
+#include <cmath>
 #include <algorithm>
 #include <grpcpp/impl/codegen/status.h>
 #include <mutex>
-#include <unistd.h>
 
 #ifndef INCLUDE_GRPCPLUSPLUS
 #include "grpcpp/security/credentials.h"
@@ -38,18 +38,173 @@
 
 #include "Config.h"
 #include "PlaybackState.h"
+#include "RingBuffer.h"
+#include "StreamSpool.h"
 #include "Util.h"
 #include "crypto/ZkpSerialization.h"
 
+namespace {
+constexpr int64_t DEFAULT_STREAM_BUFFER_BYTES = 4 * 1024 * 1024;
+constexpr int64_t DEFAULT_LIVE_BUFFER_BYTES = 64 * 1024;
+constexpr int64_t DEFAULT_SPOOL_MAX_BYTES = 256 * 1024 * 1024;
+constexpr int64_t DEFAULT_CACHE_MAX_BYTES = 2048ll * 1024 * 1024;
+constexpr int64_t DEFAULT_UPLOAD_GRACE_SECONDS = 30;
+// mpv's own default. The uploads raise it up to the maximum when their
+// data arrives irregularly.
+constexpr int64_t DEFAULT_READAHEAD_SECONDS = 1;
+constexpr int64_t DEFAULT_READAHEAD_MAX_SECONDS = 30;
+// The uploads and the authentication run at a lower priority than the rest,
+// so they can't delay the control RPCs. No limit on the uploads, a waiting
+// upload would hold the client's playback.
+constexpr int64_t DEFAULT_STREAM_THREADS = 0;
+constexpr int64_t DEFAULT_STREAM_NICE = 5;
+constexpr int64_t DEFAULT_AUTH_THREADS = 1;
+constexpr int64_t DEFAULT_AUTH_NICE = 10;
+/// How long a resumed upload waits for the call that lost the connection to
+/// notice it.
+constexpr auto RESUME_WAIT = std::chrono::seconds(10);
+/// How long the probe waits for the player to open the file. It may need
+/// more data than the client has sent for the probe.
+constexpr auto PROBE_TIMEOUT = std::chrono::seconds(3);
+
+std::string metadata_value(const grpc::ServerContextBase* context,
+                           std::string_view key) {
+  const auto it = context->client_metadata().find(
+      grpc::string_ref(key.data(), key.size()));
+  if (context->client_metadata().end() == it) {
+    return {};
+  }
+  return std::string(it->second.data(), it->second.size());
+}
+
+/// Create a spool for the incoming stream, or just a buffer if spooling is
+/// disabled or the spool file couldn't be created. Live streams get a small
+/// buffer, anything in it adds to the delay.
+std::shared_ptr<lrm::StreamSource> make_stream_source(bool live) {
+  using namespace lrm;
+
+  if (live) {
+    return std::make_shared<RingBuffer>(
+        Config::GetInt("live_buffer_bytes", DEFAULT_LIVE_BUFFER_BYTES));
+  }
+
+  const auto spool_max_bytes =
+      Config::GetInt("spool_max_bytes", DEFAULT_SPOOL_MAX_BYTES);
+  if (spool_max_bytes > 0) {
+    const auto& dir = Config::Get("spool_dir");
+    try {
+      return std::make_shared<StreamSpool>(
+          dir.empty() ? fs::temp_directory_path() : fs::path(dir),
+          spool_max_bytes);
+    } catch (const std::system_error& e) {
+      spdlog::warn("{}; the stream won't be seekable", e.what());
+    }
+  }
+
+  return std::make_shared<RingBuffer>(
+      Config::GetInt("stream_buffer_bytes", DEFAULT_STREAM_BUFFER_BYTES));
+}
+
+/// \return mpv's options for the size of its cache.
+lrm::Player::MpvOptions make_mpv_options() {
+  using namespace lrm;
+
+  Player::MpvOptions options{
+    {"demuxer-readahead-secs",
+     std::to_string(Config::GetInt("readahead_seconds",
+                                   DEFAULT_READAHEAD_SECONDS))}};
+  if (const auto& max_bytes = Config::Get("demuxer_max_bytes");
+      not max_bytes.empty()) {
+    options.emplace_back("demuxer-max-bytes", max_bytes);
+  }
+  return options;
+}
+}
+
 #define CHECK_AUTH(context)                                            \
   if(not check_auth(context)) {                                        \
     return Status(StatusCode::UNAUTHENTICATED, "Wrong passphrase.");   \
   }
 
+// The same for the callback API, the call is finished through \e reactor.
+#define CHECK_AUTH_REACTOR(context, reactor)                           \
+  if(not check_auth(context)) {                                        \
+    reactor->Finish(                                                   \
+        Status(StatusCode::UNAUTHENTICATED, "Wrong passphrase."));     \
+    return reactor;                                                    \
+  }
+
+// Declares \e zone, the zone the client has chosen.
+#define GET_ZONE(context, zone)                                        \
+  Zone* const zone = find_zone(context);                               \
+  if (not zone) {                                                      \
+    return Status(StatusCode::NOT_FOUND, "No such zone.");             \
+  }
+
+#define GET_ZONE_REACTOR(context, reactor, zone)                       \
+  Zone* const zone = find_zone(context);                               \
+  if (not zone) {                                                      \
+    reactor->Finish(Status(StatusCode::NOT_FOUND, "No such zone."));   \
+    return reactor;                                                    \
+  }
+
 using namespace grpc;
 
 namespace lrm {
-bool PlayerServiceImpl::check_auth(const ServerContext* context) const {
+PlayerServiceImpl::Zone::Zone(size_t index, std::string name,
+                              const std::string& output)
+    : index(index),
+      name(std::move(name)),
+      // Separate logs, mpv instances can't share one.
+      player(Player::Create(
+          output,
+          this->name.empty() ? "mpv.log" : "mpv-" + this->name + ".log",
+          make_mpv_options())) {}
+
+std::vector<std::unique_ptr<PlayerServiceImpl::Zone>>
+PlayerServiceImpl::make_zones() {
+  std::vector<std::unique_ptr<Zone>> zones;
+  // name=output or just name for the default output.
+  for (const auto& entry : Util::tokenize(Config::Get("zones"), ",")) {
+    const auto separator = entry.find('=');
+    const std::string name = entry.substr(0, separator);
+    const std::string output = std::string::npos == separator ?
+                               std::string() : entry.substr(separator + 1);
+
+    if (name.empty() or
+        std::any_of(zones.begin(), zones.end(),
+                    [&](const auto& zone){ return zone->name == name; })) {
+      spdlog::warn("Ignoring zone '{}': no name or a duplicate", entry);
+      continue;
+    }
+    spdlog::info("Zone '{}' plays on {}", name,
+                 output.empty() ? "the default output" : output);
+    zones.push_back(std::make_unique<Zone>(zones.size(), name, output));
+  }
+
+  if (zones.empty()) {
+    zones.push_back(
+        std::make_unique<Zone>(0, "", Config::Get("audio_output")));
+  }
+  return zones;
+}
+
+PlayerServiceImpl::Zone* PlayerServiceImpl::find_zone(
+    const grpc::ServerContextBase* context) const {
+  const auto name = metadata_value(context, "x-zone");
+  if (name.empty()) {
+    return zones_.front().get();
+  }
+  for (const auto& zone : zones_) {
+    if (zone->name == name) {
+      return zone.get();
+    }
+  }
+  return nullptr;
+}
+
+bool PlayerServiceImpl::check_auth(
+    const grpc::ServerContextBase* context) const {
   const auto metadata_key = context->client_metadata().find("x-session-key");
   if(context->client_metadata().end() == metadata_key) {
     return false;
@@ -61,6 +216,14 @@ bool PlayerServiceImpl::check_auth(const ServerContext* context) const {
   return authenticated_sessions_.find(key) != authenticated_sessions_.end();
 }
 
+Player::ReplyCallback PlayerServiceImpl::finish_with_result(
+    grpc::ServerUnaryReactor* reactor, MpvResponse* response) {
+  return [reactor, response](int result) {
+           response->set_response(result);
+           reactor->Finish(Status::OK);
+         };
+}
+
 std::string PlayerServiceImpl::generate_session_key() {
   std::array<unsigned char, 32> rnd;
   for (;;) {
@@ -75,18 +238,68 @@ std::string PlayerServiceImpl::generate_session_key() {
   }
 }
 
-PlayerServiceImpl::PlayerServiceImpl() : PlayerService::Service() {
-  player.SetStateChangeCallback(
-      [&](const lrm::PlaybackState::State& state) {
-        std::lock_guard<std::mutex> lck(playback_state_mtx_);
-        playback_state_ = state;
-        playback_state_cv_.notify_all();
-      });
+std::optional<ContentHash>
+PlayerServiceImpl::content_hash(const ServerContext* context) const {
+  return content_hash_from_hex(metadata_value(context, "x-content-hash"));
 }
 
-PlayerServiceImpl::~PlayerServiceImpl() {
-  // Break TimeInfoStream threads' sleep.
-  playback_state_cv_.notify_all();
+Status PlayerServiceImpl::find_cached(const CachedAudio* audio,
+                                      fs::path* path) {
+  if (audio->sha256().size() != std::tuple_size_v<ContentHash>) {
+    return Status{StatusCode::INVALID_ARGUMENT, "Wrong size of the hash"};
+  }
+  if (not cache_) {
+    return Status{StatusCode::NOT_FOUND, "The cache is disabled"};
+  }
+
+  ContentHash hash;
+  std::copy(audio->sha256().begin(), audio->sha256().end(), hash.begin());
+
+  const auto found = cache_->Find(hash);
+  if (not found) {
+    return Status{StatusCode::NOT_FOUND, "Not in the cache"};
+  }
+  *path = *found;
+  return Status::OK;
+}
+
+PlayerServiceImpl::PlayerServiceImpl()
+    : zones_(make_zones()),
+      stream_executor_("lrm-stream",
+                       Config::GetInt("stream_threads",
+                                      DEFAULT_STREAM_THREADS),
+                       Config::GetInt("stream_nice", DEFAULT_STREAM_NICE)),
+      auth_executor_("lrm-auth",
+                     Config::GetInt("auth_threads", DEFAULT_AUTH_THREADS),
+                     Config::GetInt("auth_nice", DEFAULT_AUTH_NICE)) {
+  for (const auto& zone : zones_) {
+    const size_t index = zone->index;
+    zone->player->SetStateChangeCallback(
+        [this, index](const lrm::PlaybackState::State& state) {
+          time_info_streams_.SetPlaybackState(state, index);
+        });
+    // We want to update clients whenever volume changes
+    zone->player->SetVolumeChangeCallback(
+        [this, index](int) {
+          time_info_streams_.Refresh(index);
+        });
+  }
+
+  const auto cache_max_bytes =
+      Config::GetInt("cache_max_bytes", DEFAULT_CACHE_MAX_BYTES);
+  if (cache_max_bytes > 0) {
+    const auto& dir = Config::Get("cache_dir");
+    try {
+      cache_ = std::make_unique<AudioCache>(
+          dir.empty() ? AudioCache::DefaultDirectory() : fs::path(dir),
+          cache_max_bytes);
+    } catch (const fs::filesystem_error& e) {
+      spdlog::error("Audio cache disabled: {}", e.what());
+    }
+  }
+
+  shared_roots_ = SharedRoots(
+      Util::tokenize(Config::Get("shared_roots"), ","));
 }
 
 Status
@@ -95,242 +308,754 @@ PlayerServiceImpl::AudioStream(ServerContext* context,
                                MpvResponse *response) {
   CHECK_AUTH(context);
 
-  AudioData data;
+  const auto upload_id = metadata_value(context, "x-upload-id");
+  const auto resume_offset = metadata_value(context, "x-upload-offset");
+
+  std::shared_ptr<UploadSession> session;
+  uint64_t skip = 0;
+
+  if (not resume_offset.empty() and not upload_id.empty()) {
+    uint64_t offset;
+    try {
+      offset = std::stoull(resume_offset);
+    } catch (const std::exception&) {
+      return Status{StatusCode::INVALID_ARGUMENT, "Invalid x-upload-offset"};
+    }
+
+    std::unique_lock<std::mutex> lck(uploads_mtx_);
+    const auto it = uploads_.find(upload_id);
+    if (it == uploads_.end()) {
+      return Status{StatusCode::NOT_FOUND,
+                    "No such upload, it may have expired"};
+    }
+    session = it->second;
 
-  int pipefd[2];
-  if (-1 == pipe(pipefd)) {
-    return Status{
-      StatusCode::ABORTED,
-      fmt::format("Audio stream pipe: {}", strerror(errno))};
+    // The call that lost the connection may not have noticed it yet.
+    if (not uploads_cv_.wait_for(lck, RESUME_WAIT,
+                                 [&]{ return not session->receiving; })) {
+      return Status{StatusCode::UNAVAILABLE,
+                    "The upload is still being received"};
+    }
+    if (uploads_.find(upload_id) == uploads_.end()) {
+      return Status{StatusCode::NOT_FOUND, "The upload has expired"};
+    }
+    if (offset > session->received) {
+      return Status{StatusCode::OUT_OF_RANGE,
+                    "The offset is past the received data"};
+    }
+
+    session->receiving = true;
+    // Lets the call that lost the connection return.
+    uploads_cv_.notify_all();
+    skip = session->received - offset;
+    response->set_response(MPV_ERROR_SUCCESS);
+    spdlog::info("Resuming audio from {} at {} bytes", context->peer(),
+                 session->received.load());
+  } else {
+    GET_ZONE(context, zone);
+
+    const bool live = not metadata_value(context, "x-live").empty();
+    session = std::make_shared<UploadSession>();
+    session->zone = zone;
+    session->source = make_stream_source(live);
+
+    if (const auto size = metadata_value(context, "x-upload-size");
+        not size.empty()) {
+      try {
+        session->total_size = std::stoull(size);
+      } catch (const std::exception&) {
+        return Status{StatusCode::INVALID_ARGUMENT, "Invalid x-upload-size"};
+      }
+      if (upload_id.empty() or not session->source->IsSeekable()) {
+        return Status{StatusCode::FAILED_PRECONDITION,
+                      "Can't receive the upload in ranges"};
+      }
+      // The player gets the duration before the last range arrives.
+      session->source->SetTotalSize(session->total_size);
+    }
+    if (const auto probe_bytes = metadata_value(context, "x-probe-bytes");
+        not probe_bytes.empty()) {
+      try {
+        session->probe_bytes = std::stoull(probe_bytes);
+      } catch (const std::exception&) {
+        return Status{StatusCode::INVALID_ARGUMENT, "Invalid x-probe-bytes"};
+      }
+    }
+
+    // If the client told what the stream's hash is, keep a copy to play it
+    // next time without the upload.
+    if (const auto hash = content_hash(context); cache_ and hash and
+        not live) {
+      try {
+        session->cache_writer = cache_->Insert(*hash);
+      } catch (const std::system_error& e) {
+        spdlog::warn("Not caching the stream: {}", e.what());
+      }
+    }
+
+    const auto readahead =
+        Config::GetInt("readahead_seconds", DEFAULT_READAHEAD_SECONDS);
+    const auto readahead_max = Config::GetInt(
+        "readahead_max_seconds", DEFAULT_READAHEAD_MAX_SECONDS);
+    if (not live and 0 == session->total_size and
+        readahead_max > readahead) {
+      session->readahead =
+          std::make_unique<ReadaheadTuner>(readahead, readahead_max);
+      // The previous upload may have raised it.
+      zone->player->SetReadahead(readahead);
+    }
+
+    spdlog::info("Playing {}audio from {}", live ? "live " : "",
+                 context->peer());
+    preempt_upload(zone, session);
+    const std::weak_ptr<UploadSession> weak_session = session;
+    const auto result = zone->player->PlayFromStream(
+        session->source,
+        [weak_session](bool loaded) {
+          const auto session = weak_session.lock();
+          if (not session) {
+            return;
+          }
+          {
+            std::lock_guard<std::mutex> lck(session->load_mtx);
+            session->loaded = loaded;
+            session->load_cv.notify_all();
+          }
+          if (not loaded) {
+            // Stops receive_stream() from writing the rest.
+            session->source->Cancel();
+          }
+        },
+        live);
+    response->set_response(result);
+
+    if (MPV_ERROR_SUCCESS != result) {
+      remove_upload("", session.get());
+      return Status{StatusCode::ABORTED, "Couldn't play from stream"};
+    }
+
+    session->receiving = true;
+    if (not upload_id.empty()) {
+      std::lock_guard<std::mutex> lck(uploads_mtx_);
+      uploads_[upload_id] = session;
+      // AudioRange calls may be waiting for it.
+      uploads_cv_.notify_all();
+    }
+  }
+
+  const auto status = receive_stream(context, reader, session.get(), skip);
+
+  bool preempted;
+  {
+    std::lock_guard<std::mutex> lck(uploads_mtx_);
+    preempted = session->preempted;
+  }
+  if (preempted) {
+    finish_upload(upload_id, session.get(), false);
+    return Status{StatusCode::CANCELLED, "Replaced by another stream"};
   }
 
-  spdlog::info("Playing audio from {}", context->peer());
-  const auto result = player.PlayFromPipe(pipefd[0]);
-  response->set_response(result);
+  // The uploads sent in ranges can't be resumed, so there's nothing to
+  // wait for.
+  if (StatusCode::CANCELLED != status.error_code() or upload_id.empty() or
+      session->total_size > 0) {
+    const bool complete = 0 == session->total_size or
+                          session->received == session->total_size;
+    // Otherwise the last AudioRange call finishes it.
+    if (not status.ok() or complete) {
+      finish_upload(upload_id, session.get(), status.ok() and complete);
+    }
+    return status;
+  }
+
+  // The client disconnected, give it some time to come back.
+  const auto grace_period = std::chrono::seconds(
+      Config::GetInt("upload_grace_seconds", DEFAULT_UPLOAD_GRACE_SECONDS));
+  std::unique_lock<std::mutex> lck(uploads_mtx_);
+  session->receiving = false;
+  uploads_cv_.notify_all();
+
+  if (not uploads_cv_.wait_for(lck, grace_period, [&]{
+                                 return session->receiving or
+                                     session->preempted;
+                               }) or session->preempted) {
+    lck.unlock();
+    spdlog::info("Audio from {} wasn't resumed, playing the {} bytes "
+                 "received", context->peer(), session->received.load());
+    finish_upload(upload_id, session.get(), false);
+  }
+  return status;
+}
+
+Status
+PlayerServiceImpl::AudioRange(ServerContext* context,
+                              ServerReader<AudioData>* reader,
+                              MpvResponse* response) {
+  CHECK_AUTH(context);
+
+  const auto upload_id = metadata_value(context, "x-upload-id");
+  if (upload_id.empty()) {
+    return Status{StatusCode::INVALID_ARGUMENT, "Missing x-upload-id"};
+  }
+  uint64_t offset;
+  try {
+    offset = std::stoull(metadata_value(context, "x-range-offset"));
+  } catch (const std::exception&) {
+    return Status{StatusCode::INVALID_ARGUMENT, "Invalid x-range-offset"};
+  }
+
+  std::shared_ptr<UploadSession> session;
+  {
+    std::unique_lock<std::mutex> lck(uploads_mtx_);
+    // The AudioStream call that starts the upload may come after this one.
+    if (not uploads_cv_.wait_for(lck, RESUME_WAIT, [&]{
+                                   return uploads_.count(upload_id) > 0;
+                                 })) {
+      return Status{StatusCode::NOT_FOUND, "No such upload"};
+    }
+    session = uploads_[upload_id];
+  }
+
+  if (0 == session->total_size) {
+    return Status{StatusCode::FAILED_PRECONDITION,
+                  "The upload isn't sent in ranges"};
+  }
 
-  if (MPV_ERROR_SUCCESS != result) {
-    return Status{StatusCode::ABORTED, "Couldn't play from pipe"};
+  const auto status = receive_stream(context, reader, session.get(), 0,
+                                     offset);
+  const bool complete = session->received == session->total_size;
+  if (not status.ok() or complete) {
+    // A lost range leaves a gap, the player gets the data before it.
+    finish_upload(upload_id, session.get(), status.ok());
   }
 
+  response->set_response(MPV_ERROR_SUCCESS);
+  return status;
+}
+
+Status
+PlayerServiceImpl::UploadStatus(ServerContext* context,
+                                const UploadId* id,
+                                UploadOffset* offset) {
+  CHECK_AUTH(context);
+
+  std::lock_guard<std::mutex> lck(uploads_mtx_);
+  const auto it = uploads_.find(id->id());
+  if (it == uploads_.end()) {
+    return Status{StatusCode::NOT_FOUND, "No such upload"};
+  }
+  offset->set_offset(it->second->received);
+
+  return Status::OK;
+}
+
+Status PlayerServiceImpl::receive_stream(ServerContext* context,
+                                         ServerReader<AudioData>* reader,
+                                         UploadSession* session,
+                                         uint64_t skip,
+                                         uint64_t range_offset) {
+  {
+    std::lock_guard<std::mutex> lck(uploads_mtx_);
+    if (session->preempted) {
+      return Status{StatusCode::CANCELLED, "Replaced by another stream"};
+    }
+    session->receivers.push_back(context);
+  }
+
+  const auto status = stream_executor_.Run(
+      [&]{ return copy_stream(context, reader, session, skip,
+                              range_offset); });
+
+  std::lock_guard<std::mutex> lck(uploads_mtx_);
+  session->receivers.erase(std::find(session->receivers.begin(),
+                                     session->receivers.end(), context));
+  return status;
+}
+
+Status PlayerServiceImpl::copy_stream(ServerContext* context,
+                                      ServerReader<AudioData>* reader,
+                                      UploadSession* session,
+                                      uint64_t skip,
+                                      uint64_t range_offset) {
+  const bool ranged = session->total_size > 0;
+  uint64_t position = range_offset;
+
+  AudioData data;
   while (reader->Read(&data)) {
-    size_t written = 0;
-    while (written < data.data().size()) {
-      const auto write_result = write(pipefd[1],
-                                      data.data().data() + written,
-                                      data.data().size() - written);
-      if (-1 == write_result) {
-        close(pipefd[1]);
-        return Status{
-          StatusCode::ABORTED,
-          fmt::format("Couldn't write to audio stream pipe: {}",
-                      strerror(errno))
-        };
+    const char* bytes = data.data().data();
+    size_t size = data.data().size();
+
+    // Sent again after resuming, but the server already has it.
+    const auto skipped = std::min<uint64_t>(skip, size);
+    bytes += skipped;
+    size -= skipped;
+    skip -= skipped;
+
+    // The data comes in order unless it's sent in ranges.
+    const uint64_t at = ranged ? position : session->received.load();
+
+    size_t written;
+    try {
+      written = ranged ?
+                session->source->WriteAt(at, bytes, size) :
+                session->source->Write(bytes, size);
+    } catch (const std::system_error& e) {
+      spdlog::error("Audio stream from {}: {}", context->peer(), e.what());
+      session->source->Cancel();
+      return Status{StatusCode::ABORTED, e.what()};
+    }
+    if (written < size) {
+      {
+        std::lock_guard<std::mutex> lck(session->load_mtx);
+        if (session->loaded == false) {
+          spdlog::info("The player can't play the stream from {}",
+                       context->peer());
+          return Status{StatusCode::INVALID_ARGUMENT,
+                        "The player can't play the stream"};
+        }
+      }
+      // The source is cancelled when mpv stops reading it.
+      spdlog::info("Playback of the stream from {} has stopped, "
+                   "dropping the rest of it", context->peer());
+      return Status{StatusCode::ABORTED, "Playback of the stream stopped"};
+    }
+    session->received += size;
+
+    if (session->readahead and session->readahead->Arrived()) {
+      spdlog::debug("Stream from {} arrives with {:.3f} s of jitter and "
+                    "stalls of {:.1f} s, reading {} s ahead",
+                    context->peer(), session->readahead->Jitter(),
+                    session->readahead->Stall(),
+                    session->readahead->Readahead());
+      session->zone->player->SetReadahead(session->readahead->Readahead());
+    }
+
+    {
+      std::lock_guard<std::mutex> lck(session->cache_writer_mtx);
+      if (session->cache_writer) {
+        try {
+          session->cache_writer->WriteAt(at, bytes, size);
+        } catch (const std::system_error& e) {
+          spdlog::warn("Not caching the stream: {}", e.what());
+          session->cache_writer.reset();
+        }
+      }
+    }
+    position += size;
+
+    if (session->probe_bytes > 0 and
+        session->received >= session->probe_bytes) {
+      session->probe_bytes = 0;
+      if (const auto status = probe(context, reader, session);
+          not status.ok()) {
+        return status;
       }
-      written += write_result;
     }
   }
 
-  close(pipefd[1]);
+  if (context->IsCancelled()) {
+    return Status{StatusCode::CANCELLED, "The client disconnected"};
+  }
   return Status::OK;
 }
 
+Status PlayerServiceImpl::probe(ServerContext* context,
+                                ServerReader<AudioData>* reader,
+                                UploadSession* session) {
+  const auto deadline = std::chrono::steady_clock::now() + PROBE_TIMEOUT;
+  std::unique_lock<std::mutex> lck(session->load_mtx);
+  // Cancelling the source doesn't wake this up, so check it every now and
+  // then.
+  while (not session->loaded and not session->source->IsCancelled() and
+         std::chrono::steady_clock::now() < deadline) {
+    session->load_cv.wait_for(lck, std::chrono::milliseconds(100));
+  }
+
+  if (session->loaded == false) {
+    spdlog::info("Rejecting the stream from {}, the player can't play it",
+                 context->peer());
+    return Status{StatusCode::INVALID_ARGUMENT,
+                  "The player can't play the stream"};
+  }
+  if (session->source->IsCancelled()) {
+    return Status{StatusCode::ABORTED, "Playback of the stream stopped"};
+  }
+
+  context->AddInitialMetadata("x-probe", session->loaded ? "ok" : "timeout");
+  reader->SendInitialMetadata();
+  return Status::OK;
+}
+
+void PlayerServiceImpl::finish_upload(const std::string& id,
+                                      UploadSession* session,
+                                      bool complete) {
+  if (session->finished.exchange(true)) {
+    return;
+  }
+
+  session->source->CloseWrite();
+  {
+    std::lock_guard<std::mutex> lck(session->cache_writer_mtx);
+    if (complete and session->cache_writer and
+        session->cache_writer->Commit()) {
+      spdlog::debug("Upload {} added to the cache", id);
+    }
+    session->cache_writer.reset();
+  }
+  remove_upload(id, session);
+}
+
+void PlayerServiceImpl::remove_upload(const std::string& id,
+                                      const UploadSession* session) {
+  std::lock_guard<std::mutex> lck(uploads_mtx_);
+  if (session->zone and session->zone->playing_upload.get() == session) {
+    session->zone->playing_upload.reset();
+  }
+  if (id.empty()) {
+    return;
+  }
+  const auto it = uploads_.find(id);
+  if (it != uploads_.end() and it->second.get() == session) {
+    uploads_.erase(it);
+  }
+  uploads_cv_.notify_all();
+}
+
+void PlayerServiceImpl::preempt_upload(
+    Zone* zone, std::shared_ptr<UploadSession> successor) {
+  std::shared_ptr<UploadSession> previous;
+  {
+    std::lock_guard<std::mutex> lck(uploads_mtx_);
+    previous = std::exchange(zone->playing_upload, std::move(successor));
+    if (not previous or previous->finished) {
+      return;
+    }
+
+    previous->preempted = true;
+    for (ServerContext* receiver : previous->receivers) {
+      receiver->TryCancel();
+    }
+    // Ends the wait for a disconnected client to come back.
+    uploads_cv_.notify_all();
+  }
+  // Unblocks a call waiting to write and closes the stream for the player.
+  previous->source->Cancel();
+  spdlog::info("Stopped receiving the previous stream, {} bytes received",
+               previous->received.load());
+}
+
 Status
-PlayerServiceImpl::Stop(ServerContext* context,
-                        const Empty*,
-                        MpvResponse* response) {
+PlayerServiceImpl::PlayCached(ServerContext* context,
+                              const CachedAudio* audio,
+                              MpvResponse* response) {
   CHECK_AUTH(context);
+  GET_ZONE(context, zone);
+
+  fs::path path;
+  if (const auto status = find_cached(audio, &path); not status.ok()) {
+    return status;
+  }
 
-  response->set_response(player.Stop());
+  spdlog::info("Playing {} from the cache for {}", path.filename().string(),
+               context->peer());
+  preempt_upload(zone);
+  zone->player->Input(path.string());
+  response->set_response(zone->player->Play());
 
   return Status::OK;
 }
 
 Status
-PlayerServiceImpl::TogglePause(ServerContext* context,
-                               const Empty*,
-                               MpvResponse* response) {
+PlayerServiceImpl::PlayByReference(ServerContext* context,
+                                   const MediaReference* reference,
+                                   MpvResponse* response) {
   CHECK_AUTH(context);
+  GET_ZONE(context, zone);
 
-  response->set_response(player.TogglePause());
+  const auto resolved = shared_roots_.Resolve(reference->reference());
+  if (not resolved) {
+    spdlog::warn("{} asked to play '{}', which is not in a shared root",
+                 context->peer(), reference->reference());
+    return Status{StatusCode::PERMISSION_DENIED, "Not in a shared root"};
+  }
+  if (not is_uri(*resolved) and not fs::is_regular_file(*resolved)) {
+    return Status{StatusCode::NOT_FOUND, "No such file"};
+  }
+
+  spdlog::info("Playing {} by reference for {}", *resolved,
+               context->peer());
+  preempt_upload(zone);
+  zone->player->Input(*resolved);
+  response->set_response(zone->player->Play());
 
   return Status::OK;
 }
 
 Status
-PlayerServiceImpl::Volume(ServerContext* context,
-                          const VolumeMessage* volume,
-                          MpvResponse* response) {
+PlayerServiceImpl::Prefetch(ServerContext* context,
+                            ServerReader<AudioData>* reader,
+                            MpvResponse* response) {
   CHECK_AUTH(context);
 
-  response->set_response(player.Volume(volume->volume()));
-  // We want to update clients whenever volume changes
-  playback_state_cv_.notify_all();
+  const auto hash = content_hash(context);
+  if (not hash) {
+    return Status{StatusCode::INVALID_ARGUMENT,
+                  "Missing or invalid x-content-hash"};
+  }
+  if (not cache_) {
+    return Status{StatusCode::FAILED_PRECONDITION, "The cache is disabled"};
+  }
+
+  std::unique_ptr<AudioCache::Writer> cache_writer;
+  try {
+    cache_writer = cache_->Insert(*hash);
+  } catch (const std::system_error& e) {
+    return Status{StatusCode::ABORTED, e.what()};
+  }
+  if (not cache_writer) {
+    return Status{StatusCode::ALREADY_EXISTS, "Already in the cache"};
+  }
+
+  spdlog::debug("Prefetching {} from {}", to_hex(*hash), context->peer());
 
+  const auto status = stream_executor_.Run(
+      [&]{
+        AudioData data;
+        while (reader->Read(&data)) {
+          try {
+            cache_writer->Write(data.data().data(), data.data().size());
+          } catch (const std::system_error& e) {
+            return Status{StatusCode::ABORTED, e.what()};
+          }
+        }
+        return Status::OK;
+      });
+  if (not status.ok()) {
+    return status;
+  }
+
+  if (not cache_writer->Commit()) {
+    return Status{StatusCode::DATA_LOSS,
+                  "The data doesn't match x-content-hash"};
+  }
+  response->set_response(MPV_ERROR_SUCCESS);
   return Status::OK;
 }
 
 Status
-PlayerServiceImpl::Seek(ServerContext* context,
-                        const SeekMessage* seek,
-                        MpvResponse* response) {
+PlayerServiceImpl::Enqueue(ServerContext* context,
+                           const CachedAudio* audio,
+                           MpvResponse* response) {
   CHECK_AUTH(context);
+  GET_ZONE(context, zone);
+
+  fs::path path;
+  if (const auto status = find_cached(audio, &path); not status.ok()) {
+    return status;
+  }
 
-  response->set_response(player.Seek(seek->seconds()));
+  response->set_response(zone->player->Enqueue(path.string()));
 
   return Status::OK;
 }
 
 Status
-PlayerServiceImpl::Ping(ServerContext* context,
-                        const Empty*,
-                        Empty*) {
+PlayerServiceImpl::ClearQueue(ServerContext* context,
+                              const Empty*,
+                              MpvResponse* response) {
   CHECK_AUTH(context);
+  GET_ZONE(context, zone);
+
+  response->set_response(zone->player->ClearQueue());
 
   return Status::OK;
 }
 
-Status PlayerServiceImpl::TimeInfoStream(
-    ServerContext* context,
-    ServerReaderWriter<TimeInfo, TimeInterval>* stream) {
+Status
+PlayerServiceImpl::ListQueue(ServerContext* context,
+                             const Empty*,
+                             QueueList* queue) {
   CHECK_AUTH(context);
+  GET_ZONE(context, zone);
 
-  TimeInterval time_interval;
-  if (not stream->Read(&time_interval)) {
-    return grpc::Status(
-        StatusCode::ABORTED,
-        "Couldn't get streaming interval time from the client");
+  int64_t current;
+  std::vector<std::string> files;
+  try {
+    files = zone->player->Queue(&current);
+  } catch (const MpvException& e) {
+    return Status{StatusCode::INTERNAL, e.what(), e.details()};
   }
 
-  std::mutex interval_mtx;
-  std::chrono::milliseconds interval{time_interval.milliseconds()};
-  spdlog::debug("Info stream interval set to {}s",
-                interval.count() / (float)1000);
+  queue->set_current(current);
+  for (const auto& file : files) {
+    auto entry = queue->add_entries();
+    // Files from the cache are named by their hash.
+    if (const auto hash = content_hash_from_hex(
+            fs::path(file).filename().string())) {
+      entry->set_sha256(hash->data(), hash->size());
+    }
+  }
 
-  std::atomic<bool> close_stream = false;
+  return Status::OK;
+}
 
-  auto reader = std::thread(
-      [&]{
-        while (stream->Read(&time_interval)) {
-          spdlog::debug(
-              "Client requested to change the update interval to {} s",
-              time_interval.milliseconds() / (float)1000);
+grpc::ServerUnaryReactor*
+PlayerServiceImpl::Stop(grpc::CallbackServerContext* context,
+                        const Empty*,
+                        MpvResponse* response) {
+  auto* reactor = context->DefaultReactor();
+  CHECK_AUTH_REACTOR(context, reactor);
+  GET_ZONE_REACTOR(context, reactor, zone);
 
-          std::lock_guard<std::mutex> lck(interval_mtx);
-          interval = std::chrono::milliseconds(time_interval.milliseconds());
-        }
-        spdlog::debug(
-            "Client requested the cancelletion of the info stream.");
-        close_stream = true;
+  preempt_upload(zone);
+  zone->player->Stop(finish_with_result(reactor, response));
 
-        playback_state_cv_.notify_all();
-      });
+  return reactor;
+}
 
-  std::chrono::time_point<std::chrono::system_clock> time =
-      std::chrono::system_clock::now();
+grpc::ServerUnaryReactor*
+PlayerServiceImpl::TogglePause(grpc::CallbackServerContext* context,
+                               const Empty*,
+                               MpvResponse* response) {
+  auto* reactor = context->DefaultReactor();
+  CHECK_AUTH_REACTOR(context, reactor);
+  GET_ZONE_REACTOR(context, reactor, zone);
 
-  TimeInfo time_info;
+  zone->player->TogglePause(finish_with_result(reactor, response));
 
-  lrm::PlaybackState::State
-      new_state = player.GetPlaybackState(),
-      old_state = lrm::PlaybackState::UNDEFINED;
-  bool state_changed = false;
-  bool force_update = false;
-  int old_volume = 0, new_volume = 0;
+  return reactor;
+}
 
-  // Runs at intervals, the playback state change makes it run early
-  while (not close_stream) {
-    try {
-      state_changed = (new_state != old_state);
-
-      if (state_changed) {
-        std::string state_str;
-        switch (new_state) {
-          case lrm::PlaybackState::PLAYING:
-            time_info.set_playback_state(TimeInfo::PLAYING);
-            break;
-          case lrm::PlaybackState::PAUSED:
-            time_info.set_playback_state(TimeInfo::PAUSED);
-            break;
-          case lrm::PlaybackState::STOPPED:
-            time_info.set_playback_state(TimeInfo::STOPPED);
-            break;
-          case lrm::PlaybackState::FINISHED:
-            time_info.set_playback_state(TimeInfo::FINISHED);
-            break;
-          case lrm::PlaybackState::FINISHED_ERROR:
-            time_info.set_playback_state(TimeInfo::FINISHED_ERROR);
-            break;
-          case lrm::PlaybackState::UNDEFINED:
-            break;
-        }
-        spdlog::debug("Sending playback state to the client: {}",
-                      lrm::PlaybackState::StateName(new_state));
+grpc::ServerUnaryReactor*
+PlayerServiceImpl::Volume(grpc::CallbackServerContext* context,
+                          const VolumeMessage* volume,
+                          MpvResponse* response) {
+  auto* reactor = context->DefaultReactor();
+  CHECK_AUTH_REACTOR(context, reactor);
+  GET_ZONE_REACTOR(context, reactor, zone);
 
-        old_state = new_state;
-      } else {
-        time_info.clear_playback_state();
-      }
+  // Clients get the new volume from the player's volume change callback.
+  zone->player->Volume(volume->volume(),
+                      finish_with_result(reactor, response));
 
-      // Update time_info only if PLAYING or just switched to PAUSED
-      bool clear = false;
-      if (lrm::PlaybackState::PLAYING == new_state or
-          (lrm::PlaybackState::PAUSED == new_state and state_changed)) {
-        try {
-          time_info.set_current_time(player.TimePosition());
-          time_info.set_remaining_time(player.TimeRemaining());
-          time_info.set_total_time(player.TotalTime());
-          time_info.set_remaining_playtime(player.PlayTimeRemaining());
-        } catch (const lrm::MpvException& e) {
-          spdlog::warn("mpv property '{}' couldn't be retrieved: {}",
-                       e.details(), e.what());
-          clear = true;
-        }
-      } else {
-        clear = true;
-      }
+  return reactor;
+}
 
-      if (clear) {
-        // Don't run time_info.Clear() because the time_info.playback_state
-        // may be set.
-        time_info.clear_current_time();
-        time_info.clear_total_time();
-        time_info.clear_remaining_time();
-        time_info.clear_remaining_playtime();
-      }
+grpc::ServerUnaryReactor*
+PlayerServiceImpl::Seek(grpc::CallbackServerContext* context,
+                        const SeekMessage* seek,
+                        MpvResponse* response) {
+  auto* reactor = context->DefaultReactor();
+  CHECK_AUTH_REACTOR(context, reactor);
+  GET_ZONE_REACTOR(context, reactor, zone);
 
-      new_volume = player.Volume();
-      time_info.set_volume(new_volume);
+  zone->player->Seek(seek->seconds(), finish_with_result(reactor, response));
 
-      force_update = state_changed | (new_volume != old_volume);
+  return reactor;
+}
 
-      if ((lrm::PlaybackState::PLAYING == new_state) or force_update) {
-        if (not stream->Write(time_info)) {
-          close_stream = true;
-          break;
-        }
-      }
+Status
+PlayerServiceImpl::Ping(ServerContext* context,
+                        const Empty*,
+                        Empty*) {
+  CHECK_AUTH(context);
 
-      {
-        std::lock_guard<std::mutex> lck(interval_mtx);
-        time += interval;
-      }
-      {
-        std::unique_lock<std::mutex> lck(playback_state_mtx_);
-        playback_state_cv_.wait_until(lck, time);
-        // playback_state_ is updated by the callback defined in the
-        // constructor
-        new_state = playback_state_;
-      }
-      old_volume = new_volume;
-    } catch (const std::exception& e) {
-      spdlog::error("Info stream loop: {}", e.what());
+  return Status::OK;
+}
+
+Status
+PlayerServiceImpl::GetCapabilities(ServerContext* context,
+                                   const Empty*,
+                                   Capabilities* capabilities) {
+  CHECK_AUTH(context);
+
+  capabilities->set_transcode_codec(Config::Get("transcode_codec"));
+  capabilities->set_transcode_format(Config::Get("transcode_format"));
+  capabilities->set_transcode_bitrate(
+      Config::GetInt("transcode_bitrate", 0));
+  capabilities->set_probe(true);
+
+  return Status::OK;
+}
+
+TimeInfoStreams::Snapshot PlayerServiceImpl::sample_player(
+    size_t zone, PlaybackState::State state) {
+  TimeInfoStreams::Snapshot snapshot;
+  snapshot.state = state;
+
+  // One consistent read of what the event loop has observed, no calls to
+  // mpv here.
+  const lrm::Player::Properties properties =
+      zones_.at(zone)->player->GetProperties();
+  constexpr uint32_t TIMES =
+      lrm::Player::TIME_POSITION | lrm::Player::TIME_REMAINING |
+      lrm::Player::TOTAL_TIME | lrm::Player::PLAYTIME_REMAINING;
+
+  if ((lrm::PlaybackState::PLAYING == state or
+       lrm::PlaybackState::PAUSED == state) and
+      properties.Has(TIMES)) {
+    snapshot.current_time = properties.time_position;
+    snapshot.remaining_time = properties.time_remaining;
+    snapshot.total_time = properties.total_time;
+    snapshot.remaining_playtime = properties.playtime_remaining;
+    snapshot.has_times = true;
+  }
+  if (properties.Has(lrm::Player::SPEED)) {
+    snapshot.speed = properties.speed;
+  }
+  if (snapshot.has_times and properties.Has(lrm::Player::CACHE_DURATION)) {
+    snapshot.cache_time = properties.cache_duration;
+    snapshot.buffered_time =
+        properties.cache_duration + upload_buffered_time(zone, properties);
+    if (properties.Has(lrm::Player::BUFFERING)) {
+      snapshot.buffering = std::lround(properties.buffering);
     }
+    snapshot.has_buffer = true;
+  }
+  snapshot.underruns = properties.underruns;
+
+  snapshot.volume = std::lround(properties.volume);
+  return snapshot;
+}
+
+double PlayerServiceImpl::upload_buffered_time(
+    size_t zone, const Player::Properties& properties) {
+  std::shared_ptr<UploadSession> upload;
+  {
+    std::lock_guard<std::mutex> lck(uploads_mtx_);
+    upload = zones_.at(zone)->playing_upload;
+  }
+  if (not upload) {
+    return 0;
   }
 
-    spdlog::debug("Closing the info stream.");
-    reader.join();
+  // What the player has read covers the position and its cache, that gives
+  // the stream's bytes per second. After seeks it's a rough estimate.
+  const auto stats = upload->source->GetStats();
+  const double read_time =
+      properties.time_position + properties.cache_duration;
+  if (read_time < 1 or stats.bytes_read == 0 or
+      stats.bytes_written <= stats.bytes_read) {
+    return 0;
+  }
+  return (stats.bytes_written - stats.bytes_read) /
+      (stats.bytes_read / read_time);
+}
 
-    return Status::OK;
+TimeInfoStreams::Reactor* PlayerServiceImpl::TimeInfoStream(
+    grpc::CallbackServerContext* context) {
+  if (not check_auth(context)) {
+    return TimeInfoStreams::Reject(
+        Status(StatusCode::UNAUTHENTICATED, "Wrong passphrase."));
+  }
+
+  const Zone* zone = find_zone(context);
+  if (not zone) {
+    return TimeInfoStreams::Reject(
+        Status(StatusCode::NOT_FOUND, "No such zone."));
+  }
+
+  return time_info_streams_.Open(zone->index);
 }
 
 Status PlayerServiceImpl::Authenticate(
@@ -356,14 +1081,20 @@ Status PlayerServiceImpl::Authenticate(
   }
 
   try {
-    auto peer_pubkey = crypto::BytesToEcPoint(
-      reinterpret_cast<const unsigned char*>(data.public_key().data()),
-      data.public_key().size());
-
-    auto zkp = crypto::zkp_deserialize(data.zkp());
-
-    if (not crypto::check_zkp(zkp, peer_pubkey.get(),
-                              server_id, secret.get())) {
+    // The checks are heavy, they run on the auth threads.
+    const bool valid = auth_executor_.Run(
+        [&]{
+          auto peer_pubkey = crypto::BytesToEcPoint(
+              reinterpret_cast<const unsigned char*>(
+                  data.public_key().data()),
+              data.public_key().size());
+
+          auto zkp = crypto::zkp_deserialize(data.zkp());
+
+          return crypto::check_zkp(zkp, peer_pubkey.get(),
+                                   server_id, secret.get());
+        });
+    if (not valid) {
       return deny();
     }
   } catch (const std::exception& e) {
@@ -384,16 +1115,19 @@ Status PlayerServiceImpl::Authenticate(
 
   // Confirm to the client that the server also knows the password.
   try {
-    auto [privkey, pubkey] = crypto::generate_key_pair(secret.get());
-
-    const auto pubkey_bytes = crypto::EcPointToBytes(pubkey.get());
-    data.set_public_key(pubkey_bytes.data(), pubkey_bytes.size());
-
-    ZkpMessage* zkp = new ZkpMessage{
-      crypto::zkp_serialize(
-          crypto::make_zkp(server_id, privkey.get(),
-                           pubkey.get(), secret.get()))};
-    data.set_allocated_zkp(zkp);
+    auth_executor_.Run(
+        [&]{
+          auto [privkey, pubkey] = crypto::generate_key_pair(secret.get());
+
+          const auto pubkey_bytes = crypto::EcPointToBytes(pubkey.get());
+          data.set_public_key(pubkey_bytes.data(), pubkey_bytes.size());
+
+          ZkpMessage* zkp = new ZkpMessage{
+            crypto::zkp_serialize(
+                crypto::make_zkp(server_id, privkey.get(),
+                                 pubkey.get(), secret.get()))};
+          data.set_allocated_zkp(zkp);
+        });
   } catch (const std::exception& e) {
     spdlog::error(
         "Failed to generate authentication data to send to the client {}: {}",
@@ -22,59 +22,228 @@
 #include "player_service.grpc.pb.h"
 
 #include <array>
+#include <map>
+#include <memory>
 #include <set>
+#include <string>
+#include <vector>
 
+#include "AudioCache.h"
 #include "Config.h"
+#include "Executor.h"
 #include "Player.h"
+#include "ReadaheadTuner.h"
+#include "SharedPaths.h"
+#include "StreamSource.h"
+#include "TimeInfoStreams.h"
 #include "Util.h"
 #include "crypto/CryptoUtil.h"
 
 using namespace grpc;
 
 namespace lrm {
-class PlayerServiceImpl : public PlayerService::Service {
-  Player player;
+/// The control RPCs and TimeInfoStream use the callback API, so they don't
+/// hold a thread while waiting for mpv. The rest are synchronous.
+using PlayerServiceBase =
+    PlayerService::WithCallbackMethod_Stop<
+      PlayerService::WithCallbackMethod_TogglePause<
+        PlayerService::WithCallbackMethod_Volume<
+          PlayerService::WithCallbackMethod_Seek<
+            PlayerService::WithCallbackMethod_TimeInfoStream<
+              PlayerService::Service>>>>>;
 
-  bool check_auth(const ServerContext* context) const;
+class PlayerServiceImpl : public PlayerServiceBase {
+  struct UploadSession;
+
+  /// One of the server's outputs, with its own player. The client chooses
+  /// it with the \e x-zone metadata, the first one is the default.
+  struct Zone {
+    /// \param output See Player::Create().
+    Zone(size_t index, std::string name, const std::string& output);
+
+    // Position in zones_ and the zone's number for time_info_streams_.
+    const size_t index;
+    const std::string name;
+    const std::unique_ptr<Player> player;
+    // The upload the player plays from, until it's finished or replaced.
+    // Guarded by uploads_mtx_.
+    std::shared_ptr<UploadSession> playing_upload;
+  };
+
+  /// \return Zones from the \e zones config entry, or a single one playing
+  /// on \e audio_output if it's not set.
+  static std::vector<std::unique_ptr<Zone>> make_zones();
+
+  /// \return Zone named by the client's \e x-zone metadata, or the first
+  /// one if it's not there. Null if there's no such zone.
+  Zone* find_zone(const grpc::ServerContextBase* context) const;
+
+  bool check_auth(const grpc::ServerContextBase* context) const;
+
+  /// \return Player's callback that puts mpv's result into \e response and
+  /// finishes the call.
+  static Player::ReplyCallback finish_with_result(
+      grpc::ServerUnaryReactor* reactor, MpvResponse* response);
+
+  /// \return The current times, volume and buffers of the zone's player,
+  /// for TimeInfoStream.
+  TimeInfoStreams::Snapshot sample_player(size_t zone,
+                                          PlaybackState::State state);
+  /// \return Seconds of audio received from the zone's playing upload that
+  /// the player hasn't read yet, 0 if nothing is uploaded.
+  double upload_buffered_time(size_t zone,
+                              const Player::Properties& properties);
 
   std::string generate_session_key();
 
+  /// Stream received by AudioStream. If the client gave it an id, it's kept
+  /// for a while after a disconnection so the client can resume it.
+  struct UploadSession {
+    // Where it's played.
+    Zone* zone = nullptr;
+    std::shared_ptr<StreamSource> source;
+    std::unique_ptr<AudioCache::Writer> cache_writer;
+    std::mutex cache_writer_mtx;
+    std::atomic<uint64_t> received = 0;
+    // Sets the player's readahead from the stream's jitter. Only for the
+    // streams sent in order by one call that aren't live, null otherwise.
+    std::unique_ptr<ReadaheadTuner> readahead;
+    // Set while an AudioStream call is receiving the data.
+    bool receiving = false;
+    // Size of the file if it's sent in ranges over several calls, 0 if it's
+    // sent in order by one call.
+    uint64_t total_size = 0;
+    std::atomic<bool> finished = false;
+    // Calls receiving the data, and whether a new stream has replaced this
+    // one. Guarded by uploads_mtx_.
+    std::vector<ServerContext*> receivers;
+    bool preempted = false;
+
+    // The client waits for the result of the probe after sending this many
+    // bytes, 0 if it doesn't or it has been sent.
+    uint64_t probe_bytes = 0;
+    // Whether the player could open the stream, unset until it tries.
+    std::optional<bool> loaded;
+    std::mutex load_mtx;
+    std::condition_variable load_cv;
+  };
+
+  /// Wait for the player to open the session's file and tell the client
+  /// the result in the initial metadata ("x-probe": "ok", or "timeout" if
+  /// the player needs more data to decide).
+  /// \return \b INVALID_ARGUMENT if the player can't play it.
+  Status probe(ServerContext* context, ServerReader<AudioData>* reader,
+               UploadSession* session);
+
+  /// Receive the data from \e reader into \e session, skipping the first
+  /// \e skip bytes. If the session has ranges, the data is written at
+  /// \e range_offset. Only the copying runs on stream_executor_. The call
+  /// can be cancelled by preempt_upload() until it returns.
+  /// \return \b CANCELLED if the client disconnected or the session was
+  /// preempted.
+  Status receive_stream(ServerContext* context,
+                        ServerReader<AudioData>* reader,
+                        UploadSession* session,
+                        uint64_t skip,
+                        uint64_t range_offset = 0);
+  Status copy_stream(ServerContext* context,
+                     ServerReader<AudioData>* reader,
+                     UploadSession* session,
+                     uint64_t skip,
+                     uint64_t range_offset);
+  /// Make \e successor the upload playing in \e zone. The previous one
+  /// stops: its calls are cancelled, so their clients stop sending at once,
+  /// and its source is closed. \e successor is null if something else
+  /// plays now.
+  void preempt_upload(Zone* zone,
+                      std::shared_ptr<UploadSession> successor = nullptr);
+  /// End the stream for the player and add it to the cache if it's
+  /// complete. Called once for every session, when the last call
+  /// receiving it finishes.
+  void finish_upload(const std::string& id, UploadSession* session,
+                     bool complete);
+  void remove_upload(const std::string& id, const UploadSession* session);
+
+  /// \return Hash from the client's \e x-content-hash metadata.
+  std::optional<ContentHash> content_hash(const ServerContext* context) const;
+  /// Find the file with the hash in \e audio in the cache.
+  /// \return Status to return to the client if the file wasn't found.
+  Status find_cached(const CachedAudio* audio, fs::path* path);
+
  public:
   PlayerServiceImpl();
-  virtual ~PlayerServiceImpl();
 
   Status AudioStream(ServerContext* context,
                      ServerReader<AudioData>* reader,
                      MpvResponse *response);
 
-  Status Stop(ServerContext* context,
-              const Empty*,
-              MpvResponse* response);
+  Status AudioRange(ServerContext* context,
+                    ServerReader<AudioData>* reader,
+                    MpvResponse* response);
 
-  Status TogglePause(ServerContext* context,
-                     const Empty*,
-                     MpvResponse* response);
+  Status UploadStatus(ServerContext* context,
+                      const UploadId* id,
+                      UploadOffset* offset);
 
-  Status Volume(ServerContext* context,
-                const VolumeMessage* volume,
-                MpvResponse* response);
+  Status PlayCached(ServerContext* context,
+                    const CachedAudio* audio,
+                    MpvResponse* response);
 
-  Status Seek(ServerContext* context,
-              const SeekMessage* seek,
-              MpvResponse* response);
+  Status PlayByReference(ServerContext* context,
+                         const MediaReference* reference,
+                         MpvResponse* response);
+
+  Status Prefetch(ServerContext* context,
+                  ServerReader<AudioData>* reader,
+                  MpvResponse* response);
+
+  Status Enqueue(ServerContext* context,
+                 const CachedAudio* audio,
+                 MpvResponse* response);
+
+  Status ClearQueue(ServerContext* context,
+                    const Empty*,
+                    MpvResponse* response);
+
+  Status ListQueue(ServerContext* context,
+                   const Empty*,
+                   QueueList* queue);
+
+  grpc::ServerUnaryReactor* Stop(grpc::CallbackServerContext* context,
+                                 const Empty*,
+                                 MpvResponse* response) override;
+
+  grpc::ServerUnaryReactor* TogglePause(
+      grpc::CallbackServerContext* context,
+      const Empty*,
+      MpvResponse* response) override;
+
+  grpc::ServerUnaryReactor* Volume(grpc::CallbackServerContext* context,
+                                   const VolumeMessage* volume,
+                                   MpvResponse* response) override;
+
+  grpc::ServerUnaryReactor* Seek(grpc::CallbackServerContext* context,
+                                 const SeekMessage* seek,
+                                 MpvResponse* response) override;
 
   Status Ping(ServerContext* context,
               const Empty*,
               Empty*);
 
-  Status TimeInfoStream(ServerContext* context,
-                        ServerReaderWriter<TimeInfo, TimeInterval>*
-                        stream);
+  Status GetCapabilities(ServerContext* context,
+                         const Empty*,
+                         Capabilities* capabilities);
+
+  TimeInfoStreams::Reactor* TimeInfoStream(
+      grpc::CallbackServerContext* context) override;
 
   Status Authenticate(ServerContext* context,
                       ServerReaderWriter<AuthData, AuthData>* stream);
 
  private:
+  // Never empty. Destroyed last, the rest may still use the players.
+  const std::vector<std::unique_ptr<Zone>> zones_;
+
   // TODO: Would be cool if it could be static, but the config isn't being
   //       initialized at static time, so it could return empty passphrase.
   const crypto::EcPoint secret =
@@ -91,11 +260,31 @@ class PlayerServiceImpl : public PlayerService::Service {
   std::set<std::string> authenticated_sessions_;
   std::mutex sessions_mtx_;
 
-  // Variables for TimeInfoBidiStream
-  PlaybackState::State playback_state_ = PlaybackState::UNDEFINED;
-  std::mutex playback_state_mtx_;
-  std::condition_variable playback_state_cv_;
-  // End of variables for TimeInfoBidiStream
+  // Null if the cache is disabled.
+  std::unique_ptr<AudioCache> cache_;
+
+  // Where PlayByReference() can play files from.
+  SharedRoots shared_roots_;
+
+  // Uploads by their id.
+  std::map<std::string, std::shared_ptr<UploadSession>> uploads_;
+  std::mutex uploads_mtx_;
+  std::condition_variable uploads_cv_;
+
+  // Threads for the uploads and for the authentication checks. The control
+  // RPCs use the callback API and the rest run on gRPC's own threads. Only
+  // the work itself runs on them: an upload waiting for its session, for a
+  // resumption or for its client to come back doesn't take a thread, so
+  // the waiting calls can't starve the ones they wait for.
+  Executor stream_executor_;
+  Executor auth_executor_;
+
+  // Destroyed first, its thread uses the players.
+  TimeInfoStreams time_info_streams_{
+    [this](size_t zone, PlaybackState::State state) {
+      return sample_player(zone, state);
+    },
+    zones_.size()};
 };
 }
 
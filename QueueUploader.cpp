@@ -0,0 +1,112 @@
+// Copyright (C) 2020 by Jakub Wojciech
+
+// This file is part of Lelo Remote Music Player.
+
+// Lelo Remote Music Player is free software: you can redistribute it
+// and/or modify it under the terms of the GNU General Public License
+// as published by the Free Software Foundation, either version 3 of
+// the License, or (at your option) any later version.
+
+// Lelo Remote Music Player is distributed in the hope that it will be
+// useful, but WITHOUT ANY WARRANTY; without even the implied warranty
+// of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+// General Public License for more details.
+
+// You should have received a copy of the GNU General Public License
+// along with Lelo Remote Music Player. If not, see
+// <https://www.gnu.org/licenses/>.
+
+#include "QueueUploader.h"
+
+namespace lrm {
+QueueUploader::QueueUploader(PlayerClient* client, size_t prefetch_count,
+                             std::chrono::milliseconds poll_interval)
+    : client_(client), prefetch_count_(std::max<size_t>(prefetch_count, 1)),
+      poll_interval_(poll_interval),
+      log_(spdlog::get("PlayerClient")) {
+  upload_thread_ = std::thread(&QueueUploader::upload_loop, this);
+}
+
+QueueUploader::~QueueUploader() {
+  {
+    std::lock_guard<std::mutex> lck(mtx_);
+    running_ = false;
+  }
+  cv_.notify_all();
+  if (upload_thread_.joinable()) {
+    upload_thread_.join();
+  }
+}
+
+void QueueUploader::Add(std::string_view filename) {
+  {
+    std::lock_guard<std::mutex> lck(mtx_);
+    pending_.emplace_back(filename);
+  }
+  cv_.notify_all();
+}
+
+void QueueUploader::Clear() {
+  std::lock_guard<std::mutex> lck(mtx_);
+  pending_.clear();
+  ++generation_;
+}
+
+std::vector<std::string> QueueUploader::Pending() const {
+  std::lock_guard<std::mutex> lck(mtx_);
+  return {pending_.begin(), pending_.end()};
+}
+
+void QueueUploader::upload_loop() {
+  std::unique_lock<std::mutex> lck(mtx_);
+  while (running_) {
+    cv_.wait(lck, [this]{ return not running_ or not pending_.empty(); });
+    if (not running_) {
+      break;
+    }
+
+    lck.unlock();
+    const bool server_full = server_queue_ahead() >= prefetch_count_;
+    lck.lock();
+
+    if (server_full) {
+      // The server will need the next file only after this one starts.
+      cv_.wait_for(lck, poll_interval_, [this]{ return not running_; });
+      continue;
+    }
+    if (pending_.empty()) {
+      // Cleared in the meantime.
+      continue;
+    }
+
+    const std::string filename = pending_.front();
+    const uint64_t generation = generation_;
+    lck.unlock();
+    try {
+      client_->Enqueue(filename);
+    } catch (const grpc::Status& status) {
+      log_->error("Couldn't enqueue '{}': {}", filename,
+                  status.error_message());
+    } catch (const std::exception& e) {
+      log_->error("Couldn't enqueue '{}': {}", filename, e.what());
+    }
+    lck.lock();
+
+    if (generation == generation_) {
+      pending_.pop_front();
+    }
+  }
+}
+
+size_t QueueUploader::server_queue_ahead() {
+  try {
+    int current;
+    const auto queue = client_->ListQueue(&current);
+    return queue.size() - std::min<size_t>(queue.size(), current + 1);
+  } catch (const grpc::Status& status) {
+    log_->warn("Couldn't get the play queue: {}", status.error_message());
+    // Don't send anything until the server answers again.
+    return prefetch_count_;
+  }
+}
+}
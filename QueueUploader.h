@@ -0,0 +1,81 @@
+// Copyright (C) 2020 by Jakub Wojciech
+
+// This file is part of Lelo Remote Music Player.
+
+// Lelo Remote Music Player is free software: you can redistribute it
+// and/or modify it under the terms of the GNU General Public License
+// as published by the Free Software Foundation, either version 3 of
+// the License, or (at your option) any later version.
+
+// Lelo Remote Music Player is distributed in the hope that it will be
+// useful, but WITHOUT ANY WARRANTY; without even the implied warranty
+// of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+// General Public License for more details.
+
+// You should have received a copy of the GNU General Public License
+// along with Lelo Remote Music Player. If not, see
+// <https://www.gnu.org/licenses/>.
+
+#ifndef LRM_QUEUEUPLOADER_H_
+#define LRM_QUEUEUPLOADER_H_
+
+#include <chrono>
+#include <condition_variable>
+#include <deque>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "spdlog/spdlog.h"
+
+#include "PlayerClient.h"
+
+namespace lrm {
+/// Adds files to the server's play queue in the background.
+///
+/// The files are sent ahead of time, but only so many that the server has
+/// \e prefetch_count files waiting after the playing one. That's enough
+/// for gapless transitions without filling the server's cache with the
+/// whole queue at once.
+class QueueUploader {
+ public:
+  QueueUploader(PlayerClient* client, size_t prefetch_count,
+                std::chrono::milliseconds poll_interval =
+                std::chrono::milliseconds(1000));
+  ~QueueUploader();
+
+  QueueUploader(const QueueUploader&) = delete;
+  QueueUploader& operator=(const QueueUploader&) = delete;
+
+  void Add(std::string_view filename);
+  /// Drop the files that weren't sent to the server yet.
+  void Clear();
+  /// \return Files that weren't sent to the server yet.
+  std::vector<std::string> Pending() const;
+
+ private:
+  void upload_loop();
+  /// \return How many files are waiting on the server after the playing
+  /// one.
+  size_t server_queue_ahead();
+
+  PlayerClient* client_;
+  const size_t prefetch_count_;
+  const std::chrono::milliseconds poll_interval_;
+
+  // The front one is being sent while the mutex is released.
+  std::deque<std::string> pending_;
+  // Bumped by Clear(), so the file being sent isn't removed afterwards
+  // from what was added after it.
+  uint64_t generation_ = 0;
+  bool running_ = true;
+  mutable std::mutex mtx_;
+  std::condition_variable cv_;
+  std::thread upload_thread_;
+
+  std::shared_ptr<spdlog::logger> log_;
+};
+}
+
+#endif  // LRM_QUEUEUPLOADER_H_
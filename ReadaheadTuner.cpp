@@ -0,0 +1,61 @@
+// Copyright (C) 2020 by Jakub Wojciech
+
+// This file is part of Lelo Remote Music Player.
+
+// Lelo Remote Music Player is free software: you can redistribute it
+// and/or modify it under the terms of the GNU General Public License
+// as published by the Free Software Foundation, either version 3 of
+// the License, or (at your option) any later version.
+
+// Lelo Remote Music Player is distributed in the hope that it will be
+// useful, but WITHOUT ANY WARRANTY; without even the implied warranty
+// of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+// General Public License for more details.
+
+// You should have received a copy of the GNU General Public License
+// along with Lelo Remote Music Player. If not, see
+// <https://www.gnu.org/licenses/>.
+
+
+#include "ReadaheadTuner.h"
+
+#include <algorithm>
+#include <cmath>
+#include <utility>
+
+namespace lrm {
+ReadaheadTuner::ReadaheadTuner(double base, double max)
+    : base_(base), max_(std::max(base, max)), readahead_(base) {}
+
+bool ReadaheadTuner::Arrived(std::chrono::steady_clock::time_point now) {
+  const auto last = std::exchange(last_arrival_, now);
+  if (not last) {
+    return false;
+  }
+
+  const double gap = std::chrono::duration<double>(now - *last).count();
+  if (gap > max_) {
+    return false;
+  }
+  if (not has_mean_) {
+    has_mean_ = true;
+    mean_gap_ = gap;
+    return false;
+  }
+
+  stall_ *= std::exp2(-gap / std::chrono::duration<double>(
+      HALF_LIFE).count());
+  stall_ = std::max(stall_, gap - mean_gap_);
+  jitter_ += (std::abs(gap - mean_gap_) - jitter_) * GAIN;
+  mean_gap_ += (gap - mean_gap_) * GAIN;
+
+  // Whole steps, so it doesn't change with every message.
+  const double extra = std::round(MARGIN * std::max(jitter_, stall_) / STEP);
+  const double readahead = std::min(base_ + extra * STEP, max_);
+  if (readahead == readahead_) {
+    return false;
+  }
+  readahead_ = readahead;
+  return true;
+}
+}
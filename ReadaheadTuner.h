@@ -0,0 +1,84 @@
+// Copyright (C) 2020 by Jakub Wojciech
+
+// This file is part of Lelo Remote Music Player.
+
+// Lelo Remote Music Player is free software: you can redistribute it
+// and/or modify it under the terms of the GNU General Public License
+// as published by the Free Software Foundation, either version 3 of
+// the License, or (at your option) any later version.
+
+// Lelo Remote Music Player is distributed in the hope that it will be
+// useful, but WITHOUT ANY WARRANTY; without even the implied warranty
+// of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+// General Public License for more details.
+
+// You should have received a copy of the GNU General Public License
+// along with Lelo Remote Music Player. If not, see
+// <https://www.gnu.org/licenses/>.
+
+
+#ifndef LRM_READAHEADTUNER_H_
+#define LRM_READAHEADTUNER_H_
+
+#include <chrono>
+#include <optional>
+
+namespace lrm {
+/// Chooses how far ahead of the playback the player reads a stream, from
+/// how irregularly the stream's data arrives.
+///
+/// The jitter is the smoothed difference between the gaps between the
+/// messages and their mean, like RFC 3550's interarrival jitter but without
+/// the sender's timestamps. A single stall, e.g. when Wi-Fi drops for a few
+/// seconds, barely moves it, so the tuner also keeps the longest recent
+/// stall, which fades away with HALF_LIFE. The readahead is the base plus
+/// MARGIN times the larger of the two, in whole STEPs.
+///
+/// Gaps longer than the maximum readahead can't be covered anyway. They're
+/// taken as the client waiting on purpose, e.g. while the playback is
+/// paused, and ignored.
+class ReadaheadTuner {
+ public:
+  /// Weight of a new gap in the smoothed mean and jitter.
+  static constexpr double GAIN = 1.0 / 16;
+  static constexpr double MARGIN = 2;
+  static constexpr std::chrono::seconds HALF_LIFE{60};
+  /// The readahead changes in steps of that many seconds.
+  static constexpr double STEP = 1;
+
+  /// \param base Readahead in seconds for a stream that arrives regularly.
+  /// \param max The most it's raised to.
+  ReadaheadTuner(double base, double max);
+
+  /// Note that a message has arrived at \e now.
+  /// \return \b true if Readahead() has changed.
+  bool Arrived(std::chrono::steady_clock::time_point now =
+               std::chrono::steady_clock::now());
+
+  /// \return The readahead in seconds, always in [base; max].
+  inline double Readahead() const {
+    return readahead_;
+  }
+  /// \return Smoothed jitter of the gaps in seconds.
+  inline double Jitter() const {
+    return jitter_;
+  }
+  /// \return Longest recent gap above the mean in seconds, faded.
+  inline double Stall() const {
+    return stall_;
+  }
+
+ private:
+  const double base_;
+  const double max_;
+
+  std::optional<std::chrono::steady_clock::time_point> last_arrival_;
+  bool has_mean_ = false;
+  double mean_gap_ = 0;
+  double jitter_ = 0;
+  double stall_ = 0;
+  double readahead_;
+};
+}
+
+#endif  // LRM_READAHEADTUNER_H_
@@ -0,0 +1,152 @@
+// Copyright (C) 2020 by Jakub Wojciech
+
+// This file is part of Lelo Remote Music Player.
+
+// Lelo Remote Music Player is free software: you can redistribute it
+// and/or modify it under the terms of the GNU General Public License
+// as published by the Free Software Foundation, either version 3 of
+// the License, or (at your option) any later version.
+
+// Lelo Remote Music Player is distributed in the hope that it will be
+// useful, but WITHOUT ANY WARRANTY; without even the implied warranty
+// of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+// General Public License for more details.
+
+// You should have received a copy of the GNU General Public License
+// along with Lelo Remote Music Player. If not, see
+// <https://www.gnu.org/licenses/>.
+
+#include "RingBuffer.h"
+
+#include <algorithm>
+#include <cstring>
+
+namespace lrm {
+namespace {
+size_t round_up_to_power_of_2(size_t value) {
+  size_t result = 1;
+  while (result < value) {
+    result <<= 1;
+  }
+  return result;
+}
+}
+
+RingBuffer::RingBuffer(size_t capacity)
+    : capacity_(round_up_to_power_of_2(std::max<size_t>(capacity, 1))),
+      data_(new char[capacity_]) {}
+
+size_t RingBuffer::Write(const char* data, size_t size) {
+  size_t written = 0;
+
+  while (written < size) {
+    const size_t head = head_.load(std::memory_order_relaxed);
+    size_t free_space = capacity_ - (head - tail_.load());
+
+    if (0 == free_space) {
+      // Announce the wait before checking again, so the reader either sees
+      // the flag or this side sees the space it has freed.
+      writer_waiting_ = true;
+      std::unique_lock<std::mutex> lck(mtx_);
+      ++writer_stalls_;
+      cv_.wait(lck, [&]{
+                      return cancelled_ or
+                          capacity_ - (head - tail_.load()) > 0;
+                    });
+      writer_waiting_ = false;
+      if (cancelled_) {
+        break;
+      }
+      continue;
+    }
+    if (cancelled_) {
+      break;
+    }
+
+    const size_t to_write = std::min(size - written, free_space);
+    const size_t position = head & (capacity_ - 1);
+    const size_t first_part = std::min(to_write, capacity_ - position);
+    std::memcpy(data_.get() + position, data + written, first_part);
+    std::memcpy(data_.get(), data + written + first_part,
+                to_write - first_part);
+
+    head_.store(head + to_write);
+    written += to_write;
+    wake(&reader_waiting_);
+  }
+
+  return written;
+}
+
+int64_t RingBuffer::Read(char* data, size_t size) {
+  if (0 == size) {
+    return 0;
+  }
+
+  for (;;) {
+    if (cancelled_) {
+      return -1;
+    }
+
+    const size_t tail = tail_.load(std::memory_order_relaxed);
+    const size_t available = head_.load() - tail;
+
+    if (0 == available) {
+      if (write_closed_ and head_.load() == tail) {
+        return 0;
+      }
+      reader_waiting_ = true;
+      std::unique_lock<std::mutex> lck(mtx_);
+      ++reader_stalls_;
+      cv_.wait(lck, [&]{
+                      return cancelled_ or write_closed_ or
+                          head_.load() != tail;
+                    });
+      reader_waiting_ = false;
+      continue;
+    }
+
+    const size_t to_read = std::min(size, available);
+    const size_t position = tail & (capacity_ - 1);
+    const size_t first_part = std::min(to_read, capacity_ - position);
+    std::memcpy(data, data_.get() + position, first_part);
+    std::memcpy(data + first_part, data_.get(), to_read - first_part);
+
+    tail_.store(tail + to_read);
+    wake(&writer_waiting_);
+
+    return to_read;
+  }
+}
+
+void RingBuffer::CloseWrite() {
+  write_closed_ = true;
+  std::lock_guard<std::mutex> lck(mtx_);
+  cv_.notify_all();
+}
+
+void RingBuffer::Cancel() {
+  cancelled_ = true;
+  std::lock_guard<std::mutex> lck(mtx_);
+  cv_.notify_all();
+}
+
+RingBuffer::Stats RingBuffer::GetStats() const {
+  Stats stats;
+  stats.bytes_written = head_;
+  stats.bytes_read = tail_;
+  stats.writer_stalls = writer_stalls_;
+  stats.reader_stalls = reader_stalls_;
+  return stats;
+}
+
+void RingBuffer::wake(std::atomic<bool>* waiting) {
+  // The other side sleeps only after setting the flag, so it's enough to
+  // take the lock when it's set. Taking it orders the notification after
+  // the other side's predicate check.
+  if (*waiting) {
+    std::lock_guard<std::mutex> lck(mtx_);
+    cv_.notify_all();
+  }
+}
+}
@@ -0,0 +1,86 @@
+// Copyright (C) 2020 by Jakub Wojciech
+
+// This file is part of Lelo Remote Music Player.
+
+// Lelo Remote Music Player is free software: you can redistribute it
+// and/or modify it under the terms of the GNU General Public License
+// as published by the Free Software Foundation, either version 3 of
+// the License, or (at your option) any later version.
+
+// Lelo Remote Music Player is distributed in the hope that it will be
+// useful, but WITHOUT ANY WARRANTY; without even the implied warranty
+// of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+// General Public License for more details.
+
+// You should have received a copy of the GNU General Public License
+// along with Lelo Remote Music Player. If not, see
+// <https://www.gnu.org/licenses/>.
+
+#ifndef LRM_RINGBUFFER_H_
+#define LRM_RINGBUFFER_H_
+
+#include <atomic>
+#include <condition_variable>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+
+#include "StreamSource.h"
+
+namespace lrm {
+/// Single-producer, single-consumer byte ring buffer.
+///
+/// The data path is lock-free: the writer and the reader only touch their
+/// own index and the bytes between them. The mutex is used only to put one
+/// side to sleep when the buffer is full or empty.
+class RingBuffer : public StreamSource {
+ public:
+  /// \param capacity Size of the buffer. It's rounded up to a power of 2.
+  explicit RingBuffer(size_t capacity);
+
+  RingBuffer(const RingBuffer&) = delete;
+  RingBuffer& operator=(const RingBuffer&) = delete;
+
+  size_t Write(const char* data, size_t size) override;
+  int64_t Read(char* data, size_t size) override;
+  void CloseWrite() override;
+  void Cancel() override;
+
+  inline bool IsCancelled() const override {
+    return cancelled_;
+  }
+
+  /// \return Number of bytes waiting to be read.
+  inline size_t Size() const {
+    return head_.load() - tail_.load();
+  }
+  inline size_t Capacity() const {
+    return capacity_;
+  }
+
+  Stats GetStats() const override;
+
+ private:
+  void wake(std::atomic<bool>* waiting);
+
+  const size_t capacity_;
+  const std::unique_ptr<char[]> data_;
+
+  // Both indices only grow, the position in data_ is index & (capacity_ - 1).
+  // They're on separate cache lines so the two sides don't share one.
+  alignas(64) std::atomic<size_t> head_ = 0;
+  alignas(64) std::atomic<size_t> tail_ = 0;
+
+  alignas(64) std::atomic<bool> write_closed_ = false;
+  std::atomic<bool> cancelled_ = false;
+  std::atomic<bool> reader_waiting_ = false;
+  std::atomic<bool> writer_waiting_ = false;
+  std::atomic<uint64_t> writer_stalls_ = 0;
+  std::atomic<uint64_t> reader_stalls_ = 0;
+
+  std::mutex mtx_;
+  std::condition_variable cv_;
+};
+}
+
+#endif  // LRM_RINGBUFFER_H_
@@ -0,0 +1,106 @@
+// Copyright (C) 2020 by Jakub Wojciech
+
+// This file is part of Lelo Remote Music Player.
+
+// Lelo Remote Music Player is free software: you can redistribute it
+// and/or modify it under the terms of the GNU General Public License
+// as published by the Free Software Foundation, either version 3 of
+// the License, or (at your option) any later version.
+
+// Lelo Remote Music Player is distributed in the hope that it will be
+// useful, but WITHOUT ANY WARRANTY; without even the implied warranty
+// of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+// General Public License for more details.
+
+// You should have received a copy of the GNU General Public License
+// along with Lelo Remote Music Player. If not, see
+// <https://www.gnu.org/licenses/>.
+
+
+#ifndef LRM_SEQLOCK_H_
+#define LRM_SEQLOCK_H_
+
+#include <atomic>
+#include <cstdint>
+#include <cstring>
+#include <thread>
+#include <type_traits>
+
+namespace lrm {
+/// Single-writer sequence lock holding a copy of \e T.
+///
+/// Readers never block the writer and never take a lock: they copy the
+/// value and retry if the writer changed it in the meantime. It's meant for
+/// small values that are read much more often than they're written.
+///
+/// The value is kept in relaxed atomic words, so the readers' copies don't
+/// race with the writer even when they have to be thrown away.
+template <typename T>
+class SeqLock {
+  static_assert(std::is_trivially_copyable_v<T>,
+                "SeqLock needs a trivially copyable type");
+
+ public:
+  explicit SeqLock(const T& value = T{}) {
+    Store(value);
+  }
+
+  SeqLock(const SeqLock&) = delete;
+  SeqLock& operator=(const SeqLock&) = delete;
+
+  /// Replace the value. Only one thread may call it.
+  void Store(const T& value) {
+    uint64_t words[WORDS] = {};
+    std::memcpy(words, &value, sizeof(T));
+
+    const uint64_t sequence = sequence_.load(std::memory_order_relaxed);
+    // Odd while writing.
+    sequence_.store(sequence + 1, std::memory_order_relaxed);
+    std::atomic_thread_fence(std::memory_order_release);
+    for (size_t i = 0; i < WORDS; ++i) {
+      words_[i].store(words[i], std::memory_order_relaxed);
+    }
+    sequence_.store(sequence + 2, std::memory_order_release);
+  }
+
+  /// Change the value in place. Only the writer may call it.
+  template <typename Function>
+  void Update(Function&& function) {
+    T value = Load();
+    function(value);
+    Store(value);
+  }
+
+  /// \return Copy of the value from a single Store().
+  T Load() const {
+    uint64_t words[WORDS];
+    for (;;) {
+      const uint64_t before = sequence_.load(std::memory_order_acquire);
+      if (before & 1) {
+        std::this_thread::yield();
+        continue;
+      }
+      for (size_t i = 0; i < WORDS; ++i) {
+        words[i] = words_[i].load(std::memory_order_relaxed);
+      }
+      std::atomic_thread_fence(std::memory_order_acquire);
+      if (sequence_.load(std::memory_order_relaxed) == before) {
+        break;
+      }
+    }
+
+    T value;
+    std::memcpy(&value, words, sizeof(T));
+    return value;
+  }
+
+ private:
+  static constexpr size_t WORDS =
+      (sizeof(T) + sizeof(uint64_t) - 1) / sizeof(uint64_t);
+
+  std::atomic<uint64_t> sequence_ = 0;
+  std::atomic<uint64_t> words_[WORDS];
+};
+}
+
+#endif  // LRM_SEQLOCK_H_
@@ -0,0 +1,68 @@
+// Copyright (C) 2020 by Jakub Wojciech
+
+// This file is part of Lelo Remote Music Player.
+
+// Lelo Remote Music Player is free software: you can redistribute it
+// and/or modify it under the terms of the GNU General Public License
+// as published by the Free Software Foundation, either version 3 of
+// the License, or (at your option) any later version.
+
+// Lelo Remote Music Player is distributed in the hope that it will be
+// useful, but WITHOUT ANY WARRANTY; without even the implied warranty
+// of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+// General Public License for more details.
+
+// You should have received a copy of the GNU General Public License
+// along with Lelo Remote Music Player. If not, see
+// <https://www.gnu.org/licenses/>.
+
+
+#include "ServerClock.h"
+
+#include <algorithm>
+
+namespace lrm {
+namespace {
+std::chrono::microseconds since_epoch(ServerClock::Clock::time_point time) {
+  return std::chrono::duration_cast<std::chrono::microseconds>(
+      time.time_since_epoch());
+}
+}
+
+void ServerClock::AddSample(Clock::time_point sent,
+                            std::chrono::microseconds hold,
+                            std::chrono::microseconds server_time,
+                            Clock::time_point received) {
+  const auto round_trip = std::max(
+      std::chrono::duration_cast<std::chrono::microseconds>(
+          received - sent) - hold,
+      std::chrono::microseconds(0));
+  // The server's time is from when it sent the reply, half of the round
+  // trip before it arrived.
+  const auto offset = server_time - (since_epoch(received) - round_trip / 2);
+
+  samples_.push_back({round_trip, offset});
+  if (samples_.size() > WINDOW) {
+    samples_.pop_front();
+  }
+  best_ = *std::min_element(
+      samples_.begin(), samples_.end(),
+      [](const Sample& a, const Sample& b) {
+        return a.round_trip < b.round_trip;
+      });
+}
+
+std::chrono::microseconds ServerClock::RoundTrip() const {
+  return best_.round_trip;
+}
+
+ServerClock::Clock::time_point ServerClock::ToLocal(
+    std::chrono::microseconds server_time,
+    Clock::time_point fallback) const {
+  if (not IsSynchronized()) {
+    return fallback;
+  }
+  return Clock::time_point(
+      std::chrono::duration_cast<Clock::duration>(server_time - best_.offset));
+}
+}
@@ -0,0 +1,77 @@
+// Copyright (C) 2020 by Jakub Wojciech
+
+// This file is part of Lelo Remote Music Player.
+
+// Lelo Remote Music Player is free software: you can redistribute it
+// and/or modify it under the terms of the GNU General Public License
+// as published by the Free Software Foundation, either version 3 of
+// the License, or (at your option) any later version.
+
+// Lelo Remote Music Player is distributed in the hope that it will be
+// useful, but WITHOUT ANY WARRANTY; without even the implied warranty
+// of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+// General Public License for more details.
+
+// You should have received a copy of the GNU General Public License
+// along with Lelo Remote Music Player. If not, see
+// <https://www.gnu.org/licenses/>.
+
+
+#ifndef LRM_SERVERCLOCK_H_
+#define LRM_SERVERCLOCK_H_
+
+#include <chrono>
+#include <cstddef>
+#include <deque>
+
+namespace lrm {
+/// Maps the server's monotonic clock onto the client's one.
+///
+/// It's estimated from round trips: the client sends its time, the server
+/// echoes it with its own time and how long it held the message. Assuming
+/// the network delay is the same both ways, the server's time was taken
+/// half of the round trip before the reply arrived. The sample with the
+/// shortest round trip of the last WINDOW ones is used, it has the least
+/// room for asymmetric delays.
+class ServerClock {
+ public:
+  using Clock = std::chrono::steady_clock;
+
+  static constexpr size_t WINDOW = 8;
+
+  /// Add a round trip.
+  /// \param sent Client's time when the request was sent.
+  /// \param hold How long the server held the request before
+  /// \e server_time.
+  /// \param server_time Server's clock in the reply.
+  /// \param received Client's time when the reply arrived.
+  void AddSample(Clock::time_point sent, std::chrono::microseconds hold,
+                 std::chrono::microseconds server_time,
+                 Clock::time_point received);
+
+  /// \return \b true if there's at least one sample.
+  inline bool IsSynchronized() const {
+    return not samples_.empty();
+  }
+
+  /// \return Round trip of the sample in use, without the server's hold.
+  std::chrono::microseconds RoundTrip() const;
+
+  /// \return Client's time when the server's clock showed \e server_time.
+  /// \e fallback if there are no samples yet.
+  Clock::time_point ToLocal(std::chrono::microseconds server_time,
+                            Clock::time_point fallback) const;
+
+ private:
+  struct Sample {
+    std::chrono::microseconds round_trip;
+    /// Server's clock minus the client's one.
+    std::chrono::microseconds offset;
+  };
+
+  std::deque<Sample> samples_;
+  Sample best_{};
+};
+}
+
+#endif  // LRM_SERVERCLOCK_H_
@@ -0,0 +1,175 @@
+// Copyright (C) 2020 by Jakub Wojciech
+
+// This file is part of Lelo Remote Music Player.
+
+// Lelo Remote Music Player is free software: you can redistribute it
+// and/or modify it under the terms of the GNU General Public License
+// as published by the Free Software Foundation, either version 3 of
+// the License, or (at your option) any later version.
+
+// Lelo Remote Music Player is distributed in the hope that it will be
+// useful, but WITHOUT ANY WARRANTY; without even the implied warranty
+// of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+// General Public License for more details.
+
+// You should have received a copy of the GNU General Public License
+// along with Lelo Remote Music Player. If not, see
+// <https://www.gnu.org/licenses/>.
+
+
+#include "SharedPaths.h"
+
+#include <algorithm>
+#include <cctype>
+#include <stdexcept>
+
+namespace lrm {
+namespace {
+/// \return \b true if \e path is \e root or inside it. Both must be
+/// normalized.
+bool is_under(const fs::path& path, const fs::path& root) {
+  auto root_it = root.begin();
+  auto path_it = path.begin();
+  for (; root_it != root.end(); ++root_it, ++path_it) {
+    // A trailing separator makes an empty last element.
+    if (root_it->empty()) {
+      continue;
+    }
+    if (path_it == path.end() or *path_it != *root_it) {
+      return false;
+    }
+  }
+  return true;
+}
+
+std::string with_trailing_slash(std::string_view uri) {
+  std::string result(uri);
+  if (result.back() != '/') {
+    result += '/';
+  }
+  return result;
+}
+
+/// \return \b true if \e uri has a "..", also percent-encoded, anywhere in
+/// its path.
+bool has_parent_segment(std::string_view uri) {
+  std::string lower(uri);
+  std::transform(lower.begin(), lower.end(), lower.begin(),
+                 [](unsigned char c){ return std::tolower(c); });
+  if (lower.find("%2e") != std::string::npos) {
+    return true;
+  }
+
+  for (size_t pos = lower.find(".."); pos != std::string::npos;
+       pos = lower.find("..", pos + 1)) {
+    const bool starts = 0 == pos or '/' == lower[pos - 1];
+    const bool ends = pos + 2 == lower.size() or '/' == lower[pos + 2] or
+                      '?' == lower[pos + 2] or '#' == lower[pos + 2];
+    if (starts and ends) {
+      return true;
+    }
+  }
+  return false;
+}
+}
+
+bool is_uri(std::string_view reference) {
+  const auto colon = reference.find("://");
+  if (colon == std::string_view::npos or 0 == colon or
+      not std::isalpha(static_cast<unsigned char>(reference[0]))) {
+    return false;
+  }
+  return std::all_of(reference.begin(), reference.begin() + colon,
+                     [](unsigned char c){
+                       return std::isalnum(c) or '+' == c or '-' == c or
+                           '.' == c;
+                     });
+}
+
+SharedRoots::SharedRoots(const std::vector<std::string>& roots) {
+  for (const auto& root : roots) {
+    if (root.empty()) {
+      continue;
+    }
+    if (is_uri(root)) {
+      uri_prefixes_.push_back(with_trailing_slash(root));
+    } else {
+      directories_.push_back(fs::weakly_canonical(fs::absolute(root)));
+    }
+  }
+}
+
+std::optional<std::string>
+SharedRoots::Resolve(std::string_view reference) const {
+  if (reference.empty()) {
+    return std::nullopt;
+  }
+
+  if (is_uri(reference)) {
+    if (has_parent_segment(reference)) {
+      return std::nullopt;
+    }
+    for (const auto& prefix : uri_prefixes_) {
+      if (reference.substr(0, prefix.size()) == prefix) {
+        return std::string(reference);
+      }
+    }
+    return std::nullopt;
+  }
+
+  // Only absolute paths, the server's working directory means nothing to
+  // the client.
+  const fs::path path(reference);
+  if (not path.is_absolute()) {
+    return std::nullopt;
+  }
+  std::error_code ec;
+  const auto canonical = fs::weakly_canonical(path, ec);
+  if (ec) {
+    return std::nullopt;
+  }
+  for (const auto& directory : directories_) {
+    if (is_under(canonical, directory)) {
+      return canonical.string();
+    }
+  }
+  return std::nullopt;
+}
+
+SharedPrefixes::SharedPrefixes(const std::vector<std::string>& mappings) {
+  for (const auto& mapping : mappings) {
+    if (mapping.empty()) {
+      continue;
+    }
+    const auto equals = mapping.find('=');
+    if (equals == std::string::npos or 0 == equals or
+        mapping.size() - 1 == equals) {
+      throw std::invalid_argument("Shared prefix '" + mapping +
+                                  "' is not in the form LOCAL=REMOTE");
+    }
+    prefixes_.emplace_back(
+        fs::absolute(mapping.substr(0, equals)).lexically_normal(),
+        mapping.substr(equals + 1));
+  }
+}
+
+std::optional<std::string> SharedPrefixes::Map(std::string_view file) const {
+  std::error_code ec;
+  const auto path = fs::absolute(fs::path(file), ec).lexically_normal();
+  if (ec) {
+    return std::nullopt;
+  }
+
+  for (const auto& [local, remote] : prefixes_) {
+    if (not is_under(path, local)) {
+      continue;
+    }
+    const auto relative = path.lexically_relative(local);
+    if (is_uri(remote)) {
+      return with_trailing_slash(remote) + relative.generic_string();
+    }
+    return (fs::path(remote) / relative).lexically_normal().string();
+  }
+  return std::nullopt;
+}
+}
@@ -0,0 +1,81 @@
+// Copyright (C) 2020 by Jakub Wojciech
+
+// This file is part of Lelo Remote Music Player.
+
+// Lelo Remote Music Player is free software: you can redistribute it
+// and/or modify it under the terms of the GNU General Public License
+// as published by the Free Software Foundation, either version 3 of
+// the License, or (at your option) any later version.
+
+// Lelo Remote Music Player is distributed in the hope that it will be
+// useful, but WITHOUT ANY WARRANTY; without even the implied warranty
+// of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+// General Public License for more details.
+
+// You should have received a copy of the GNU General Public License
+// along with Lelo Remote Music Player. If not, see
+// <https://www.gnu.org/licenses/>.
+
+
+#ifndef LRM_SHAREDPATHS_H_
+#define LRM_SHAREDPATHS_H_
+
+#include <optional>
+#include <string>
+#include <string_view>
+#include <utility>
+#include <vector>
+
+#include "filesystem.h"
+
+namespace lrm {
+/// \return \b true if \e reference looks like "scheme://...".
+bool is_uri(std::string_view reference);
+
+/// Server-side allow-list of the places clients can play files from by
+/// reference, without uploading them.
+class SharedRoots {
+ public:
+  SharedRoots() = default;
+  /// \param roots Directories and URI prefixes, e.g. "/srv/music" or
+  /// "smb://nas/music". Empty strings are ignored.
+  explicit SharedRoots(const std::vector<std::string>& roots);
+
+  /// \return What the player should open for \e reference, or nothing if
+  /// it's not inside any of the roots. Paths are returned in their
+  /// canonical form, so symbolic links and ".." can't lead out of a root.
+  std::optional<std::string> Resolve(std::string_view reference) const;
+
+  inline bool Empty() const {
+    return directories_.empty() and uri_prefixes_.empty();
+  }
+
+ private:
+  std::vector<fs::path> directories_;
+  std::vector<std::string> uri_prefixes_;
+};
+
+/// Client-side mapping of local directories to the server's names for the
+/// same files, e.g. "/mnt/nas/music" to "/srv/music" when both machines
+/// mount the same share.
+class SharedPrefixes {
+ public:
+  SharedPrefixes() = default;
+  /// \param mappings "LOCAL=REMOTE" pairs. Empty strings are ignored.
+  /// \exception std::invalid_argument A mapping has no '=' or an empty side.
+  explicit SharedPrefixes(const std::vector<std::string>& mappings);
+
+  /// \return The server's name for \e file or nothing if it's not under
+  /// any of the local prefixes.
+  std::optional<std::string> Map(std::string_view file) const;
+
+  inline bool Empty() const {
+    return prefixes_.empty();
+  }
+
+ private:
+  std::vector<std::pair<fs::path, std::string>> prefixes_;
+};
+}
+
+#endif  // LRM_SHAREDPATHS_H_
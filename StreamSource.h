@@ -0,0 +1,107 @@
+// Copyright (C) 2020 by Jakub Wojciech
+
+// This file is part of Lelo Remote Music Player.
+
+// Lelo Remote Music Player is free software: you can redistribute it
+// and/or modify it under the terms of the GNU General Public License
+// as published by the Free Software Foundation, either version 3 of
+// the License, or (at your option) any later version.
+
+// Lelo Remote Music Player is distributed in the hope that it will be
+// useful, but WITHOUT ANY WARRANTY; without even the implied warranty
+// of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+// General Public License for more details.
+
+// You should have received a copy of the GNU General Public License
+// along with Lelo Remote Music Player. If not, see
+// <https://www.gnu.org/licenses/>.
+
+#ifndef LRM_STREAMSOURCE_H_
+#define LRM_STREAMSOURCE_H_
+
+#include <cstddef>
+#include <cstdint>
+#include <stdexcept>
+
+namespace lrm {
+/// Byte stream written by the server as the data arrives and read by the
+/// player. One thread writes and one thread reads.
+class StreamSource {
+ public:
+  struct Stats {
+    uint64_t bytes_written = 0;
+    uint64_t bytes_read = 0;
+    /// How many times the writer had to wait for the reader.
+    uint64_t writer_stalls = 0;
+    /// How many times the reader had to wait for the data.
+    uint64_t reader_stalls = 0;
+    /// How many seeks failed because the data wasn't available.
+    uint64_t failed_seeks = 0;
+  };
+
+  virtual ~StreamSource() = default;
+
+  /// Write all of the \e data, waiting for the reader if necessary.
+  /// \return Number of bytes written. Less than \e size only if the source
+  /// was cancelled.
+  virtual size_t Write(const char* data, size_t size) = 0;
+
+  /// Read up to \e size bytes, waiting until there is at least one.
+  /// \return Number of bytes read, \b 0 at the end of the stream or \b -1 if
+  /// the source was cancelled.
+  virtual int64_t Read(char* data, size_t size) = 0;
+
+  /// Mark the end of the stream. The reader gets the rest of the data and
+  /// then the end of the stream.
+  virtual void CloseWrite() = 0;
+
+  /// Stop both sides. Blocked calls return at once and all following calls
+  /// fail.
+  virtual void Cancel() = 0;
+
+  virtual bool IsCancelled() const = 0;
+
+  /// \return \b true if the source supports Seek() and WriteAt().
+  virtual bool IsSeekable() const {
+    return false;
+  }
+
+  /// Write \e data at \e offset from the start of the stream. The reader
+  /// gets it when everything before it has been written too. Can be
+  /// called from several threads at once for different parts of the
+  /// stream.
+  /// \return Number of bytes written. Less than \e size only if the source
+  /// was cancelled.
+  /// \exception std::logic_error The source isn't seekable.
+  virtual size_t WriteAt(uint64_t offset, const char* data, size_t size) {
+    (void)offset;
+    (void)data;
+    (void)size;
+    throw std::logic_error("Writing at an offset is not supported");
+  }
+
+  /// Move the read position to \e offset from the start of the stream.
+  /// It never waits for the data to arrive.
+  /// \return The new position or \b -1 if the data at \e offset isn't
+  /// available.
+  virtual int64_t Seek(uint64_t offset) {
+    (void)offset;
+    return -1;
+  }
+
+  /// \return Size of the whole stream or \b -1 if it's not known yet.
+  virtual int64_t TotalSize() const {
+    return -1;
+  }
+
+  /// Tell the size of the whole stream before all of it has been written,
+  /// so TotalSize() can report it. Ignored by the sources that can't seek.
+  virtual void SetTotalSize(uint64_t size) {
+    (void)size;
+  }
+
+  virtual Stats GetStats() const = 0;
+};
+}
+
+#endif  // LRM_STREAMSOURCE_H_
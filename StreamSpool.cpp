@@ -0,0 +1,262 @@
+// Copyright (C) 2020 by Jakub Wojciech
+
+// This file is part of Lelo Remote Music Player.
+
+// Lelo Remote Music Player is free software: you can redistribute it
+// and/or modify it under the terms of the GNU General Public License
+// as published by the Free Software Foundation, either version 3 of
+// the License, or (at your option) any later version.
+
+// Lelo Remote Music Player is distributed in the hope that it will be
+// useful, but WITHOUT ANY WARRANTY; without even the implied warranty
+// of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+// General Public License for more details.
+
+// You should have received a copy of the GNU General Public License
+// along with Lelo Remote Music Player. If not, see
+// <https://www.gnu.org/licenses/>.
+
+#include "StreamSpool.h"
+
+#include <algorithm>
+#include <cerrno>
+#include <string>
+#include <system_error>
+
+#include <fcntl.h>
+#include <stdlib.h>
+#include <unistd.h>
+
+#include "spdlog/spdlog.h"
+
+namespace lrm {
+namespace {
+// Holes are punched in whole blocks so the file system can free them.
+constexpr uint64_t DISCARD_ALIGNMENT = 64 * 1024;
+
+int create_anonymous_file(const fs::path& directory) {
+  int fd = open(directory.c_str(), O_TMPFILE | O_RDWR | O_CLOEXEC, 0600);
+  if (-1 != fd) {
+    return fd;
+  }
+
+  // Not every file system supports O_TMPFILE.
+  std::string name = (directory / "lrm-spool-XXXXXX").string();
+  fd = mkostemp(name.data(), O_CLOEXEC);
+  if (-1 == fd) {
+    throw std::system_error(errno, std::generic_category(),
+                            "Couldn't create the spool file in " +
+                            directory.string());
+  }
+  unlink(name.c_str());
+  return fd;
+}
+}
+
+StreamSpool::StreamSpool(const fs::path& directory, uint64_t max_bytes)
+    : fd_(create_anonymous_file(directory)),
+      max_bytes_(std::max(max_bytes, DISCARD_ALIGNMENT)) {}
+
+StreamSpool::~StreamSpool() {
+  close(fd_);
+}
+
+size_t StreamSpool::Write(const char* data, size_t size) {
+  const size_t written = WriteAt(append_offset_, data, size);
+  append_offset_ += written;
+  return written;
+}
+
+size_t StreamSpool::WriteAt(uint64_t offset, const char* data, size_t size) {
+  size_t written = 0;
+
+  while (written < size) {
+    const uint64_t position = offset + written;
+    size_t to_write;
+    {
+      std::unique_lock<std::mutex> lck(mtx_);
+      if (position >= read_pos_ + max_bytes_) {
+        ++writer_stalls_;
+        cv_.wait(lck, [&]{
+                        return cancelled_ or
+                            position < read_pos_ + max_bytes_;
+                      });
+      }
+      if (cancelled_) {
+        break;
+      }
+      to_write = std::min<uint64_t>(size - written,
+                                    read_pos_ + max_bytes_ - position);
+    }
+
+    // The reader never touches the bytes past written_ and the writers
+    // write different parts, so the file can be written without the lock.
+    const auto result = pwrite(fd_, data + written, to_write, position);
+    if (-1 == result) {
+      if (EINTR == errno) {
+        continue;
+      }
+      throw std::system_error(errno, std::generic_category(),
+                              "Couldn't write to the spool file");
+    }
+    written += result;
+
+    std::lock_guard<std::mutex> lck(mtx_);
+    add_written(position, position + result);
+    discard_old();
+    cv_.notify_all();
+  }
+
+  return written;
+}
+
+int64_t StreamSpool::Read(char* data, size_t size) {
+  if (0 == size) {
+    return 0;
+  }
+
+  uint64_t offset;
+  {
+    std::unique_lock<std::mutex> lck(mtx_);
+    if (not cancelled_ and not write_closed_ and read_pos_ >= written_) {
+      ++reader_stalls_;
+      cv_.wait(lck, [&]{
+                      return cancelled_ or write_closed_ or
+                          read_pos_ < written_;
+                    });
+    }
+    if (cancelled_) {
+      return -1;
+    }
+    if (read_pos_ >= written_) {
+      return 0;
+    }
+    offset = read_pos_;
+    size = std::min<uint64_t>(size, written_ - read_pos_);
+  }
+
+  // Seek() is called from the reading thread, so nothing can move
+  // read_pos_ back past discarded_ while the lock is released.
+  ssize_t result;
+  do {
+    result = pread(fd_, data, size, offset);
+  } while (-1 == result and EINTR == errno);
+  if (result <= 0) {
+    return -1;
+  }
+
+  std::lock_guard<std::mutex> lck(mtx_);
+  read_pos_ = offset + result;
+  bytes_read_ += result;
+  cv_.notify_all();
+
+  return result;
+}
+
+void StreamSpool::CloseWrite() {
+  std::lock_guard<std::mutex> lck(mtx_);
+  write_closed_ = true;
+  cv_.notify_all();
+}
+
+void StreamSpool::Cancel() {
+  std::lock_guard<std::mutex> lck(mtx_);
+  cancelled_ = true;
+  cv_.notify_all();
+}
+
+int64_t StreamSpool::Seek(uint64_t offset) {
+  std::lock_guard<std::mutex> lck(mtx_);
+  if (offset < discarded_ or offset > written_) {
+    ++failed_seeks_;
+    return -1;
+  }
+
+  read_pos_ = offset;
+  // Seeking forward may have made room for the writer.
+  cv_.notify_all();
+  return offset;
+}
+
+int64_t StreamSpool::TotalSize() const {
+  std::lock_guard<std::mutex> lck(mtx_);
+  return write_closed_ ? written_ : total_size_;
+}
+
+void StreamSpool::SetTotalSize(uint64_t size) {
+  std::lock_guard<std::mutex> lck(mtx_);
+  total_size_ = size;
+}
+
+StreamSource::Stats StreamSpool::GetStats() const {
+  std::lock_guard<std::mutex> lck(mtx_);
+  Stats stats;
+  stats.bytes_written = written_;
+  stats.bytes_read = bytes_read_;
+  stats.writer_stalls = writer_stalls_;
+  stats.reader_stalls = reader_stalls_;
+  stats.failed_seeks = failed_seeks_;
+  return stats;
+}
+
+void StreamSpool::add_written(uint64_t begin, uint64_t end) {
+  if (end <= written_) {
+    return;
+  }
+  if (begin > written_) {
+    // Merge with the parts that touch it.
+    auto next = ahead_.lower_bound(begin);
+    if (next != ahead_.begin()) {
+      auto previous = std::prev(next);
+      if (previous->second >= begin) {
+        begin = previous->first;
+        end = std::max(end, previous->second);
+        ahead_.erase(previous);
+      }
+    }
+    while (next != ahead_.end() and next->first <= end) {
+      end = std::max(end, next->second);
+      next = ahead_.erase(next);
+    }
+    ahead_.emplace(begin, end);
+    return;
+  }
+
+  written_ = end;
+  // The reader can get the parts that were waiting for this one.
+  auto next = ahead_.begin();
+  while (next != ahead_.end() and next->first <= written_) {
+    written_ = std::max(written_, next->second);
+    next = ahead_.erase(next);
+  }
+}
+
+bool StreamSpool::punch_hole(uint64_t offset, uint64_t length) {
+  return 0 == fallocate(fd_, FALLOC_FL_PUNCH_HOLE | FALLOC_FL_KEEP_SIZE,
+                        offset, length);
+}
+
+void StreamSpool::discard_old() {
+  if (keep_all_ or written_ - discarded_ <= max_bytes_) {
+    return;
+  }
+
+  // The reader may have seeked back behind the point the writer assumed,
+  // never drop what's in front of it.
+  uint64_t new_discarded = std::min(written_ - max_bytes_, read_pos_);
+  new_discarded -= new_discarded % DISCARD_ALIGNMENT;
+  if (new_discarded <= discarded_) {
+    return;
+  }
+
+  if (not punch_hole(discarded_, new_discarded - discarded_)) {
+    // The stream can still be played, it just takes more space.
+    spdlog::warn("Couldn't discard old data from the spool file, it will "
+                 "grow past the limit to the whole stream: {}",
+                 std::generic_category().message(errno));
+    keep_all_ = true;
+    return;
+  }
+  discarded_ = new_discarded;
+}
+}
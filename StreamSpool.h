@@ -0,0 +1,121 @@
+// Copyright (C) 2020 by Jakub Wojciech
+
+// This file is part of Lelo Remote Music Player.
+
+// Lelo Remote Music Player is free software: you can redistribute it
+// and/or modify it under the terms of the GNU General Public License
+// as published by the Free Software Foundation, either version 3 of
+// the License, or (at your option) any later version.
+
+// Lelo Remote Music Player is distributed in the hope that it will be
+// useful, but WITHOUT ANY WARRANTY; without even the implied warranty
+// of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+// General Public License for more details.
+
+// You should have received a copy of the GNU General Public License
+// along with Lelo Remote Music Player. If not, see
+// <https://www.gnu.org/licenses/>.
+
+#ifndef LRM_STREAMSPOOL_H_
+#define LRM_STREAMSPOOL_H_
+
+#include <atomic>
+#include <condition_variable>
+#include <map>
+#include <mutex>
+
+#include "filesystem.h"
+#include "StreamSource.h"
+
+namespace lrm {
+/// Stream kept in an anonymous temporary file, so the reader can seek back
+/// to the data it has already read and forward to the data that has already
+/// arrived.
+///
+/// At most \e max_bytes of the stream are kept. When the writer goes over
+/// that, the oldest data behind the reader is dropped by punching a hole in
+/// the file, and the writer waits if the reader is that far behind.
+///
+/// If the file system can't punch holes, nothing is dropped: the file
+/// keeps the whole stream and \e max_bytes no longer limits its size, only
+/// how far the writer can get ahead of the reader.
+class StreamSpool : public StreamSource {
+ public:
+  /// \param directory Where to create the file. Use a tmpfs mount to keep
+  /// the data in memory.
+  /// \param max_bytes How much of the stream to keep.
+  /// \exception std::system_error The file couldn't be created.
+  StreamSpool(const fs::path& directory, uint64_t max_bytes);
+  ~StreamSpool();
+
+  StreamSpool(const StreamSpool&) = delete;
+  StreamSpool& operator=(const StreamSpool&) = delete;
+
+  /// \exception std::system_error Writing to the file failed.
+  size_t Write(const char* data, size_t size) override;
+  /// Waits while \e offset is more than \e max_bytes ahead of the reader.
+  /// \exception std::system_error Writing to the file failed.
+  size_t WriteAt(uint64_t offset, const char* data, size_t size) override;
+  int64_t Read(char* data, size_t size) override;
+  void CloseWrite() override;
+  void Cancel() override;
+
+  inline bool IsCancelled() const override {
+    return cancelled_;
+  }
+
+  inline bool IsSeekable() const override {
+    return true;
+  }
+
+  /// Fails at once if \e offset was dropped or hasn't arrived yet.
+  int64_t Seek(uint64_t offset) override;
+  /// \return The size given to SetTotalSize() until the writing is closed,
+  /// then the size of what has been written.
+  int64_t TotalSize() const override;
+  void SetTotalSize(uint64_t size) override;
+
+  Stats GetStats() const override;
+
+ protected:
+  /// Free [\e offset, \e offset + \e length) of the file.
+  /// \return \b false if it couldn't, \e errno tells why.
+  virtual bool punch_hole(uint64_t offset, uint64_t length);
+
+ private:
+  /// Mark [\e begin, \e end) as written and move written_ past all the
+  /// parts that follow it without a gap. Must be called with mtx_ locked.
+  void add_written(uint64_t begin, uint64_t end);
+  /// Drop the data that doesn't fit in max_bytes_ and the reader has
+  /// already passed. Must be called with mtx_ locked.
+  void discard_old();
+
+  int fd_ = -1;
+  const uint64_t max_bytes_;
+
+  // Offsets from the start of the stream. Everything in [discarded_,
+  // written_) is in the file.
+  uint64_t written_ = 0;
+  // Parts written with WriteAt() past written_, end by start.
+  std::map<uint64_t, uint64_t> ahead_;
+  // Where Write() continues.
+  uint64_t append_offset_ = 0;
+  uint64_t discarded_ = 0;
+  // Set when punching a hole has failed, it's not tried again.
+  bool keep_all_ = false;
+  uint64_t read_pos_ = 0;
+  int64_t total_size_ = -1;
+  bool write_closed_ = false;
+  std::atomic<bool> cancelled_ = false;
+
+  uint64_t bytes_read_ = 0;
+  uint64_t writer_stalls_ = 0;
+  uint64_t reader_stalls_ = 0;
+  uint64_t failed_seeks_ = 0;
+
+  mutable std::mutex mtx_;
+  std::condition_variable cv_;
+};
+}
+
+#endif  // LRM_STREAMSPOOL_H_
@@ -0,0 +1,434 @@
+// Copyright (C) 2020 by Jakub Wojciech
+
+// This file is part of Lelo Remote Music Player.
+
+// Lelo Remote Music Player is free software: you can redistribute it
+// and/or modify it under the terms of the GNU General Public License
+// as published by the Free Software Foundation, either version 3 of
+// the License, or (at your option) any later version.
+
+// Lelo Remote Music Player is distributed in the hope that it will be
+// useful, but WITHOUT ANY WARRANTY; without even the implied warranty
+// of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+// General Public License for more details.
+
+// You should have received a copy of the GNU General Public License
+// along with Lelo Remote Music Player. If not, see
+// <https://www.gnu.org/licenses/>.
+
+
+#include "TimeInfoStreams.h"
+
+#include <algorithm>
+#include <cmath>
+#include <optional>
+
+#include "spdlog/spdlog.h"
+
+namespace lrm {
+namespace {
+/// \return The first multiple of TICK since the clock's epoch at or after
+/// \e time.
+std::chrono::steady_clock::time_point align_to_tick(
+    std::chrono::steady_clock::time_point time) {
+  const auto tick =
+      std::chrono::duration_cast<std::chrono::steady_clock::duration>(
+          TimeInfoStreams::TICK);
+  const auto since_epoch = time.time_since_epoch();
+  return std::chrono::steady_clock::time_point(
+      (since_epoch + tick - std::chrono::steady_clock::duration(1)) /
+      tick * tick);
+}
+
+TimeInfo::PlaybackState to_message_state(PlaybackState::State state) {
+  switch (state) {
+    case PlaybackState::PLAYING:
+      return TimeInfo::PLAYING;
+    case PlaybackState::PAUSED:
+      return TimeInfo::PAUSED;
+    case PlaybackState::STOPPED:
+      return TimeInfo::STOPPED;
+    case PlaybackState::FINISHED:
+      return TimeInfo::FINISHED;
+    case PlaybackState::FINISHED_ERROR:
+      return TimeInfo::FINISHED_ERROR;
+    case PlaybackState::UNDEFINED:
+      break;
+  }
+  return TimeInfo::NOT_CHANGED;
+}
+
+int64_t to_microseconds(std::chrono::steady_clock::duration duration) {
+  return std::chrono::duration_cast<std::chrono::microseconds>(
+      duration).count();
+}
+}
+
+/// One TimeInfoStream call. All of its state is guarded by the mutex of
+/// TimeInfoStreams.
+class TimeInfoStreams::Stream : public Reactor {
+ public:
+  Stream(TimeInfoStreams* streams, size_t zone)
+      : streams_(streams), zone_(zone) {
+    StartRead(&interval_);
+  }
+
+  void OnReadDone(bool ok) override {
+    std::lock_guard<std::mutex> lck(streams_->mtx_);
+    if (not ok) {
+      spdlog::debug("Client requested the cancellation of the info stream.");
+      finish();
+      return;
+    }
+
+    if (interval_.client_time_us() != 0) {
+      // Answered by the next message.
+      echo_client_time_ = interval_.client_time_us();
+      echo_received_ = std::chrono::steady_clock::now();
+    }
+
+    const std::chrono::milliseconds interval{interval_.milliseconds()};
+    if (registered_) {
+      // The client also sends it again just to measure the round trip.
+      if (interval != requested_interval_) {
+        spdlog::debug(
+            "Client requested to change the update interval to {} s",
+            interval_.milliseconds() / (float)1000);
+      }
+    } else {
+      spdlog::debug("Info stream interval set to {}s",
+                    interval_.milliseconds() / (float)1000);
+      registered_ = true;
+      streams_->streams_.insert(this);
+    }
+    requested_interval_ = interval;
+    interval_duration_ = std::max<std::chrono::milliseconds>(interval, TICK);
+    next_update_ = std::chrono::steady_clock::now();
+    streams_->cv_.notify_all();
+
+    StartRead(&interval_);
+  }
+
+  void OnWriteDone(bool ok) override {
+    std::lock_guard<std::mutex> lck(streams_->mtx_);
+    writing_ = false;
+    if (not ok) {
+      finish();
+    } else if (finishing_) {
+      Finish(grpc::Status::OK);
+    } else if (missed_update_) {
+      // Send what has changed in the meantime.
+      missed_update_ = false;
+      next_update_ = std::chrono::steady_clock::now();
+      streams_->cv_.notify_all();
+    }
+  }
+
+  void OnDone() override {
+    spdlog::debug("Closing the info stream.");
+    {
+      std::lock_guard<std::mutex> lck(streams_->mtx_);
+      streams_->streams_.erase(this);
+    }
+    delete this;
+  }
+
+  inline size_t Zone() const {
+    return zone_;
+  }
+
+  inline std::chrono::steady_clock::time_point NextUpdate() const {
+    return next_update_;
+  }
+
+  /// Wait for the next interval, e.g. when the player couldn't be sampled.
+  inline void Skip(std::chrono::steady_clock::time_point now) {
+    next_update_ = align_to_tick(now + interval_duration_);
+  }
+
+  inline void UpdateNow() {
+    next_update_ = std::chrono::steady_clock::now();
+  }
+
+  /// Send the client \e snapshot if it needs it.
+  void Update(const Snapshot& snapshot,
+              std::chrono::steady_clock::time_point now) {
+    next_update_ = align_to_tick(now + interval_duration_);
+    if (writing_) {
+      missed_update_ = true;
+      return;
+    }
+
+    message_.Clear();
+    const bool first = 0 == sequence_;
+
+    const bool state_changed = first or snapshot.state != sent_.state;
+    if (state_changed) {
+      message_.set_playback_state(to_message_state(snapshot.state));
+      spdlog::debug("Sending playback state to the client: {}",
+                    PlaybackState::StateName(snapshot.state));
+    }
+    if (first or snapshot.volume != sent_.volume) {
+      message_.set_volume(snapshot.volume);
+    }
+
+    const bool playing = PlaybackState::PLAYING == snapshot.state;
+    const bool active = playing or PlaybackState::PAUSED == snapshot.state;
+    bool times_cleared = false;
+    if (snapshot.has_times and active) {
+      if (not times_sent_ or snapshot.total_time != sent_.total_time) {
+        message_.set_total_time(snapshot.total_time);
+      }
+      if (not times_sent_ or snapshot.speed != sent_.speed) {
+        message_.set_speed(snapshot.speed);
+      }
+      // A new speed applies from the times sent with it.
+      if (not times_sent_ or state_changed or message_.has_speed() or
+          std::abs(snapshot.current_time - extrapolate(snapshot.time)) >
+          DRIFT_TOLERANCE) {
+        message_.set_current_time(snapshot.current_time);
+        message_.set_remaining_time(snapshot.remaining_time);
+        message_.set_remaining_playtime(snapshot.remaining_playtime);
+      }
+    } else if (not active and times_sent_) {
+      // Otherwise the client keeps the times of the file that has ended.
+      message_.set_total_time(0);
+      message_.set_current_time(0);
+      message_.set_remaining_time(0);
+      message_.set_remaining_playtime(0);
+      times_cleared = true;
+    }
+
+    if (snapshot.has_buffer and active) {
+      if (not buffer_sent_ or
+          std::abs(snapshot.buffered_time - sent_.buffered_time) >
+          BUFFER_TOLERANCE) {
+        message_.set_buffered_time(snapshot.buffered_time);
+        message_.set_cache_time(snapshot.cache_time);
+      }
+      if (not buffer_sent_ or snapshot.buffering != sent_.buffering) {
+        message_.set_buffering(snapshot.buffering);
+      }
+    } else {
+      // Everything again for the next file.
+      buffer_sent_ = false;
+    }
+    if (first or snapshot.underruns != sent_.underruns) {
+      message_.set_underruns(snapshot.underruns);
+    }
+
+    if (echo_client_time_ != 0) {
+      message_.set_echo_client_time_us(echo_client_time_);
+      message_.set_echo_hold_us(std::max<int64_t>(
+          0, to_microseconds(snapshot.time - echo_received_)));
+      echo_client_time_ = 0;
+    }
+
+    // Everything is as the client expects it.
+    if (0 == message_.ByteSizeLong()) {
+      return;
+    }
+
+    sent_.state = snapshot.state;
+    sent_.volume = snapshot.volume;
+    if (times_cleared) {
+      // Everything again for the next file.
+      sent_.total_time = 0;
+      sent_.current_time = 0;
+      times_sent_ = false;
+    } else if (message_.has_total_time()) {
+      sent_.total_time = snapshot.total_time;
+    }
+    if (message_.has_speed()) {
+      sent_.speed = snapshot.speed;
+    }
+    if (message_.has_current_time() and not times_cleared) {
+      sent_.current_time = snapshot.current_time;
+      sent_.time = snapshot.time;
+      times_sent_ = true;
+    }
+    if (message_.has_buffered_time()) {
+      sent_.buffered_time = snapshot.buffered_time;
+      buffer_sent_ = true;
+    }
+    if (message_.has_buffering()) {
+      sent_.buffering = snapshot.buffering;
+    }
+    sent_.underruns = snapshot.underruns;
+
+    message_.set_server_time_us(to_microseconds(
+        snapshot.time.time_since_epoch()));
+    message_.set_sequence(++sequence_);
+
+    writing_ = true;
+    StartWrite(&message_);
+  }
+
+ private:
+  /// \return Position the client assumes at \e time, from the last times
+  /// sent to it.
+  double extrapolate(std::chrono::steady_clock::time_point time) const {
+    if (PlaybackState::PLAYING != sent_.state) {
+      return sent_.current_time;
+    }
+    const std::chrono::duration<double> elapsed = time - sent_.time;
+    return sent_.current_time + elapsed.count() * sent_.speed;
+  }
+
+  /// End the call once the last write is done.
+  void finish() {
+    if (finishing_) {
+      return;
+    }
+    finishing_ = true;
+    streams_->streams_.erase(this);
+    if (not writing_) {
+      Finish(grpc::Status::OK);
+    }
+  }
+
+  TimeInfoStreams* streams_;
+  const size_t zone_;
+
+  TimeInterval interval_;
+  std::chrono::milliseconds requested_interval_{0};
+  std::chrono::milliseconds interval_duration_{0};
+  std::chrono::steady_clock::time_point next_update_;
+  bool registered_ = false;
+
+  TimeInfo message_;
+  bool writing_ = false;
+  bool missed_update_ = false;
+  bool finishing_ = false;
+
+  // What the client knows, from the messages sent to it so far. The times
+  // are from the Snapshot taken at sent_.time.
+  Snapshot sent_;
+  bool times_sent_ = false;
+  bool buffer_sent_ = false;
+  uint64_t sequence_ = 0;
+
+  // The client's timestamp to echo and when it has been received.
+  int64_t echo_client_time_ = 0;
+  std::chrono::steady_clock::time_point echo_received_;
+};
+
+namespace {
+class RejectedStream : public TimeInfoStreams::Reactor {
+ public:
+  explicit RejectedStream(const grpc::Status& status) {
+    Finish(status);
+  }
+
+  void OnDone() override {
+    delete this;
+  }
+};
+}
+
+TimeInfoStreams::TimeInfoStreams(Sampler sampler, size_t zones)
+    : sampler_(std::move(sampler)),
+      states_(zones, PlaybackState::UNDEFINED),
+      thread_(&TimeInfoStreams::run, this) {}
+
+TimeInfoStreams::~TimeInfoStreams() {
+  {
+    std::lock_guard<std::mutex> lck(mtx_);
+    stop_ = true;
+  }
+  cv_.notify_all();
+  thread_.join();
+}
+
+TimeInfoStreams::Reactor* TimeInfoStreams::Open(size_t zone) {
+  return new Stream(this, zone);
+}
+
+TimeInfoStreams::Reactor* TimeInfoStreams::Reject(
+    const grpc::Status& status) {
+  return new RejectedStream(status);
+}
+
+void TimeInfoStreams::SetPlaybackState(PlaybackState::State state,
+                                       size_t zone) {
+  std::lock_guard<std::mutex> lck(mtx_);
+  states_.at(zone) = state;
+  update_now(zone);
+}
+
+void TimeInfoStreams::Refresh(size_t zone) {
+  std::lock_guard<std::mutex> lck(mtx_);
+  update_now(zone);
+}
+
+void TimeInfoStreams::update_now(size_t zone) {
+  for (Stream* stream : streams_) {
+    if (stream->Zone() == zone) {
+      stream->UpdateNow();
+    }
+  }
+  cv_.notify_all();
+}
+
+size_t TimeInfoStreams::Size() const {
+  std::lock_guard<std::mutex> lck(mtx_);
+  return streams_.size();
+}
+
+void TimeInfoStreams::run() {
+  std::unique_lock<std::mutex> lck(mtx_);
+  while (not stop_) {
+    if (streams_.empty()) {
+      cv_.wait(lck);
+      continue;
+    }
+
+    const auto now = std::chrono::steady_clock::now();
+    std::vector<bool> due(states_.size(), false);
+    bool any_due = false;
+    for (const Stream* stream : streams_) {
+      if (stream->NextUpdate() <= now and stream->Zone() < due.size()) {
+        due[stream->Zone()] = true;
+        any_due = true;
+      }
+    }
+
+    if (any_due) {
+      // mpv can take a moment, don't hold the streams meanwhile.
+      const auto states = states_;
+      lck.unlock();
+      std::vector<std::optional<Snapshot>> snapshots(states.size());
+      for (size_t zone = 0; zone < states.size(); ++zone) {
+        if (not due[zone]) {
+          continue;
+        }
+        try {
+          snapshots[zone] = sampler_(zone, states[zone]);
+          snapshots[zone]->time = std::chrono::steady_clock::now();
+        } catch (const std::exception& e) {
+          spdlog::error("Info stream loop: {}", e.what());
+        }
+        ++samples_;
+      }
+      lck.lock();
+
+      for (Stream* stream : streams_) {
+        if (stream->NextUpdate() <= now) {
+          if (stream->Zone() < snapshots.size() and
+              snapshots[stream->Zone()]) {
+            stream->Update(*snapshots[stream->Zone()], now);
+          } else {
+            stream->Skip(now);
+          }
+        }
+      }
+    }
+
+    auto wake_up = std::chrono::steady_clock::time_point::max();
+    for (const Stream* stream : streams_) {
+      wake_up = std::min(wake_up, stream->NextUpdate());
+    }
+    cv_.wait_until(lck, wake_up);
+  }
+}
+}
@@ -0,0 +1,152 @@
+// Copyright (C) 2020 by Jakub Wojciech
+
+// This file is part of Lelo Remote Music Player.
+
+// Lelo Remote Music Player is free software: you can redistribute it
+// and/or modify it under the terms of the GNU General Public License
+// as published by the Free Software Foundation, either version 3 of
+// the License, or (at your option) any later version.
+
+// Lelo Remote Music Player is distributed in the hope that it will be
+// useful, but WITHOUT ANY WARRANTY; without even the implied warranty
+// of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+// General Public License for more details.
+
+// You should have received a copy of the GNU General Public License
+// along with Lelo Remote Music Player. If not, see
+// <https://www.gnu.org/licenses/>.
+
+
+#ifndef LRM_TIMEINFOSTREAMS_H_
+#define LRM_TIMEINFOSTREAMS_H_
+
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <functional>
+#include <mutex>
+#include <set>
+#include <thread>
+#include <vector>
+
+#include "grpcpp/support/server_callback.h"
+
+#include "player_service.pb.h"
+
+#include "PlaybackState.h"
+
+namespace lrm {
+/// Serves the TimeInfoStream calls with gRPC's callback API.
+///
+/// With the synchronous API every connected client holds two threads of
+/// the server for as long as it's connected: one sending the updates and
+/// one reading the client's messages. Here a single thread sends the
+/// updates to all of the clients, at the interval each of them asked for,
+/// and gRPC's callback threads handle the rest.
+///
+/// The server may have several players, one per zone, and every client
+/// follows one of them. Each player is sampled at most once per tick,
+/// whatever the number of clients. Every update falls on a multiple of
+/// TICK, so the clients of a zone that are due at the same time get the same
+/// Snapshot.
+///
+/// Each client gets only what has changed since its previous message. The
+/// times are extrapolated by the client from the server's timestamp and the
+/// playback speed, so while playing they're sent again only when they drift
+/// from that by more than DRIFT_TOLERANCE. The same goes for the buffered
+/// time and BUFFER_TOLERANCE.
+class TimeInfoStreams {
+ public:
+  using Reactor = grpc::ServerBidiReactor<TimeInterval, TimeInfo>;
+
+  /// The player's state at one moment.
+  struct Snapshot {
+    PlaybackState::State state = PlaybackState::UNDEFINED;
+    /// Whether the times are set. They're read only while something is
+    /// playing or paused.
+    bool has_times = false;
+    double current_time = 0;
+    double remaining_time = 0;
+    double total_time = 0;
+    double remaining_playtime = 0;
+    double speed = 1;
+    int volume = 0;
+    /// Whether the buffer's fields are set. Like the times, only while
+    /// something is playing or paused.
+    bool has_buffer = false;
+    /// See TimeInfo.
+    double buffered_time = 0;
+    double cache_time = 0;
+    int buffering = 100;
+    uint64_t underruns = 0;
+    /// When it was taken. Set by TimeInfoStreams, not by the Sampler.
+    std::chrono::steady_clock::time_point time;
+  };
+
+  /// \return Snapshot of the player of \e zone in \e state.
+  using Sampler =
+      std::function<Snapshot(size_t zone, PlaybackState::State state)>;
+
+  /// Resolution of the updates' timing. Shorter intervals are raised to it.
+  static constexpr std::chrono::milliseconds TICK{50};
+
+  /// How far, in seconds, the position may go from the client's
+  /// extrapolation before it's sent again.
+  static constexpr double DRIFT_TOLERANCE = 0.1;
+
+  /// How far, in seconds, the buffered time may go from the one sent last
+  /// before it's sent again.
+  static constexpr double BUFFER_TOLERANCE = 0.5;
+
+  /// \param zones Number of players. They're numbered from 0.
+  explicit TimeInfoStreams(Sampler sampler, size_t zones = 1);
+  ~TimeInfoStreams();
+
+  TimeInfoStreams(const TimeInfoStreams&) = delete;
+  TimeInfoStreams& operator=(const TimeInfoStreams&) = delete;
+
+  /// \return Reactor serving a new call for the player of \e zone. It
+  /// deletes itself when the call ends.
+  Reactor* Open(size_t zone = 0);
+
+  /// \return Reactor that fails the call with \e status at once.
+  static Reactor* Reject(const grpc::Status& status);
+
+  /// Send \e state to all clients of \e zone now.
+  void SetPlaybackState(PlaybackState::State state, size_t zone = 0);
+
+  /// Check for changes, e.g. of the volume, and send them to all clients of
+  /// \e zone now.
+  void Refresh(size_t zone = 0);
+
+  /// \return Number of connected clients.
+  size_t Size() const;
+
+  /// \return How many times the players have been sampled.
+  inline uint64_t Samples() const {
+    return samples_;
+  }
+
+ private:
+  class Stream;
+
+  /// Make the clients of \e zone due now. Called with mtx_ locked.
+  void update_now(size_t zone);
+  void run();
+
+  const Sampler sampler_;
+  std::atomic<uint64_t> samples_ = 0;
+
+  // Streams that have received the interval and haven't finished yet.
+  std::set<Stream*> streams_;
+  // By zone.
+  std::vector<PlaybackState::State> states_;
+  bool stop_ = false;
+  mutable std::mutex mtx_;
+  std::condition_variable cv_;
+
+  std::thread thread_;
+};
+}
+
+#endif  // LRM_TIMEINFOSTREAMS_H_
@@ -0,0 +1,166 @@
+// Copyright (C) 2020 by Jakub Wojciech
+
+// This file is part of Lelo Remote Music Player.
+
+// Lelo Remote Music Player is free software: you can redistribute it
+// and/or modify it under the terms of the GNU General Public License
+// as published by the Free Software Foundation, either version 3 of
+// the License, or (at your option) any later version.
+
+// Lelo Remote Music Player is distributed in the hope that it will be
+// useful, but WITHOUT ANY WARRANTY; without even the implied warranty
+// of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+// General Public License for more details.
+
+// You should have received a copy of the GNU General Public License
+// along with Lelo Remote Music Player. If not, see
+// <https://www.gnu.org/licenses/>.
+
+
+#include "Transcoder.h"
+
+#include <algorithm>
+#include <cctype>
+#include <stdexcept>
+
+#include <sys/resource.h>
+
+#include "mpv/client.h"
+
+#include "crypto/CryptoUtil.h"
+
+namespace lrm {
+namespace {
+std::string to_lower(std::string str) {
+  std::transform(str.begin(), str.end(), str.begin(),
+                 [](unsigned char c){ return std::tolower(c); });
+  return str;
+}
+
+std::chrono::duration<double> cpu_time() {
+  rusage usage;
+  getrusage(RUSAGE_SELF, &usage);
+  return std::chrono::seconds(usage.ru_utime.tv_sec +
+                              usage.ru_stime.tv_sec) +
+      std::chrono::microseconds(usage.ru_utime.tv_usec +
+                                usage.ru_stime.tv_usec);
+}
+
+void set_option(mpv_handle* ctx, const char* name, const std::string& value) {
+  const int result = mpv_set_option_string(ctx, name, value.c_str());
+  if (result < 0) {
+    throw std::runtime_error(std::string("Setting mpv's option '") + name +
+                             "' to '" + value + "': " +
+                             mpv_error_string(result));
+  }
+}
+}
+
+const Transcoder::Settings Transcoder::DEFAULT_SETTINGS{"libopus", "ogg",
+                                                        128000};
+
+Transcoder::Settings Transcoder::Settings::Or(const Settings& other) const {
+  Settings result = *this;
+  if (result.codec.empty()) {
+    result.codec = other.codec;
+  }
+  if (result.format.empty()) {
+    result.format = other.format;
+  }
+  if (0 == result.bitrate) {
+    result.bitrate = other.bitrate;
+  }
+  return result;
+}
+
+Transcoder::Output::~Output() {
+  std::error_code ec;
+  fs::remove(path_, ec);
+}
+
+Transcoder::Transcoder(const std::vector<std::string>& extensions,
+                       fs::path directory)
+    : directory_(std::move(directory)) {
+  for (const auto& extension : extensions) {
+    if (extension.empty()) {
+      continue;
+    }
+    extensions_.push_back(
+        to_lower(extension.front() == '.' ? extension : '.' + extension));
+  }
+}
+
+bool Transcoder::Accepts(const fs::path& file) const {
+  const std::string extension = to_lower(file.extension().string());
+  return std::find(extensions_.begin(), extensions_.end(), extension) !=
+      extensions_.end();
+}
+
+std::unique_ptr<Transcoder::Output> Transcoder::Transcode(
+    const fs::path& input, const Settings& settings) const {
+  std::unique_ptr<Output> output{new Output(
+      directory_ / ("lrm-transcoded-" + crypto::generate_random_hex(8) +
+                    '.' + settings.format))};
+
+  const auto cpu_start = cpu_time();
+  const auto wall_start = std::chrono::steady_clock::now();
+  {
+    std::unique_ptr<mpv_handle, decltype(&mpv_terminate_destroy)> ctx{
+      mpv_create(), &mpv_terminate_destroy};
+    if (not ctx) {
+      throw std::runtime_error("Couldn't create an mpv instance");
+    }
+
+    set_option(ctx.get(), "o", output->Path().string());
+    set_option(ctx.get(), "of", settings.format);
+    set_option(ctx.get(), "oac", settings.codec);
+    if (settings.bitrate > 0) {
+      set_option(ctx.get(), "oacopts",
+                 "b=" + std::to_string(settings.bitrate));
+    }
+    // Only the audio, without the cover art.
+    set_option(ctx.get(), "vid", "no");
+    set_option(ctx.get(), "sid", "no");
+    set_option(ctx.get(), "audio-display", "no");
+
+    int result = mpv_initialize(ctx.get());
+    if (result < 0) {
+      throw std::runtime_error(std::string("Initializing mpv: ") +
+                               mpv_error_string(result));
+    }
+
+    const std::string input_str = input.string();
+    const char* command[] = {"loadfile", input_str.c_str(), nullptr};
+    result = mpv_command(ctx.get(), command);
+    if (result < 0) {
+      throw std::runtime_error("Transcoding '" + input_str + "': " +
+                               mpv_error_string(result));
+    }
+
+    for (;;) {
+      const mpv_event* event = mpv_wait_event(ctx.get(), -1);
+      if (MPV_EVENT_SHUTDOWN == event->event_id) {
+        throw std::runtime_error("Transcoding '" + input_str +
+                                 "': mpv has quit");
+      }
+      if (MPV_EVENT_END_FILE == event->event_id) {
+        const auto* end_file =
+            static_cast<const mpv_event_end_file*>(event->data);
+        if (MPV_END_FILE_REASON_ERROR == end_file->reason) {
+          throw std::runtime_error("Transcoding '" + input_str + "': " +
+                                   mpv_error_string(end_file->error));
+        }
+        break;
+      }
+    }
+    // Destroying the instance finishes the output file.
+  }
+
+  output->stats_.cpu_time = cpu_time() - cpu_start;
+  output->stats_.wall_time = std::chrono::steady_clock::now() - wall_start;
+  output->stats_.input_bytes = fs::file_size(input);
+  output->stats_.output_bytes = fs::file_size(output->Path());
+
+  return output;
+}
+}
@@ -0,0 +1,102 @@
+// Copyright (C) 2020 by Jakub Wojciech
+
+// This file is part of Lelo Remote Music Player.
+
+// Lelo Remote Music Player is free software: you can redistribute it
+// and/or modify it under the terms of the GNU General Public License
+// as published by the Free Software Foundation, either version 3 of
+// the License, or (at your option) any later version.
+
+// Lelo Remote Music Player is distributed in the hope that it will be
+// useful, but WITHOUT ANY WARRANTY; without even the implied warranty
+// of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+// General Public License for more details.
+
+// You should have received a copy of the GNU General Public License
+// along with Lelo Remote Music Player. If not, see
+// <https://www.gnu.org/licenses/>.
+
+
+#ifndef LRM_TRANSCODER_H_
+#define LRM_TRANSCODER_H_
+
+#include <chrono>
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <string_view>
+#include <vector>
+
+#include "filesystem.h"
+
+namespace lrm {
+/// Converts audio files with libmpv's encoding mode before they're sent,
+/// so the server has less to decode and the network less to carry.
+class Transcoder {
+ public:
+  struct Settings {
+    /// FFmpeg's audio encoder, e.g. \e libopus.
+    std::string codec;
+    /// FFmpeg's muxer, e.g. \e ogg.
+    std::string format;
+    /// Bits per second, 0 for the encoder's default.
+    int64_t bitrate = 0;
+
+    /// \return The settings with the empty fields taken from \e other.
+    Settings Or(const Settings& other) const;
+  };
+  /// Used when neither the client nor the server chooses anything.
+  static const Settings DEFAULT_SETTINGS;
+
+  struct Stats {
+    /// CPU time of the whole process while transcoding.
+    std::chrono::duration<double> cpu_time{0};
+    std::chrono::duration<double> wall_time{0};
+    uint64_t input_bytes = 0;
+    uint64_t output_bytes = 0;
+  };
+
+  /// Transcoded file, removed when it's destroyed.
+  class Output {
+   public:
+    ~Output();
+    Output(const Output&) = delete;
+    Output& operator=(const Output&) = delete;
+
+    inline const fs::path& Path() const {
+      return path_;
+    }
+    inline const Stats& GetStats() const {
+      return stats_;
+    }
+
+   private:
+    friend class Transcoder;
+    Output(fs::path path) : path_(std::move(path)) {}
+
+    const fs::path path_;
+    Stats stats_;
+  };
+
+  /// \param extensions Files with these extensions are transcoded, e.g.
+  /// \e flac. The case doesn't matter.
+  /// \param directory Where to put the transcoded files.
+  Transcoder(const std::vector<std::string>& extensions,
+             fs::path directory = fs::temp_directory_path());
+
+  /// \return \b true if \e file should be transcoded.
+  bool Accepts(const fs::path& file) const;
+
+  /// Transcode \e input with \e settings. It takes as long as the encoder
+  /// needs to go through the whole file.
+  /// \exception std::runtime_error mpv couldn't read or encode the file.
+  std::unique_ptr<Output> Transcode(const fs::path& input,
+                                    const Settings& settings) const;
+
+ private:
+  std::vector<std::string> extensions_;
+  const fs::path directory_;
+};
+}
+
+#endif  // LRM_TRANSCODER_H_
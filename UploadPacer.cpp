@@ -0,0 +1,119 @@
+// Copyright (C) 2020 by Jakub Wojciech
+
+// This file is part of Lelo Remote Music Player.
+
+// Lelo Remote Music Player is free software: you can redistribute it
+// and/or modify it under the terms of the GNU General Public License
+// as published by the Free Software Foundation, either version 3 of
+// the License, or (at your option) any later version.
+
+// Lelo Remote Music Player is distributed in the hope that it will be
+// useful, but WITHOUT ANY WARRANTY; without even the implied warranty
+// of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+// General Public License for more details.
+
+// You should have received a copy of the GNU General Public License
+// along with Lelo Remote Music Player. If not, see
+// <https://www.gnu.org/licenses/>.
+
+
+#include "UploadPacer.h"
+
+#include <algorithm>
+
+namespace lrm {
+UploadPacer::UploadPacer(const Settings& settings, uint64_t file_size,
+                         PlaybackSource playback)
+    : settings_(settings),
+      file_size_(file_size),
+      playback_source_(std::move(playback)) {}
+
+void UploadPacer::SetPosition(uint64_t offset) {
+  position_ = offset;
+}
+
+std::chrono::steady_clock::duration UploadPacer::Delay(
+    std::chrono::steady_clock::time_point now) {
+  if (playback_source_) {
+    playback_ = playback_source_();
+  }
+
+  double delay = 0;
+
+  const double rate = Rate();
+  if (rate > 0) {
+    if (last_refill_) {
+      const std::chrono::duration<double> elapsed = now - *last_refill_;
+      tokens_ = std::min(tokens_ + rate * elapsed.count(),
+                         rate * std::chrono::duration<double>(
+                             MAX_BURST).count());
+    }
+    last_refill_ = now;
+    if (tokens_ < 0) {
+      delay = -tokens_ / rate;
+    }
+  }
+
+  const double track_rate = byte_rate();
+  if (settings_.lead.count() > 0 and track_rate > 0) {
+    const double allowed =
+        (playback_->elapsed_time + settings_.lead).count() * track_rate;
+    if (position_ > allowed) {
+      // Until the playback gets that far.
+      delay = std::max(delay, (position_ - allowed) / track_rate);
+    }
+  }
+
+  return std::chrono::duration_cast<std::chrono::steady_clock::duration>(
+      std::chrono::duration<double>(delay));
+}
+
+void UploadPacer::Sent(size_t bytes) {
+  position_ += bytes;
+  if (Rate() > 0) {
+    tokens_ -= bytes;
+  }
+}
+
+size_t UploadPacer::ChunkSize(size_t max_size) const {
+  const double rate = Rate();
+  if (0 == rate) {
+    return max_size;
+  }
+  const auto burst = static_cast<size_t>(
+      rate * std::chrono::duration<double>(MAX_BURST).count());
+  return std::min(max_size, std::max(burst, MIN_CHUNK_SIZE));
+}
+
+double UploadPacer::Rate() const {
+  double rate = settings_.rate;
+  if (settings_.target_buffer.count() > 0 and playback_ and
+      playback_->buffered) {
+    const double track_rate = byte_rate();
+    const double buffered = playback_->buffered->count();
+    const double scale = buffered <= 0 ?
+                         MAX_BUFFER_SCALE :
+                         std::clamp(settings_.target_buffer.count() /
+                                    buffered,
+                                    MIN_BUFFER_SCALE, MAX_BUFFER_SCALE);
+    const double from_buffer =
+        (track_rate > 0 ? track_rate : DEFAULT_BYTE_RATE) * scale;
+    return rate > 0 ? std::min(rate, from_buffer) : from_buffer;
+  }
+  if (settings_.headroom > 0) {
+    const double track_rate = byte_rate();
+    const double from_bitrate =
+        (track_rate > 0 ? track_rate : DEFAULT_BYTE_RATE) *
+        settings_.headroom;
+    rate = rate > 0 ? std::min(rate, from_bitrate) : from_bitrate;
+  }
+  return rate;
+}
+
+double UploadPacer::byte_rate() const {
+  if (not playback_ or playback_->total_time.count() <= 0) {
+    return 0;
+  }
+  return file_size_ / playback_->total_time.count();
+}
+}
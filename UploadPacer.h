@@ -0,0 +1,133 @@
+// Copyright (C) 2020 by Jakub Wojciech
+
+// This file is part of Lelo Remote Music Player.
+
+// Lelo Remote Music Player is free software: you can redistribute it
+// and/or modify it under the terms of the GNU General Public License
+// as published by the Free Software Foundation, either version 3 of
+// the License, or (at your option) any later version.
+
+// Lelo Remote Music Player is distributed in the hope that it will be
+// useful, but WITHOUT ANY WARRANTY; without even the implied warranty
+// of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+// General Public License for more details.
+
+// You should have received a copy of the GNU General Public License
+// along with Lelo Remote Music Player. If not, see
+// <https://www.gnu.org/licenses/>.
+
+
+#ifndef LRM_UPLOADPACER_H_
+#define LRM_UPLOADPACER_H_
+
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <optional>
+
+namespace lrm {
+/// Limits the rate of an upload, so it doesn't take the whole link.
+///
+/// It's a token bucket filled with the configured rate, or with the track's
+/// average bitrate times a headroom factor. On top of that, when the
+/// playback position of the track is known, it keeps at most \e lead of
+/// audio ahead of it; the rest is sent as the playback goes on.
+///
+/// With a target buffer, the rate follows what the server reports to have
+/// buffered instead: real time keeps the buffer as it is, faster fills it
+/// and slower drains it. The rate is the track's bitrate times the target
+/// divided by the buffer, within [MIN_BUFFER_SCALE; MAX_BUFFER_SCALE]. A
+/// fixed rate still caps it, the headroom applies only until the server
+/// reports its buffer.
+///
+/// The bitrate is the size of the file divided by its duration, so the lead
+/// is exact only for files with a constant bitrate.
+class UploadPacer {
+ public:
+  struct Settings {
+    /// Bytes per second, 0 for no fixed limit.
+    double rate = 0;
+    /// If above 0, the rate is the track's bitrate times that.
+    double headroom = 0;
+    /// How much audio to keep ahead of the playback position, 0 for no
+    /// limit.
+    std::chrono::duration<double> lead{0};
+    /// How much audio the server should have buffered ahead of the
+    /// playback, 0 for no target.
+    std::chrono::duration<double> target_buffer{0};
+
+    /// \return \b true if the settings limit anything.
+    inline bool IsEnabled() const {
+      return rate > 0 or headroom > 0 or lead.count() > 0 or
+          target_buffer.count() > 0;
+    }
+  };
+
+  struct Playback {
+    std::chrono::duration<double> total_time;
+    std::chrono::duration<double> elapsed_time;
+    /// What the server has buffered, if it has said.
+    std::optional<std::chrono::duration<double>> buffered = std::nullopt;
+  };
+  /// \return Playback of the track being uploaded or \b std::nullopt if
+  /// it's not playing yet.
+  using PlaybackSource = std::function<std::optional<Playback>()>;
+
+  /// Assumed until the track's duration is known: CD audio, more than most
+  /// compressed files need.
+  static constexpr double DEFAULT_BYTE_RATE = 44100 * 2 * 2;
+  /// How long the bucket can save up for. It's also the longest burst.
+  static constexpr std::chrono::milliseconds MAX_BURST{100};
+  static constexpr size_t MIN_CHUNK_SIZE = 4 * 1024;
+  /// Bounds of the rate relative to the track's bitrate while keeping the
+  /// target buffer.
+  static constexpr double MIN_BUFFER_SCALE = 0.25;
+  static constexpr double MAX_BUFFER_SCALE = 4;
+
+  /// \param file_size Size of the whole file, even if only a part of it is
+  /// sent.
+  UploadPacer(const Settings& settings, uint64_t file_size,
+              PlaybackSource playback = {});
+
+  inline bool IsEnabled() const {
+    return settings_.IsEnabled();
+  }
+
+  /// Set the offset in the file of the next byte to be sent, e.g. when
+  /// resuming an upload.
+  void SetPosition(uint64_t offset);
+
+  /// \return How long to wait before sending the next message.
+  std::chrono::steady_clock::duration Delay(
+      std::chrono::steady_clock::time_point now =
+      std::chrono::steady_clock::now());
+
+  /// Take \e bytes out of the bucket.
+  void Sent(size_t bytes);
+
+  /// \return The largest message that doesn't exceed the allowed burst,
+  /// at most \e max_size.
+  size_t ChunkSize(size_t max_size) const;
+
+  /// \return The current rate limit in bytes per second, 0 if there's none.
+  double Rate() const;
+
+ private:
+  /// Track's average bytes per second, 0 if unknown.
+  double byte_rate() const;
+
+  const Settings settings_;
+  const uint64_t file_size_;
+  const PlaybackSource playback_source_;
+
+  std::optional<Playback> playback_;
+  uint64_t position_ = 0;
+  /// Bytes that can be sent now. Negative after a message larger than
+  /// what was saved up.
+  double tokens_ = 0;
+  std::optional<std::chrono::steady_clock::time_point> last_refill_;
+};
+}
+
+#endif  // LRM_UPLOADPACER_H_
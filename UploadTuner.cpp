@@ -0,0 +1,57 @@
+// Copyright (C) 2020 by Jakub Wojciech
+
+// This file is part of Lelo Remote Music Player.
+
+// Lelo Remote Music Player is free software: you can redistribute it
+// and/or modify it under the terms of the GNU General Public License
+// as published by the Free Software Foundation, either version 3 of
+// the License, or (at your option) any later version.
+
+// Lelo Remote Music Player is distributed in the hope that it will be
+// useful, but WITHOUT ANY WARRANTY; without even the implied warranty
+// of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+// General Public License for more details.
+
+// You should have received a copy of the GNU General Public License
+// along with Lelo Remote Music Player. If not, see
+// <https://www.gnu.org/licenses/>.
+
+#include "UploadTuner.h"
+
+#include <algorithm>
+
+namespace lrm {
+namespace {
+// Weight of the newest measurement in the smoothed throughput.
+constexpr double THROUGHPUT_SMOOTHING = 0.25;
+// Keep the sizes page aligned.
+constexpr size_t CHUNK_ALIGNMENT = 4096;
+}
+
+UploadTuner::UploadTuner(std::chrono::microseconds rtt) : rtt_(rtt) {}
+
+void UploadTuner::WriteCompleted(
+    size_t bytes, std::chrono::steady_clock::duration duration) {
+  // A write that returns immediately was only buffered, count it as taking
+  // at least a microsecond so it doesn't divide by zero.
+  const double seconds = std::max(
+      std::chrono::duration<double>(duration).count(), 1e-6);
+  const double rate = bytes / seconds;
+
+  throughput_ = throughput_ == 0 ?
+                rate :
+                THROUGHPUT_SMOOTHING * rate +
+                (1 - THROUGHPUT_SMOOTHING) * throughput_;
+
+  const double bdp =
+      throughput_ * std::chrono::duration<double>(rtt_).count();
+  size_t target = static_cast<size_t>(
+      std::min<double>(bdp / MESSAGES_PER_RTT, MAX_CHUNK_SIZE));
+  target -= target % CHUNK_ALIGNMENT;
+
+  // Grow gradually, so a burst of buffered writes doesn't jump straight to
+  // the maximum, but shrink at once when the link slows down.
+  chunk_size_ = std::clamp(std::min(target, chunk_size_ * 2),
+                           MIN_CHUNK_SIZE, MAX_CHUNK_SIZE);
+}
+}
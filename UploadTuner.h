@@ -0,0 +1,68 @@
+// Copyright (C) 2020 by Jakub Wojciech
+
+// This file is part of Lelo Remote Music Player.
+
+// Lelo Remote Music Player is free software: you can redistribute it
+// and/or modify it under the terms of the GNU General Public License
+// as published by the Free Software Foundation, either version 3 of
+// the License, or (at your option) any later version.
+
+// Lelo Remote Music Player is distributed in the hope that it will be
+// useful, but WITHOUT ANY WARRANTY; without even the implied warranty
+// of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+// General Public License for more details.
+
+// You should have received a copy of the GNU General Public License
+// along with Lelo Remote Music Player. If not, see
+// <https://www.gnu.org/licenses/>.
+
+#ifndef LRM_UPLOADTUNER_H_
+#define LRM_UPLOADTUNER_H_
+
+#include <chrono>
+#include <cstddef>
+
+namespace lrm {
+/// Chooses the size of the AudioData messages for an upload.
+///
+/// The size follows the bandwidth-delay product of the link: the measured
+/// throughput times the round trip time, split into a few messages. On a
+/// fast or distant link the messages grow, so there are fewer of them per
+/// byte; on a slow link they stay small, so the first audio reaches the
+/// server quickly.
+class UploadTuner {
+ public:
+  static constexpr size_t MIN_CHUNK_SIZE = 16 * 1024;
+  static constexpr size_t MAX_CHUNK_SIZE = 1024 * 1024;
+  /// How many messages should fit into one round trip.
+  static constexpr size_t MESSAGES_PER_RTT = 4;
+
+  explicit UploadTuner(std::chrono::microseconds rtt);
+
+  /// \return Size of the next message, always in the range
+  /// [MIN_CHUNK_SIZE; MAX_CHUNK_SIZE].
+  inline size_t ChunkSize() const {
+    return chunk_size_;
+  }
+
+  /// Update the estimates after a message of \e bytes has been written in
+  /// \e duration.
+  void WriteCompleted(size_t bytes,
+                      std::chrono::steady_clock::duration duration);
+
+  /// \return Smoothed throughput in bytes per second.
+  inline double Throughput() const {
+    return throughput_;
+  }
+  inline std::chrono::microseconds Rtt() const {
+    return rtt_;
+  }
+
+ private:
+  const std::chrono::microseconds rtt_;
+  size_t chunk_size_ = MIN_CHUNK_SIZE;
+  double throughput_ = 0;
+};
+}
+
+#endif  // LRM_UPLOADTUNER_H_
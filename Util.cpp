@@ -24,7 +24,11 @@
 #include <string_view>
 #include <vector>
 
+#include <system_error>
+
 #include <arpa/inet.h>
+#include <sys/socket.h>
+#include <unistd.h>
 
 namespace lrm::Util {
 std::vector<std::string> tokenize(std::string_view str,
@@ -94,4 +98,88 @@ std::vector<std::byte> str_to_bytes(std::string_view str) {
   safe_memcpy(result.data(), str.data(), str.size());
   return result;
 }
+
+void send_with_fd(int socket, std::string_view data, int fd) {
+  iovec iov;
+  iov.iov_base = const_cast<char*>(data.data());
+  iov.iov_len = data.size();
+
+  // The descriptor goes with the first byte, the rest is sent as usual.
+  alignas(cmsghdr) char control[CMSG_SPACE(sizeof(int))] = {};
+  msghdr msg{};
+  msg.msg_iov = &iov;
+  msg.msg_iovlen = 1;
+  msg.msg_control = control;
+  msg.msg_controllen = sizeof(control);
+
+  cmsghdr* cmsg = CMSG_FIRSTHDR(&msg);
+  cmsg->cmsg_level = SOL_SOCKET;
+  cmsg->cmsg_type = SCM_RIGHTS;
+  cmsg->cmsg_len = CMSG_LEN(sizeof(int));
+  std::memcpy(CMSG_DATA(cmsg), &fd, sizeof(int));
+
+  ssize_t sent;
+  do {
+    sent = sendmsg(socket, &msg, MSG_NOSIGNAL);
+  } while (sent < 0 and EINTR == errno);
+  if (sent < 0) {
+    throw std::system_error(errno, std::system_category(),
+                            "Sending a file descriptor");
+  }
+
+  for (size_t total = sent; total < data.size();) {
+    sent = send(socket, data.data() + total, data.size() - total,
+                MSG_NOSIGNAL);
+    if (sent < 0 and EINTR != errno) {
+      throw std::system_error(errno, std::system_category(),
+                              "Sending data");
+    }
+    total += std::max<ssize_t>(sent, 0);
+  }
+}
+
+std::string receive_with_fds(int socket, std::vector<int>* fds) {
+  std::string result;
+  char buffer[4096];
+
+  for (;;) {
+    iovec iov;
+    iov.iov_base = buffer;
+    iov.iov_len = sizeof(buffer);
+
+    alignas(cmsghdr) char control[CMSG_SPACE(4 * sizeof(int))];
+    msghdr msg{};
+    msg.msg_iov = &iov;
+    msg.msg_iovlen = 1;
+    msg.msg_control = control;
+    msg.msg_controllen = sizeof(control);
+
+    const ssize_t received = recvmsg(socket, &msg, MSG_CMSG_CLOEXEC);
+    if (received < 0) {
+      if (EINTR == errno) {
+        continue;
+      }
+      throw std::system_error(errno, std::system_category(),
+                              "Receiving data");
+    }
+
+    for (cmsghdr* cmsg = CMSG_FIRSTHDR(&msg); cmsg;
+         cmsg = CMSG_NXTHDR(&msg, cmsg)) {
+      if (SOL_SOCKET != cmsg->cmsg_level or SCM_RIGHTS != cmsg->cmsg_type) {
+        continue;
+      }
+      const size_t count = (cmsg->cmsg_len - CMSG_LEN(0)) / sizeof(int);
+      for (size_t i = 0; i < count; ++i) {
+        int fd;
+        std::memcpy(&fd, CMSG_DATA(cmsg) + i * sizeof(int), sizeof(int));
+        fds->push_back(fd);
+      }
+    }
+
+    if (0 == received) {
+      return result;
+    }
+    result.append(buffer, received);
+  }
+}
 }
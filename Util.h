@@ -60,6 +60,15 @@ std::vector<std::string> tokenize(std::string_view str,
                                   std::string_view delimiters = " ");
 bool is_ipv4(std::string_view ip);
 std::string file_to_str(std::string_view filename);
+
+/// Send \e data over the Unix socket \e socket with a copy of the file
+/// descriptor \e fd attached.
+/// \exception std::system_error
+void send_with_fd(int socket, std::string_view data, int fd);
+/// Read from the Unix socket \e socket until the other side stops sending.
+/// File descriptors sent with the data are appended to \e fds.
+/// \exception std::system_error
+std::string receive_with_fds(int socket, std::vector<int>* fds);
 inline bool file_exists(std::string_view filename) {
   struct stat buffer;
   return stat(filename.data(), &buffer) == 0;
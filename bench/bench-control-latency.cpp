@@ -0,0 +1,279 @@
+// Copyright (C) 2020 by Jakub Wojciech
+
+// This file is part of Lelo Remote Music Player.
+
+// Lelo Remote Music Player is free software: you can redistribute it
+// and/or modify it under the terms of the GNU General Public License
+// as published by the Free Software Foundation, either version 3 of
+// the License, or (at your option) any later version.
+
+// Lelo Remote Music Player is distributed in the hope that it will be
+// useful, but WITHOUT ANY WARRANTY; without even the implied warranty
+// of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+// General Public License for more details.
+
+// You should have received a copy of the GNU General Public License
+// along with Lelo Remote Music Player. If not, see
+// <https://www.gnu.org/licenses/>.
+
+
+// Measures the latency of a control RPC while other clients upload files and
+// authenticate, with and without the server's separate upload and
+// authentication threads.
+//
+// Usage: bench-control-latency [UPLOADERS] [HANDSHAKERS] [SECONDS]
+//
+// Two servers run in child processes: "shared" runs everything at the same
+// priority with no limit on the authentication threads, "isolated" uses the
+// defaults. The numbers are most telling with fewer cores than load threads,
+// e.g. under taskset -c 0.
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstdio>
+#include <fstream>
+#include <random>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include <signal.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+#ifndef INCLUDE_GRPCPLUSPLUS
+#include "grpcpp/create_channel.h"
+#include "grpcpp/security/credentials.h"
+#include "grpcpp/security/server_credentials.h"
+#include "grpcpp/server.h"
+#include "grpcpp/server_builder.h"
+#else
+#include "grpc++/create_channel.h"
+#include "grpc++/security/credentials.h"
+#include "grpc++/security/server_credentials.h"
+#include "grpc++/server.h"
+#include "grpc++/server_builder.h"
+#endif  // INCLUDE_GRPCPLUSPLUS
+
+#include "spdlog/spdlog.h"
+#include "spdlog/sinks/stdout_color_sinks.h"
+
+#include "filesystem.h"
+#include "Config.h"
+#include "PlayerClient.h"
+#include "PlayerServiceImpl.h"
+
+using namespace lrm;
+
+namespace {
+constexpr char PASSPHRASE[] = "bench-control-latency";
+
+/// Run the server with the config from \e config and write its port to
+/// \e port_fd.
+[[noreturn]] void run_server(const fs::path& config, int port_fd) {
+  Config::Load(config);
+
+  PlayerServiceImpl service;
+  int port = 0;
+  grpc::ServerBuilder builder;
+  builder.AddListeningPort("127.0.0.1:0", grpc::InsecureServerCredentials(),
+                           &port);
+  builder.RegisterService(&service);
+  auto server = builder.BuildAndStart();
+
+  if (write(port_fd, &port, sizeof(port)) != sizeof(port)) {
+    _exit(EXIT_FAILURE);
+  }
+  server->Wait();
+  _exit(EXIT_SUCCESS);
+}
+
+/// Start the server in a child process.
+/// \return Port of the server, 0 if it didn't start.
+int start_server(const fs::path& config, pid_t* pid) {
+  int fds[2];
+  if (pipe(fds) != 0) {
+    std::perror("pipe");
+    return 0;
+  }
+  *pid = fork();
+  if (0 == *pid) {
+    close(fds[0]);
+    run_server(config, fds[1]);
+  }
+  close(fds[1]);
+  int port = 0;
+  if (read(fds[0], &port, sizeof(port)) != sizeof(port)) {
+    port = 0;
+  }
+  close(fds[0]);
+  return port;
+}
+
+void write_config(const fs::path& path, const std::string& extra) {
+  // The null player, so it runs without sound hardware.
+  std::ofstream(path) << "passphrase = " << PASSPHRASE << '\n'
+                      << "cache_max_bytes = 0\n"
+                      << "audio_output = null\n"
+                      << extra;
+}
+
+void write_random_file(const fs::path& path, size_t size) {
+  std::mt19937_64 gen(size);
+  std::vector<uint64_t> data(size / sizeof(uint64_t));
+  for (auto& word : data) {
+    word = gen();
+  }
+  std::ofstream(path, std::ios::binary).write(
+      reinterpret_cast<const char*>(data.data()),
+      data.size() * sizeof(uint64_t));
+}
+
+std::unique_ptr<PlayerClient> make_client(int port) {
+  grpc::ChannelArguments args;
+  // Separate connections, like separate daemons would have.
+  args.SetInt(GRPC_ARG_USE_LOCAL_SUBCHANNEL_POOL, 1);
+  return std::make_unique<PlayerClient>(grpc::CreateCustomChannel(
+      "127.0.0.1:" + std::to_string(port),
+      grpc::InsecureChannelCredentials(), args));
+}
+
+struct Latencies {
+  double p50 = 0;
+  double p99 = 0;
+  double max = 0;
+};
+
+/// Time TogglePause() on \e client for \e duration.
+/// \return Latencies in milliseconds.
+Latencies measure(PlayerClient* client, std::chrono::seconds duration) {
+  using clock = std::chrono::steady_clock;
+
+  std::vector<double> samples;
+  const auto end = clock::now() + duration;
+  while (clock::now() < end) {
+    const auto start = clock::now();
+    try {
+      client->TogglePause();
+    } catch (const grpc::Status&) {}
+    samples.push_back(
+        std::chrono::duration<double, std::milli>(clock::now() - start)
+        .count());
+    std::this_thread::sleep_for(std::chrono::milliseconds(20));
+  }
+
+  std::sort(samples.begin(), samples.end());
+  Latencies result;
+  if (not samples.empty()) {
+    result.p50 = samples[samples.size() / 2];
+    result.p99 = samples[samples.size() * 99 / 100];
+    result.max = samples.back();
+  }
+  return result;
+}
+
+void print(const char* server, const char* load, const Latencies& latencies) {
+  std::printf("%-10s %-8s %10.2f %10.2f %10.2f\n", server, load,
+              latencies.p50, latencies.p99, latencies.max);
+}
+}
+
+int main(int argc, char** argv) {
+  const size_t uploaders = argc > 1 ? std::stoul(argv[1]) : 4;
+  const size_t handshakers = argc > 2 ? std::stoul(argv[2]) : 4;
+  const std::chrono::seconds duration(argc > 3 ? std::stoi(argv[3]) : 10);
+
+  const fs::path tmp = fs::temp_directory_path();
+  const fs::path shared_config = tmp / "lrm-bench-control-shared.conf";
+  const fs::path isolated_config = tmp / "lrm-bench-control-isolated.conf";
+  const fs::path file = tmp / "lrm-bench-control.bin";
+  write_config(shared_config,
+               "auth_threads = 0\nauth_nice = 0\nstream_nice = 0\n");
+  write_config(isolated_config, "");
+  write_random_file(file, 64 * 1024 * 1024);
+
+  // Fork before gRPC starts any threads. The config is loaded once per
+  // process, so the servers load their own.
+  const std::pair<const char*, const fs::path*> servers[] = {
+    {"shared", &shared_config},
+    {"isolated", &isolated_config}
+  };
+  std::vector<std::pair<pid_t, int>> started;
+  for (const auto& [name, config] : servers) {
+    pid_t pid = 0;
+    const int port = start_server(*config, &pid);
+    if (0 == port) {
+      std::fprintf(stderr, "The %s server didn't start\n", name);
+      return EXIT_FAILURE;
+    }
+    started.emplace_back(pid, port);
+  }
+  Config::Load(isolated_config);
+
+  spdlog::set_level(spdlog::level::warn);
+  spdlog::stdout_color_mt("PlayerClient")->set_level(spdlog::level::err);
+
+  std::printf("%-10s %-8s %10s %10s %10s\n", "server", "load", "p50 ms",
+              "p99 ms", "max ms");
+
+  int exit_status = EXIT_SUCCESS;
+  for (size_t i = 0; i < started.size(); ++i) {
+    const char* name = servers[i].first;
+    const int port = started[i].second;
+
+    auto control = make_client(port);
+    if (not control->Authenticate()) {
+      std::fprintf(stderr, "Authentication failed\n");
+      exit_status = EXIT_FAILURE;
+      break;
+    }
+    print(name, "idle", measure(control.get(), duration));
+
+    std::atomic<bool> stop = false;
+    std::vector<std::thread> load;
+    for (size_t j = 0; j < uploaders; ++j) {
+      load.emplace_back(
+          [&]{
+            auto client = make_client(port);
+            client->Authenticate();
+            // Upload every time instead of playing from the server's cache.
+            client->SetHashFirst(false);
+            while (not stop) {
+              try {
+                client->Play(file.string());
+              } catch (const grpc::Status&) {
+                // Preempted by another uploader.
+              }
+            }
+          });
+    }
+    for (size_t j = 0; j < handshakers; ++j) {
+      load.emplace_back(
+          [&]{
+            while (not stop) {
+              make_client(port)->Authenticate();
+            }
+          });
+    }
+
+    // Let the load start.
+    std::this_thread::sleep_for(std::chrono::seconds(1));
+    print(name, "loaded", measure(control.get(), duration));
+
+    stop = true;
+    for (auto& thread : load) {
+      thread.join();
+    }
+  }
+
+  for (const auto& [pid, port] : started) {
+    kill(pid, SIGKILL);
+    waitpid(pid, nullptr, 0);
+  }
+  fs::remove(shared_config);
+  fs::remove(isolated_config);
+  fs::remove(file);
+
+  return exit_status;
+}
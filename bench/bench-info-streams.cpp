@@ -0,0 +1,164 @@
+// Copyright (C) 2020 by Jakub Wojciech
+
+// This file is part of Lelo Remote Music Player.
+
+// Lelo Remote Music Player is free software: you can redistribute it
+// and/or modify it under the terms of the GNU General Public License
+// as published by the Free Software Foundation, either version 3 of
+// the License, or (at your option) any later version.
+
+// Lelo Remote Music Player is distributed in the hope that it will be
+// useful, but WITHOUT ANY WARRANTY; without even the implied warranty
+// of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+// General Public License for more details.
+
+// You should have received a copy of the GNU General Public License
+// along with Lelo Remote Music Player. If not, see
+// <https://www.gnu.org/licenses/>.
+
+
+// Measures the server's threads and memory against the number of clients
+// receiving TimeInfoStream updates.
+//
+// Usage: bench-info-streams [MAX_CLIENTS] [STEP]
+//
+// The server runs in a child process, so the clients' threads aren't
+// counted. Every client has its own connection, like separate daemons.
+
+#include <chrono>
+#include <cstdio>
+#include <fstream>
+#include <memory>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include <signal.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+#ifndef INCLUDE_GRPCPLUSPLUS
+#include "grpcpp/create_channel.h"
+#include "grpcpp/security/credentials.h"
+#include "grpcpp/security/server_credentials.h"
+#include "grpcpp/server.h"
+#include "grpcpp/server_builder.h"
+#else
+#include "grpc++/create_channel.h"
+#include "grpc++/security/credentials.h"
+#include "grpc++/security/server_credentials.h"
+#include "grpc++/server.h"
+#include "grpc++/server_builder.h"
+#endif  // INCLUDE_GRPCPLUSPLUS
+
+#include "spdlog/spdlog.h"
+#include "spdlog/sinks/stdout_color_sinks.h"
+
+#include "filesystem.h"
+#include "Config.h"
+#include "PlayerClient.h"
+#include "PlayerServiceImpl.h"
+
+using namespace lrm;
+
+namespace {
+/// Run the server and write its port to \e port_fd.
+[[noreturn]] void run_server(int port_fd) {
+  PlayerServiceImpl service;
+  int port = 0;
+  grpc::ServerBuilder builder;
+  builder.AddListeningPort("127.0.0.1:0", grpc::InsecureServerCredentials(),
+                           &port);
+  builder.RegisterService(&service);
+  auto server = builder.BuildAndStart();
+
+  if (write(port_fd, &port, sizeof(port)) != sizeof(port)) {
+    _exit(EXIT_FAILURE);
+  }
+  server->Wait();
+  _exit(EXIT_SUCCESS);
+}
+
+/// \return Value of \e field from /proc/PID/status, e.g. "Threads".
+long proc_status(pid_t pid, const std::string& field) {
+  std::ifstream status("/proc/" + std::to_string(pid) + "/status");
+  std::string line;
+  while (std::getline(status, line)) {
+    if (line.compare(0, field.size() + 1, field + ":") == 0) {
+      return std::stol(line.substr(field.size() + 1));
+    }
+  }
+  return -1;
+}
+}
+
+int main(int argc, char** argv) {
+  const size_t max_clients = argc > 1 ? std::stoul(argv[1]) : 200;
+  const size_t step = argc > 2 ? std::stoul(argv[2]) : 50;
+
+  const fs::path config =
+      fs::temp_directory_path() / "lrm-bench-info-streams.conf";
+  std::ofstream(config) << "passphrase = bench-info-streams\n"
+                        << "cache_max_bytes = 0\n";
+  Config::Load(config);
+
+  // Fork before gRPC starts any threads.
+  int fds[2];
+  if (pipe(fds) != 0) {
+    std::perror("pipe");
+    return EXIT_FAILURE;
+  }
+  const pid_t server_pid = fork();
+  if (0 == server_pid) {
+    close(fds[0]);
+    run_server(fds[1]);
+  }
+  close(fds[1]);
+  int port = 0;
+  if (read(fds[0], &port, sizeof(port)) != sizeof(port)) {
+    std::fprintf(stderr, "The server didn't start\n");
+    return EXIT_FAILURE;
+  }
+  close(fds[0]);
+
+  spdlog::set_level(spdlog::level::warn);
+  spdlog::stdout_color_mt("PlayerClient")->set_level(spdlog::level::warn);
+
+  std::printf("%-10s %10s %12s\n", "clients", "threads", "RSS KiB");
+
+  std::vector<std::unique_ptr<PlayerClient>> clients;
+  int exit_status = EXIT_SUCCESS;
+  for (size_t count = 0; count <= max_clients; count += step) {
+    while (clients.size() < count) {
+      grpc::ChannelArguments args;
+      // Separate connections, like separate daemons would have.
+      args.SetInt(GRPC_ARG_USE_LOCAL_SUBCHANNEL_POOL, 1);
+      auto client = std::make_unique<PlayerClient>(grpc::CreateCustomChannel(
+          "127.0.0.1:" + std::to_string(port),
+          grpc::InsecureChannelCredentials(), args));
+      if (not client->Authenticate()) {
+        std::fprintf(stderr, "Authentication failed\n");
+        exit_status = EXIT_FAILURE;
+        break;
+      }
+      client->StreamInfoStart();
+      clients.push_back(std::move(client));
+    }
+    if (EXIT_FAILURE == exit_status) {
+      break;
+    }
+
+    // Let the server settle.
+    std::this_thread::sleep_for(std::chrono::seconds(2));
+    std::printf("%-10zu %10ld %12ld\n", clients.size(),
+                proc_status(server_pid, "Threads"),
+                proc_status(server_pid, "VmRSS"));
+  }
+
+  clients.clear();
+  kill(server_pid, SIGKILL);
+  waitpid(server_pid, nullptr, 0);
+  fs::remove(config);
+
+  return exit_status;
+}
@@ -0,0 +1,223 @@
+// Copyright (C) 2020 by Jakub Wojciech
+
+// This file is part of Lelo Remote Music Player.
+
+// Lelo Remote Music Player is free software: you can redistribute it
+// and/or modify it under the terms of the GNU General Public License
+// as published by the Free Software Foundation, either version 3 of
+// the License, or (at your option) any later version.
+
+// Lelo Remote Music Player is distributed in the hope that it will be
+// useful, but WITHOUT ANY WARRANTY; without even the implied warranty
+// of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+// General Public License for more details.
+
+// You should have received a copy of the GNU General Public License
+// along with Lelo Remote Music Player. If not, see
+// <https://www.gnu.org/licenses/>.
+
+
+// Measures the delay of the live mode, from capturing a sample to playing
+// it.
+//
+// Usage: bench-live [SECONDS]
+//
+// A generated WAV stream goes through a pipe, as if from a capture program,
+// to PlayerClient::PlayLive(), and over gRPC to an in-process server that
+// plays it with mpv. Every block is written to the pipe when it would be
+// captured, so the sample at position P was captured at START + P. The
+// delay is the difference between that and the playback position reported
+// by the server. mpv's position already accounts for the audio output's
+// buffer. It needs a working audio output.
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cmath>
+#include <cstdint>
+#include <cstdio>
+#include <fstream>
+#include <thread>
+#include <vector>
+
+#include <unistd.h>
+
+#ifndef INCLUDE_GRPCPLUSPLUS
+#include "grpcpp/create_channel.h"
+#include "grpcpp/security/credentials.h"
+#include "grpcpp/security/server_credentials.h"
+#include "grpcpp/server.h"
+#include "grpcpp/server_builder.h"
+#else
+#include "grpc++/create_channel.h"
+#include "grpc++/security/credentials.h"
+#include "grpc++/security/server_credentials.h"
+#include "grpc++/server.h"
+#include "grpc++/server_builder.h"
+#endif  // INCLUDE_GRPCPLUSPLUS
+
+#include "spdlog/spdlog.h"
+#include "spdlog/sinks/stdout_color_sinks.h"
+
+#include "filesystem.h"
+#include "Config.h"
+#include "LiveReader.h"
+#include "PlayerClient.h"
+#include "PlayerServiceImpl.h"
+
+using namespace lrm;
+
+namespace {
+constexpr uint32_t SAMPLE_RATE = 48000;
+constexpr uint16_t CHANNELS = 2;
+constexpr uint16_t BYTES_PER_SAMPLE = 2;
+constexpr auto BLOCK_DURATION = std::chrono::milliseconds(10);
+
+std::string wav_header() {
+  std::string header;
+  const auto put = [&](uint32_t value, int bytes) {
+                     for (int i = 0; i < bytes; ++i) {
+                       header += static_cast<char>(value >> (8 * i));
+                     }
+                   };
+  const uint32_t frame_size = CHANNELS * BYTES_PER_SAMPLE;
+  // Unknown length, like arecord writes to a pipe.
+  header += "RIFF";
+  put(0xffffffff, 4);
+  header += "WAVEfmt ";
+  put(16, 4);
+  put(1, 2);
+  put(CHANNELS, 2);
+  put(SAMPLE_RATE, 4);
+  put(SAMPLE_RATE * frame_size, 4);
+  put(frame_size, 2);
+  put(BYTES_PER_SAMPLE * 8, 2);
+  header += "data";
+  put(0xffffffff, 4);
+  return header;
+}
+
+/// Write a quiet tone to \e fd in real time until \e stop is set.
+void capture(int fd, std::chrono::steady_clock::time_point start,
+             const std::atomic<bool>& stop) {
+  const std::string header = wav_header();
+  if (write(fd, header.data(), header.size()) < 0) {
+    return;
+  }
+
+  const size_t frames =
+      SAMPLE_RATE * BLOCK_DURATION.count() / 1000;
+  std::vector<int16_t> block(frames * CHANNELS);
+  uint64_t position = 0;
+
+  for (int i = 1; not stop; ++i) {
+    for (size_t frame = 0; frame < frames; ++frame, ++position) {
+      const auto sample = static_cast<int16_t>(
+          1000 * std::sin(2 * M_PI * 440 * position / SAMPLE_RATE));
+      std::fill_n(block.begin() + frame * CHANNELS, CHANNELS, sample);
+    }
+    // A capture program has the block only after its last sample.
+    std::this_thread::sleep_until(start + i * BLOCK_DURATION);
+
+    const char* data = reinterpret_cast<const char*>(block.data());
+    size_t size = block.size() * sizeof(int16_t);
+    while (size > 0) {
+      const ssize_t written = write(fd, data, size);
+      if (written < 0) {
+        return;
+      }
+      data += written;
+      size -= written;
+    }
+  }
+}
+}
+
+int main(int argc, char** argv) {
+  const int seconds = argc > 1 ? std::stoi(argv[1]) : 20;
+
+  spdlog::set_level(spdlog::level::warn);
+  spdlog::stdout_color_mt("PlayerClient")->set_level(spdlog::level::warn);
+
+  const fs::path config =
+      fs::temp_directory_path() / "lrm-bench-live.conf";
+  std::ofstream(config) << "passphrase = bench-live\n";
+  Config::Load(config);
+
+  PlayerServiceImpl service;
+  int port = 0;
+  grpc::ServerBuilder builder;
+  builder.AddListeningPort("127.0.0.1:0", grpc::InsecureServerCredentials(),
+                           &port);
+  builder.RegisterService(&service);
+  auto server = builder.BuildAndStart();
+
+  PlayerClient client(grpc::CreateChannel(
+      "127.0.0.1:" + std::to_string(port),
+      grpc::InsecureChannelCredentials()));
+  if (not client.Authenticate()) {
+    std::fprintf(stderr, "Authentication failed\n");
+    return EXIT_FAILURE;
+  }
+  client.StreamInfoStart();
+
+  int fds[2];
+  if (pipe(fds) != 0) {
+    std::perror("pipe");
+    return EXIT_FAILURE;
+  }
+  LiveReader reader(fds[0]);
+
+  std::atomic<bool> stop = false;
+  const auto start = std::chrono::steady_clock::now();
+  std::thread capture_thread(capture, fds[1], start, std::cref(stop));
+  std::thread stream_thread([&]{
+                              try {
+                                client.PlayLive(&reader);
+                              } catch (const grpc::Status& status) {
+                                std::fprintf(stderr, "PlayLive: %s\n",
+                                             status.error_message().c_str());
+                              }
+                            });
+
+  // Let the playback settle first.
+  std::this_thread::sleep_for(std::chrono::seconds(2));
+
+  std::vector<double> delays;
+  const auto end = std::chrono::steady_clock::now() +
+                   std::chrono::seconds(seconds);
+  while (std::chrono::steady_clock::now() < end) {
+    const auto info = client.GetPlaybackInfo();
+    if (PlaybackState::PLAYING == info.playback_state) {
+      const std::chrono::duration<double> captured =
+          std::chrono::steady_clock::now() - start;
+      delays.push_back((captured - info.elapsed_time).count() * 1000);
+    }
+    std::this_thread::sleep_for(std::chrono::milliseconds(100));
+  }
+
+  stop = true;
+  capture_thread.join();
+  reader.Stop();
+  stream_thread.join();
+  close(fds[1]);
+  server->Shutdown();
+  fs::remove(config);
+
+  if (delays.empty()) {
+    std::fprintf(stderr, "The stream never played\n");
+    return EXIT_FAILURE;
+  }
+  std::sort(delays.begin(), delays.end());
+  double sum = 0;
+  for (double delay : delays) {
+    sum += delay;
+  }
+  std::printf("%-10s %10s %10s %10s %10s\n", "samples", "min ms", "avg ms",
+              "p95 ms", "max ms");
+  std::printf("%-10zu %10.1f %10.1f %10.1f %10.1f\n", delays.size(),
+              delays.front(), sum / delays.size(),
+              delays[delays.size() * 95 / 100], delays.back());
+
+  return EXIT_SUCCESS;
+}
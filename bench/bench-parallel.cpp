@@ -0,0 +1,359 @@
+// Copyright (C) 2020 by Jakub Wojciech
+
+// This file is part of Lelo Remote Music Player.
+
+// Lelo Remote Music Player is free software: you can redistribute it
+// and/or modify it under the terms of the GNU General Public License
+// as published by the Free Software Foundation, either version 3 of
+// the License, or (at your option) any later version.
+
+// Lelo Remote Music Player is distributed in the hope that it will be
+// useful, but WITHOUT ANY WARRANTY; without even the implied warranty
+// of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+// General Public License for more details.
+
+// You should have received a copy of the GNU General Public License
+// along with Lelo Remote Music Player. If not, see
+// <https://www.gnu.org/licenses/>.
+
+
+// Measures the throughput of PlayerClient::Play() with the file split over
+// 1, 2, 4 and 8 connections, on links with a few different round trip
+// times.
+//
+// Usage: bench-parallel [SIZE_MIB] [RTT_MS...]
+//
+// The client connects to an in-process server that only counts the
+// received bytes. Its connections go through a local TCP proxy which holds
+// every chunk of data for half of the round trip time in each direction.
+
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstdio>
+#include <deque>
+#include <fstream>
+#include <mutex>
+#include <random>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+#ifndef INCLUDE_GRPCPLUSPLUS
+#include "grpcpp/create_channel.h"
+#include "grpcpp/security/credentials.h"
+#include "grpcpp/security/server_credentials.h"
+#include "grpcpp/server.h"
+#include "grpcpp/server_builder.h"
+#include "grpcpp/support/channel_arguments.h"
+#else
+#include "grpc++/create_channel.h"
+#include "grpc++/security/credentials.h"
+#include "grpc++/security/server_credentials.h"
+#include "grpc++/server.h"
+#include "grpc++/server_builder.h"
+#include "grpc++/support/channel_arguments.h"
+#endif  // INCLUDE_GRPCPLUSPLUS
+
+#include "spdlog/spdlog.h"
+#include "spdlog/sinks/stdout_color_sinks.h"
+
+#include "filesystem.h"
+#include "player_service.grpc.pb.h"
+#include "PlayerClient.h"
+
+using namespace lrm;
+
+namespace {
+class DrainService : public PlayerService::Service {
+ public:
+  grpc::Status AudioStream(grpc::ServerContext* context,
+                           grpc::ServerReader<AudioData>* reader,
+                           MpvResponse* response) override {
+    return drain(context, reader, response);
+  }
+
+  grpc::Status AudioRange(grpc::ServerContext* context,
+                          grpc::ServerReader<AudioData>* reader,
+                          MpvResponse* response) override {
+    return drain(context, reader, response);
+  }
+
+  grpc::Status Ping(grpc::ServerContext*, const Empty*, Empty*) override {
+    return grpc::Status::OK;
+  }
+
+  std::atomic<size_t> received = 0;
+
+ private:
+  grpc::Status drain(grpc::ServerContext* context,
+                     grpc::ServerReader<AudioData>* reader,
+                     MpvResponse* response) {
+    const auto probe = context->client_metadata().find("x-probe-bytes");
+    size_t probe_bytes = probe == context->client_metadata().end() ? 0 :
+        std::stoul(std::string(probe->second.data(), probe->second.size()));
+
+    AudioData data;
+    size_t stream_received = 0;
+    while (reader->Read(&data)) {
+      received += data.data().size();
+      stream_received += data.data().size();
+      // Accept everything, the client waits for it.
+      if (probe_bytes > 0 and stream_received >= probe_bytes) {
+        probe_bytes = 0;
+        context->AddInitialMetadata("x-probe", "ok");
+        reader->SendInitialMetadata();
+      }
+    }
+    response->set_response(0);
+    return grpc::Status::OK;
+  }
+};
+
+/// TCP proxy adding a fixed delay to everything passing through it.
+class DelayProxy {
+ public:
+  DelayProxy(int target_port, std::chrono::milliseconds rtt)
+      : target_port_(target_port), delay_(rtt / 2) {
+    listen_fd_ = socket(AF_INET, SOCK_STREAM, 0);
+    sockaddr_in addr = loopback(0);
+    if (bind(listen_fd_, reinterpret_cast<sockaddr*>(&addr),
+             sizeof(addr)) != 0 or listen(listen_fd_, 16) != 0) {
+      throw std::system_error(errno, std::system_category(),
+                              "Starting the proxy");
+    }
+    socklen_t len = sizeof(addr);
+    getsockname(listen_fd_, reinterpret_cast<sockaddr*>(&addr), &len);
+    port_ = ntohs(addr.sin_port);
+
+    accept_thread_ = std::thread(&DelayProxy::accept_loop, this);
+  }
+
+  ~DelayProxy() {
+    stopped_ = true;
+    shutdown(listen_fd_, SHUT_RDWR);
+    accept_thread_.join();
+    {
+      std::lock_guard<std::mutex> lck(mtx_);
+      for (int fd : fds_) {
+        shutdown(fd, SHUT_RDWR);
+      }
+    }
+    for (auto& thread : threads_) {
+      thread.join();
+    }
+    for (int fd : fds_) {
+      close(fd);
+    }
+    close(listen_fd_);
+  }
+
+  inline int Port() const {
+    return port_;
+  }
+
+ private:
+  using Clock = std::chrono::steady_clock;
+
+  /// Data waiting to be delivered in one direction.
+  struct Pipe {
+    std::mutex mtx;
+    std::condition_variable cv;
+    std::deque<std::pair<Clock::time_point, std::string>> chunks;
+    bool closed = false;
+  };
+
+  static sockaddr_in loopback(int port) {
+    sockaddr_in addr{};
+    addr.sin_family = AF_INET;
+    addr.sin_port = htons(port);
+    addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    return addr;
+  }
+
+  void accept_loop() {
+    for (;;) {
+      const int client = accept(listen_fd_, nullptr, nullptr);
+      if (client < 0 or stopped_) {
+        if (client >= 0) {
+          close(client);
+        }
+        return;
+      }
+      const int server = socket(AF_INET, SOCK_STREAM, 0);
+      sockaddr_in addr = loopback(target_port_);
+      if (connect(server, reinterpret_cast<sockaddr*>(&addr),
+                  sizeof(addr)) != 0) {
+        close(client);
+        close(server);
+        continue;
+      }
+      for (int fd : {client, server}) {
+        const int one = 1;
+        setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &one, sizeof(one));
+      }
+
+      std::lock_guard<std::mutex> lck(mtx_);
+      fds_.push_back(client);
+      fds_.push_back(server);
+      for (const auto& [from, to] : {std::pair{client, server},
+                                     std::pair{server, client}}) {
+        auto pipe = std::make_shared<Pipe>();
+        threads_.emplace_back(&DelayProxy::receive, this, from, pipe);
+        threads_.emplace_back(&DelayProxy::deliver, this, to, pipe);
+      }
+    }
+  }
+
+  void receive(int fd, std::shared_ptr<Pipe> pipe) {
+    std::string buffer(64 * 1024, '\0');
+    ssize_t size;
+    while ((size = read(fd, buffer.data(), buffer.size())) > 0) {
+      std::lock_guard<std::mutex> lck(pipe->mtx);
+      pipe->chunks.emplace_back(Clock::now() + delay_,
+                                buffer.substr(0, size));
+      pipe->cv.notify_one();
+    }
+    std::lock_guard<std::mutex> lck(pipe->mtx);
+    pipe->closed = true;
+    pipe->cv.notify_one();
+  }
+
+  void deliver(int fd, std::shared_ptr<Pipe> pipe) {
+    std::unique_lock<std::mutex> lck(pipe->mtx);
+    for (;;) {
+      pipe->cv.wait(lck, [&]{
+                           return pipe->closed or not pipe->chunks.empty();
+                         });
+      if (pipe->chunks.empty()) {
+        break;
+      }
+      const auto due = pipe->chunks.front().first;
+      if (Clock::now() < due) {
+        pipe->cv.wait_until(lck, due);
+        continue;
+      }
+      const std::string chunk = std::move(pipe->chunks.front().second);
+      pipe->chunks.pop_front();
+
+      lck.unlock();
+      for (size_t sent = 0; sent < chunk.size();) {
+        const ssize_t result = write(fd, chunk.data() + sent,
+                                     chunk.size() - sent);
+        if (result <= 0) {
+          return;
+        }
+        sent += result;
+      }
+      lck.lock();
+    }
+    shutdown(fd, SHUT_WR);
+  }
+
+  const int target_port_;
+  const std::chrono::milliseconds delay_;
+  int listen_fd_ = -1;
+  int port_ = 0;
+  std::atomic<bool> stopped_ = false;
+  std::thread accept_thread_;
+
+  std::mutex mtx_;
+  std::vector<int> fds_;
+  std::vector<std::thread> threads_;
+};
+
+void write_random_file(const fs::path& path, size_t size) {
+  std::mt19937_64 gen(size);
+  std::vector<uint64_t> block(1024 * 1024 / sizeof(uint64_t));
+
+  std::ofstream ofs(path, std::ios::binary);
+  for (size_t written = 0; written < size;) {
+    for (auto& word : block) {
+      word = gen();
+    }
+    const size_t to_write =
+        std::min(size - written, block.size() * sizeof(uint64_t));
+    ofs.write(reinterpret_cast<const char*>(block.data()), to_write);
+    written += to_write;
+  }
+}
+}
+
+int main(int argc, char** argv) {
+  const size_t size_mib = argc > 1 ? std::stoul(argv[1]) : 64;
+  const size_t size = size_mib * 1024 * 1024;
+  std::vector<int> rtts_ms;
+  for (int i = 2; i < argc; ++i) {
+    rtts_ms.push_back(std::stoi(argv[i]));
+  }
+  if (rtts_ms.empty()) {
+    rtts_ms = {0, 20, 80};
+  }
+
+  auto logger = spdlog::stdout_color_mt("PlayerClient");
+  logger->set_level(spdlog::level::warn);
+
+  const fs::path file =
+      fs::temp_directory_path() / "lrm-bench-parallel.bin";
+  write_random_file(file, size);
+
+  DrainService service;
+  int port = 0;
+  grpc::ServerBuilder builder;
+  builder.AddListeningPort("127.0.0.1:0", grpc::InsecureServerCredentials(),
+                           &port);
+  builder.RegisterService(&service);
+  auto server = builder.BuildAndStart();
+
+  std::printf("%-8s %-8s %10s %10s\n", "RTT ms", "streams", "MiB/s",
+              "wall s");
+
+  int exit_status = EXIT_SUCCESS;
+  for (const int rtt_ms : rtts_ms) {
+    DelayProxy proxy(port, std::chrono::milliseconds(rtt_ms));
+    const std::string address = "127.0.0.1:" + std::to_string(proxy.Port());
+
+    for (const int streams : {1, 2, 4, 8}) {
+      // Same arguments as the daemon's channels.
+      grpc::ChannelArguments args;
+      args.SetInt(GRPC_ARG_HTTP2_BDP_PROBE, 1);
+      args.SetInt(GRPC_ARG_USE_LOCAL_SUBCHANNEL_POOL, 1);
+
+      std::vector<std::shared_ptr<grpc::Channel>> channels;
+      for (int i = 0; i < streams; ++i) {
+        channels.push_back(grpc::CreateCustomChannel(
+            address, grpc::InsecureChannelCredentials(), args));
+      }
+      PlayerClient client(channels.front());
+      client.SetHashFirst(false);
+      client.SetUploadChannels(channels);
+
+      service.received = 0;
+      const auto wall_start = std::chrono::steady_clock::now();
+      client.Play(file.string());
+      const std::chrono::duration<double> wall =
+          std::chrono::steady_clock::now() - wall_start;
+
+      if (service.received != size) {
+        std::fprintf(stderr, "%d ms, %d streams: received %zu bytes, "
+                     "expected %zu\n",
+                     rtt_ms, streams, service.received.load(), size);
+        exit_status = EXIT_FAILURE;
+      }
+
+      std::printf("%-8d %-8d %10.1f %10.3f\n", rtt_ms, streams,
+                  size_mib / wall.count(), wall.count());
+    }
+  }
+
+  server->Shutdown();
+  fs::remove(file);
+
+  return exit_status;
+}
@@ -0,0 +1,164 @@
+// Copyright (C) 2020 by Jakub Wojciech
+
+// This file is part of Lelo Remote Music Player.
+
+// Lelo Remote Music Player is free software: you can redistribute it
+// and/or modify it under the terms of the GNU General Public License
+// as published by the Free Software Foundation, either version 3 of
+// the License, or (at your option) any later version.
+
+// Lelo Remote Music Player is distributed in the hope that it will be
+// useful, but WITHOUT ANY WARRANTY; without even the implied warranty
+// of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+// General Public License for more details.
+
+// You should have received a copy of the GNU General Public License
+// along with Lelo Remote Music Player. If not, see
+// <https://www.gnu.org/licenses/>.
+
+
+// Measures the whole server, from the client's upload to the player, on a
+// machine without sound hardware.
+//
+// Usage: bench-service [SIZE_MIB] [REPEATS]
+//
+// An in-process PlayerServiceImpl plays with the null player, which reads
+// the stream as fast as it arrives. Unlike bench-upload, the data goes
+// through the server's spool and the player's reads too. The server logs
+// how fast the player has read every stream. Then the latency of the
+// control commands is measured while nothing is sent.
+
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <fstream>
+#include <random>
+#include <vector>
+
+#ifndef INCLUDE_GRPCPLUSPLUS
+#include "grpcpp/create_channel.h"
+#include "grpcpp/security/credentials.h"
+#include "grpcpp/security/server_credentials.h"
+#include "grpcpp/server.h"
+#include "grpcpp/server_builder.h"
+#else
+#include "grpc++/create_channel.h"
+#include "grpc++/security/credentials.h"
+#include "grpc++/security/server_credentials.h"
+#include "grpc++/server.h"
+#include "grpc++/server_builder.h"
+#endif  // INCLUDE_GRPCPLUSPLUS
+
+#include "spdlog/spdlog.h"
+#include "spdlog/sinks/stdout_color_sinks.h"
+
+#include "filesystem.h"
+#include "Config.h"
+#include "PlayerClient.h"
+#include "PlayerServiceImpl.h"
+
+using namespace lrm;
+
+namespace {
+void write_random_file(const fs::path& path, size_t size) {
+  std::mt19937_64 gen(size);
+  std::vector<uint64_t> block(1024 * 1024 / sizeof(uint64_t));
+
+  std::ofstream ofs(path, std::ios::binary);
+  for (size_t written = 0; written < size;) {
+    for (auto& word : block) {
+      word = gen();
+    }
+    const size_t to_write =
+        std::min(size - written, block.size() * sizeof(uint64_t));
+    ofs.write(reinterpret_cast<const char*>(block.data()), to_write);
+    written += to_write;
+  }
+}
+}
+
+int main(int argc, char** argv) {
+  const size_t size_mib = argc > 1 ? std::stoul(argv[1]) : 256;
+  const int repeats = argc > 2 ? std::stoi(argv[2]) : 3;
+  const size_t size = size_mib * 1024 * 1024;
+
+  const fs::path tmp = fs::temp_directory_path();
+  const fs::path config = tmp / "lrm-bench-service.conf";
+  const fs::path file = tmp / "lrm-bench-service.bin";
+  std::ofstream(config) << "passphrase = bench-service\n"
+                        << "cache_max_bytes = 0\n"
+                        << "audio_output = null\n";
+  Config::Load(config);
+  write_random_file(file, size);
+
+  spdlog::set_level(spdlog::level::info);
+  spdlog::stdout_color_mt("PlayerClient")->set_level(spdlog::level::warn);
+
+  PlayerServiceImpl service;
+  int port = 0;
+  grpc::ServerBuilder builder;
+  builder.AddListeningPort("127.0.0.1:0", grpc::InsecureServerCredentials(),
+                           &port);
+  builder.RegisterService(&service);
+  auto server = builder.BuildAndStart();
+
+  PlayerClient client(grpc::CreateChannel(
+      "127.0.0.1:" + std::to_string(port),
+      grpc::InsecureChannelCredentials()));
+  if (not client.Authenticate()) {
+    std::fprintf(stderr, "Authentication failed\n");
+    return EXIT_FAILURE;
+  }
+  // Send the file every time, the cache is disabled anyway.
+  client.SetHashFirst(false);
+
+  const std::pair<const char*, PlayerClient::UploadMode> modes[] = {
+    {"copy", PlayerClient::COPY},
+    {"mmap", PlayerClient::MMAP}
+  };
+
+  std::vector<std::pair<const char*, double>> results;
+  int exit_status = EXIT_SUCCESS;
+  for (const auto& [name, mode] : modes) {
+    client.SetUploadMode(mode);
+
+    for (int i = 0; i < repeats; ++i) {
+      const auto start = std::chrono::steady_clock::now();
+      try {
+        client.Play(file.string());
+      } catch (const grpc::Status& status) {
+        std::fprintf(stderr, "%s: %s\n", name,
+                     status.error_message().c_str());
+        exit_status = EXIT_FAILURE;
+        continue;
+      }
+      const std::chrono::duration<double> wall =
+          std::chrono::steady_clock::now() - start;
+      results.emplace_back(name, wall.count());
+    }
+  }
+
+  constexpr int CONTROL_SAMPLES = 200;
+  std::vector<double> latencies;
+  for (int i = 0; i < CONTROL_SAMPLES; ++i) {
+    const auto start = std::chrono::steady_clock::now();
+    client.TogglePause();
+    latencies.push_back(std::chrono::duration<double, std::milli>(
+        std::chrono::steady_clock::now() - start).count());
+  }
+  std::sort(latencies.begin(), latencies.end());
+
+  std::printf("\n%-6s %10s %12s\n", "mode", "MiB/s", "wall s");
+  for (const auto& [name, wall] : results) {
+    std::printf("%-6s %10.1f %12.3f\n", name, size_mib / wall, wall);
+  }
+  std::printf("\nTogglePause: p50 %.3f ms, p99 %.3f ms, max %.3f ms\n",
+              latencies[latencies.size() / 2],
+              latencies[latencies.size() * 99 / 100], latencies.back());
+
+  server->Shutdown();
+  fs::remove(file);
+  fs::remove(config);
+
+  return exit_status;
+}
@@ -0,0 +1,118 @@
+// Copyright (C) 2020 by Jakub Wojciech
+
+// This file is part of Lelo Remote Music Player.
+
+// Lelo Remote Music Player is free software: you can redistribute it
+// and/or modify it under the terms of the GNU General Public License
+// as published by the Free Software Foundation, either version 3 of
+// the License, or (at your option) any later version.
+
+// Lelo Remote Music Player is distributed in the hope that it will be
+// useful, but WITHOUT ANY WARRANTY; without even the implied warranty
+// of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+// General Public License for more details.
+
+// You should have received a copy of the GNU General Public License
+// along with Lelo Remote Music Player. If not, see
+// <https://www.gnu.org/licenses/>.
+
+
+// Shows what transcoding on the client saves the server.
+//
+// Usage: bench-transcode FILE [CODEC FORMAT BITRATE]
+//
+// Transcodes FILE like the daemon does, then decodes the original and the
+// result as fast as possible, the way the server's player would without
+// the audio output. Run it on the server's hardware: the difference in the
+// decoding time is the CPU the server saves on every play of the file.
+
+#include <cstdio>
+#include <stdexcept>
+#include <string>
+
+#include <sys/resource.h>
+
+#include "mpv/client.h"
+
+#include "Transcoder.h"
+
+using namespace lrm;
+
+namespace {
+double cpu_seconds() {
+  rusage usage;
+  getrusage(RUSAGE_SELF, &usage);
+  return usage.ru_utime.tv_sec + usage.ru_stime.tv_sec +
+      (usage.ru_utime.tv_usec + usage.ru_stime.tv_usec) / 1e6;
+}
+
+/// Decode \e file without playing it.
+/// \return CPU seconds it took.
+double decode(const std::string& file) {
+  mpv_handle* ctx = mpv_create();
+  mpv_set_option_string(ctx, "ao", "null");
+  mpv_set_option_string(ctx, "untimed", "yes");
+  mpv_set_option_string(ctx, "video", "no");
+  mpv_initialize(ctx);
+
+  const double start = cpu_seconds();
+  const char* command[] = {"loadfile", file.c_str(), nullptr};
+  mpv_command(ctx, command);
+  for (;;) {
+    const mpv_event* event = mpv_wait_event(ctx, -1);
+    if (MPV_EVENT_END_FILE == event->event_id) {
+      const auto* end_file =
+          static_cast<const mpv_event_end_file*>(event->data);
+      if (MPV_END_FILE_REASON_ERROR == end_file->reason) {
+        mpv_terminate_destroy(ctx);
+        throw std::runtime_error("Decoding '" + file + "': " +
+                                 mpv_error_string(end_file->error));
+      }
+      break;
+    }
+  }
+  const double result = cpu_seconds() - start;
+
+  mpv_terminate_destroy(ctx);
+  return result;
+}
+}
+
+int main(int argc, char** argv) {
+  if (argc != 2 and argc != 5) {
+    std::fprintf(stderr, "Usage: %s FILE [CODEC FORMAT BITRATE]\n", argv[0]);
+    return EXIT_FAILURE;
+  }
+  const std::string file = argv[1];
+
+  Transcoder::Settings settings = Transcoder::DEFAULT_SETTINGS;
+  if (5 == argc) {
+    settings.codec = argv[2];
+    settings.format = argv[3];
+    settings.bitrate = std::stoll(argv[4]);
+  }
+
+  Transcoder transcoder({});
+  const auto output = transcoder.Transcode(file, settings);
+  const auto& stats = output->GetStats();
+
+  const double original_cpu = decode(file);
+  const double transcoded_cpu = decode(output->Path().string());
+
+  std::printf("transcoding to %s/%s at %lld b/s: %.2f s of CPU\n\n",
+              settings.codec.c_str(), settings.format.c_str(),
+              static_cast<long long>(settings.bitrate),
+              stats.cpu_time.count());
+  std::printf("%-12s %12s %14s\n", "", "KiB", "decode CPU s");
+  std::printf("%-12s %12llu %14.3f\n", "original",
+              static_cast<unsigned long long>(stats.input_bytes / 1024),
+              original_cpu);
+  std::printf("%-12s %12llu %14.3f\n", "transcoded",
+              static_cast<unsigned long long>(stats.output_bytes / 1024),
+              transcoded_cpu);
+  std::printf("\nsaved: %.0f%% of the bytes, %.0f%% of the decoding CPU\n",
+              100.0 - 100.0 * stats.output_bytes / stats.input_bytes,
+              100.0 - 100.0 * transcoded_cpu / original_cpu);
+
+  return EXIT_SUCCESS;
+}
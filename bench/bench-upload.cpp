@@ -0,0 +1,183 @@
+// Copyright (C) 2020 by Jakub Wojciech
+
+// This file is part of Lelo Remote Music Player.
+
+// Lelo Remote Music Player is free software: you can redistribute it
+// and/or modify it under the terms of the GNU General Public License
+// as published by the Free Software Foundation, either version 3 of
+// the License, or (at your option) any later version.
+
+// Lelo Remote Music Player is distributed in the hope that it will be
+// useful, but WITHOUT ANY WARRANTY; without even the implied warranty
+// of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+// General Public License for more details.
+
+// You should have received a copy of the GNU General Public License
+// along with Lelo Remote Music Player. If not, see
+// <https://www.gnu.org/licenses/>.
+
+// Compares the upload modes of PlayerClient::Play() by streaming a file to
+// an in-process server that only counts the received bytes.
+//
+// Usage: bench-upload [SIZE_MIB] [REPEATS]
+//
+// Both the client and the server run in this process, so the CPU time
+// includes the server's work too. That work is the same for every mode, so
+// the difference between the modes is the cost of the client's upload path.
+
+#include <atomic>
+#include <chrono>
+#include <cstdio>
+#include <fstream>
+#include <random>
+#include <vector>
+
+#include <sys/resource.h>
+
+#ifndef INCLUDE_GRPCPLUSPLUS
+#include "grpcpp/create_channel.h"
+#include "grpcpp/security/credentials.h"
+#include "grpcpp/security/server_credentials.h"
+#include "grpcpp/server.h"
+#include "grpcpp/server_builder.h"
+#else
+#include "grpc++/create_channel.h"
+#include "grpc++/security/credentials.h"
+#include "grpc++/security/server_credentials.h"
+#include "grpc++/server.h"
+#include "grpc++/server_builder.h"
+#endif  // INCLUDE_GRPCPLUSPLUS
+
+#include "spdlog/spdlog.h"
+#include "spdlog/sinks/stdout_color_sinks.h"
+
+#include "filesystem.h"
+#include "player_service.grpc.pb.h"
+#include "PlayerClient.h"
+
+using namespace lrm;
+
+namespace {
+class DrainService : public PlayerService::Service {
+ public:
+  grpc::Status AudioStream(grpc::ServerContext* context,
+                           grpc::ServerReader<AudioData>* reader,
+                           MpvResponse* response) override {
+    const auto probe = context->client_metadata().find("x-probe-bytes");
+    size_t probe_bytes = probe == context->client_metadata().end() ? 0 :
+        std::stoul(std::string(probe->second.data(), probe->second.size()));
+
+    AudioData data;
+    size_t stream_received = 0;
+    while (reader->Read(&data)) {
+      received += data.data().size();
+      stream_received += data.data().size();
+      // Accept everything, the client waits for it.
+      if (probe_bytes > 0 and stream_received >= probe_bytes) {
+        probe_bytes = 0;
+        context->AddInitialMetadata("x-probe", "ok");
+        reader->SendInitialMetadata();
+      }
+    }
+    response->set_response(0);
+    return grpc::Status::OK;
+  }
+
+  grpc::Status Ping(grpc::ServerContext*, const Empty*, Empty*) override {
+    return grpc::Status::OK;
+  }
+
+  std::atomic<size_t> received = 0;
+};
+
+double cpu_seconds() {
+  rusage usage;
+  getrusage(RUSAGE_SELF, &usage);
+  return usage.ru_utime.tv_sec + usage.ru_stime.tv_sec +
+      (usage.ru_utime.tv_usec + usage.ru_stime.tv_usec) / 1e6;
+}
+
+void write_random_file(const fs::path& path, size_t size) {
+  std::mt19937_64 gen(size);
+  std::vector<uint64_t> block(1024 * 1024 / sizeof(uint64_t));
+
+  std::ofstream ofs(path, std::ios::binary);
+  for (size_t written = 0; written < size;) {
+    for (auto& word : block) {
+      word = gen();
+    }
+    const size_t to_write =
+        std::min(size - written, block.size() * sizeof(uint64_t));
+    ofs.write(reinterpret_cast<const char*>(block.data()), to_write);
+    written += to_write;
+  }
+}
+}
+
+int main(int argc, char** argv) {
+  const size_t size_mib = argc > 1 ? std::stoul(argv[1]) : 256;
+  const int repeats = argc > 2 ? std::stoi(argv[2]) : 3;
+  const size_t size = size_mib * 1024 * 1024;
+
+  auto logger = spdlog::stdout_color_mt("PlayerClient");
+  logger->set_level(spdlog::level::warn);
+
+  const fs::path file =
+      fs::temp_directory_path() / "lrm-bench-upload.bin";
+  write_random_file(file, size);
+
+  DrainService service;
+  int port = 0;
+  grpc::ServerBuilder builder;
+  builder.AddListeningPort("127.0.0.1:0", grpc::InsecureServerCredentials(),
+                           &port);
+  builder.RegisterService(&service);
+  auto server = builder.BuildAndStart();
+
+  PlayerClient client(grpc::CreateChannel(
+      "127.0.0.1:" + std::to_string(port),
+      grpc::InsecureChannelCredentials()));
+  // Measure the upload itself, without hashing the file first.
+  client.SetHashFirst(false);
+
+  std::printf("%-6s %10s %12s %12s\n", "mode", "MiB/s", "CPU s/GiB",
+              "wall s");
+
+  const std::pair<const char*, PlayerClient::UploadMode> modes[] = {
+    {"copy", PlayerClient::COPY},
+    {"mmap", PlayerClient::MMAP}
+  };
+
+  int exit_status = EXIT_SUCCESS;
+  for (const auto& [name, mode] : modes) {
+    client.SetUploadMode(mode);
+
+    for (int i = 0; i < repeats; ++i) {
+      service.received = 0;
+
+      const double cpu_start = cpu_seconds();
+      const auto wall_start = std::chrono::steady_clock::now();
+
+      client.Play(file.string());
+
+      const std::chrono::duration<double> wall =
+          std::chrono::steady_clock::now() - wall_start;
+      const double cpu = cpu_seconds() - cpu_start;
+
+      if (service.received != size) {
+        std::fprintf(stderr, "%s: received %zu bytes, expected %zu\n",
+                     name, service.received.load(), size);
+        exit_status = EXIT_FAILURE;
+      }
+
+      const double gib = size / (1024.0 * 1024.0 * 1024.0);
+      std::printf("%-6s %10.1f %12.3f %12.3f\n", name,
+                  size_mib / wall.count(), cpu / gib, wall.count());
+    }
+  }
+
+  server->Shutdown();
+  fs::remove(file);
+
+  return exit_status;
+}
@@ -14,10 +14,13 @@ const char* argp_program_bug_address = "<doesnt@exist.addr>";
 static char doc[] =
     "Lelo Remote Music Control -- Client for Lelo Remote Music Player\v"
     "Commands:\n"
+    "  clear-queue\t\t" "Remove everything but the playing file from the queue\n"
     "  daemon\t\t" "Start a daemon\n"
+    "  enqueue FILE\t\t" "Play the FILE after the ones already queued\n"
     "  info FORMAT\t\t" "Print an info about the currently playing file\n"
     "  ping\t\t\t" "Ping the server\n"
-    "  play FILE\t\t" "Play the FILE\n"
+    "  play FILE\t\t" "Play the FILE; stream it live if it's '-' (stdin) or a FIFO\n"
+    "  queue\t\t\t" "Show the play queue\n"
     "  seek SECONDS\t\t" "Seek forward or backward in the playing file (unreliable)\n"
     "  stop\t\t\t" "Stop the playback\n"
     "  toggle-pause\t\t" "Pause or unpause the playback\n"
@@ -44,6 +47,9 @@ struct arguments {
 // bool value is true if the command requires an argument
 static const std::unordered_map<std::string, bool> commands = {
   {"play", true},
+  {"enqueue", true},
+  {"queue", false},
+  {"clear-queue", false},
   {"seek", true},
   {"stop", false},
   {"toggle-pause", false},
@@ -146,8 +152,9 @@ static error_t global_parse_opt(int key, char* arg, argp_state* state) {
         if (not args->command_arg.empty()) {
           return ARGP_ERR_UNKNOWN;
         }
-        if (args->command == "play") {
-          if (lrm::Util::file_exists(arg)) {
+        if (args->command == "play" or args->command == "enqueue") {
+          if ((args->command == "play" and std::strcmp(arg, "-") == 0) or
+              lrm::Util::file_exists(arg)) {
             args->command_arg = arg;
           } else {
             argp_error(state, "File doesn't exist: %s", arg);
@@ -26,6 +26,8 @@
 #include <future>
 #include <mutex>
 
+#include <unistd.h>
+
 #ifndef INCLUDE_GRPCPLUSPLUS
 #include "grpcpp/create_channel.h"
 #else
@@ -319,7 +321,18 @@ int main(int argc, char** argv) {
   cmd.set_command(args.command);
   cmd.set_command_arg(args.command_arg);
 
-  cmd.SerializeToFileDescriptor(socket.native_handle());
+  if (args.command == "play" and args.command_arg == "-") {
+    // The daemon reads the standard input by itself.
+    try {
+      Util::send_with_fd(socket.native_handle(), cmd.SerializeAsString(),
+                         STDIN_FILENO);
+    } catch (const std::system_error& e) {
+      std::cerr << e.what() << '\n';
+      return EXIT_FAILURE;
+    }
+  } else {
+    cmd.SerializeToFileDescriptor(socket.native_handle());
+  }
   socket.shutdown(socket.shutdown_send);
 
   DaemonResponse response;
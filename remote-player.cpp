@@ -42,6 +42,8 @@
 
 using namespace lrm;
 
+static constexpr int DEFAULT_HTTP2_WINDOW_BYTES = 4 * 1024 * 1024;
+
 const char* argp_program_version = "lrm-server 0.1";
 const char* argp_program_bug_address = "<doesnt@exist.addr>";
 static char doc[] =
@@ -232,6 +234,15 @@ int main(int argc, char** argv) {
   grpc::string address("0.0.0.0:" + Config::Get("grpc_port"));
   builder.AddListeningPort(address, creds);
 
+  // The receiver's window limits how much of an upload can be in flight, so
+  // make it big enough for distant clients and let gRPC adjust it to the
+  // bandwidth-delay product.
+  builder.AddChannelArgument(
+      GRPC_ARG_HTTP2_STREAM_LOOKAHEAD_BYTES,
+      static_cast<int>(Config::GetInt("http2_window_bytes",
+                                      DEFAULT_HTTP2_WINDOW_BYTES)));
+  builder.AddChannelArgument(GRPC_ARG_HTTP2_BDP_PROBE, 1);
+
   builder.RegisterService((Service*) &player_service);
 
   std::unique_ptr<Server> server(builder.BuildAndStart());
@@ -0,0 +1,178 @@
+// Copyright (C) 2020 by Jakub Wojciech
+
+// This file is part of Lelo Remote Music Player.
+
+// Lelo Remote Music Player is free software: you can redistribute it
+// and/or modify it under the terms of the GNU General Public License
+// as published by the Free Software Foundation, either version 3 of
+// the License, or (at your option) any later version.
+
+// Lelo Remote Music Player is distributed in the hope that it will be
+// useful, but WITHOUT ANY WARRANTY; without even the implied warranty
+// of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+// General Public License for more details.
+
+// You should have received a copy of the GNU General Public License
+// along with Lelo Remote Music Player. If not, see
+// <https://www.gnu.org/licenses/>.
+
+#include <gtest/gtest.h>
+
+#include <fstream>
+#include <string>
+
+#include "filesystem.h"
+#include "AudioCache.h"
+
+using namespace lrm;
+
+class AudioCacheTest : public ::testing::Test {
+ protected:
+  const fs::path cache_dir = fs::temp_directory_path() / "lrm-test-cache";
+
+  void SetUp() override {
+    fs::remove_all(cache_dir);
+  }
+
+  void TearDown() override {
+    fs::remove_all(cache_dir);
+  }
+
+  static ContentHash hash_of(const std::string& data) {
+    ContentHasher hasher;
+    hasher.Update(data.data(), data.size());
+    return hasher.Finish();
+  }
+
+  static bool store(AudioCache& cache, const std::string& data) {
+    auto writer = cache.Insert(hash_of(data));
+    if (not writer) {
+      return false;
+    }
+    writer->Write(data.data(), data.size());
+    return writer->Commit();
+  }
+};
+
+TEST_F(AudioCacheTest, stores_and_finds) {
+  AudioCache cache(cache_dir, 1024);
+  const std::string data(100, 'a');
+
+  EXPECT_FALSE(cache.Find(hash_of(data)));
+  ASSERT_TRUE(store(cache, data));
+
+  const auto path = cache.Find(hash_of(data));
+  ASSERT_TRUE(path);
+  EXPECT_EQ(data.size(), fs::file_size(*path));
+  EXPECT_EQ(data.size(), cache.Size());
+
+  EXPECT_FALSE(cache.Insert(hash_of(data))) << "Already in the cache";
+}
+
+TEST_F(AudioCacheTest, rejects_wrong_hash) {
+  AudioCache cache(cache_dir, 1024);
+  const auto hash = hash_of("expected");
+
+  auto writer = cache.Insert(hash);
+  ASSERT_TRUE(writer);
+  writer->Write("something else", 14);
+  EXPECT_FALSE(writer->Commit());
+  writer.reset();
+
+  EXPECT_FALSE(cache.Find(hash));
+  EXPECT_TRUE(fs::is_empty(cache_dir)) << "Partial file left behind";
+}
+
+TEST_F(AudioCacheTest, parts_out_of_order) {
+  AudioCache cache(cache_dir, 1024);
+  const std::string data = "0123456789abcdef";
+
+  auto writer = cache.Insert(hash_of(data));
+  ASSERT_TRUE(writer);
+  writer->WriteAt(8, data.data() + 8, 8);
+  writer->WriteAt(0, data.data(), 8);
+  EXPECT_TRUE(writer->Commit());
+
+  EXPECT_TRUE(cache.Find(hash_of(data)));
+}
+
+TEST_F(AudioCacheTest, evicts_least_recently_used) {
+  AudioCache cache(cache_dir, 250);
+  const std::string a(100, 'a'), b(100, 'b'), c(100, 'c');
+
+  ASSERT_TRUE(store(cache, a));
+  ASSERT_TRUE(store(cache, b));
+  // Now 'b' is the least recently used.
+  ASSERT_TRUE(cache.Find(hash_of(a)));
+  ASSERT_TRUE(store(cache, c));
+
+  EXPECT_TRUE(cache.Find(hash_of(a)));
+  EXPECT_FALSE(cache.Find(hash_of(b)));
+  EXPECT_TRUE(cache.Find(hash_of(c)));
+  EXPECT_EQ(200, cache.Size());
+}
+
+TEST_F(AudioCacheTest, keeps_files_after_restart) {
+  const std::string data(100, 'a');
+  {
+    AudioCache cache(cache_dir, 1024);
+    ASSERT_TRUE(store(cache, data));
+  }
+
+  AudioCache cache(cache_dir, 1024);
+  EXPECT_TRUE(cache.Find(hash_of(data)));
+  EXPECT_EQ(data.size(), cache.Size());
+}
+
+TEST_F(AudioCacheTest, drops_files_not_matching_their_names) {
+  const std::string data(100, 'a');
+  {
+    AudioCache cache(cache_dir, 1024);
+    ASSERT_TRUE(store(cache, data));
+  }
+  // Someone else has put a different file under the name.
+  std::ofstream(cache_dir / to_hex(hash_of(data)), std::ios::trunc)
+      << "something else";
+
+  AudioCache cache(cache_dir, 1024);
+  EXPECT_FALSE(cache.Find(hash_of(data)));
+  EXPECT_EQ(0, cache.Size());
+  EXPECT_TRUE(fs::is_empty(cache_dir));
+}
+
+TEST_F(AudioCacheTest, doesnt_follow_planted_links) {
+  const fs::path target = fs::temp_directory_path() / "lrm-test-target";
+  std::ofstream(target) << "precious";
+
+  AudioCache cache(cache_dir, 1024);
+  const std::string data(100, 'a');
+  fs::create_symlink(target,
+                     cache_dir / (to_hex(hash_of(data)) + ".part"));
+  ASSERT_TRUE(store(cache, data));
+
+  std::string contents;
+  std::ifstream(target) >> contents;
+  EXPECT_EQ("precious", contents);
+  EXPECT_FALSE(fs::is_symlink(*cache.Find(hash_of(data))));
+  fs::remove(target);
+}
+
+TEST_F(AudioCacheTest, directory_is_private) {
+  fs::create_directories(cache_dir);
+  fs::permissions(cache_dir, fs::perms::all);
+
+  AudioCache cache(cache_dir, 1024);
+  EXPECT_EQ(fs::perms::owner_all,
+            fs::status(cache_dir).permissions() & fs::perms::all);
+}
+
+TEST(ContentHash, hex_round_trip) {
+  ContentHash hash;
+  for (size_t i = 0; i < hash.size(); ++i) {
+    hash[i] = static_cast<unsigned char>(i * 9);
+  }
+
+  EXPECT_EQ(hash, content_hash_from_hex(to_hex(hash)));
+  EXPECT_FALSE(content_hash_from_hex("abc"));
+  EXPECT_FALSE(content_hash_from_hex(std::string(64, 'g')));
+}
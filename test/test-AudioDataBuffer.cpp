@@ -0,0 +1,88 @@
+// Copyright (C) 2020 by Jakub Wojciech
+
+// This file is part of Lelo Remote Music Player.
+
+// Lelo Remote Music Player is free software: you can redistribute it
+// and/or modify it under the terms of the GNU General Public License
+// as published by the Free Software Foundation, either version 3 of
+// the License, or (at your option) any later version.
+
+// Lelo Remote Music Player is distributed in the hope that it will be
+// useful, but WITHOUT ANY WARRANTY; without even the implied warranty
+// of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+// General Public License for more details.
+
+// You should have received a copy of the GNU General Public License
+// along with Lelo Remote Music Player. If not, see
+// <https://www.gnu.org/licenses/>.
+
+#include <gtest/gtest.h>
+
+#include <fstream>
+#include <string>
+#include <vector>
+
+#include "filesystem.h"
+#include "player_service.pb.h"
+#include "AudioDataBuffer.h"
+#include "MappedFile.h"
+
+using namespace lrm;
+
+class AudioDataBufferTest : public ::testing::TestWithParam<size_t> {
+ protected:
+  static constexpr char test_file[] = "lrm-test-audio-data.bin";
+
+  void SetUp() override {
+    contents.resize(300 * 1000);
+    for (size_t i = 0; i < contents.size(); ++i) {
+      contents[i] = static_cast<char>(i * 7 + i / 251);
+    }
+    std::ofstream ofs(test_file, std::ios::binary);
+    ofs.write(contents.data(), contents.size());
+  }
+
+  void TearDown() override {
+    fs::remove(test_file);
+  }
+
+  static std::string to_string(const grpc::ByteBuffer& buffer) {
+    std::vector<grpc::Slice> slices;
+    EXPECT_TRUE(buffer.Dump(&slices).ok());
+
+    std::string result;
+    for (const auto& slice : slices) {
+      result.append(reinterpret_cast<const char*>(slice.begin()),
+                    slice.size());
+    }
+    return result;
+  }
+
+  std::string contents;
+};
+
+TEST_P(AudioDataBufferTest, parses_as_AudioData) {
+  const size_t size = GetParam();
+  const size_t offset = 1234;
+
+  grpc::ByteBuffer buffer;
+  {
+    // The buffer must keep the mapping alive on its own.
+    auto file = std::make_shared<const MappedFile>(test_file);
+    buffer = make_audio_data(file, offset, size);
+  }
+
+  AudioData data;
+  ASSERT_TRUE(data.ParseFromString(to_string(buffer)));
+  EXPECT_EQ(contents.substr(offset, size), data.data());
+}
+
+// Sizes around the boundaries of the varint encoding of the length.
+INSTANTIATE_TEST_SUITE_P(Sizes, AudioDataBufferTest,
+                         ::testing::Values(1, 127, 128, 16383, 16384,
+                                           200 * 1000));
+
+TEST(MappedFile, nonexistent_file) {
+  EXPECT_THROW(MappedFile("lrm-test-doesnt-exist.bin"),
+               std::invalid_argument);
+}
@@ -0,0 +1,117 @@
+// Copyright (C) 2020 by Jakub Wojciech
+
+// This file is part of Lelo Remote Music Player.
+
+// Lelo Remote Music Player is free software: you can redistribute it
+// and/or modify it under the terms of the GNU General Public License
+// as published by the Free Software Foundation, either version 3 of
+// the License, or (at your option) any later version.
+
+// Lelo Remote Music Player is distributed in the hope that it will be
+// useful, but WITHOUT ANY WARRANTY; without even the implied warranty
+// of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+// General Public License for more details.
+
+// You should have received a copy of the GNU General Public License
+// along with Lelo Remote Music Player. If not, see
+// <https://www.gnu.org/licenses/>.
+
+#include <gtest/gtest.h>
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <stdexcept>
+#include <thread>
+
+#include <sys/resource.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+
+#include "Executor.h"
+
+using namespace lrm;
+
+namespace {
+int thread_nice() {
+  return getpriority(PRIO_PROCESS, static_cast<id_t>(syscall(SYS_gettid)));
+}
+}
+
+TEST(Executor, returns_results_and_exceptions) {
+  Executor executor("test", 1, 0);
+
+  EXPECT_EQ(42, executor.Run([]{ return 42; }));
+  EXPECT_NE(std::this_thread::get_id(),
+            executor.Run([]{ return std::this_thread::get_id(); }));
+  EXPECT_THROW(executor.Run([]() -> int {
+                              throw std::runtime_error("error");
+                            }),
+               std::runtime_error);
+}
+
+TEST(Executor, limits_threads) {
+  Executor executor("test", 2, 0);
+  std::atomic<int> running = 0;
+  std::atomic<int> most_running = 0;
+
+  std::vector<std::thread> callers;
+  for (int i = 0; i < 6; ++i) {
+    callers.emplace_back([&]{
+                           executor.Run([&]{
+                             const int now = ++running;
+                             int most = most_running;
+                             while (now > most and
+                                    not most_running.compare_exchange_weak(
+                                        most, now)) {}
+                             std::this_thread::sleep_for(
+                                 std::chrono::milliseconds(20));
+                             --running;
+                           });
+                         });
+  }
+  for (auto& caller : callers) {
+    caller.join();
+  }
+
+  EXPECT_EQ(2, most_running);
+  EXPECT_EQ(2, executor.Threads());
+}
+
+TEST(Executor, grows_without_limit) {
+  Executor executor("test", 0, 0);
+  constexpr int count = 5;
+  std::atomic<int> arrived = 0;
+
+  // Every task waits for all of the others, so they must run at once.
+  std::vector<std::thread> callers;
+  for (int i = 0; i < count; ++i) {
+    callers.emplace_back([&]{
+                           executor.Run([&]{
+                             ++arrived;
+                             const auto deadline =
+                                 std::chrono::steady_clock::now() +
+                                 std::chrono::seconds(5);
+                             while (arrived < count and
+                                    std::chrono::steady_clock::now() <
+                                    deadline) {
+                               std::this_thread::yield();
+                             }
+                           });
+                         });
+  }
+  for (auto& caller : callers) {
+    caller.join();
+  }
+
+  EXPECT_EQ(count, arrived);
+  EXPECT_EQ(count, executor.Threads());
+}
+
+TEST(Executor, lowers_priority) {
+  const int before = thread_nice();
+  Executor executor("test", 1, 5);
+  EXPECT_EQ(std::min(before + 5, 19), executor.Run(thread_nice));
+  // The caller's thread isn't affected.
+  EXPECT_EQ(before, thread_nice());
+}
@@ -0,0 +1,105 @@
+// Copyright (C) 2020 by Jakub Wojciech
+
+// This file is part of Lelo Remote Music Player.
+
+// Lelo Remote Music Player is free software: you can redistribute it
+// and/or modify it under the terms of the GNU General Public License
+// as published by the Free Software Foundation, either version 3 of
+// the License, or (at your option) any later version.
+
+// Lelo Remote Music Player is distributed in the hope that it will be
+// useful, but WITHOUT ANY WARRANTY; without even the implied warranty
+// of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+// General Public License for more details.
+
+// You should have received a copy of the GNU General Public License
+// along with Lelo Remote Music Player. If not, see
+// <https://www.gnu.org/licenses/>.
+
+#include <gtest/gtest.h>
+
+#include <fstream>
+#include <random>
+#include <vector>
+
+#include "filesystem.h"
+#include "FileChunkReader.h"
+
+using namespace lrm;
+
+class FileChunkReaderTest : public ::testing::Test {
+ protected:
+  static constexpr char test_file[] = "lrm-test-chunk-reader.bin";
+
+  void WriteTestFile(size_t size) {
+    std::mt19937 gen(size);
+    std::uniform_int_distribution<int> dist(0, 255);
+
+    contents.resize(size);
+    for (auto& c : contents) {
+      c = static_cast<char>(dist(gen));
+    }
+
+    std::ofstream ofs(test_file, std::ios::binary);
+    ofs.write(contents.data(), contents.size());
+  }
+
+  std::vector<char> ReadAll(FileChunkReader& reader) {
+    std::vector<char> result;
+    while (const auto chunk = reader.Next()) {
+      EXPECT_LE(chunk.size(), reader.ChunkSize());
+      result.insert(result.end(), chunk.data(), chunk.data() + chunk.size());
+    }
+    return result;
+  }
+
+  void TearDown() override {
+    fs::remove(test_file);
+  }
+
+  std::vector<char> contents;
+};
+
+TEST_F(FileChunkReaderTest, reads_whole_file) {
+  // Not a multiple of the chunk size and more than the pool can hold.
+  WriteTestFile(100 * 1000 + 7);
+
+  FileChunkReader reader(test_file, 4096, 2);
+  EXPECT_EQ(contents, ReadAll(reader));
+  EXPECT_FALSE(reader.Next()) << "Chunk returned after the end of file";
+}
+
+TEST_F(FileChunkReaderTest, chunk_size_multiple) {
+  WriteTestFile(4 * 4096);
+
+  FileChunkReader reader(test_file, 4096, 3);
+  EXPECT_EQ(contents, ReadAll(reader));
+}
+
+TEST_F(FileChunkReaderTest, empty_file) {
+  WriteTestFile(0);
+
+  FileChunkReader reader(test_file);
+  EXPECT_FALSE(reader.Next());
+}
+
+TEST_F(FileChunkReaderTest, starts_at_offset) {
+  WriteTestFile(10 * 1000);
+
+  FileChunkReader reader(test_file, 4096, 2, 1234);
+  EXPECT_EQ(std::vector<char>(contents.begin() + 1234, contents.end()),
+            ReadAll(reader));
+}
+
+TEST_F(FileChunkReaderTest, destroy_before_the_end) {
+  WriteTestFile(100 * 1000);
+
+  // The reading thread is blocked on a full pool, it should still stop.
+  FileChunkReader reader(test_file, 1024, 2);
+  EXPECT_TRUE(reader.Next());
+}
+
+TEST(FileChunkReader, nonexistent_file) {
+  EXPECT_THROW(FileChunkReader("lrm-test-doesnt-exist.bin"),
+               std::invalid_argument);
+}
@@ -0,0 +1,79 @@
+// Copyright (C) 2020 by Jakub Wojciech
+
+// This file is part of Lelo Remote Music Player.
+
+// Lelo Remote Music Player is free software: you can redistribute it
+// and/or modify it under the terms of the GNU General Public License
+// as published by the Free Software Foundation, either version 3 of
+// the License, or (at your option) any later version.
+
+// Lelo Remote Music Player is distributed in the hope that it will be
+// useful, but WITHOUT ANY WARRANTY; without even the implied warranty
+// of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+// General Public License for more details.
+
+// You should have received a copy of the GNU General Public License
+// along with Lelo Remote Music Player. If not, see
+// <https://www.gnu.org/licenses/>.
+
+
+#include <gtest/gtest.h>
+
+#include <chrono>
+#include <string>
+#include <thread>
+
+#include <unistd.h>
+
+#include "LiveReader.h"
+
+using namespace lrm;
+
+class LiveReaderTest : public ::testing::Test {
+ protected:
+  void SetUp() override {
+    ASSERT_EQ(0, pipe(fds));
+  }
+
+  void TearDown() override {
+    if (fds[1] != -1) {
+      close(fds[1]);
+    }
+  }
+
+  int fds[2];
+};
+
+TEST_F(LiveReaderTest, returns_available_data) {
+  LiveReader reader(fds[0], 4096);
+  ASSERT_EQ(3, write(fds[1], "abc", 3));
+
+  // Doesn't wait for the buffer to fill.
+  std::string out(64, '\0');
+  ASSERT_EQ(3, reader.Read(out.data(), out.size()));
+  EXPECT_EQ("abc", out.substr(0, 3));
+}
+
+TEST_F(LiveReaderTest, end_of_pipe) {
+  LiveReader reader(fds[0], 0);
+  ASSERT_EQ(2, write(fds[1], "ab", 2));
+  close(fds[1]);
+  fds[1] = -1;
+
+  char out[4];
+  EXPECT_EQ(2, reader.Read(out, sizeof(out)));
+  EXPECT_EQ(0, reader.Read(out, sizeof(out)));
+}
+
+TEST_F(LiveReaderTest, stop_unblocks_reader) {
+  LiveReader reader(fds[0]);
+  std::thread stopper([&]{
+                        std::this_thread::sleep_for(
+                            std::chrono::milliseconds(20));
+                        reader.Stop();
+                      });
+
+  char out[4];
+  EXPECT_EQ(0, reader.Read(out, sizeof(out)));
+  stopper.join();
+}
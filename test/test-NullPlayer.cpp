@@ -0,0 +1,140 @@
+// Copyright (C) 2020 by Jakub Wojciech
+
+// This file is part of Lelo Remote Music Player.
+
+// Lelo Remote Music Player is free software: you can redistribute it
+// and/or modify it under the terms of the GNU General Public License
+// as published by the Free Software Foundation, either version 3 of
+// the License, or (at your option) any later version.
+
+// Lelo Remote Music Player is distributed in the hope that it will be
+// useful, but WITHOUT ANY WARRANTY; without even the implied warranty
+// of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+// General Public License for more details.
+
+// You should have received a copy of the GNU General Public License
+// along with Lelo Remote Music Player. If not, see
+// <https://www.gnu.org/licenses/>.
+
+
+#include <gtest/gtest.h>
+
+#include <atomic>
+#include <chrono>
+#include <fstream>
+#include <functional>
+#include <thread>
+
+#include "filesystem.h"
+#include "NullPlayer.h"
+#include "RingBuffer.h"
+
+using namespace lrm;
+
+namespace {
+/// Wait until \e condition is met.
+/// \return \b false if it wasn't within a few seconds.
+bool wait_for(const std::function<bool()>& condition) {
+  const auto end = std::chrono::steady_clock::now() + std::chrono::seconds(5);
+  while (not condition()) {
+    if (std::chrono::steady_clock::now() > end) {
+      return false;
+    }
+    std::this_thread::sleep_for(std::chrono::milliseconds(1));
+  }
+  return true;
+}
+}
+
+TEST(NullPlayer, plays_file_to_the_end) {
+  const fs::path file = fs::temp_directory_path() / "lrm-test-null.bin";
+  std::ofstream(file, std::ios::binary)
+      << std::string(NullPlayer::BYTES_PER_SECOND * 2, 'x');
+
+  NullPlayer player;
+  std::atomic<bool> played = false;
+  player.SetStateChangeCallback([&](const PlaybackState::State& state) {
+                                  if (PlaybackState::PLAYING == state) {
+                                    played = true;
+                                  }
+                                });
+  player.Input(file.string());
+  ASSERT_EQ(MPV_ERROR_SUCCESS, player.Play());
+
+  EXPECT_TRUE(wait_for([&]{
+                         return played and PlaybackState::STOPPED ==
+                             player.GetPlaybackState();
+                       }));
+  EXPECT_FALSE(player.GetProperties().Has(Player::TIME_POSITION));
+  fs::remove(file);
+}
+
+TEST(NullPlayer, times_from_stream_bytes) {
+  auto source = std::make_shared<RingBuffer>(1024 * 1024);
+  std::atomic<int> loaded = -1;
+
+  NullPlayer player;
+  ASSERT_EQ(MPV_ERROR_SUCCESS,
+            player.PlayFromStream(source, [&](bool ok){ loaded = ok; }));
+
+  const std::string second(NullPlayer::BYTES_PER_SECOND, 'x');
+  source->Write(second.data(), second.size());
+  ASSERT_TRUE(wait_for([&]{
+                         return 1 == player.GetProperties().time_position;
+                       }));
+  EXPECT_EQ(1, loaded);
+  EXPECT_EQ(PlaybackState::PLAYING, player.GetPlaybackState());
+  // The size of a stream isn't known.
+  EXPECT_FALSE(player.GetProperties().Has(Player::TOTAL_TIME));
+
+  source->CloseWrite();
+  EXPECT_TRUE(wait_for([&]{
+                         return PlaybackState::STOPPED ==
+                             player.GetPlaybackState();
+                       }));
+}
+
+TEST(NullPlayer, pause_and_volume) {
+  auto source = std::make_shared<RingBuffer>(1024);
+  NullPlayer player;
+  player.PlayFromStream(source);
+
+  int result = -1;
+  player.TogglePause([&](int reply){ result = reply; });
+  EXPECT_EQ(MPV_ERROR_SUCCESS, result);
+  EXPECT_EQ(PlaybackState::PAUSED, player.GetPlaybackState());
+  EXPECT_TRUE(player.GetProperties().paused);
+
+  int changed = -1;
+  player.SetVolumeChangeCallback([&](int volume){ changed = volume; });
+  player.Volume("50", {});
+  EXPECT_EQ(50, changed);
+  player.Volume("-", {});
+  EXPECT_EQ(45, player.Volume());
+  player.Volume("+100", {});
+  EXPECT_EQ(100, player.Volume());
+  player.Volume("loud", [&](int reply){ result = reply; });
+  EXPECT_EQ(MPV_ERROR_INVALID_PARAMETER, result);
+}
+
+TEST(NullPlayer, queue) {
+  auto source = std::make_shared<RingBuffer>(1024);
+  NullPlayer player;
+  // Nothing is written, so the stream plays until it's stopped.
+  player.PlayFromStream(source);
+  player.Enqueue("a.flac");
+  player.Enqueue("b.flac");
+
+  int64_t current;
+  EXPECT_EQ((std::vector<std::string>{"stream", "a.flac", "b.flac"}),
+            player.Queue(&current));
+  EXPECT_EQ(0, current);
+
+  player.ClearQueue();
+  EXPECT_EQ(1, player.Queue(&current).size());
+
+  player.Stop({});
+  EXPECT_TRUE(player.Queue(&current).empty());
+  EXPECT_EQ(-1, current);
+  EXPECT_TRUE(source->IsCancelled());
+}
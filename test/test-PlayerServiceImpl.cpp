@@ -0,0 +1,108 @@
+// Copyright (C) 2020 by Jakub Wojciech
+
+// This file is part of Lelo Remote Music Player.
+
+// Lelo Remote Music Player is free software: you can redistribute it
+// and/or modify it under the terms of the GNU General Public License
+// as published by the Free Software Foundation, either version 3 of
+// the License, or (at your option) any later version.
+
+// Lelo Remote Music Player is distributed in the hope that it will be
+// useful, but WITHOUT ANY WARRANTY; without even the implied warranty
+// of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+// General Public License for more details.
+
+// You should have received a copy of the GNU General Public License
+// along with Lelo Remote Music Player. If not, see
+// <https://www.gnu.org/licenses/>.
+
+
+#include <gtest/gtest.h>
+
+#include <chrono>
+#include <fstream>
+#include <memory>
+#include <vector>
+
+#ifndef INCLUDE_GRPCPLUSPLUS
+#include "grpcpp/create_channel.h"
+#include "grpcpp/security/credentials.h"
+#include "grpcpp/security/server_credentials.h"
+#include "grpcpp/server.h"
+#include "grpcpp/server_builder.h"
+#include "grpcpp/support/channel_arguments.h"
+#else
+#include "grpc++/create_channel.h"
+#include "grpc++/security/credentials.h"
+#include "grpc++/security/server_credentials.h"
+#include "grpc++/server.h"
+#include "grpc++/server_builder.h"
+#include "grpc++/support/channel_arguments.h"
+#endif  // INCLUDE_GRPCPLUSPLUS
+
+#include "spdlog/spdlog.h"
+#include "spdlog/sinks/null_sink.h"
+
+#include "filesystem.h"
+#include "Config.h"
+#include "PlayerClient.h"
+#include "PlayerServiceImpl.h"
+
+using namespace lrm;
+
+// The ranges wait for the upload to start and for each other. That must not
+// take the stream threads from the ones that could make progress.
+TEST(PlayerServiceImpl, receives_more_ranges_than_stream_threads) {
+  constexpr int RANGES = 4;
+  const fs::path file = fs::temp_directory_path() / "lrm-test-ranges.bin";
+  // Large enough to be sent in parts.
+  std::ofstream(file, std::ios::binary) << std::string(8 * 1024 * 1024, 'x');
+
+  if (not spdlog::get("PlayerClient")) {
+    spdlog::null_logger_mt("PlayerClient");
+  }
+  Config::Set("passphrase", "test-ranges");
+  Config::Set("audio_output", "null");
+  Config::Set("cache_max_bytes", "0");
+  Config::Set("stream_threads", "1");
+
+  {
+    PlayerServiceImpl service;
+    int port = 0;
+    grpc::ServerBuilder builder;
+    builder.AddListeningPort("127.0.0.1:0",
+                             grpc::InsecureServerCredentials(), &port);
+    builder.RegisterService(&service);
+    const auto server = builder.BuildAndStart();
+    ASSERT_NE(0, port);
+
+    const std::string address = "127.0.0.1:" + std::to_string(port);
+    std::vector<std::shared_ptr<grpc::Channel>> channels;
+    for (int i = 0; i < RANGES; ++i) {
+      // Separate connections, like the client makes for the ranges.
+      grpc::ChannelArguments args;
+      args.SetInt(GRPC_ARG_USE_LOCAL_SUBCHANNEL_POOL, 1);
+      channels.push_back(grpc::CreateCustomChannel(
+          address, grpc::InsecureChannelCredentials(), args));
+    }
+
+    PlayerClient client(channels.front());
+    ASSERT_TRUE(client.Authenticate());
+    client.SetHashFirst(false);
+    client.SetUploadChannels(channels);
+
+    // Otherwise a range would be stuck until the server gives up on it.
+    const auto start = std::chrono::steady_clock::now();
+    EXPECT_NO_THROW(client.Play(file.string()));
+    EXPECT_LT(std::chrono::steady_clock::now() - start,
+              std::chrono::seconds(5));
+
+    server->Shutdown();
+  }
+
+  for (const auto* variable : {"passphrase", "audio_output",
+                               "cache_max_bytes", "stream_threads"}) {
+    Config::Unset(variable);
+  }
+  fs::remove(file);
+}
@@ -0,0 +1,88 @@
+// Copyright (C) 2020 by Jakub Wojciech
+
+// This file is part of Lelo Remote Music Player.
+
+// Lelo Remote Music Player is free software: you can redistribute it
+// and/or modify it under the terms of the GNU General Public License
+// as published by the Free Software Foundation, either version 3 of
+// the License, or (at your option) any later version.
+
+// Lelo Remote Music Player is distributed in the hope that it will be
+// useful, but WITHOUT ANY WARRANTY; without even the implied warranty
+// of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+// General Public License for more details.
+
+// You should have received a copy of the GNU General Public License
+// along with Lelo Remote Music Player. If not, see
+// <https://www.gnu.org/licenses/>.
+
+
+#include <gtest/gtest.h>
+
+#include "ReadaheadTuner.h"
+
+using namespace lrm;
+using namespace std::chrono_literals;
+
+namespace {
+/// Simulate \e count messages arriving every \e gap.
+std::chrono::steady_clock::time_point arrive_regularly(
+    ReadaheadTuner* tuner, std::chrono::steady_clock::time_point start,
+    std::chrono::steady_clock::duration gap, int count) {
+  auto now = start;
+  for (int i = 0; i < count; ++i) {
+    now += gap;
+    tuner->Arrived(now);
+  }
+  return now;
+}
+}
+
+TEST(ReadaheadTuner, regular_stream_stays_at_base) {
+  ReadaheadTuner tuner(2, 30);
+  arrive_regularly(&tuner, {}, 100ms, 1000);
+  EXPECT_EQ(2, tuner.Readahead());
+  EXPECT_NEAR(0, tuner.Jitter(), 1e-6);
+}
+
+TEST(ReadaheadTuner, stall_raises_readahead) {
+  ReadaheadTuner tuner(2, 30);
+  auto now = arrive_regularly(&tuner, {}, 100ms, 100);
+
+  // Wi-Fi drops for 3 seconds.
+  now += 3s;
+  EXPECT_TRUE(tuner.Arrived(now));
+  EXPECT_NEAR(2 + ReadaheadTuner::MARGIN * 2.9, tuner.Readahead(),
+              ReadaheadTuner::STEP);
+}
+
+TEST(ReadaheadTuner, goes_back_to_base) {
+  ReadaheadTuner tuner(2, 30);
+  auto now = arrive_regularly(&tuner, {}, 100ms, 100);
+  now += 5s;
+  tuner.Arrived(now);
+  ASSERT_GT(tuner.Readahead(), 10);
+
+  // Ten half-lives later the stall is forgotten.
+  arrive_regularly(&tuner, now, 100ms, 10 * 600);
+  EXPECT_EQ(2, tuner.Readahead());
+}
+
+TEST(ReadaheadTuner, stays_in_range) {
+  ReadaheadTuner tuner(2, 10);
+  auto now = arrive_regularly(&tuner, {}, 100ms, 100);
+  now += 9s;
+  tuner.Arrived(now);
+  EXPECT_EQ(10, tuner.Readahead());
+}
+
+TEST(ReadaheadTuner, ignores_gaps_beyond_max) {
+  ReadaheadTuner tuner(2, 10);
+  auto now = arrive_regularly(&tuner, {}, 100ms, 100);
+
+  // The playback was paused for a minute.
+  now += 60s;
+  EXPECT_FALSE(tuner.Arrived(now));
+  arrive_regularly(&tuner, now, 100ms, 100);
+  EXPECT_EQ(2, tuner.Readahead());
+}
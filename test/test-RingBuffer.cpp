@@ -0,0 +1,119 @@
+// Copyright (C) 2020 by Jakub Wojciech
+
+// This file is part of Lelo Remote Music Player.
+
+// Lelo Remote Music Player is free software: you can redistribute it
+// and/or modify it under the terms of the GNU General Public License
+// as published by the Free Software Foundation, either version 3 of
+// the License, or (at your option) any later version.
+
+// Lelo Remote Music Player is distributed in the hope that it will be
+// useful, but WITHOUT ANY WARRANTY; without even the implied warranty
+// of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+// General Public License for more details.
+
+// You should have received a copy of the GNU General Public License
+// along with Lelo Remote Music Player. If not, see
+// <https://www.gnu.org/licenses/>.
+
+#include <gtest/gtest.h>
+
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "RingBuffer.h"
+
+using namespace lrm;
+
+TEST(RingBuffer, capacity_is_power_of_2) {
+  EXPECT_EQ(1024, RingBuffer(1000).Capacity());
+  EXPECT_EQ(1024, RingBuffer(1024).Capacity());
+}
+
+TEST(RingBuffer, wraps_around) {
+  RingBuffer buffer(8);
+  std::string out(8, '\0');
+
+  ASSERT_EQ(6, buffer.Write("abcdef", 6));
+  ASSERT_EQ(4, buffer.Read(out.data(), 4));
+  EXPECT_EQ("abcd", out.substr(0, 4));
+
+  // Goes over the end of the underlying array.
+  ASSERT_EQ(6, buffer.Write("ghijkl", 6));
+  EXPECT_EQ(8, buffer.Size());
+  ASSERT_EQ(8, buffer.Read(out.data(), out.size()));
+  EXPECT_EQ("efghijkl", out);
+}
+
+TEST(RingBuffer, end_of_stream) {
+  RingBuffer buffer(16);
+  std::string out(16, '\0');
+
+  buffer.Write("abc", 3);
+  buffer.CloseWrite();
+
+  EXPECT_EQ(3, buffer.Read(out.data(), out.size()));
+  EXPECT_EQ(0, buffer.Read(out.data(), out.size()));
+}
+
+TEST(RingBuffer, threaded_transfer) {
+  constexpr size_t size = 1000 * 1000 + 3;
+  std::vector<char> input(size);
+  for (size_t i = 0; i < size; ++i) {
+    input[i] = static_cast<char>(i * 13 + i / 256);
+  }
+
+  // Small buffer and odd block sizes so both sides have to wait.
+  RingBuffer buffer(4096);
+  std::thread writer([&]{
+                       for (size_t pos = 0; pos < size; pos += 1000) {
+                         const size_t len = std::min<size_t>(1000,
+                                                             size - pos);
+                         ASSERT_EQ(len, buffer.Write(&input[pos], len));
+                       }
+                       buffer.CloseWrite();
+                     });
+
+  std::vector<char> output;
+  char block[777];
+  int64_t read;
+  while ((read = buffer.Read(block, sizeof(block))) > 0) {
+    output.insert(output.end(), block, block + read);
+  }
+  writer.join();
+
+  EXPECT_EQ(0, read);
+  EXPECT_EQ(input, output);
+
+  const auto stats = buffer.GetStats();
+  EXPECT_EQ(size, stats.bytes_written);
+  EXPECT_EQ(size, stats.bytes_read);
+}
+
+TEST(RingBuffer, cancel_unblocks_writer) {
+  RingBuffer buffer(4);
+  std::thread canceller([&]{
+                          std::this_thread::sleep_for(
+                              std::chrono::milliseconds(20));
+                          buffer.Cancel();
+                        });
+
+  // Only 4 bytes fit, the rest waits until cancelled.
+  EXPECT_EQ(4, buffer.Write("abcdefgh", 8));
+  canceller.join();
+  EXPECT_TRUE(buffer.IsCancelled());
+}
+
+TEST(RingBuffer, cancel_unblocks_reader) {
+  RingBuffer buffer(4);
+  std::thread canceller([&]{
+                          std::this_thread::sleep_for(
+                              std::chrono::milliseconds(20));
+                          buffer.Cancel();
+                        });
+
+  char out[4];
+  EXPECT_EQ(-1, buffer.Read(out, sizeof(out)));
+  canceller.join();
+}
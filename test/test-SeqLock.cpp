@@ -0,0 +1,82 @@
+// Copyright (C) 2020 by Jakub Wojciech
+
+// This file is part of Lelo Remote Music Player.
+
+// Lelo Remote Music Player is free software: you can redistribute it
+// and/or modify it under the terms of the GNU General Public License
+// as published by the Free Software Foundation, either version 3 of
+// the License, or (at your option) any later version.
+
+// Lelo Remote Music Player is distributed in the hope that it will be
+// useful, but WITHOUT ANY WARRANTY; without even the implied warranty
+// of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+// General Public License for more details.
+
+// You should have received a copy of the GNU General Public License
+// along with Lelo Remote Music Player. If not, see
+// <https://www.gnu.org/licenses/>.
+
+
+#include <gtest/gtest.h>
+
+#include <atomic>
+#include <thread>
+#include <vector>
+
+#include "SeqLock.h"
+
+using namespace lrm;
+
+namespace {
+// Bigger than a word, so a torn read would show.
+struct Triple {
+  int64_t a = 0;
+  int64_t b = 0;
+  double c = 0;
+};
+}
+
+TEST(SeqLock, stores_and_loads) {
+  SeqLock<Triple> lock;
+  EXPECT_EQ(0, lock.Load().a);
+
+  lock.Store({1, 2, 3.5});
+  const Triple value = lock.Load();
+  EXPECT_EQ(1, value.a);
+  EXPECT_EQ(2, value.b);
+  EXPECT_EQ(3.5, value.c);
+
+  lock.Update([](Triple& value){ value.b = 7; });
+  EXPECT_EQ(1, lock.Load().a);
+  EXPECT_EQ(7, lock.Load().b);
+}
+
+TEST(SeqLock, readers_see_whole_values) {
+  SeqLock<Triple> lock;
+  std::atomic<bool> done = false;
+  std::atomic<int> torn = 0;
+
+  std::vector<std::thread> readers;
+  for (int i = 0; i < 4; ++i) {
+    readers.emplace_back([&]{
+                           while (not done) {
+                             const Triple value = lock.Load();
+                             if (value.b != -value.a or
+                                 value.c != value.a * 0.5) {
+                               ++torn;
+                             }
+                           }
+                         });
+  }
+
+  for (int64_t i = 0; i < 200 * 1000; ++i) {
+    lock.Store({i, -i, i * 0.5});
+  }
+  done = true;
+  for (auto& reader : readers) {
+    reader.join();
+  }
+
+  EXPECT_EQ(0, torn);
+  EXPECT_EQ(200 * 1000 - 1, lock.Load().a);
+}
@@ -0,0 +1,74 @@
+// Copyright (C) 2020 by Jakub Wojciech
+
+// This file is part of Lelo Remote Music Player.
+
+// Lelo Remote Music Player is free software: you can redistribute it
+// and/or modify it under the terms of the GNU General Public License
+// as published by the Free Software Foundation, either version 3 of
+// the License, or (at your option) any later version.
+
+// Lelo Remote Music Player is distributed in the hope that it will be
+// useful, but WITHOUT ANY WARRANTY; without even the implied warranty
+// of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+// General Public License for more details.
+
+// You should have received a copy of the GNU General Public License
+// along with Lelo Remote Music Player. If not, see
+// <https://www.gnu.org/licenses/>.
+
+
+#include <gtest/gtest.h>
+
+#include "ServerClock.h"
+
+using namespace lrm;
+using namespace std::chrono_literals;
+
+namespace {
+// Server's clock is 1000 s ahead of the client's one.
+constexpr std::chrono::microseconds OFFSET = 1000s;
+
+ServerClock::Clock::time_point at(std::chrono::microseconds time) {
+  return ServerClock::Clock::time_point(time);
+}
+}
+
+TEST(ServerClock, falls_back_until_synchronized) {
+  ServerClock clock;
+  EXPECT_FALSE(clock.IsSynchronized());
+  EXPECT_EQ(at(5s), clock.ToLocal(123s, at(5s)));
+}
+
+TEST(ServerClock, symmetric_round_trip) {
+  ServerClock clock;
+  // Sent at 10 s, 20 ms each way, held by the server for 5 ms before
+  // taking its time.
+  clock.AddSample(at(10s), 5ms, 10s + 25ms + OFFSET, at(10s + 45ms));
+
+  ASSERT_TRUE(clock.IsSynchronized());
+  EXPECT_EQ(40ms, clock.RoundTrip());
+  EXPECT_EQ(at(10s + 25ms), clock.ToLocal(10s + 25ms + OFFSET, {}));
+  EXPECT_EQ(at(12s), clock.ToLocal(12s + OFFSET, {}));
+}
+
+TEST(ServerClock, prefers_shortest_round_trip) {
+  ServerClock clock;
+  clock.AddSample(at(10s), 0ms, 10s + 10ms + OFFSET, at(10s + 20ms));
+  // Delayed on the way back by 200 ms, it would shift the estimate by
+  // 100 ms.
+  clock.AddSample(at(20s), 0ms, 20s + 10ms + OFFSET, at(20s + 220ms));
+
+  EXPECT_EQ(20ms, clock.RoundTrip());
+  EXPECT_EQ(at(30s), clock.ToLocal(30s + OFFSET, {}));
+}
+
+TEST(ServerClock, forgets_old_samples) {
+  ServerClock clock;
+  clock.AddSample(at(0s), 0ms, 0s + OFFSET, at(0s));
+  for (size_t i = 1; i <= ServerClock::WINDOW; ++i) {
+    const auto sent = std::chrono::seconds(i);
+    clock.AddSample(at(sent), 0ms, sent + 30ms + OFFSET, at(sent + 60ms));
+  }
+
+  EXPECT_EQ(60ms, clock.RoundTrip());
+}
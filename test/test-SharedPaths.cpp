@@ -0,0 +1,86 @@
+// Copyright (C) 2020 by Jakub Wojciech
+
+// This file is part of Lelo Remote Music Player.
+
+// Lelo Remote Music Player is free software: you can redistribute it
+// and/or modify it under the terms of the GNU General Public License
+// as published by the Free Software Foundation, either version 3 of
+// the License, or (at your option) any later version.
+
+// Lelo Remote Music Player is distributed in the hope that it will be
+// useful, but WITHOUT ANY WARRANTY; without even the implied warranty
+// of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+// General Public License for more details.
+
+// You should have received a copy of the GNU General Public License
+// along with Lelo Remote Music Player. If not, see
+// <https://www.gnu.org/licenses/>.
+
+
+#include <gtest/gtest.h>
+
+#include <fstream>
+
+#include "filesystem.h"
+#include "SharedPaths.h"
+
+using namespace lrm;
+
+class SharedRootsTest : public ::testing::Test {
+ protected:
+  void SetUp() override {
+    base = fs::canonical(fs::temp_directory_path()) /
+           "lrm-test-shared-roots";
+    fs::create_directories(base / "music" / "album");
+    fs::create_directories(base / "private");
+    std::ofstream(base / "music" / "album" / "song.flac") << "song";
+    std::ofstream(base / "private" / "secret.flac") << "secret";
+    fs::create_symlink(base / "private", base / "music" / "escape");
+  }
+
+  void TearDown() override {
+    fs::remove_all(base);
+  }
+
+  fs::path base;
+};
+
+TEST_F(SharedRootsTest, allows_files_under_roots) {
+  const SharedRoots roots({(base / "music").string(), "smb://nas/music"});
+
+  const auto song = base / "music" / "album" / "song.flac";
+  EXPECT_EQ(song.string(), roots.Resolve(song.string()));
+  EXPECT_EQ("smb://nas/music/a/b.flac",
+            roots.Resolve("smb://nas/music/a/b.flac"));
+}
+
+TEST_F(SharedRootsTest, rejects_escapes) {
+  const SharedRoots roots({(base / "music").string(), "smb://nas/music"});
+
+  EXPECT_FALSE(roots.Resolve(
+      (base / "music" / ".." / "private" / "secret.flac").string()));
+  EXPECT_FALSE(roots.Resolve(
+      (base / "music" / "escape" / "secret.flac").string()));
+  EXPECT_FALSE(roots.Resolve((base / "music-2" / "song.flac").string()));
+  EXPECT_FALSE(roots.Resolve("music/album/song.flac"));
+  EXPECT_FALSE(roots.Resolve("smb://nas/music/../etc/passwd"));
+  EXPECT_FALSE(roots.Resolve("smb://nas/music/%2E%2E/etc/passwd"));
+  EXPECT_FALSE(roots.Resolve("smb://nas/music2/song.flac"));
+  EXPECT_FALSE(roots.Resolve("http://example.com/song.flac"));
+}
+
+TEST(SharedPrefixes, maps_local_files) {
+  const SharedPrefixes prefixes({"/mnt/nas/music=/srv/music",
+                                 "/home/me/share/=smb://nas/share"});
+
+  EXPECT_EQ("/srv/music/a/b.flac", prefixes.Map("/mnt/nas/music/a/b.flac"));
+  EXPECT_EQ("smb://nas/share/c.ogg", prefixes.Map("/home/me/share/c.ogg"));
+  EXPECT_EQ("/srv/music/b.flac", prefixes.Map("/mnt/nas/music/a/../b.flac"));
+  EXPECT_FALSE(prefixes.Map("/mnt/nas/music-2/b.flac"));
+  EXPECT_FALSE(prefixes.Map("/mnt/nas/music/../b.flac"));
+}
+
+TEST(SharedPrefixes, invalid_mapping) {
+  EXPECT_THROW(SharedPrefixes({"/mnt/nas/music"}), std::invalid_argument);
+  EXPECT_THROW(SharedPrefixes({"=/srv/music"}), std::invalid_argument);
+}
@@ -0,0 +1,217 @@
+// Copyright (C) 2020 by Jakub Wojciech
+
+// This file is part of Lelo Remote Music Player.
+
+// Lelo Remote Music Player is free software: you can redistribute it
+// and/or modify it under the terms of the GNU General Public License
+// as published by the Free Software Foundation, either version 3 of
+// the License, or (at your option) any later version.
+
+// Lelo Remote Music Player is distributed in the hope that it will be
+// useful, but WITHOUT ANY WARRANTY; without even the implied warranty
+// of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+// General Public License for more details.
+
+// You should have received a copy of the GNU General Public License
+// along with Lelo Remote Music Player. If not, see
+// <https://www.gnu.org/licenses/>.
+
+#include <gtest/gtest.h>
+
+#include <cerrno>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "filesystem.h"
+#include "StreamSpool.h"
+
+using namespace lrm;
+
+namespace {
+std::string make_data(size_t size) {
+  std::string data(size, '\0');
+  for (size_t i = 0; i < size; ++i) {
+    data[i] = static_cast<char>(i * 7 + i / 256);
+  }
+  return data;
+}
+
+std::string read_exactly(StreamSpool& spool, size_t size) {
+  std::string result(size, '\0');
+  size_t pos = 0;
+  while (pos < size) {
+    const auto read = spool.Read(result.data() + pos, size - pos);
+    if (read <= 0) {
+      break;
+    }
+    pos += read;
+  }
+  result.resize(pos);
+  return result;
+}
+}
+
+TEST(StreamSpool, reads_in_order) {
+  const auto data = make_data(100 * 1000);
+  StreamSpool spool(fs::temp_directory_path(), 1024 * 1024);
+
+  ASSERT_EQ(data.size(), spool.Write(data.data(), data.size()));
+  EXPECT_EQ(-1, spool.TotalSize());
+  spool.CloseWrite();
+
+  EXPECT_EQ(data, read_exactly(spool, data.size() + 1));
+  EXPECT_EQ(data.size(), spool.TotalSize());
+}
+
+TEST(StreamSpool, reports_the_size_given_before_the_end) {
+  const auto data = make_data(10 * 1000);
+  StreamSpool spool(fs::temp_directory_path(), 1024 * 1024);
+  spool.SetTotalSize(data.size());
+
+  spool.WriteAt(5000, data.data() + 5000, 5000);
+  EXPECT_EQ(data.size(), spool.TotalSize());
+
+  // A part has been lost, the stream ends where the data does.
+  spool.WriteAt(0, data.data(), 1000);
+  spool.CloseWrite();
+  EXPECT_EQ(1000, spool.TotalSize());
+}
+
+TEST(StreamSpool, seeks_within_received_data) {
+  const auto data = make_data(10 * 1000);
+  StreamSpool spool(fs::temp_directory_path(), 1024 * 1024);
+  spool.Write(data.data(), data.size());
+
+  EXPECT_EQ(data.substr(0, 5000), read_exactly(spool, 5000));
+
+  // Backwards.
+  ASSERT_EQ(100, spool.Seek(100));
+  EXPECT_EQ(data.substr(100, 50), read_exactly(spool, 50));
+
+  // Forwards, past the read position but not past the received data.
+  ASSERT_EQ(9000, spool.Seek(9000));
+  EXPECT_EQ(data.substr(9000, 1000), read_exactly(spool, 1000));
+}
+
+TEST(StreamSpool, seek_past_received_data_fails_at_once) {
+  const auto data = make_data(1000);
+  StreamSpool spool(fs::temp_directory_path(), 1024 * 1024);
+  spool.Write(data.data(), data.size());
+
+  EXPECT_EQ(-1, spool.Seek(1001));
+  EXPECT_EQ(1, spool.GetStats().failed_seeks);
+
+  // The read position didn't change.
+  EXPECT_EQ(data.substr(0, 10), read_exactly(spool, 10));
+}
+
+TEST(StreamSpool, drops_data_over_the_limit) {
+  constexpr size_t max_bytes = 256 * 1024;
+  const auto data = make_data(4 * max_bytes);
+  StreamSpool spool(fs::temp_directory_path(), max_bytes);
+
+  std::thread writer([&]{
+                       spool.Write(data.data(), data.size());
+                       spool.CloseWrite();
+                     });
+  // The writer can't get more than max_bytes ahead, so it waits for this.
+  EXPECT_EQ(data, read_exactly(spool, data.size()));
+  writer.join();
+
+  EXPECT_EQ(-1, spool.Seek(0)) << "The beginning should have been dropped";
+  EXPECT_EQ(data.size() - 1000, spool.Seek(data.size() - 1000));
+  EXPECT_EQ(data.substr(data.size() - 1000), read_exactly(spool, 1000));
+}
+
+TEST(StreamSpool, keeps_everything_if_it_cant_drop_data) {
+  class Spool : public StreamSpool {
+   public:
+    using StreamSpool::StreamSpool;
+
+   protected:
+    bool punch_hole(uint64_t, uint64_t) override {
+      errno = EOPNOTSUPP;
+      return false;
+    }
+  };
+
+  constexpr size_t max_bytes = 256 * 1024;
+  const auto data = make_data(4 * max_bytes);
+  Spool spool(fs::temp_directory_path(), max_bytes);
+
+  std::thread writer([&]{
+                       spool.Write(data.data(), data.size());
+                       spool.CloseWrite();
+                     });
+  EXPECT_EQ(data, read_exactly(spool, data.size()));
+  writer.join();
+
+  EXPECT_FALSE(spool.IsCancelled());
+  ASSERT_EQ(0, spool.Seek(0)) << "Nothing should have been dropped";
+  EXPECT_EQ(data.substr(0, 1000), read_exactly(spool, 1000));
+}
+
+TEST(StreamSpool, reassembles_parts) {
+  const auto data = make_data(30 * 1000);
+  StreamSpool spool(fs::temp_directory_path(), 1024 * 1024);
+
+  // The last part first, the reader can't get it yet.
+  ASSERT_EQ(10000, spool.WriteAt(20000, data.data() + 20000, 10000));
+  EXPECT_EQ(-1, spool.Seek(20000));
+
+  std::thread writer([&]{
+                       spool.WriteAt(10000, data.data() + 10000, 10000);
+                       spool.WriteAt(0, data.data(), 10000);
+                       spool.CloseWrite();
+                     });
+  EXPECT_EQ(data, read_exactly(spool, data.size() + 1));
+  writer.join();
+}
+
+TEST(StreamSpool, parallel_writers) {
+  constexpr size_t part_size = 300 * 1000;
+  constexpr size_t parts = 4;
+  const auto data = make_data(parts * part_size);
+  StreamSpool spool(fs::temp_directory_path(), 256 * 1024);
+
+  // Later parts are more than max_bytes ahead, so they wait for the reader.
+  std::vector<std::thread> writers;
+  for (size_t i = 0; i < parts; ++i) {
+    writers.emplace_back([&, i]{
+                           for (size_t pos = 0; pos < part_size;
+                                pos += 10000) {
+                             const size_t offset = i * part_size + pos;
+                             spool.WriteAt(offset, data.data() + offset,
+                                           10000);
+                           }
+                         });
+  }
+
+  EXPECT_EQ(data, read_exactly(spool, data.size()));
+  for (auto& writer : writers) {
+    writer.join();
+  }
+}
+
+TEST(StreamSpool, cancel_unblocks_writer) {
+  constexpr size_t max_bytes = 64 * 1024;
+  const auto data = make_data(2 * max_bytes);
+  StreamSpool spool(fs::temp_directory_path(), max_bytes);
+
+  std::thread canceller([&]{
+                          std::this_thread::sleep_for(
+                              std::chrono::milliseconds(20));
+                          spool.Cancel();
+                        });
+  EXPECT_EQ(max_bytes, spool.Write(data.data(), data.size()));
+  canceller.join();
+
+  char out[16];
+  EXPECT_EQ(-1, spool.Read(out, sizeof(out)));
+}
+
+TEST(StreamSpool, nonexistent_directory) {
+  EXPECT_THROW(StreamSpool("lrm-test-doesnt-exist", 1024),
+               std::system_error);
+}
@@ -0,0 +1,348 @@
+// Copyright (C) 2020 by Jakub Wojciech
+
+// This file is part of Lelo Remote Music Player.
+
+// Lelo Remote Music Player is free software: you can redistribute it
+// and/or modify it under the terms of the GNU General Public License
+// as published by the Free Software Foundation, either version 3 of
+// the License, or (at your option) any later version.
+
+// Lelo Remote Music Player is distributed in the hope that it will be
+// useful, but WITHOUT ANY WARRANTY; without even the implied warranty
+// of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+// General Public License for more details.
+
+// You should have received a copy of the GNU General Public License
+// along with Lelo Remote Music Player. If not, see
+// <https://www.gnu.org/licenses/>.
+
+
+#include <gtest/gtest.h>
+
+#include <atomic>
+#include <chrono>
+#include <thread>
+
+#ifndef INCLUDE_GRPCPLUSPLUS
+#include "grpcpp/create_channel.h"
+#include "grpcpp/security/credentials.h"
+#include "grpcpp/security/server_credentials.h"
+#include "grpcpp/server.h"
+#include "grpcpp/server_builder.h"
+#else
+#include "grpc++/create_channel.h"
+#include "grpc++/security/credentials.h"
+#include "grpc++/security/server_credentials.h"
+#include "grpc++/server.h"
+#include "grpc++/server_builder.h"
+#endif  // INCLUDE_GRPCPLUSPLUS
+
+#include "player_service.grpc.pb.h"
+#include "TimeInfoStreams.h"
+
+using namespace lrm;
+
+namespace {
+class InfoService
+    : public PlayerService::WithCallbackMethod_TimeInfoStream<
+        PlayerService::Service> {
+ public:
+  TimeInfoStreams::Reactor* TimeInfoStream(
+      grpc::CallbackServerContext* context) override {
+    // The second zone if the client asks for it.
+    return streams.Open(context->client_metadata().count("x-zone"));
+  }
+
+  std::atomic<int> volume = 50;
+  // Position at start, it advances in real time if \e advancing is set.
+  std::atomic<double> position = 12;
+  std::atomic<bool> advancing = false;
+  std::atomic<double> buffered = 10;
+  std::atomic<uint64_t> underruns = 0;
+  const std::chrono::steady_clock::time_point start =
+      std::chrono::steady_clock::now();
+
+  // The second zone's player is always at volume 20.
+  TimeInfoStreams streams{
+    [this](size_t zone, PlaybackState::State state) {
+      TimeInfoStreams::Snapshot snapshot;
+      snapshot.state = state;
+      snapshot.has_times = true;
+      snapshot.current_time = position;
+      if (advancing) {
+        snapshot.current_time += std::chrono::duration<double>(
+            std::chrono::steady_clock::now() - start).count();
+      }
+      snapshot.total_time = 300;
+      snapshot.volume = 1 == zone ? 20 : volume.load();
+      snapshot.has_buffer = true;
+      snapshot.buffered_time = buffered;
+      snapshot.cache_time = 1;
+      snapshot.underruns = underruns;
+      return snapshot;
+    },
+    2};
+};
+}
+
+class TimeInfoStreamsTest : public ::testing::Test {
+ protected:
+  TimeInfoStreamsTest() {
+    int port = 0;
+    grpc::ServerBuilder builder;
+    builder.AddListeningPort("127.0.0.1:0",
+                             grpc::InsecureServerCredentials(), &port);
+    builder.RegisterService(&service);
+    server = builder.BuildAndStart();
+    stub = PlayerService::NewStub(grpc::CreateChannel(
+        "127.0.0.1:" + std::to_string(port),
+        grpc::InsecureChannelCredentials()));
+  }
+
+  ~TimeInfoStreamsTest() {
+    server->Shutdown();
+  }
+
+  InfoService service;
+  std::unique_ptr<grpc::Server> server;
+  std::unique_ptr<PlayerService::Stub> stub;
+};
+
+TEST_F(TimeInfoStreamsTest, sends_only_changes) {
+  grpc::ClientContext context;
+  auto stream = stub->TimeInfoStream(&context);
+
+  TimeInterval interval;
+  interval.set_milliseconds(50);
+  ASSERT_TRUE(stream->Write(interval));
+
+  // The first update carries the volume.
+  TimeInfo info;
+  ASSERT_TRUE(stream->Read(&info));
+  EXPECT_EQ(1, info.sequence());
+  EXPECT_GT(info.server_time_us(), 0);
+  ASSERT_TRUE(info.has_volume());
+  EXPECT_EQ(50, info.volume());
+
+  service.volume = 70;
+  service.streams.Refresh();
+  ASSERT_TRUE(stream->Read(&info));
+  EXPECT_EQ(2, info.sequence());
+  EXPECT_EQ(70, info.volume());
+  EXPECT_FALSE(info.has_current_time());
+
+  // Starting the playback sends the times.
+  service.advancing = true;
+  service.streams.SetPlaybackState(PlaybackState::PLAYING);
+  ASSERT_TRUE(stream->Read(&info));
+  EXPECT_EQ(3, info.sequence());
+  EXPECT_EQ(TimeInfo::PLAYING, info.playback_state());
+  ASSERT_TRUE(info.has_current_time());
+  EXPECT_GE(info.current_time(), 12);
+  EXPECT_EQ(300, info.total_time());
+  EXPECT_EQ(1, info.speed());
+  EXPECT_FALSE(info.has_volume());
+
+  // The position goes as the client extrapolates it, nothing is sent even
+  // though the interval has passed many times.
+  std::this_thread::sleep_for(std::chrono::milliseconds(500));
+  service.volume = 80;
+  service.streams.Refresh();
+  ASSERT_TRUE(stream->Read(&info));
+  EXPECT_EQ(4, info.sequence());
+  EXPECT_EQ(TimeInfo::NOT_CHANGED, info.playback_state());
+  EXPECT_EQ(80, info.volume());
+  EXPECT_FALSE(info.has_current_time());
+  EXPECT_FALSE(info.has_total_time());
+
+  // A jump, e.g. a seek, is sent at the next interval.
+  service.position = 100;
+  ASSERT_TRUE(stream->Read(&info));
+  EXPECT_EQ(5, info.sequence());
+  ASSERT_TRUE(info.has_current_time());
+  EXPECT_GE(info.current_time(), 100);
+  EXPECT_FALSE(info.has_volume());
+
+  // The times of the stopped file are cleared.
+  service.streams.SetPlaybackState(PlaybackState::STOPPED);
+  ASSERT_TRUE(stream->Read(&info));
+  EXPECT_EQ(TimeInfo::STOPPED, info.playback_state());
+  ASSERT_TRUE(info.has_current_time());
+  EXPECT_EQ(0, info.current_time());
+  EXPECT_EQ(0, info.remaining_time());
+  EXPECT_EQ(0, info.total_time());
+
+  EXPECT_EQ(1, service.streams.Size());
+  stream->WritesDone();
+  while (stream->Read(&info)) {}
+  EXPECT_TRUE(stream->Finish().ok());
+}
+
+TEST_F(TimeInfoStreamsTest, sends_buffer_changes) {
+  grpc::ClientContext context;
+  auto stream = stub->TimeInfoStream(&context);
+
+  TimeInterval interval;
+  interval.set_milliseconds(50);
+  ASSERT_TRUE(stream->Write(interval));
+
+  // Nothing is buffered while stopped, but the underruns are counted.
+  TimeInfo info;
+  ASSERT_TRUE(stream->Read(&info));
+  EXPECT_FALSE(info.has_buffered_time());
+  ASSERT_TRUE(info.has_underruns());
+  EXPECT_EQ(0, info.underruns());
+
+  service.streams.SetPlaybackState(PlaybackState::PLAYING);
+  ASSERT_TRUE(stream->Read(&info));
+  ASSERT_TRUE(info.has_buffered_time());
+  EXPECT_EQ(10, info.buffered_time());
+  EXPECT_EQ(1, info.cache_time());
+  EXPECT_EQ(100, info.buffering());
+  EXPECT_FALSE(info.has_underruns());
+
+  // Small changes aren't sent, an underrun is.
+  service.buffered = 10.2;
+  std::this_thread::sleep_for(std::chrono::milliseconds(200));
+  service.buffered = 2;
+  ASSERT_TRUE(stream->Read(&info));
+  EXPECT_EQ(2, info.buffered_time());
+  EXPECT_FALSE(info.has_buffering());
+  EXPECT_FALSE(info.has_underruns());
+
+  service.underruns = 1;
+  ASSERT_TRUE(stream->Read(&info));
+  EXPECT_EQ(1, info.underruns());
+  EXPECT_FALSE(info.has_buffered_time());
+
+  stream->WritesDone();
+  while (stream->Read(&info)) {}
+  EXPECT_TRUE(stream->Finish().ok());
+}
+
+TEST_F(TimeInfoStreamsTest, echoes_client_time) {
+  grpc::ClientContext context;
+  auto stream = stub->TimeInfoStream(&context);
+
+  TimeInterval interval;
+  interval.set_milliseconds(1000);
+  interval.set_client_time_us(1234);
+  ASSERT_TRUE(stream->Write(interval));
+
+  TimeInfo info;
+  ASSERT_TRUE(stream->Read(&info));
+  EXPECT_EQ(1234, info.echo_client_time_us());
+  EXPECT_GE(info.echo_hold_us(), 0);
+
+  // Sending the same interval again only measures the round trip.
+  interval.set_client_time_us(5678);
+  ASSERT_TRUE(stream->Write(interval));
+  ASSERT_TRUE(stream->Read(&info));
+  EXPECT_EQ(2, info.sequence());
+  EXPECT_EQ(5678, info.echo_client_time_us());
+  EXPECT_FALSE(info.has_volume());
+
+  stream->WritesDone();
+  while (stream->Read(&info)) {}
+  EXPECT_TRUE(stream->Finish().ok());
+}
+
+TEST_F(TimeInfoStreamsTest, zones_are_separate) {
+  grpc::ClientContext first_context;
+  grpc::ClientContext second_context;
+  second_context.AddMetadata("x-zone", "second");
+  auto first = stub->TimeInfoStream(&first_context);
+  auto second = stub->TimeInfoStream(&second_context);
+
+  TimeInterval interval;
+  interval.set_milliseconds(1000);
+  ASSERT_TRUE(first->Write(interval));
+  ASSERT_TRUE(second->Write(interval));
+
+  TimeInfo info;
+  ASSERT_TRUE(first->Read(&info));
+  EXPECT_EQ(50, info.volume());
+  ASSERT_TRUE(second->Read(&info));
+  EXPECT_EQ(20, info.volume());
+
+  // Only the second zone plays.
+  service.streams.SetPlaybackState(PlaybackState::PLAYING, 1);
+  ASSERT_TRUE(second->Read(&info));
+  EXPECT_EQ(TimeInfo::PLAYING, info.playback_state());
+
+  service.volume = 60;
+  service.streams.Refresh(0);
+  ASSERT_TRUE(first->Read(&info));
+  EXPECT_EQ(60, info.volume());
+  EXPECT_EQ(TimeInfo::NOT_CHANGED, info.playback_state());
+  EXPECT_FALSE(info.has_current_time());
+
+  first_context.TryCancel();
+  second_context.TryCancel();
+  first->Finish();
+  second->Finish();
+}
+
+TEST_F(TimeInfoStreamsTest, many_clients) {
+  constexpr int count = 20;
+  std::vector<std::unique_ptr<grpc::ClientContext>> contexts;
+  std::vector<std::unique_ptr<
+    grpc::ClientReaderWriter<TimeInterval, TimeInfo>>> streams;
+
+  TimeInterval interval;
+  interval.set_milliseconds(1000);
+  for (int i = 0; i < count; ++i) {
+    contexts.push_back(std::make_unique<grpc::ClientContext>());
+    streams.push_back(stub->TimeInfoStream(contexts.back().get()));
+    ASSERT_TRUE(streams.back()->Write(interval));
+  }
+
+  TimeInfo info;
+  for (auto& stream : streams) {
+    ASSERT_TRUE(stream->Read(&info));
+  }
+  EXPECT_EQ(count, service.streams.Size());
+
+  for (auto& context : contexts) {
+    context->TryCancel();
+  }
+  for (auto& stream : streams) {
+    stream->Finish();
+  }
+}
+
+TEST_F(TimeInfoStreamsTest, samples_once_per_tick) {
+  constexpr int count = 50;
+  std::vector<std::unique_ptr<grpc::ClientContext>> contexts;
+  std::vector<std::unique_ptr<
+    grpc::ClientReaderWriter<TimeInterval, TimeInfo>>> streams;
+
+  service.streams.SetPlaybackState(PlaybackState::PLAYING);
+  TimeInterval interval;
+  interval.set_milliseconds(100);
+  for (int i = 0; i < count; ++i) {
+    contexts.push_back(std::make_unique<grpc::ClientContext>());
+    streams.push_back(stub->TimeInfoStream(contexts.back().get()));
+    ASSERT_TRUE(streams.back()->Write(interval));
+  }
+
+  TimeInfo info;
+  for (auto& stream : streams) {
+    ASSERT_TRUE(stream->Read(&info));
+  }
+
+  // Only the changes are sent, so count the samples over a second: 10
+  // intervals.
+  const auto samples = service.streams.Samples();
+  std::this_thread::sleep_for(std::chrono::seconds(1));
+  // Not a sample per client. A 100 ms interval falls on one of two 50 ms
+  // ticks, so at most two per interval.
+  EXPECT_LE(service.streams.Samples() - samples, 2 * 10 + 2);
+
+  for (auto& context : contexts) {
+    context->TryCancel();
+  }
+  for (auto& stream : streams) {
+    stream->Finish();
+  }
+}
@@ -0,0 +1,48 @@
+// Copyright (C) 2020 by Jakub Wojciech
+
+// This file is part of Lelo Remote Music Player.
+
+// Lelo Remote Music Player is free software: you can redistribute it
+// and/or modify it under the terms of the GNU General Public License
+// as published by the Free Software Foundation, either version 3 of
+// the License, or (at your option) any later version.
+
+// Lelo Remote Music Player is distributed in the hope that it will be
+// useful, but WITHOUT ANY WARRANTY; without even the implied warranty
+// of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+// General Public License for more details.
+
+// You should have received a copy of the GNU General Public License
+// along with Lelo Remote Music Player. If not, see
+// <https://www.gnu.org/licenses/>.
+
+
+#include <gtest/gtest.h>
+
+#include "Transcoder.h"
+
+using namespace lrm;
+
+TEST(Transcoder, accepts_by_extension) {
+  Transcoder transcoder({"flac", ".APE", ""});
+
+  EXPECT_TRUE(transcoder.Accepts("/music/track.flac"));
+  EXPECT_TRUE(transcoder.Accepts("/music/track.FLAC"));
+  EXPECT_TRUE(transcoder.Accepts("track.ape"));
+  EXPECT_FALSE(transcoder.Accepts("/music/track.mp3"));
+  EXPECT_FALSE(transcoder.Accepts("/music/flac"));
+}
+
+TEST(Transcoder, settings_fall_back_per_field) {
+  Transcoder::Settings client;
+  client.bitrate = 96000;
+  Transcoder::Settings server;
+  server.codec = "libvorbis";
+  server.bitrate = 192000;
+
+  const auto settings =
+      client.Or(server).Or(Transcoder::DEFAULT_SETTINGS);
+  EXPECT_EQ("libvorbis", settings.codec);
+  EXPECT_EQ(Transcoder::DEFAULT_SETTINGS.format, settings.format);
+  EXPECT_EQ(96000, settings.bitrate);
+}
@@ -0,0 +1,146 @@
+// Copyright (C) 2020 by Jakub Wojciech
+
+// This file is part of Lelo Remote Music Player.
+
+// Lelo Remote Music Player is free software: you can redistribute it
+// and/or modify it under the terms of the GNU General Public License
+// as published by the Free Software Foundation, either version 3 of
+// the License, or (at your option) any later version.
+
+// Lelo Remote Music Player is distributed in the hope that it will be
+// useful, but WITHOUT ANY WARRANTY; without even the implied warranty
+// of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+// General Public License for more details.
+
+// You should have received a copy of the GNU General Public License
+// along with Lelo Remote Music Player. If not, see
+// <https://www.gnu.org/licenses/>.
+
+
+#include <gtest/gtest.h>
+
+#include "UploadPacer.h"
+
+using namespace lrm;
+using namespace std::chrono_literals;
+
+namespace {
+/// Send \e bytes in \e chunk_size messages as fast as \e pacer allows.
+/// \return Time it took.
+std::chrono::duration<double> simulate_upload(UploadPacer* pacer,
+                                              uint64_t bytes,
+                                              size_t chunk_size) {
+  auto now = std::chrono::steady_clock::time_point();
+  const auto start = now;
+  for (uint64_t sent = 0; sent < bytes;) {
+    now += pacer->Delay(now);
+    const size_t size = pacer->ChunkSize(chunk_size);
+    pacer->Sent(size);
+    sent += size;
+  }
+  return now - start;
+}
+}
+
+TEST(UploadPacer, disabled_by_default) {
+  UploadPacer pacer({}, 1000);
+  EXPECT_FALSE(pacer.IsEnabled());
+  EXPECT_EQ(0, pacer.Rate());
+  EXPECT_EQ(1 << 20, pacer.ChunkSize(1 << 20));
+  EXPECT_EQ(0s, simulate_upload(&pacer, 100 << 20, 1 << 20));
+}
+
+TEST(UploadPacer, fixed_rate) {
+  UploadPacer::Settings settings;
+  settings.rate = 1e6;
+  UploadPacer pacer(settings, 10e6);
+
+  // Messages no bigger than the burst.
+  EXPECT_EQ(100000, pacer.ChunkSize(1 << 20));
+  EXPECT_NEAR(10, simulate_upload(&pacer, 10e6, 1 << 20).count(), 0.2);
+}
+
+TEST(UploadPacer, rate_from_bitrate) {
+  UploadPacer::Settings settings;
+  settings.headroom = 2;
+  // 4 MB in 100 s is 40 kB/s.
+  UploadPacer pacer(settings, 4e6, []{
+                                     return UploadPacer::Playback{100s, 0s};
+                                   });
+  pacer.Delay();
+  EXPECT_DOUBLE_EQ(80e3, pacer.Rate());
+}
+
+TEST(UploadPacer, assumed_bitrate_until_known) {
+  UploadPacer::Settings settings;
+  settings.headroom = 1.5;
+  UploadPacer pacer(settings, 4e6, []{ return std::nullopt; });
+  pacer.Delay();
+  EXPECT_DOUBLE_EQ(UploadPacer::DEFAULT_BYTE_RATE * 1.5, pacer.Rate());
+}
+
+TEST(UploadPacer, keeps_lead_ahead_of_playback) {
+  UploadPacer::Settings settings;
+  settings.lead = 10s;
+  std::chrono::duration<double> elapsed = 30s;
+  // 100 kB/s of audio.
+  UploadPacer pacer(settings, 10e6, [&]{
+                                      return UploadPacer::Playback{100s,
+                                                                   elapsed};
+                                    });
+
+  pacer.SetPosition(3e6);
+  EXPECT_EQ(0s, pacer.Delay());
+
+  // 45 s sent, 40 s allowed, so it waits 5 s of playback.
+  pacer.SetPosition(4.5e6);
+  EXPECT_NEAR(5, std::chrono::duration<double>(pacer.Delay()).count(),
+              1e-6);
+
+  elapsed = 35s;
+  EXPECT_EQ(0s, pacer.Delay());
+}
+
+TEST(UploadPacer, keeps_target_buffer) {
+  UploadPacer::Settings settings;
+  settings.headroom = 1.5;
+  settings.target_buffer = 10s;
+  std::optional<std::chrono::duration<double>> buffered;
+  // 40 kB/s of audio.
+  UploadPacer pacer(settings, 4e6, [&]{
+                                     return UploadPacer::Playback{
+                                       100s, 0s, buffered};
+                                   });
+
+  // The headroom until the server reports its buffer.
+  pacer.Delay();
+  EXPECT_DOUBLE_EQ(60e3, pacer.Rate());
+
+  // Real time at the target, faster below it and slower above.
+  buffered = 10s;
+  pacer.Delay();
+  EXPECT_DOUBLE_EQ(40e3, pacer.Rate());
+  buffered = 5s;
+  pacer.Delay();
+  EXPECT_DOUBLE_EQ(80e3, pacer.Rate());
+  buffered = 20s;
+  pacer.Delay();
+  EXPECT_DOUBLE_EQ(20e3, pacer.Rate());
+
+  // An empty buffer gets as much as it's allowed.
+  buffered = 0s;
+  pacer.Delay();
+  EXPECT_DOUBLE_EQ(40e3 * UploadPacer::MAX_BUFFER_SCALE, pacer.Rate());
+}
+
+TEST(UploadPacer, fixed_rate_caps_target_buffer) {
+  UploadPacer::Settings settings;
+  settings.rate = 50e3;
+  settings.target_buffer = 10s;
+  UploadPacer pacer(settings, 4e6, []{
+                                     return UploadPacer::Playback{100s, 0s,
+                                                                  1s};
+                                   });
+  pacer.Delay();
+  EXPECT_DOUBLE_EQ(50e3, pacer.Rate());
+}
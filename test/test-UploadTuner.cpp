@@ -0,0 +1,75 @@
+// Copyright (C) 2020 by Jakub Wojciech
+
+// This file is part of Lelo Remote Music Player.
+
+// Lelo Remote Music Player is free software: you can redistribute it
+// and/or modify it under the terms of the GNU General Public License
+// as published by the Free Software Foundation, either version 3 of
+// the License, or (at your option) any later version.
+
+// Lelo Remote Music Player is distributed in the hope that it will be
+// useful, but WITHOUT ANY WARRANTY; without even the implied warranty
+// of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+// General Public License for more details.
+
+// You should have received a copy of the GNU General Public License
+// along with Lelo Remote Music Player. If not, see
+// <https://www.gnu.org/licenses/>.
+
+#include <gtest/gtest.h>
+
+#include "UploadTuner.h"
+
+using namespace lrm;
+using namespace std::chrono_literals;
+
+namespace {
+/// Simulate writes on a link with \e bytes_per_second throughput.
+void simulate_link(UploadTuner* tuner, double bytes_per_second,
+                   int writes) {
+  for (int i = 0; i < writes; ++i) {
+    const size_t size = tuner->ChunkSize();
+    tuner->WriteCompleted(
+        size,
+        std::chrono::duration_cast<std::chrono::steady_clock::duration>(
+            std::chrono::duration<double>(size / bytes_per_second)));
+  }
+}
+}
+
+TEST(UploadTuner, starts_small) {
+  UploadTuner tuner(80ms);
+  EXPECT_EQ(UploadTuner::MIN_CHUNK_SIZE, tuner.ChunkSize());
+}
+
+TEST(UploadTuner, grows_on_fast_distant_link) {
+  UploadTuner tuner(80ms);
+  // 100 MB/s * 80 ms is far above the maximum chunk size.
+  simulate_link(&tuner, 100e6, 20);
+  EXPECT_EQ(UploadTuner::MAX_CHUNK_SIZE, tuner.ChunkSize());
+  EXPECT_NEAR(100e6, tuner.Throughput(), 1e6);
+}
+
+TEST(UploadTuner, follows_bandwidth_delay_product) {
+  UploadTuner tuner(20ms);
+  // 10 MB/s * 20 ms = 200 kB, split into MESSAGES_PER_RTT messages.
+  simulate_link(&tuner, 10e6, 50);
+  const double expected = 10e6 * 0.02 / UploadTuner::MESSAGES_PER_RTT;
+  EXPECT_NEAR(expected, tuner.ChunkSize(), 4096);
+}
+
+TEST(UploadTuner, shrinks_when_link_slows_down) {
+  UploadTuner tuner(50ms);
+  simulate_link(&tuner, 100e6, 20);
+  ASSERT_EQ(UploadTuner::MAX_CHUNK_SIZE, tuner.ChunkSize());
+
+  simulate_link(&tuner, 100e3, 50);
+  EXPECT_EQ(UploadTuner::MIN_CHUNK_SIZE, tuner.ChunkSize());
+}
+
+TEST(UploadTuner, instant_writes) {
+  UploadTuner tuner(1ms);
+  tuner.WriteCompleted(tuner.ChunkSize(), 0s);
+  EXPECT_GE(tuner.ChunkSize(), UploadTuner::MIN_CHUNK_SIZE);
+  EXPECT_LE(tuner.ChunkSize(), UploadTuner::MAX_CHUNK_SIZE);
+}